@@ -0,0 +1,497 @@
+//***************************************************************************************
+// AssetLoaderBenchmark.cpp
+//
+// Loads the skull and the Chapter 11 textures through AssetLoader with a stub
+// uploader, and times how long the app waits for them: loading them in place the
+// way the demos used to, against queuing them and getting the handles back.
+//
+// Checks that the handles give out their placeholders until Update, that every
+// upload happens on the calling thread inside a batch, that Update keeps to its
+// byte budget, that each done callback is called exactly once, that a callback can
+// queue more loads, and that a missing file, a file that is not a .dds, a decoder
+// that fails and an upload that fails all end as Failed with an error.  Exits with
+// a non-zero code if any check fails, so it can be run as a regression test.
+//
+// Run as
+//
+//   AssetLoaderBenchmark [skull.txt [textures directory]]
+//***************************************************************************************
+
+#include "../../Common/AssetLoader.h"
+#include "../../Common/MeshCache.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	// The demos' vertex, which the mesh is copied into.
+	struct ModelVertex
+	{
+		XMFLOAT3 Pos;
+		XMFLOAT3 Normal;
+		XMFLOAT2 TexC;
+	};
+
+	// What the stub uploader makes.
+	struct StubMesh
+	{
+		string Name;
+		uint32_t VertexCount = 0;
+		uint32_t IndexCount = 0;
+	};
+
+	struct StubTexture
+	{
+		string Name;
+		size_t Bytes = 0;
+	};
+
+	// Checks that it is only used from the thread that made it, inside a batch, and
+	// remembers the size of each batch.  Fails the upload of any texture whose name
+	// starts with "bad".
+	class StubUploader : public AssetUploader
+	{
+	public:
+		struct Batch
+		{
+			uint32_t Assets = 0;
+			uint64_t Bytes = 0;
+		};
+
+		virtual void BeginBatch()override
+		{
+			Check(!mInBatch, "BeginBatch inside a batch");
+			mInBatch = true;
+			Batches.push_back(Batch());
+		}
+
+		virtual shared_ptr<void> UploadMesh(const string& name, const MeshData& mesh, string& error)override
+		{
+			Check(mInBatch, "UploadMesh outside a batch");
+			Check(mesh.VertexStride != 0 && mesh.Vertices.size() % mesh.VertexStride == 0 && !mesh.Parts.empty(),
+				"UploadMesh given a bad mesh");
+
+			for(uint32_t index : mesh.Indices)
+			{
+				if(index >= mesh.VertexCount())
+				{
+					Check(false, "UploadMesh given an index out of range");
+					break;
+				}
+			}
+
+			Batches.back().Assets++;
+			Batches.back().Bytes += mesh.Vertices.size() + mesh.Indices.size()*sizeof(uint32_t);
+
+			auto stub = make_shared<StubMesh>();
+			stub->Name = name;
+			stub->VertexCount = mesh.VertexCount();
+			stub->IndexCount = (uint32_t)mesh.Indices.size();
+			return stub;
+		}
+
+		virtual shared_ptr<void> UploadTexture(const string& name, const TextureData& texture, string& error)override
+		{
+			Check(mInBatch, "UploadTexture outside a batch");
+			Check(texture.File.Size() > 128 && memcmp(texture.File.Data(), "DDS ", 4) == 0,
+				"UploadTexture given something that is not a .dds file");
+
+			Batches.back().Assets++;
+			Batches.back().Bytes += texture.File.Size();
+
+			if(name.compare(0, 3, "bad") == 0)
+			{
+				error = name + ": rejected by the uploader";
+				return nullptr;
+			}
+
+			auto stub = make_shared<StubTexture>();
+			stub->Name = name;
+			stub->Bytes = texture.File.Size();
+			return stub;
+		}
+
+		virtual void EndBatch()override
+		{
+			Check(mInBatch, "EndBatch outside a batch");
+			mInBatch = false;
+		}
+
+		vector<Batch> Batches;
+		bool Ok = true;
+
+	private:
+		void Check(bool condition, const char* what)
+		{
+			if(this_thread::get_id() != mThread)
+			{
+				cout << "    the uploader was called from a worker" << endl;
+				Ok = false;
+			}
+
+			if(!condition)
+			{
+				cout << "    " << what << endl;
+				Ok = false;
+			}
+		}
+
+		thread::id mThread = this_thread::get_id();
+		bool mInBatch = false;
+	};
+
+	// The model paths are ASCII.
+	wstring Widen(const string& s)
+	{
+		return wstring(s.begin(), s.end());
+	}
+
+	double Milliseconds(chrono::steady_clock::time_point start)
+	{
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	// What the demos do on a worker: parse a text model into their own vertices.
+	bool DecodeModel(const string& filename, MeshData& mesh, string& error, TaskSystem& taskSystem)
+	{
+		MappedFile file;
+		if(!file.Open(Widen(filename).c_str()))
+		{
+			error = filename + " not found.";
+			return false;
+		}
+
+		vector<MeshCache::Vertex> parsed;
+		vector<uint32_t> indices;
+		if(!MeshCache::ParseText((const char*)file.Data(), file.Size(), parsed, indices, &error, taskSystem))
+			return false;
+
+		vector<ModelVertex> vertices(parsed.size());
+		for(size_t i = 0; i < parsed.size(); ++i)
+		{
+			vertices[i].Pos = parsed[i].Pos;
+			vertices[i].Normal = parsed[i].Normal;
+			vertices[i].TexC = XMFLOAT2(0.0f, 0.0f);
+		}
+
+		mesh.SetVertices(vertices);
+		mesh.Indices = move(indices);
+		return true;
+	}
+
+	struct Expected
+	{
+		const char* Name;
+		bool Loaded;
+	};
+
+	// Loads the skull and the textures alongside every way a load can fail.
+	bool RunLoads(const string& skullFile, const string& textureDir, TaskSystem& taskSystem)
+	{
+		bool ok = true;
+
+		StubUploader uploader;
+		AssetLoader loader(uploader, taskSystem);
+
+		StubMesh placeholderMesh;
+		StubTexture placeholderTexture;
+
+		const Expected expected[] =
+		{
+			{ "skull", true },
+			{ "bricksTex", true },
+			{ "checkboardTex", true },
+			{ "iceTex", true },
+			{ "missingTex", false },
+			{ "notDdsTex", false },
+			{ "badTex", false },
+			{ "failingMesh", false },
+			{ "emptyMesh", false },
+			{ "chainedTex", true },
+		};
+		const size_t count = sizeof(expected) / sizeof(expected[0]);
+
+		vector<int> calls(count, 0);
+		vector<AssetHandle<StubMesh>> meshes;
+		vector<AssetHandle<StubTexture>> textures;
+
+		auto onDone = [&](size_t i)
+		{
+			return [&, i](bool loaded)
+			{
+				calls[i]++;
+				if(loaded != expected[i].Loaded)
+				{
+					cout << "    " << expected[i].Name << (loaded ? " loaded" : " failed") << endl;
+					ok = false;
+				}
+			};
+		};
+
+		meshes.push_back(loader.LoadMesh("skull", [&](MeshData& mesh, string& error)
+		{
+			return DecodeModel(skullFile, mesh, error, taskSystem);
+		}, &placeholderMesh, onDone(0)));
+
+		textures.push_back(loader.LoadTexture("bricksTex", Widen(textureDir + "/bricks3.dds"), &placeholderTexture, onDone(1)));
+		textures.push_back(loader.LoadTexture("checkboardTex", Widen(textureDir + "/checkboard.dds"), &placeholderTexture, onDone(2)));
+		textures.push_back(loader.LoadTexture("iceTex", Widen(textureDir + "/ice.dds"), &placeholderTexture, onDone(3)));
+		textures.push_back(loader.LoadTexture("missingTex", Widen(textureDir + "/missing.dds"), &placeholderTexture, onDone(4)));
+		textures.push_back(loader.LoadTexture("notDdsTex", Widen(skullFile), &placeholderTexture, onDone(5)));
+		textures.push_back(loader.LoadTexture("badTex", Widen(textureDir + "/ice.dds"), &placeholderTexture, onDone(6)));
+
+		meshes.push_back(loader.LoadMesh("failingMesh", [](MeshData& mesh, string& error)
+		{
+			error = "failingMesh: could not be parsed";
+			return false;
+		}, &placeholderMesh, onDone(7)));
+
+		meshes.push_back(loader.LoadMesh("emptyMesh", [](MeshData& mesh, string& error)
+		{
+			return true;
+		}, &placeholderMesh, onDone(8)));
+
+		// A callback that queues another load, as a demo streaming in a level might.
+		AssetHandle<StubTexture> chained;
+		textures.push_back(loader.LoadTexture("chainedSourceTex", Widen(textureDir + "/bricks3.dds"), &placeholderTexture,
+			[&](bool loaded)
+		{
+			chained = loader.LoadTexture("chainedTex", Widen(textureDir + "/bricks3.dds"), &placeholderTexture, onDone(9));
+		}));
+
+		// Nothing is ready until Update, however quickly the workers get through it.
+		this_thread::sleep_for(chrono::milliseconds(50));
+
+		for(const auto& mesh : meshes)
+			ok &= mesh.State() == AssetState::Loading && mesh.Get() == &placeholderMesh;
+		for(const auto& texture : textures)
+			ok &= texture.State() == AssetState::Loading && texture.Get() == &placeholderTexture;
+
+		if(!ok || !uploader.Batches.empty())
+		{
+			cout << "    an asset was ready before Update" << endl;
+			ok = false;
+		}
+
+		loader.Finish();
+
+		if(!chained.IsValid())
+		{
+			cout << "    the chained load was never queued" << endl;
+			ok = false;
+			return false;
+		}
+
+		textures.push_back(chained);
+
+		auto check = [&](const string& name, AssetState state, bool isPlaceholder, const string& error)
+		{
+			for(size_t i = 0; i < count; ++i)
+			{
+				if(name != expected[i].Name)
+					continue;
+
+				if(calls[i] != 1)
+				{
+					cout << "    " << name << "'s callback was called " << calls[i] << " times" << endl;
+					ok = false;
+				}
+
+				const bool good = expected[i].Loaded ?
+					state == AssetState::Ready && !isPlaceholder :
+					state == AssetState::Failed && isPlaceholder && !error.empty();
+
+				if(!good)
+				{
+					cout << "    " << name << " did not end as it should" << endl;
+					ok = false;
+				}
+				else if(!expected[i].Loaded)
+				{
+					cout << "  " << setw(14) << left << name << right << " failed: " << error << endl;
+				}
+			}
+		};
+
+		for(const auto& mesh : meshes)
+			check(mesh.Name(), mesh.State(), mesh.Get() == &placeholderMesh, mesh.Error());
+		for(const auto& texture : textures)
+			check(texture.Name(), texture.State(), texture.Get() == &placeholderTexture, texture.Error());
+
+		if(meshes[0].IsReady() && (meshes[0]->IndexCount == 0 || meshes[0]->Name != "skull"))
+		{
+			cout << "    the skull was uploaded empty" << endl;
+			ok = false;
+		}
+
+		const AssetLoader::Stats& stats = loader.GetStats();
+		if(stats.Requested != count + 1 || stats.Ready != 6 || stats.Failed != 5 || loader.PendingCount() != 0)
+		{
+			cout << "    the stats are off: " << stats.Requested << " requested, " << stats.Ready << " ready, "
+				<< stats.Failed << " failed" << endl;
+			ok = false;
+		}
+
+		return ok && uploader.Ok;
+	}
+
+	// Streams the same textures in again and again with a budget of two a frame.
+	bool RunBudget(const string& textureDir, TaskSystem& taskSystem)
+	{
+		bool ok = true;
+
+		StubUploader uploader;
+		AssetLoader loader(uploader, taskSystem);
+
+		const char* files[] = { "bricks3.dds", "checkboard.dds", "ice.dds" };
+
+		vector<AssetHandle<StubTexture>> textures;
+		for(int i = 0; i < 24; ++i)
+		{
+			const string file = files[i % 3];
+			textures.push_back(loader.LoadTexture<StubTexture>(file, Widen(textureDir + "/" + file)));
+		}
+
+		const uint64_t budget = 2*131200;
+
+		uint32_t frames = 0;
+		while(loader.PendingCount() > 0)
+		{
+			if(loader.Update(budget) == 0)
+				this_thread::yield();
+			else
+				++frames;
+		}
+
+		for(const auto& batch : uploader.Batches)
+		{
+			if(batch.Assets > 1 && batch.Bytes > budget)
+			{
+				cout << "    a batch of " << batch.Bytes << " bytes went over the budget" << endl;
+				ok = false;
+			}
+		}
+
+		for(const auto& texture : textures)
+			ok &= texture.IsReady();
+
+		if(frames < 12 || loader.GetStats().BytesUploaded != 24*131200)
+		{
+			cout << "    the budget was not kept to" << endl;
+			ok = false;
+		}
+
+		// One asset bigger than the budget still goes through, on its own.
+		auto big = loader.LoadTexture<StubTexture>("big", Widen(textureDir + "/bricks3.dds"));
+		while(loader.PendingCount() > 0)
+		{
+			if(loader.Update(1000) == 0)
+				this_thread::yield();
+		}
+
+		if(!big.IsReady())
+		{
+			cout << "    an asset over the budget never went through" << endl;
+			ok = false;
+		}
+
+		cout << "  24 textures streamed in " << frames << " frames with a budget of two a frame" << endl;
+
+		return ok && uploader.Ok;
+	}
+
+	// The demo's start-up: the skull and three textures, loaded in place against
+	// queued, in milliseconds until the first frame can be drawn and until they are
+	// all in.
+	void RunTimings(const string& skullFile, const string& textureDir, TaskSystem& taskSystem)
+	{
+		const char* files[] = { "bricks3.dds", "checkboard.dds", "ice.dds" };
+
+		double syncMs = 0.0;
+		{
+			auto start = chrono::steady_clock::now();
+
+			StubUploader uploader;
+			MeshData mesh;
+			string error;
+			DecodeModel(skullFile, mesh, error, taskSystem);
+
+			MeshData::Part part;
+			part.Name = "skull";
+			part.IndexCount = (uint32_t)mesh.Indices.size();
+			mesh.Parts.push_back(part);
+
+			uploader.BeginBatch();
+			uploader.UploadMesh("skull", mesh, error);
+			for(const char* file : files)
+			{
+				TextureData texture;
+				texture.File.Open(Widen(textureDir + "/" + file).c_str());
+				uploader.UploadTexture(file, texture, error);
+			}
+			uploader.EndBatch();
+
+			syncMs = Milliseconds(start);
+		}
+
+		double queueMs = 0.0;
+		double finishMs = 0.0;
+		{
+			StubUploader uploader;
+			AssetLoader loader(uploader, taskSystem);
+
+			auto start = chrono::steady_clock::now();
+
+			auto skull = loader.LoadMesh<StubMesh>("skull", [&](MeshData& mesh, string& error)
+			{
+				return DecodeModel(skullFile, mesh, error, taskSystem);
+			});
+
+			vector<AssetHandle<StubTexture>> textures;
+			for(const char* file : files)
+				textures.push_back(loader.LoadTexture<StubTexture>(file, Widen(textureDir + "/" + file)));
+
+			queueMs = Milliseconds(start);
+
+			loader.Finish();
+			finishMs = Milliseconds(start);
+		}
+
+		cout << fixed << setprecision(3)
+			<< "  loading in place    " << setw(9) << syncMs << " ms before the first frame" << endl
+			<< "  AssetLoader         " << setw(9) << queueMs << " ms before the first frame, "
+			<< finishMs << " ms until all are in" << endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	string skullFile = argc > 1 ? argv[1] : "../../Chapter 11 Stenciling/StencilDemo/Models/skull.txt";
+	string textureDir = argc > 2 ? argv[2] : "../../Textures";
+
+	TaskSystem oneWorker(1);
+	TaskSystem fourWorkers(4);
+
+	bool ok = true;
+
+	cout << "one worker" << endl;
+	ok &= RunLoads(skullFile, textureDir, oneWorker);
+	ok &= RunBudget(textureDir, oneWorker);
+	RunTimings(skullFile, textureDir, oneWorker);
+
+	cout << "four workers" << endl;
+	ok &= RunLoads(skullFile, textureDir, fourWorkers);
+	ok &= RunBudget(textureDir, fourWorkers);
+	RunTimings(skullFile, textureDir, fourWorkers);
+
+	return ok ? 0 : 1;
+}
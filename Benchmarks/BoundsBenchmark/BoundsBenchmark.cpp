@@ -0,0 +1,463 @@
+//***************************************************************************************
+// BoundsBenchmark.cpp
+//
+// Compares the bounding volumes of BoundsBuilder with those of DirectXCollision on
+// the skull, the car and a few synthetic point sets: how long each takes, how
+// large it is, and how often it makes a frustum test pass for a model that is
+// actually out of view.  Also times the min/max reduction against the scalar loop
+// the demos used to compute their boxes with, and the batch box transform against
+// BoundingBox::Transform on a large set of instances.
+//
+// Checks that every volume contains every point, that ComputeBox matches the
+// scalar loop exactly and that the batch transform matches BoundingBox::Transform.
+// Exits with a non-zero code if any check fails, so it can be run as a regression
+// test.  The model paths can be given on the command line.
+//***************************************************************************************
+
+#include "../../Common/BoundsBuilder.h"
+#include "../TextModelLoader.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	// Same layout as the demos' vertices, so positions are strided.
+	struct ModelVertex
+	{
+		XMFLOAT3 Pos;
+		XMFLOAT3 Normal;
+		XMFLOAT2 TexC;
+	};
+
+	// Copies a text model into the strided layout.
+	bool LoadModel(const string& filename, vector<ModelVertex>& vertices)
+	{
+		vector<TextModelVertex> model;
+		if(!LoadTextModel(filename, model))
+			return false;
+
+		vertices.resize(model.size());
+		for(size_t i = 0; i < model.size(); ++i)
+		{
+			vertices[i].Pos = model[i].Pos;
+			vertices[i].Normal = model[i].Normal;
+			vertices[i].TexC = XMFLOAT2(0.0f, 0.0f);
+		}
+
+		return true;
+	}
+
+	// Points allowed outside a volume, relative to its size.
+	const float ContainmentTolerance = 1e-5f;
+
+	const int ViewCount = 2000;
+	const int InstanceCount = 100000;
+
+	double Milliseconds(chrono::steady_clock::time_point start)
+	{
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	// Runs f often enough to time it and returns milliseconds per call.
+	template<typename F>
+	double Time(const F& f)
+	{
+		int runs = 0;
+		auto start = chrono::steady_clock::now();
+		do
+		{
+			f();
+			++runs;
+		}
+		while(Milliseconds(start) < 50.0);
+		return Milliseconds(start) / runs;
+	}
+
+	// The loop the demos computed their boxes with.
+	BoundingBox ScalarBox(const vector<ModelVertex>& vertices)
+	{
+		XMVECTOR vMin = XMVectorReplicate(FLT_MAX);
+		XMVECTOR vMax = XMVectorReplicate(-FLT_MAX);
+		for(const auto& v : vertices)
+		{
+			XMVECTOR p = XMLoadFloat3(&v.Pos);
+			vMin = XMVectorMin(vMin, p);
+			vMax = XMVectorMax(vMax, p);
+		}
+
+		BoundingBox box;
+		XMStoreFloat3(&box.Center, 0.5f*(vMin + vMax));
+		XMStoreFloat3(&box.Extents, 0.5f*(vMax - vMin));
+		return box;
+	}
+
+	bool Contains(const BoundingSphere& s, const vector<ModelVertex>& vertices)
+	{
+		float limit = s.Radius*(1.0f + ContainmentTolerance);
+		XMVECTOR center = XMLoadFloat3(&s.Center);
+		for(const auto& v : vertices)
+		{
+			if(XMVectorGetX(XMVector3Length(XMLoadFloat3(&v.Pos) - center)) > limit)
+				return false;
+		}
+		return true;
+	}
+
+	bool Contains(const BoundingOrientedBox& box, const vector<ModelVertex>& vertices)
+	{
+		XMVECTOR center = XMLoadFloat3(&box.Center);
+		XMVECTOR orientation = XMLoadFloat4(&box.Orientation);
+		XMVECTOR extents = XMLoadFloat3(&box.Extents);
+		XMVECTOR limit = extents + XMVectorReplicate(ContainmentTolerance*XMVectorGetX(XMVector3Length(extents)));
+		for(const auto& v : vertices)
+		{
+			XMVECTOR local = XMVector3InverseRotate(XMLoadFloat3(&v.Pos) - center, orientation);
+			if(!XMVector3LessOrEqual(XMVectorAbs(local), limit))
+				return false;
+		}
+		return true;
+	}
+
+	float Volume(const BoundingSphere& s)
+	{
+		return 4.0f / 3.0f*XM_PI*s.Radius*s.Radius*s.Radius;
+	}
+
+	float Volume(const BoundingOrientedBox& b)
+	{
+		return 8.0f*b.Extents.x*b.Extents.y*b.Extents.z;
+	}
+
+	float HalfArea(const XMFLOAT3& extents)
+	{
+		return extents.x*extents.y + extents.y*extents.z + extents.z*extents.x;
+	}
+
+	// Random views from 1.5 to 4 bounding radii away and a narrow field of view, so
+	// the model is out of view about half the time.
+	struct View
+	{
+		BoundingFrustum Frustum;
+
+		// Whether any vertex is inside the frustum.
+		bool Visible = false;
+	};
+
+	vector<View> MakeViews(const vector<ModelVertex>& vertices, const BoundingSphere& bounds)
+	{
+		XMMATRIX proj = XMMatrixPerspectiveFovLH(0.15f*XM_PI, 16.0f / 9.0f, 0.1f, 1000.0f);
+		BoundingFrustum viewFrustum(proj);
+
+		mt19937 rng(1234);
+		uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		uniform_real_distribution<float> distance(1.5f, 4.0f);
+
+		auto randomDirection = [&]()
+		{
+			XMVECTOR d;
+			do
+			{
+				d = XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f);
+			}
+			while(XMVectorGetX(XMVector3LengthSq(d)) > 1.0f || XMVectorGetX(XMVector3LengthSq(d)) < 1e-4f);
+			return XMVector3Normalize(d);
+		};
+
+		vector<View> views(ViewCount);
+		for(auto& view : views)
+		{
+			XMVECTOR center = XMLoadFloat3(&bounds.Center);
+			XMVECTOR eye = center + randomDirection()*distance(rng)*bounds.Radius;
+			XMVECTOR target = center + randomDirection()*1.5f*bounds.Radius;
+
+			XMMATRIX viewMatrix = XMMatrixLookAtLH(eye, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+			XMVECTOR det = XMMatrixDeterminant(viewMatrix);
+			viewFrustum.Transform(view.Frustum, XMMatrixInverse(&det, viewMatrix));
+
+			for(const auto& v : vertices)
+			{
+				if(view.Frustum.Contains(XMLoadFloat3(&v.Pos)) != DISJOINT)
+				{
+					view.Visible = true;
+					break;
+				}
+			}
+		}
+
+		return views;
+	}
+
+	// Percentage of the views with the model out of view that the bound still
+	// passes.
+	template<typename Bound>
+	double FalsePositives(const vector<View>& views, const Bound& bound)
+	{
+		int hidden = 0;
+		int passed = 0;
+		for(const auto& view : views)
+		{
+			if(view.Visible)
+				continue;
+
+			++hidden;
+			if(view.Frustum.Contains(bound) != DISJOINT)
+				++passed;
+		}
+		return hidden > 0 ? 100.0*passed / hidden : 0.0;
+	}
+
+	template<typename Bound>
+	void Report(const char* name, const Bound& bound, double ms, float volume, const vector<View>& views)
+	{
+		cout << "    " << left << setw(26) << name << right << fixed
+			<< setprecision(3) << setw(8) << ms << " ms  volume " << setprecision(4) << setw(12) << volume;
+		if(!views.empty())
+			cout << "  false positives " << setprecision(1) << setw(5) << FalsePositives(views, bound) << "%";
+		cout << endl;
+	}
+
+	// Views are only made for models small enough to test every vertex against.
+	bool RunModel(const char* name, const vector<ModelVertex>& vertices, bool cullViews = true)
+	{
+		bool ok = true;
+		const uint32_t count = (uint32_t)vertices.size();
+		const size_t stride = sizeof(ModelVertex);
+		const size_t offset = offsetof(ModelVertex, Pos);
+		const XMFLOAT3* positions = &vertices[0].Pos;
+
+		cout << name << ": " << count << " vertices" << endl;
+
+		//
+		// Axis-aligned boxes.
+		//
+
+		BoundingBox scalarBox, createdBox, box;
+		double scalarMs = Time([&]() { scalarBox = ScalarBox(vertices); });
+		double createdMs = Time([&]() { BoundingBox::CreateFromPoints(createdBox, count, positions, stride); });
+		double boxMs = Time([&]() { box = BoundsBuilder::ComputeBox(vertices.data(), stride, count, offset); });
+
+		cout << "  box: scalar loop " << fixed << setprecision(3) << scalarMs << " ms, CreateFromPoints "
+			<< createdMs << " ms, ComputeBox " << boxMs << " ms (" << setprecision(1) << scalarMs / boxMs
+			<< "x)" << endl;
+
+		if(box.Center.x != scalarBox.Center.x || box.Center.y != scalarBox.Center.y ||
+			box.Center.z != scalarBox.Center.z || box.Extents.x != scalarBox.Extents.x ||
+			box.Extents.y != scalarBox.Extents.y || box.Extents.z != scalarBox.Extents.z)
+		{
+			cout << "    ComputeBox does not match the scalar loop" << endl;
+			ok = false;
+		}
+
+		//
+		// Spheres and oriented boxes, and how often they fail to cull.
+		//
+
+		BoundingSphere created, fromBox, ritter, epos6, epos14, epos26, epos98;
+		double createdSphereMs = Time([&]() { BoundingSphere::CreateFromPoints(created, count, positions, stride); });
+		BoundingSphere::CreateFromBoundingBox(fromBox, box);
+		double ritterMs = Time([&]() { ritter = BoundsBuilder::ComputeRitterSphere(vertices.data(), stride, count, offset); });
+		double epos6Ms = Time([&]() { epos6 = BoundsBuilder::ComputeEposSphere(vertices.data(), stride, count, offset,
+			BoundsBuilder::EposDirections::Epos6); });
+		double epos14Ms = Time([&]() { epos14 = BoundsBuilder::ComputeEposSphere(vertices.data(), stride, count, offset,
+			BoundsBuilder::EposDirections::Epos14); });
+		double epos26Ms = Time([&]() { epos26 = BoundsBuilder::ComputeEposSphere(vertices.data(), stride, count, offset,
+			BoundsBuilder::EposDirections::Epos26); });
+		double epos98Ms = Time([&]() { epos98 = BoundsBuilder::ComputeEposSphere(vertices.data(), stride, count, offset,
+			BoundsBuilder::EposDirections::Epos98); });
+
+		BoundingOrientedBox pca, obb;
+		double pcaMs = Time([&]() { BoundingOrientedBox::CreateFromPoints(pca, count, positions, stride); });
+		double obbMs = Time([&]() { obb = BoundsBuilder::ComputeOrientedBox(vertices.data(), stride, count, offset); });
+
+		vector<View> views;
+		if(cullViews)
+		{
+			views = MakeViews(vertices, epos98);
+			int hidden = (int)count_if(views.begin(), views.end(), [](const View& v) { return !v.Visible; });
+			cout << "  " << hidden << " of " << ViewCount << " views have the model out of view" << endl;
+		}
+
+		Report("box (ComputeBox)", box, boxMs, 8.0f*box.Extents.x*box.Extents.y*box.Extents.z, views);
+		Report("sphere around the box", fromBox, 0.0, Volume(fromBox), views);
+		Report("sphere (CreateFromPoints)", created, createdSphereMs, Volume(created), views);
+		Report("sphere (Ritter)", ritter, ritterMs, Volume(ritter), views);
+		Report("sphere (EPOS-6)", epos6, epos6Ms, Volume(epos6), views);
+		Report("sphere (EPOS-14)", epos14, epos14Ms, Volume(epos14), views);
+		Report("sphere (EPOS-26)", epos26, epos26Ms, Volume(epos26), views);
+		Report("sphere (EPOS-98)", epos98, epos98Ms, Volume(epos98), views);
+		Report("oriented box (PCA)", pca, pcaMs, Volume(pca), views);
+		Report("oriented box (DiTO-14)", obb, obbMs, Volume(obb), views);
+
+		const BoundingSphere* spheres[] = { &ritter, &epos6, &epos14, &epos26, &epos98 };
+		for(const BoundingSphere* s : spheres)
+		{
+			if(!Contains(*s, vertices))
+			{
+				cout << "    a sphere misses some of the points" << endl;
+				ok = false;
+			}
+		}
+
+		if(!Contains(obb, vertices))
+		{
+			cout << "    the oriented box misses some of the points" << endl;
+			ok = false;
+		}
+
+		if(HalfArea(obb.Extents) > HalfArea(box.Extents)*(1.0f + ContainmentTolerance))
+		{
+			cout << "    the oriented box has more surface than the axis-aligned one" << endl;
+			ok = false;
+		}
+
+		return ok;
+	}
+
+	// Points on the surface of a box turned off the axes, and on a sphere.
+	vector<ModelVertex> MakeRotatedBox(uint32_t count)
+	{
+		mt19937 rng(42);
+		uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+		XMMATRIX rotation = XMMatrixRotationRollPitchYaw(0.3f, 0.7f, -0.4f);
+		vector<ModelVertex> vertices(count);
+		for(uint32_t i = 0; i < count; ++i)
+		{
+			float p[3] = { 4.0f*unit(rng), 1.0f*unit(rng), 0.5f*unit(rng) };
+			const float size[3] = { 4.0f, 1.0f, 0.5f };
+			int face = i % 3;
+			p[face] = (i / 3) % 2 ? size[face] : -size[face];
+
+			XMStoreFloat3(&vertices[i].Pos, XMVector3Transform(XMVectorSet(p[0], p[1], p[2], 1.0f), rotation));
+			vertices[i].Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			vertices[i].TexC = XMFLOAT2(0.0f, 0.0f);
+		}
+		return vertices;
+	}
+
+	vector<ModelVertex> MakeSphere(uint32_t count)
+	{
+		mt19937 rng(7);
+		normal_distribution<float> gauss;
+
+		vector<ModelVertex> vertices(count);
+		for(auto& v : vertices)
+		{
+			XMVECTOR d = XMVector3Normalize(XMVectorSet(gauss(rng), gauss(rng), gauss(rng), 0.0f));
+			XMStoreFloat3(&v.Pos, 3.0f*d + XMVectorSet(1.0f, 2.0f, 3.0f, 0.0f));
+			v.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			v.TexC = XMFLOAT2(0.0f, 0.0f);
+		}
+		return vertices;
+	}
+
+	// Transforms the skull's box by many random instance matrices, both ways.
+	bool RunTransform(const BoundingBox& box)
+	{
+		struct Instance
+		{
+			XMFLOAT4X4 World;
+			XMFLOAT4X4 TexTransform;
+			uint32_t MaterialIndex;
+		};
+
+		mt19937 rng(99);
+		uniform_real_distribution<float> angle(-XM_PI, XM_PI);
+		uniform_real_distribution<float> scale(0.5f, 2.0f);
+		uniform_real_distribution<float> position(-500.0f, 500.0f);
+
+		vector<Instance> instances(InstanceCount);
+		for(auto& instance : instances)
+		{
+			XMMATRIX world = XMMatrixScaling(scale(rng), scale(rng), scale(rng))*
+				XMMatrixRotationRollPitchYaw(angle(rng), angle(rng), angle(rng))*
+				XMMatrixTranslation(position(rng), position(rng), position(rng));
+			XMStoreFloat4x4(&instance.World, world);
+			instance.TexTransform = instance.World;
+			instance.MaterialIndex = 0;
+		}
+
+		vector<BoundingBox> expected(InstanceCount), worldBoxes(InstanceCount);
+		double transformMs = Time([&]()
+		{
+			for(int i = 0; i < InstanceCount; ++i)
+				box.Transform(expected[i], XMLoadFloat4x4(&instances[i].World));
+		});
+		double batchMs = Time([&]()
+		{
+			BoundsBuilder::TransformBoxes(box, &instances[0].World, sizeof(Instance), InstanceCount, worldBoxes.data());
+		});
+
+		cout << InstanceCount << " instance boxes: BoundingBox::Transform " << fixed << setprecision(3)
+			<< transformMs << " ms, TransformBoxes " << batchMs << " ms (" << setprecision(1)
+			<< transformMs / batchMs << "x)" << endl;
+
+		// Both are exact for the box's corners, up to rounding.
+		float maxError = 0.0f;
+		for(int i = 0; i < InstanceCount; ++i)
+		{
+			XMVECTOR c0 = XMLoadFloat3(&expected[i].Center), c1 = XMLoadFloat3(&worldBoxes[i].Center);
+			XMVECTOR e0 = XMLoadFloat3(&expected[i].Extents), e1 = XMLoadFloat3(&worldBoxes[i].Extents);
+			XMVECTOR error = XMVectorMax(XMVectorAbs(c0 - c1), XMVectorAbs(e0 - e1)) / (XMVectorAbs(c0) + e0 + XMVectorSplatOne());
+			maxError = max(maxError, max(XMVectorGetX(error), max(XMVectorGetY(error), XMVectorGetZ(error))));
+		}
+
+		if(maxError > 1e-4f)
+		{
+			cout << "  TransformBoxes differs from BoundingBox::Transform by " << maxError << endl;
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	string skullFile = argc > 1 ? argv[1] : "../../Chapter 8 Lighting/LitColumns/Models/skull.txt";
+	string carFile = argc > 2 ? argv[2] : "../../Chapter 8 Lighting/LitColumns/Models/car.txt";
+
+	bool ok = true;
+
+	vector<ModelVertex> skull;
+	if(LoadModel(skullFile, skull))
+	{
+		ok &= RunModel("skull", skull);
+		ok &= RunTransform(BoundsBuilder::ComputeBox(skull.data(), sizeof(ModelVertex), (uint32_t)skull.size(),
+			offsetof(ModelVertex, Pos)));
+	}
+	else
+	{
+		cout << skullFile << " not found." << endl;
+		ok = false;
+	}
+
+	vector<ModelVertex> car;
+	if(LoadModel(carFile, car))
+	{
+		ok &= RunModel("car", car);
+	}
+	else
+	{
+		cout << carFile << " not found." << endl;
+		ok = false;
+	}
+
+	ok &= RunModel("rotated box", MakeRotatedBox(100000));
+	ok &= RunModel("sphere", MakeSphere(100000));
+
+	// Large enough not to fit in the caches.
+	ok &= RunModel("large sphere", MakeSphere(4000000), false);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+//***************************************************************************************
+// IndexBuilderBenchmark.cpp
+//
+// Builds index buffers with IndexBuilder and prints the format and parts it
+// picks, and how much smaller the indices get than 32-bit ones:
+//
+//   - the soldier model, one submesh per subset, which fits 16-bit indices;
+//   - the same with the part size forced down to 1024 vertices, so subsets have
+//     to be split, over windows (the soldier's triangles span too many vertices
+//     for that, so it falls back to 32-bit) and with remapped vertices;
+//   - a 300x300 grid, too large for one 16-bit draw, in its own vertex order
+//     (split over windows of the vertex buffer) and with its vertices shuffled
+//     (split with remapped vertices), and with splitting turned off.
+//
+// Checks that every submesh draws exactly the triangles it was given.  Exits with
+// a non-zero code if not, so it can be run as a regression test.  The model path
+// can be given on the command line.
+//***************************************************************************************
+
+#include "../../Common/IndexBuilder.h"
+#include "../../Common/GeometryGenerator.h"
+#include "../../Chapter 23 Character Animation/SkinnedMesh/LoadM3d.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+
+using namespace std;
+
+namespace
+{
+	using Triangle = array<uint32_t, 3>;
+
+	// Rotates the smallest vertex first, keeping the winding.
+	Triangle Canonical(uint32_t a, uint32_t b, uint32_t c)
+	{
+		if(b < a && b < c)
+			return { b, c, a };
+		if(c < a && c < b)
+			return { c, a, b };
+		return { a, b, c };
+	}
+
+	// Checks that the parts of each submesh draw the submesh's triangles, in terms
+	// of the original vertices.
+	template<typename Index>
+	bool Validate(const IndexBuilder::IndexData& data, const Index* indices, uint32_t vertexCount,
+		const vector<IndexBuilder::Submesh>& submeshes)
+	{
+		const uint32_t outVertexCount = data.VertexRemap.empty() ? vertexCount : (uint32_t)data.VertexRemap.size();
+
+		auto index = [&](size_t i)
+		{
+			return data.Is16Bit() ? (uint32_t)data.Indices16[i] : data.Indices32[i];
+		};
+
+		for(uint32_t s = 0; s < (uint32_t)submeshes.size(); ++s)
+		{
+			const auto& submesh = submeshes[s];
+
+			vector<Triangle> expected;
+			for(uint32_t i = 0; i < submesh.IndexCount; i += 3)
+			{
+				const Index* tri = indices + submesh.StartIndex + i;
+				expected.push_back(Canonical(tri[0] + submesh.BaseVertex, tri[1] + submesh.BaseVertex,
+					tri[2] + submesh.BaseVertex));
+			}
+
+			vector<Triangle> drawn;
+			for(const auto& part : data.Parts)
+			{
+				if(part.Submesh != s)
+					continue;
+
+				uint32_t v[3];
+				for(uint32_t i = 0; i < part.IndexCount; ++i)
+				{
+					uint32_t out = (uint32_t)(part.BaseVertex + (int64_t)index(part.StartIndex + i));
+					if(out >= outVertexCount)
+						return false;
+
+					v[i % 3] = data.VertexRemap.empty() ? out : data.VertexRemap[out];
+					if(i % 3 == 2)
+						drawn.push_back(Canonical(v[0], v[1], v[2]));
+				}
+			}
+
+			sort(expected.begin(), expected.end());
+			sort(drawn.begin(), drawn.end());
+			if(expected != drawn)
+				return false;
+		}
+
+		return true;
+	}
+
+	template<typename Index>
+	bool Run(const char* name, const Index* indices, uint32_t vertexCount,
+		const vector<IndexBuilder::Submesh>& submeshes, IndexBuilder::SplitMode mode,
+		uint32_t maxPartVertices = IndexBuilder::MaxVertices16)
+	{
+		auto start = chrono::steady_clock::now();
+		IndexBuilder::IndexData data = IndexBuilder::Build(indices, vertexCount, submeshes, mode, maxPartVertices);
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+		size_t indexCount = 0;
+		for(const auto& s : submeshes)
+			indexCount += s.IndexCount;
+
+		size_t outVertexCount = data.VertexRemap.empty() ? vertexCount : data.VertexRemap.size();
+
+		cout << name << ": " << submeshes.size() << " submeshes drawn in " << data.Parts.size() << " parts with "
+			<< (data.Is16Bit() ? 16 : 32) << "-bit indices, " << fixed << setprecision(1)
+			<< indexCount*sizeof(uint32_t) / 1024.0 << " -> " << data.ByteSize() / 1024.0 << " KB, "
+			<< vertexCount << " -> " << outVertexCount << " vertices, built in " << setprecision(2) << ms << " ms"
+			<< endl;
+
+		bool ok = Validate(data, indices, vertexCount, submeshes);
+		if(!ok)
+			cout << "  parts do not draw the submesh triangles" << endl;
+
+		return ok;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	string soldierFile = argc > 1 ? argv[1] : "../../Chapter 23 Character Animation/SkinnedMesh/Models/soldier.m3d";
+
+	bool ok = true;
+
+	vector<M3DLoader::SkinnedVertex> soldierVertices;
+	vector<UINT> soldierIndices;
+	vector<M3DLoader::Subset> soldierSubsets;
+	vector<M3DLoader::M3dMaterial> soldierMats;
+	SkinnedData soldierSkin;
+
+	M3DLoader m3dLoader;
+	if(m3dLoader.LoadM3d(soldierFile, soldierVertices, soldierIndices, soldierSubsets, soldierMats, soldierSkin))
+	{
+		vector<IndexBuilder::Submesh> submeshes(soldierSubsets.size());
+		for(size_t i = 0; i < soldierSubsets.size(); ++i)
+		{
+			submeshes[i].StartIndex = soldierSubsets[i].FaceStart * 3;
+			submeshes[i].IndexCount = soldierSubsets[i].FaceCount * 3;
+		}
+
+		const uint32_t vertexCount = (uint32_t)soldierVertices.size();
+		ok &= Run("soldier", soldierIndices.data(), vertexCount, submeshes, IndexBuilder::SplitMode::Remap);
+		ok &= Run("soldier, 1024-vertex windows", soldierIndices.data(), vertexCount, submeshes,
+			IndexBuilder::SplitMode::Contiguous, 1024);
+		ok &= Run("soldier, 1024-vertex remapped parts", soldierIndices.data(), vertexCount, submeshes,
+			IndexBuilder::SplitMode::Remap, 1024);
+	}
+	else
+	{
+		cout << soldierFile << " not found." << endl;
+		ok = false;
+	}
+
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData grid = geoGen.CreateGrid(100.0f, 100.0f, 300, 300);
+	const uint32_t gridVertexCount = (uint32_t)grid.Vertices.size();
+
+	vector<IndexBuilder::Submesh> gridSubmesh(1);
+	gridSubmesh[0].IndexCount = (uint32_t)grid.Indices32.size();
+
+	ok &= Run("grid", grid.Indices32.data(), gridVertexCount, gridSubmesh, IndexBuilder::SplitMode::Remap);
+	ok &= Run("grid, no splitting", grid.Indices32.data(), gridVertexCount, gridSubmesh, IndexBuilder::SplitMode::None);
+
+	// The same triangles over shuffled vertices, as an unoptimized mesh might have.
+	vector<uint32_t> shuffle(gridVertexCount);
+	iota(shuffle.begin(), shuffle.end(), 0);
+	mt19937 rng(1234);
+	std::shuffle(shuffle.begin(), shuffle.end(), rng);
+
+	vector<uint32_t> shuffledIndices(grid.Indices32.size());
+	for(size_t i = 0; i < shuffledIndices.size(); ++i)
+		shuffledIndices[i] = shuffle[grid.Indices32[i]];
+
+	ok &= Run("shuffled grid", shuffledIndices.data(), gridVertexCount, gridSubmesh, IndexBuilder::SplitMode::Remap);
+	ok &= Run("shuffled grid, windows only", shuffledIndices.data(), gridVertexCount, gridSubmesh,
+		IndexBuilder::SplitMode::Contiguous);
+
+	return ok ? 0 : 1;
+}
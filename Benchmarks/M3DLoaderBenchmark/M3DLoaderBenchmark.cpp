@@ -0,0 +1,823 @@
+//***************************************************************************************
+// M3DLoaderBenchmark.cpp
+//
+// Times loading the soldier with M3DLoader, which maps the file and scans it with
+// TextScanner, against the ifstream reader it replaced, kept here as it was; and
+// against loading the .m3b it compiles to.  M3DLoader is timed on one worker and on
+// four, as it parses the vertex, triangle and keyframe lists in parallel.
+//
+// Checks that all of them give exactly the same vertices, indices, subsets,
+// materials, bone offsets, hierarchy and keyframes, on any number of workers and
+// when a list does not keep to the same lines a record; that the .m3b keyframes are
+// viewed in place and outlive the loader; that LoadCompiled compiles the .m3b once
+// and again only when the text changes; that TextScanner::ParseFloat rounds like
+// strtof on a million random numbers; and that truncated or corrupt files, text or
+// binary, are rejected.  Exits with a non-zero code if any check fails, so it can
+// be run as a regression test.
+//
+// Its scratch files are written to the working directory.  Run as
+//
+//   M3DLoaderBenchmark [soldier.m3d]
+//   M3DLoaderBenchmark -convert model.m3d...
+//
+// the second form compiles each model to model.m3b beside it.
+//***************************************************************************************
+
+#include "../../Chapter 23 Character Animation/SkinnedMesh/LoadM3d.h"
+#include "../../Common/TaskSystem.h"
+#include "../../Common/TextScanner.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	// Everything an .m3d file holds, as the ifstream reader read it.
+	struct StreamModel
+	{
+		vector<M3DLoader::SkinnedVertex> Vertices;
+		vector<UINT> Indices;
+		vector<M3DLoader::Subset> Subsets;
+		vector<M3DLoader::M3dMaterial> Materials;
+		vector<XMFLOAT4X4> BoneOffsets;
+		vector<int> BoneHierarchy;
+		unordered_map<string, AnimationClip> Animations;
+	};
+
+	// The reader M3DLoader used before it scanned mapped files.
+	bool LoadWithStream(const string& filename, StreamModel& model)
+	{
+		ifstream fin(filename);
+		if(!fin)
+			return false;
+
+		UINT numMaterials = 0;
+		UINT numVertices = 0;
+		UINT numTriangles = 0;
+		UINT numBones = 0;
+		UINT numAnimationClips = 0;
+
+		string ignore;
+
+		fin >> ignore; // file header text
+		fin >> ignore >> numMaterials;
+		fin >> ignore >> numVertices;
+		fin >> ignore >> numTriangles;
+		fin >> ignore >> numBones;
+		fin >> ignore >> numAnimationClips;
+
+		auto& mats = model.Materials;
+		mats.resize(numMaterials);
+		fin >> ignore; // materials header text
+		for(UINT i = 0; i < numMaterials; ++i)
+		{
+			fin >> ignore >> mats[i].Name;
+			fin >> ignore >> mats[i].DiffuseAlbedo.x >> mats[i].DiffuseAlbedo.y >> mats[i].DiffuseAlbedo.z;
+			fin >> ignore >> mats[i].FresnelR0.x >> mats[i].FresnelR0.y >> mats[i].FresnelR0.z;
+			fin >> ignore >> mats[i].Roughness;
+			fin >> ignore >> mats[i].AlphaClip;
+			fin >> ignore >> mats[i].MaterialTypeName;
+			fin >> ignore >> mats[i].DiffuseMapName;
+			fin >> ignore >> mats[i].NormalMapName;
+		}
+
+		auto& subsets = model.Subsets;
+		subsets.resize(numMaterials);
+		fin >> ignore; // subset header text
+		for(UINT i = 0; i < numMaterials; ++i)
+		{
+			fin >> ignore >> subsets[i].Id;
+			fin >> ignore >> subsets[i].VertexStart;
+			fin >> ignore >> subsets[i].VertexCount;
+			fin >> ignore >> subsets[i].FaceStart;
+			fin >> ignore >> subsets[i].FaceCount;
+		}
+
+		auto& vertices = model.Vertices;
+		vertices.resize(numVertices);
+		fin >> ignore; // vertices header text
+		int boneIndices[4];
+		float weights[4];
+		for(UINT i = 0; i < numVertices; ++i)
+		{
+			fin >> ignore >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
+			fin >> ignore >> vertices[i].TangentU.x >> vertices[i].TangentU.y >> vertices[i].TangentU.z >> vertices[i].TangentU.w;
+			fin >> ignore >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
+			fin >> ignore >> vertices[i].TexC.x >> vertices[i].TexC.y;
+			fin >> ignore >> weights[0] >> weights[1] >> weights[2] >> weights[3];
+			fin >> ignore >> boneIndices[0] >> boneIndices[1] >> boneIndices[2] >> boneIndices[3];
+
+			vertices[i].BoneWeights = XMFLOAT3(weights[0], weights[1], weights[2]);
+			for(int j = 0; j < 4; ++j)
+				vertices[i].BoneIndices[j] = (BYTE)boneIndices[j];
+		}
+
+		auto& indices = model.Indices;
+		indices.resize(numTriangles * 3);
+		fin >> ignore; // triangles header text
+		for(UINT i = 0; i < numTriangles; ++i)
+		{
+			fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
+		}
+
+		auto& boneOffsets = model.BoneOffsets;
+		boneOffsets.resize(numBones);
+		fin >> ignore; // BoneOffsets header text
+		for(UINT i = 0; i < numBones; ++i)
+		{
+			fin >> ignore;
+			for(int r = 0; r < 4; ++r)
+				fin >> boneOffsets[i](r, 0) >> boneOffsets[i](r, 1) >> boneOffsets[i](r, 2) >> boneOffsets[i](r, 3);
+		}
+
+		model.BoneHierarchy.resize(numBones);
+		fin >> ignore; // BoneHierarchy header text
+		for(UINT i = 0; i < numBones; ++i)
+		{
+			fin >> ignore >> model.BoneHierarchy[i];
+		}
+
+		fin >> ignore; // AnimationClips header text
+		for(UINT clipIndex = 0; clipIndex < numAnimationClips; ++clipIndex)
+		{
+			string clipName;
+			fin >> ignore >> clipName;
+			fin >> ignore; // {
+
+			AnimationClip clip;
+			clip.BoneAnimations.resize(numBones);
+			for(UINT boneIndex = 0; boneIndex < numBones; ++boneIndex)
+			{
+				UINT numKeyframes = 0;
+				fin >> ignore >> ignore >> numKeyframes;
+				fin >> ignore; // {
+
+				auto& keyframes = clip.BoneAnimations[boneIndex].Keyframes;
+				keyframes.resize(numKeyframes);
+				for(UINT i = 0; i < numKeyframes; ++i)
+				{
+					Keyframe& k = keyframes[i];
+					fin >> ignore >> k.TimePos;
+					fin >> ignore >> k.Translation.x >> k.Translation.y >> k.Translation.z;
+					fin >> ignore >> k.Scale.x >> k.Scale.y >> k.Scale.z;
+					fin >> ignore >> k.RotationQuat.x >> k.RotationQuat.y >> k.RotationQuat.z >> k.RotationQuat.w;
+				}
+
+				fin >> ignore; // }
+			}
+			fin >> ignore; // }
+
+			model.Animations[clipName] = clip;
+		}
+
+		return !fin.fail();
+	}
+
+	double Milliseconds(chrono::steady_clock::time_point start)
+	{
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	// Runs f often enough to time it and returns milliseconds per call.
+	template<typename F>
+	double Time(const F& f)
+	{
+		int runs = 0;
+		auto start = chrono::steady_clock::now();
+		do
+		{
+			f();
+			++runs;
+		}
+		while(Milliseconds(start) < 500.0);
+		return Milliseconds(start) / runs;
+	}
+
+	// Bitwise, so that -0 and 0 are told apart.
+	template<typename T>
+	bool Same(const T& a, const T& b)
+	{
+		return memcmp(&a, &b, sizeof(T)) == 0;
+	}
+
+	bool Same(const M3DLoader::SkinnedVertex& a, const M3DLoader::SkinnedVertex& b)
+	{
+		return Same(a.Pos, b.Pos) && Same(a.Normal, b.Normal) && Same(a.TexC, b.TexC) && Same(a.TangentU, b.TangentU) &&
+			Same(a.BoneWeights, b.BoneWeights) && memcmp(a.BoneIndices, b.BoneIndices, 4) == 0;
+	}
+
+	bool Same(const M3DLoader::Subset& a, const M3DLoader::Subset& b)
+	{
+		return a.Id == b.Id && a.VertexStart == b.VertexStart && a.VertexCount == b.VertexCount &&
+			a.FaceStart == b.FaceStart && a.FaceCount == b.FaceCount;
+	}
+
+	bool Same(const M3DLoader::M3dMaterial& a, const M3DLoader::M3dMaterial& b)
+	{
+		return a.Name == b.Name && Same(a.DiffuseAlbedo, b.DiffuseAlbedo) && Same(a.FresnelR0, b.FresnelR0) &&
+			Same(a.Roughness, b.Roughness) && a.AlphaClip == b.AlphaClip && a.MaterialTypeName == b.MaterialTypeName &&
+			a.DiffuseMapName == b.DiffuseMapName && a.NormalMapName == b.NormalMapName;
+	}
+
+	bool Same(const Keyframe& a, const Keyframe& b)
+	{
+		return Same(a.TimePos, b.TimePos) && Same(a.Translation, b.Translation) && Same(a.Scale, b.Scale) &&
+			Same(a.RotationQuat, b.RotationQuat);
+	}
+
+	template<typename T>
+	bool SameArray(const vector<T>& a, const vector<T>& b)
+	{
+		if(a.size() != b.size())
+			return false;
+
+		for(size_t i = 0; i < a.size(); ++i)
+		{
+			if(!Same(a[i], b[i]))
+				return false;
+		}
+
+		return true;
+	}
+
+	bool SameAnimations(const unordered_map<string, AnimationClip>& a, const unordered_map<string, AnimationClip>& b)
+	{
+		if(a.size() != b.size())
+			return false;
+
+		for(const auto& clip : a)
+		{
+			auto other = b.find(clip.first);
+			if(other == b.end() || clip.second.BoneAnimations.size() != other->second.BoneAnimations.size())
+				return false;
+
+			for(size_t i = 0; i < clip.second.BoneAnimations.size(); ++i)
+			{
+				const BoneAnimation& boneA = clip.second.BoneAnimations[i];
+				const BoneAnimation& boneB = other->second.BoneAnimations[i];
+				if(boneA.GetKeyframeCount() != boneB.GetKeyframeCount())
+					return false;
+
+				for(UINT k = 0; k < boneA.GetKeyframeCount(); ++k)
+				{
+					if(!Same(boneA.GetKeyframes()[k], boneB.GetKeyframes()[k]))
+						return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	size_t KeyframeCount(const unordered_map<string, AnimationClip>& animations)
+	{
+		size_t keyframes = 0;
+		for(const auto& clip : animations)
+		{
+			for(const auto& bone : clip.second.BoneAnimations)
+				keyframes += bone.GetKeyframeCount();
+		}
+		return keyframes;
+	}
+
+	// Compares a loaded model with what the ifstream reader read.
+	bool SameAsReference(const char* what, const vector<M3DLoader::SkinnedVertex>& vertices, const vector<UINT>& indices,
+		const vector<M3DLoader::Subset>& subsets, const vector<M3DLoader::M3dMaterial>& mats, const SkinnedData& skin,
+		const StreamModel& reference)
+	{
+		bool ok = true;
+		if(!SameArray(vertices, reference.Vertices) || indices != reference.Indices)
+		{
+			cout << "    " << what << ": the vertices or indices differ from the ifstream reader's" << endl;
+			ok = false;
+		}
+
+		if(!SameArray(subsets, reference.Subsets) || !SameArray(mats, reference.Materials))
+		{
+			cout << "    " << what << ": the subsets or materials differ from the ifstream reader's" << endl;
+			ok = false;
+		}
+
+		if(!SameArray(skin.BoneOffsets(), reference.BoneOffsets) || skin.BoneHierarchy() != reference.BoneHierarchy ||
+			!SameAnimations(skin.Animations(), reference.Animations))
+		{
+			cout << "    " << what << ": the skeleton or animations differ from the ifstream reader's" << endl;
+			ok = false;
+		}
+
+		return ok;
+	}
+
+	// Whether skin's keyframes are viewed in a mapped file rather than copied.
+	bool ViewsKeyframes(const SkinnedData& skin)
+	{
+		for(const auto& clip : skin.Animations())
+		{
+			for(const auto& bone : clip.second.BoneAnimations)
+			{
+				if(bone.MappedKeyframes == nullptr || !bone.Keyframes.empty())
+					return false;
+			}
+		}
+
+		return !skin.Animations().empty();
+	}
+
+	string ReadFile(const string& filename)
+	{
+		ifstream fin(filename, ios::binary);
+		ostringstream contents;
+		contents << fin.rdbuf();
+		return contents.str();
+	}
+
+	void WriteFile(const string& filename, const string& contents)
+	{
+		ofstream fout(filename, ios::binary | ios::trunc);
+		fout << contents;
+	}
+
+	// The line, counting from 1, that offset is on.
+	int LineOf(const string& contents, size_t offset)
+	{
+		return 1 + (int)count(contents.begin(), contents.begin() + offset, '\n');
+	}
+
+	// Loads contents from a scratch file, expecting it to fail with an error that
+	// names line.
+	bool ExpectFailure(const char* what, const string& contents, int line)
+	{
+		const string scratchFile = "M3DLoaderBenchmark.m3d";
+		WriteFile(scratchFile, contents);
+
+		vector<M3DLoader::SkinnedVertex> vertices;
+		vector<UINT> indices;
+		vector<M3DLoader::Subset> subsets;
+		vector<M3DLoader::M3dMaterial> mats;
+		SkinnedData skin;
+
+		M3DLoader loader;
+		bool loaded = loader.LoadM3d(scratchFile, vertices, indices, subsets, mats, skin);
+		remove(scratchFile.c_str());
+
+		const string expected = scratchFile + "(" + to_string(line) + "):";
+		if(loaded || loader.Error().compare(0, expected.size(), expected) != 0)
+		{
+			cout << "    " << what << ": expected an error on line " << line << ", got \""
+				<< (loaded ? "no error" : loader.Error()) << "\"" << endl;
+			return false;
+		}
+
+		cout << "  " << what << ": " << loader.Error() << endl;
+		return true;
+	}
+
+	// Loads contents from a scratch file with loader, expecting the model of reference.
+	bool LoadsAsReference(const char* what, M3DLoader& loader, const string& contents, const StreamModel& reference)
+	{
+		const string scratchFile = "M3DLoaderBenchmark.m3d";
+		WriteFile(scratchFile, contents);
+
+		vector<M3DLoader::SkinnedVertex> vertices;
+		vector<UINT> indices;
+		vector<M3DLoader::Subset> subsets;
+		vector<M3DLoader::M3dMaterial> mats;
+		SkinnedData skin;
+
+		bool loaded = loader.LoadM3d(scratchFile, vertices, indices, subsets, mats, skin);
+		remove(scratchFile.c_str());
+
+		if(!loaded)
+		{
+			cout << "    " << what << ": " << loader.Error() << endl;
+			return false;
+		}
+
+		return SameAsReference(what, vertices, indices, subsets, mats, skin, reference);
+	}
+
+	// contents with the line that has the first token past the middle of
+	// [first, last) joined onto the line before it.
+	string WithJoinedLine(const string& contents, size_t first, size_t last, const char* token)
+	{
+		size_t at = contents.find(token, first + (last - first) / 2);
+
+		string result = contents;
+		result[result.rfind('\n', at)] = ' ';
+		return result;
+	}
+
+	bool RunParallel(const string& filename)
+	{
+		StreamModel reference;
+		if(!LoadWithStream(filename, reference))
+		{
+			cout << filename << " not found." << endl;
+			return false;
+		}
+
+		// Four workers split the lists even on a machine with fewer cores.
+		TaskSystem fourWorkers(4);
+		M3DLoader parallelLoader(fourWorkers);
+
+		string contents = ReadFile(filename);
+		bool ok = LoadsAsReference("four workers", parallelLoader, contents, reference);
+
+		// A record on one line fewer throws off the split after it, which must be
+		// noticed and the list read in order instead.
+		size_t vertices = contents.find("Vertices*");
+		size_t triangles = contents.find("Triangles*");
+		size_t boneOffsets = contents.find("BoneOffsets*");
+		size_t clips = contents.find("AnimationClips*");
+
+		ok &= LoadsAsReference("joined vertex lines", parallelLoader,
+			WithJoinedLine(contents, vertices, triangles, "Normal:"), reference);
+		ok &= LoadsAsReference("joined triangle lines", parallelLoader,
+			WithJoinedLine(contents, triangles, boneOffsets, "\n"), reference);
+		ok &= LoadsAsReference("joined keyframe lines", parallelLoader,
+			WithJoinedLine(contents, clips, contents.size(), "Time:"), reference);
+
+		TaskSystem oneWorker(1);
+		M3DLoader serialLoader(oneWorker);
+
+		vector<M3DLoader::SkinnedVertex> skinnedVertices;
+		vector<UINT> indices;
+		vector<M3DLoader::Subset> subsets;
+		vector<M3DLoader::M3dMaterial> mats;
+
+		double oneWorkerMs = Time([&]()
+		{
+			SkinnedData s;
+			serialLoader.LoadM3d(filename, skinnedVertices, indices, subsets, mats, s);
+		});
+
+		double fourWorkersMs = Time([&]()
+		{
+			SkinnedData s;
+			parallelLoader.LoadM3d(filename, skinnedVertices, indices, subsets, mats, s);
+		});
+
+		cout << "Parallel parsing, " << thread::hardware_concurrency() << " hardware threads: " << fixed
+			<< setprecision(3) << oneWorkerMs << " ms on one worker, " << fourWorkersMs << " ms on four, "
+			<< setprecision(1) << oneWorkerMs / fourWorkersMs << "x" << endl;
+
+		return ok;
+	}
+
+	bool RunParseFloat()
+	{
+		mt19937 rng(1234);
+		uniform_int_distribution<uint32_t> bits;
+		uniform_int_distribution<int> precision(1, 9);
+
+		const int numbers = 1000000;
+		int mismatches = 0;
+		char text[64];
+		for(int i = 0; i < numbers; ++i)
+		{
+			// Random bit patterns cover every exponent.  Skip NaNs, infinities and
+			// denormals, which the model files never hold and which from_chars and
+			// strtof treat differently.
+			uint32_t u = bits(rng);
+			float f;
+			memcpy(&f, &u, sizeof(f));
+			if(!isnormal(f))
+				continue;
+
+			int length = snprintf(text, sizeof(text), (i & 1) ? "%.*g" : "%.*E", precision(rng), f);
+
+			float expected = strtof(text, nullptr);
+			if(!isnormal(expected))
+				continue;
+
+			float parsed = 0.0f;
+			const char* end = TextScanner::ParseFloat(text, text + length, parsed);
+
+			if(end != text + length || !Same(parsed, expected))
+			{
+				if(mismatches++ < 5)
+					cout << "    ParseFloat(\"" << text << "\") = " << setprecision(9) << parsed << ", strtof gives "
+						<< expected << endl;
+			}
+		}
+
+		cout << "ParseFloat: " << numbers << " random numbers, " << mismatches << " differ from strtof" << endl;
+		return mismatches == 0;
+	}
+
+	bool RunModel(const string& filename)
+	{
+		StreamModel reference;
+		if(!LoadWithStream(filename, reference))
+		{
+			cout << filename << " not found." << endl;
+			return false;
+		}
+
+		vector<M3DLoader::SkinnedVertex> vertices;
+		vector<UINT> indices;
+		vector<M3DLoader::Subset> subsets;
+		vector<M3DLoader::M3dMaterial> mats;
+		SkinnedData skin;
+
+		M3DLoader loader;
+		if(!loader.LoadM3d(filename, vertices, indices, subsets, mats, skin))
+		{
+			cout << "    " << loader.Error() << endl;
+			return false;
+		}
+
+		cout << filename << ": " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles, "
+			<< skin.BoneCount() << " bones, " << KeyframeCount(skin.Animations()) << " keyframes" << endl;
+
+		bool ok = SameAsReference("LoadM3d", vertices, indices, subsets, mats, skin, reference);
+
+		double streamMs = Time([&]()
+		{
+			StreamModel model;
+			LoadWithStream(filename, model);
+		});
+
+		double loaderMs = Time([&]()
+		{
+			SkinnedData s;
+			loader.LoadM3d(filename, vertices, indices, subsets, mats, s);
+		});
+
+		cout << fixed << setprecision(3)
+			<< "  ifstream   " << setw(9) << streamMs << " ms" << endl
+			<< "  M3DLoader  " << setw(9) << loaderMs << " ms, " << setprecision(1) << streamMs / loaderMs << "x faster"
+			<< endl;
+
+		// Malformed files fail with the line of the problem rather than loading zeros.
+		string contents = ReadFile(filename);
+
+		size_t position = contents.find("Position:");
+		size_t number = contents.find_first_of("-0123456789", position);
+		string badNumber = contents;
+		badNumber.replace(number, 1, "x");
+		ok &= ExpectFailure("bad number", badNumber, LineOf(contents, number));
+
+		size_t keyframe = contents.rfind("Time:");
+		ok &= ExpectFailure("truncated", contents.substr(0, keyframe + 5), LineOf(contents, keyframe));
+
+		size_t vertexCount = contents.find("#Vertices");
+		size_t digits = contents.find_first_of("0123456789", vertexCount);
+		string hugeCount = contents;
+		hugeCount.replace(digits, contents.find_first_not_of("0123456789", digits) - digits, "4000000000");
+		ok &= ExpectFailure("huge count", hugeCount, LineOf(contents, digits));
+
+		size_t triangles = contents.find("Triangles*");
+		size_t index = contents.find_first_of("0123456789", contents.find('\n', triangles));
+		string badIndex = contents;
+		badIndex.replace(index, contents.find_first_not_of("0123456789", index) - index, "99999999");
+		ok &= ExpectFailure("index out of range", badIndex, LineOf(contents, index));
+
+		return ok;
+	}
+
+	// Loads contents as an .m3b from a scratch file, expecting it to be rejected.
+	bool ExpectM3bFailure(const char* what, const string& contents)
+	{
+		const string scratchFile = "M3DLoaderBenchmarkCorrupt.m3b";
+		WriteFile(scratchFile, contents);
+
+		vector<M3DLoader::SkinnedVertex> vertices;
+		vector<UINT> indices;
+		vector<M3DLoader::Subset> subsets;
+		vector<M3DLoader::M3dMaterial> mats;
+		SkinnedData skin;
+
+		M3DLoader loader;
+		bool loaded = loader.LoadM3b(scratchFile, vertices, indices, subsets, mats, skin);
+		remove(scratchFile.c_str());
+
+		if(loaded)
+		{
+			cout << "    " << what << ": loaded without an error" << endl;
+			return false;
+		}
+
+		cout << "  " << what << ": " << loader.Error() << endl;
+		return true;
+	}
+
+	// Overwrites the 32-bit value at offset in image.
+	void Poke(string& image, size_t offset, uint32_t value)
+	{
+		memcpy(&image[offset], &value, sizeof(value));
+	}
+
+	// The offset of a section of an .m3b image.  The section table starts 64 bytes
+	// into the header, with an offset and a size for each section in the order they
+	// are listed in LoadM3d.h.
+	size_t SectionOffset(const string& image, int section)
+	{
+		uint64_t offset = 0;
+		memcpy(&offset, &image[64 + 16 * section], sizeof(offset));
+		return (size_t)offset;
+	}
+
+	bool RunBinary(const string& filename)
+	{
+		StreamModel reference;
+		if(!LoadWithStream(filename, reference))
+			return false;
+
+		const string scratchText = "M3DLoaderBenchmark.m3d";
+		const string scratchFile = M3DLoader::CompiledFile(scratchText);
+
+		M3DLoader loader;
+		auto start = chrono::steady_clock::now();
+		if(!loader.ConvertToM3b(filename, scratchFile))
+		{
+			cout << "    " << loader.Error() << endl;
+			return false;
+		}
+		double convertMs = Milliseconds(start);
+
+		const string image = ReadFile(scratchFile);
+		cout << scratchFile << ": " << image.size() / 1024 << " KB, from " << ReadFile(filename).size() / 1024
+			<< " KB of text" << endl;
+
+		vector<M3DLoader::SkinnedVertex> vertices;
+		vector<UINT> indices;
+		vector<M3DLoader::Subset> subsets;
+		vector<M3DLoader::M3dMaterial> mats;
+		SkinnedData skin;
+
+		if(!loader.LoadM3b(scratchFile, vertices, indices, subsets, mats, skin))
+		{
+			cout << "    " << loader.Error() << endl;
+			return false;
+		}
+
+		bool ok = SameAsReference("LoadM3b", vertices, indices, subsets, mats, skin, reference);
+		if(!ViewsKeyframes(skin))
+		{
+			cout << "    LoadM3b copied the keyframes rather than viewing them in place" << endl;
+			ok = false;
+		}
+
+		// The views keep the file mapped after the loader is done with it, and are
+		// shared by copies of the SkinnedData.
+		SkinnedData copy = skin;
+		skin = SkinnedData();
+		if(!SameAnimations(copy.Animations(), reference.Animations))
+		{
+			cout << "    the keyframes changed once the loader closed the file" << endl;
+			ok = false;
+		}
+
+		// Animating from the views gives the same transforms as from the text.
+		SkinnedData textSkin;
+		loader.LoadM3d(filename, vertices, indices, subsets, mats, textSkin);
+
+		const string clipName = reference.Animations.begin()->first;
+		const float startTime = textSkin.GetClipStartTime(clipName);
+		const float endTime = textSkin.GetClipEndTime(clipName);
+
+		vector<XMFLOAT4X4> textTransforms(textSkin.BoneCount());
+		vector<XMFLOAT4X4> binaryTransforms(copy.BoneCount());
+		for(int i = 0; i <= 16; ++i)
+		{
+			float t = startTime + (endTime - startTime) * i / 16.0f;
+			textSkin.GetFinalTransforms(clipName, t, textTransforms);
+			copy.GetFinalTransforms(clipName, t, binaryTransforms);
+			if(!SameArray(textTransforms, binaryTransforms))
+			{
+				cout << "    the bone transforms at " << t << " differ from the text's" << endl;
+				ok = false;
+				break;
+			}
+		}
+
+		double textMs = Time([&]()
+		{
+			SkinnedData s;
+			loader.LoadM3d(filename, vertices, indices, subsets, mats, s);
+		});
+
+		double binaryMs = Time([&]()
+		{
+			SkinnedData s;
+			loader.LoadM3b(scratchFile, vertices, indices, subsets, mats, s);
+		});
+
+		double openMs = Time([&]()
+		{
+			M3bFile file;
+			SkinnedData s;
+			file.Open(scratchFile);
+			file.GetSkinnedData(s);
+		});
+
+		cout << fixed << setprecision(3)
+			<< "  ConvertToM3b     " << setw(9) << convertMs << " ms" << endl
+			<< "  LoadM3d          " << setw(9) << textMs << " ms" << endl
+			<< "  LoadM3b          " << setw(9) << binaryMs << " ms, " << setprecision(1) << textMs / binaryMs
+			<< "x faster (copies vertices and indices)" << endl
+			<< setprecision(3)
+			<< "  M3bFile          " << setw(9) << openMs << " ms, " << setprecision(1) << textMs / openMs
+			<< "x faster (in place)" << endl;
+
+		// LoadCompiled compiles the text once, then loads the binary until the text
+		// changes.
+		string contents = ReadFile(filename);
+		WriteFile(scratchText, contents);
+		remove(scratchFile.c_str());
+
+		const char* expected[] = { "text", "binary", "text", "binary" };
+		for(int i = 0; i < 4; ++i)
+		{
+			if(i == 2)
+				WriteFile(scratchText, contents + "\n");
+
+			SkinnedData compiled;
+			if(!loader.LoadCompiled(scratchText, vertices, indices, subsets, mats, compiled))
+			{
+				cout << "    LoadCompiled: " << loader.Error() << endl;
+				ok = false;
+				break;
+			}
+
+			const char* source = ViewsKeyframes(compiled) ? "binary" : "text";
+			if(strcmp(source, expected[i]) != 0 ||
+				!SameAsReference("LoadCompiled", vertices, indices, subsets, mats, compiled, reference))
+			{
+				cout << "    LoadCompiled load " << i + 1 << " read the " << source << ", expected the " << expected[i]
+					<< endl;
+				ok = false;
+			}
+		}
+
+		remove(scratchText.c_str());
+		remove(scratchFile.c_str());
+
+		// Damaged files are rejected rather than read out of bounds.
+		string badMagic = image;
+		badMagic[0] = 'X';
+		ok &= ExpectM3bFailure("bad magic", badMagic);
+
+		string badVersion = image;
+		Poke(badVersion, 4, 99);
+		ok &= ExpectM3bFailure("other version", badVersion);
+
+		ok &= ExpectM3bFailure("truncated", image.substr(0, image.size() / 2));
+
+		string badIndex = image;
+		Poke(badIndex, SectionOffset(image, 4), 0xFFFFFFFF);
+		ok &= ExpectM3bFailure("index out of range", badIndex);
+
+		string badTrack = image;
+		Poke(badTrack, SectionOffset(image, 8), 0xFFFFFFF0);
+		ok &= ExpectM3bFailure("keyframes out of range", badTrack);
+
+		return ok;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if(argc > 1 && strcmp(argv[1], "-convert") == 0)
+	{
+		bool ok = true;
+		for(int i = 2; i < argc; ++i)
+		{
+			M3DLoader loader;
+			string m3bFile = M3DLoader::CompiledFile(argv[i]);
+			if(loader.ConvertToM3b(argv[i], m3bFile))
+			{
+				cout << m3bFile << " written" << endl;
+			}
+			else
+			{
+				cout << loader.Error() << endl;
+				ok = false;
+			}
+		}
+
+		return ok ? 0 : 1;
+	}
+
+	string soldierFile = argc > 1 ? argv[1] : "../../Chapter 23 Character Animation/SkinnedMesh/Models/soldier.m3d";
+
+	bool ok = true;
+	ok &= RunParseFloat();
+	ok &= RunModel(soldierFile);
+	ok &= RunParallel(soldierFile);
+	ok &= RunBinary(soldierFile);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,537 @@
+//***************************************************************************************
+// MeshCacheBenchmark.cpp
+//
+// Times loading the skull and the car the way the demos used to, with ifstream,
+// against MeshCache: parsing the text and writing the cache on the first run, and
+// opening the cache on every run after it.
+//
+// Checks that the cache holds exactly what the text parses to, that the demos'
+// reader agrees with it, that the parallel parse gives the same floats as reading
+// the text in order, and that the cache is reused, restamped or rebuilt as its
+// text is left alone, rewritten with the same contents, changed or deleted, and
+// when the cache itself is damaged.  Exits with a non-zero code if any check fails,
+// so it can be run as a regression test.
+//
+// The caches it makes are written to the working directory.  Run as
+//
+//   MeshCacheBenchmark [skull.txt [car.txt]]
+//   MeshCacheBenchmark -convert model.txt...
+//
+// the second form converts each model to model.txt.cache beside it, so a cache can
+// be shipped with, or instead of, the text.
+//***************************************************************************************
+
+#include "../../Common/MeshCache.h"
+#include "../../Common/TaskSystem.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	// The demos' vertex, which the mesh is copied into.
+	struct ModelVertex
+	{
+		XMFLOAT3 Pos;
+		XMFLOAT3 Normal;
+		XMFLOAT2 TexC;
+	};
+
+	// The reader the demos used before MeshCache.
+	bool LoadWithStream(const string& filename, vector<ModelVertex>& vertices, vector<int32_t>& indices)
+	{
+		ifstream fin(filename);
+		if(!fin)
+			return false;
+
+		uint32_t vcount = 0;
+		uint32_t tcount = 0;
+		string ignore;
+
+		fin >> ignore >> vcount;
+		fin >> ignore >> tcount;
+		fin >> ignore >> ignore >> ignore >> ignore;
+
+		vertices.resize(vcount);
+		for(uint32_t i = 0; i < vcount; ++i)
+		{
+			fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
+			fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
+			vertices[i].TexC = XMFLOAT2(0.0f, 0.0f);
+		}
+
+		fin >> ignore;
+		fin >> ignore;
+		fin >> ignore;
+
+		indices.resize(3 * tcount);
+		for(uint32_t i = 0; i < tcount; ++i)
+		{
+			fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
+		}
+
+		return !fin.fail();
+	}
+
+	// The text read token by token, in order, with strtof; TextScanner rounds the
+	// same way.
+	bool ParseWithStrtof(const string& contents, vector<MeshCache::Vertex>& vertices, vector<uint32_t>& indices)
+	{
+		istringstream in(contents);
+
+		uint32_t vcount = 0;
+		uint32_t tcount = 0;
+		string token;
+
+		in >> token >> vcount;
+		in >> token >> tcount;
+		in >> token >> token >> token >> token;
+
+		vertices.resize(vcount);
+		for(uint32_t i = 0; i < vcount; ++i)
+		{
+			float* values = &vertices[i].Pos.x;
+			for(int j = 0; j < 6 && in >> token; ++j)
+				values[j] = strtof(token.c_str(), nullptr);
+		}
+
+		in >> token >> token >> token;
+
+		indices.resize(3 * (size_t)tcount);
+		for(size_t i = 0; i < indices.size() && in >> token; ++i)
+			indices[i] = (uint32_t)stoul(token);
+
+		return !in.fail();
+	}
+
+	// What a demo does with an open cache: copy it into its own vertices and indices.
+	void CopyOut(const MeshCache& mesh, vector<ModelVertex>& vertices, vector<int32_t>& indices)
+	{
+		vertices.resize(mesh.VertexCount());
+		for(uint32_t i = 0; i < mesh.VertexCount(); ++i)
+		{
+			vertices[i].Pos = mesh.Vertices()[i].Pos;
+			vertices[i].Normal = mesh.Vertices()[i].Normal;
+			vertices[i].TexC = XMFLOAT2(0.0f, 0.0f);
+		}
+
+		indices.assign(mesh.Indices(), mesh.Indices() + mesh.IndexCount());
+	}
+
+	// The model paths are ASCII.
+	wstring Widen(const string& s)
+	{
+		return wstring(s.begin(), s.end());
+	}
+
+	string ReadFile(const string& filename)
+	{
+		ifstream fin(filename, ios::binary);
+		ostringstream contents;
+		contents << fin.rdbuf();
+		return contents.str();
+	}
+
+	void WriteFile(const string& filename, const string& contents)
+	{
+		ofstream fout(filename, ios::binary | ios::trunc);
+		fout << contents;
+	}
+
+	double Milliseconds(chrono::steady_clock::time_point start)
+	{
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	// Runs f often enough to time it and returns milliseconds per call.
+	template<typename F>
+	double Time(const F& f)
+	{
+		int runs = 0;
+		auto start = chrono::steady_clock::now();
+		do
+		{
+			f();
+			++runs;
+		}
+		while(Milliseconds(start) < 200.0);
+		return Milliseconds(start) / runs;
+	}
+
+	const char* SourceName(MeshCache::Source source)
+	{
+		switch(source)
+		{
+		case MeshCache::Source::Cache: return "cache";
+		case MeshCache::Source::RestampedCache: return "restamped cache";
+		case MeshCache::Source::Text: return "text";
+		default: return "nothing";
+		}
+	}
+
+	bool SameFloat(float a, float b)
+	{
+		return memcmp(&a, &b, sizeof(float)) == 0;
+	}
+
+	bool SameVertex(const XMFLOAT3& pa, const XMFLOAT3& na, const XMFLOAT3& pb, const XMFLOAT3& nb)
+	{
+		return SameFloat(pa.x, pb.x) && SameFloat(pa.y, pb.y) && SameFloat(pa.z, pb.z) &&
+			SameFloat(na.x, nb.x) && SameFloat(na.y, nb.y) && SameFloat(na.z, nb.z);
+	}
+
+	// Whether mesh holds exactly vertices and indices.
+	bool Matches(const MeshCache& mesh, const vector<MeshCache::Vertex>& vertices, const vector<uint32_t>& indices)
+	{
+		if(mesh.VertexCount() != vertices.size() || mesh.IndexCount() != indices.size())
+			return false;
+
+		for(size_t i = 0; i < vertices.size(); ++i)
+		{
+			const MeshCache::Vertex& v = mesh.Vertices()[i];
+			if(!SameVertex(v.Pos, v.Normal, vertices[i].Pos, vertices[i].Normal))
+				return false;
+		}
+
+		return memcmp(mesh.Indices(), indices.data(), indices.size() * sizeof(uint32_t)) == 0;
+	}
+
+	bool SameMesh(const vector<MeshCache::Vertex>& a, const vector<uint32_t>& aIndices,
+		const vector<MeshCache::Vertex>& b, const vector<uint32_t>& bIndices)
+	{
+		return a.size() == b.size() && aIndices == bIndices &&
+			memcmp(a.data(), b.data(), a.size() * sizeof(MeshCache::Vertex)) == 0;
+	}
+
+	// contents with the line that has the first token past offset joined onto the
+	// line before it.
+	string WithJoinedLine(const string& contents, size_t offset, const char* token)
+	{
+		string result = contents;
+		result[result.rfind('\n', contents.find(token, offset))] = ' ';
+		return result;
+	}
+
+	// Checks ParseText on one worker and four against the text read in order, also
+	// with a list that does not keep to a line a record, which throws off the split
+	// and must be noticed.
+	bool RunParallel(const string& contents)
+	{
+		vector<MeshCache::Vertex> expectedVertices;
+		vector<uint32_t> expectedIndices;
+		ParseWithStrtof(contents, expectedVertices, expectedIndices);
+
+		// Four workers split the lists even on a machine with fewer cores.
+		TaskSystem oneWorker(1);
+		TaskSystem fourWorkers(4);
+
+		const size_t vertexList = contents.find('{');
+		const size_t triangleList = contents.find('{', contents.find("TriangleList"));
+
+		struct Variant
+		{
+			const char* Name;
+			string Text;
+		};
+
+		const Variant variants[] =
+		{
+			{ "as written", contents },
+			{ "joined vertex lines", WithJoinedLine(contents, vertexList + (triangleList - vertexList) / 2, "\n") },
+			{ "joined triangle lines", WithJoinedLine(contents, triangleList + (contents.size() - triangleList) / 2, "\n") }
+		};
+
+		bool ok = true;
+		for(const Variant& variant : variants)
+		{
+			for(TaskSystem* taskSystem : { &oneWorker, &fourWorkers })
+			{
+				vector<MeshCache::Vertex> vertices;
+				vector<uint32_t> indices;
+				if(!MeshCache::ParseText(variant.Text.data(), variant.Text.size(), vertices, indices, nullptr, *taskSystem) ||
+					!SameMesh(vertices, indices, expectedVertices, expectedIndices))
+				{
+					cout << "    ParseText on " << taskSystem->WorkerCount() << " workers, " << variant.Name
+						<< ": differs from the text read in order" << endl;
+					ok = false;
+				}
+			}
+		}
+
+		vector<MeshCache::Vertex> vertices;
+		vector<uint32_t> indices;
+
+		double oneWorkerMs = Time([&]()
+		{
+			MeshCache::ParseText(contents.data(), contents.size(), vertices, indices, nullptr, oneWorker);
+		});
+
+		double fourWorkersMs = Time([&]()
+		{
+			MeshCache::ParseText(contents.data(), contents.size(), vertices, indices, nullptr, fourWorkers);
+		});
+
+		cout << fixed << setprecision(3)
+			<< "  ParseText, " << thread::hardware_concurrency() << " hardware threads: " << oneWorkerMs
+			<< " ms on one worker, " << fourWorkersMs << " ms on four, " << setprecision(1)
+			<< oneWorkerMs / fourWorkersMs << "x" << endl;
+
+		return ok;
+	}
+
+	bool Expect(const char* what, MeshCache& mesh, const wstring& text, const wstring& cache,
+		MeshCache::Source expected)
+	{
+		bool opened = mesh.Open(text.c_str(), cache.c_str());
+		if(opened && mesh.GetSource() == expected)
+			return true;
+
+		cout << "    " << what << ": expected the mesh from the " << SourceName(expected) << ", got it from the "
+			<< SourceName(opened ? mesh.GetSource() : MeshCache::Source::None) << endl;
+		return false;
+	}
+
+	bool RunModel(const string& name, const string& textFile)
+	{
+		string contents = ReadFile(textFile);
+
+		vector<ModelVertex> streamVertices;
+		vector<int32_t> streamIndices;
+		if(contents.empty() || !LoadWithStream(textFile, streamVertices, streamIndices))
+		{
+			cout << textFile << " not found." << endl;
+			return false;
+		}
+
+		cout << name << ": " << streamVertices.size() << " vertices, " << streamIndices.size() / 3
+			<< " triangles, " << contents.size() / 1024 << " KB of text" << endl;
+
+		bool ok = true;
+
+		// Work on a copy, so the caches and the edits to the text stay out of the
+		// model directories.
+		const string copyFile = name + ".txt";
+		const string cacheFile = copyFile + ".cache";
+		const wstring wideCopy = Widen(copyFile);
+		const wstring wideCache = Widen(cacheFile);
+
+		WriteFile(copyFile, contents);
+		remove(cacheFile.c_str());
+
+		vector<MeshCache::Vertex> parsedVertices;
+		vector<uint32_t> parsedIndices;
+		if(!MeshCache::ParseText(contents.data(), contents.size(), parsedVertices, parsedIndices))
+		{
+			cout << "    ParseText rejects the model" << endl;
+			return false;
+		}
+
+		MeshCache mesh;
+
+		auto start = chrono::steady_clock::now();
+		ok &= Expect("first open", mesh, wideCopy, wideCache, MeshCache::Source::Text);
+		double firstMs = Milliseconds(start);
+
+		ok &= Expect("second open", mesh, wideCopy, wideCache, MeshCache::Source::Cache);
+		if(!Matches(mesh, parsedVertices, parsedIndices))
+		{
+			cout << "    the cache does not hold what the text parses to" << endl;
+			ok = false;
+		}
+
+		// The demos' reader parses floats its own way; count the values on which it
+		// differs from strtof, and fail only on a real difference.
+		vector<ModelVertex> cachedVertices;
+		vector<int32_t> cachedIndices;
+		CopyOut(mesh, cachedVertices, cachedIndices);
+
+		size_t inexact = 0;
+		float maxError = 0.0f;
+		for(size_t i = 0; i < cachedVertices.size(); ++i)
+		{
+			const float* a = &cachedVertices[i].Pos.x;
+			const float* b = &streamVertices[i].Pos.x;
+			for(int j = 0; j < 6; ++j)
+			{
+				if(!SameFloat(a[j], b[j]))
+				{
+					++inexact;
+					maxError = max(maxError, fabsf(a[j] - b[j]) / max(fabsf(b[j]), 1.0f));
+				}
+			}
+		}
+
+		if(maxError > 1e-6f || cachedIndices != streamIndices)
+		{
+			cout << "    the cache differs from the demos' reader" << endl;
+			ok = false;
+		}
+
+		double streamMs = Time([&]()
+		{
+			LoadWithStream(textFile, streamVertices, streamIndices);
+		});
+
+		double parseMs = Time([&]()
+		{
+			MeshCache::ParseText(contents.data(), contents.size(), parsedVertices, parsedIndices);
+		});
+
+		double openMs = Time([&]()
+		{
+			mesh.Open(wideCopy.c_str(), wideCache.c_str());
+		});
+
+		double copyMs = Time([&]()
+		{
+			mesh.Open(wideCopy.c_str(), wideCache.c_str());
+			CopyOut(mesh, cachedVertices, cachedIndices);
+		});
+
+		cout << fixed << setprecision(3)
+			<< "  ifstream            " << setw(9) << streamMs << " ms" << endl
+			<< "  ParseText           " << setw(9) << parseMs << " ms" << endl
+			<< "  first Open          " << setw(9) << firstMs << " ms (parse, hash, bounds and write)" << endl
+			<< "  Open                " << setw(9) << openMs << " ms" << endl
+			<< "  Open and copy out   " << setw(9) << copyMs << " ms, "
+			<< setprecision(0) << streamMs / copyMs << "x faster than ifstream" << endl;
+
+		if(inexact > 0)
+			cout << "  " << inexact << " values differ from ifstream's in the last place" << endl;
+
+		const BoundingBox& box = mesh.Box();
+		const BoundingSphere& sphere = mesh.Sphere();
+		cout << setprecision(3) << "  box extents (" << box.Extents.x << ", " << box.Extents.y << ", " << box.Extents.z
+			<< "), sphere radius " << sphere.Radius << endl;
+
+		for(const auto& v : parsedVertices)
+		{
+			if(box.Contains(XMLoadFloat3(&v.Pos)) == DISJOINT ||
+				XMVectorGetX(XMVector3Length(XMLoadFloat3(&v.Pos) - XMLoadFloat3(&sphere.Center))) > sphere.Radius*1.00001f)
+			{
+				cout << "    the cached bounds miss some of the vertices" << endl;
+				ok = false;
+				break;
+			}
+		}
+
+		// Rewriting the same text gives it a new stamp but the same hash.
+		mesh.Close();
+		WriteFile(copyFile, contents);
+		if(mesh.Open(wideCopy.c_str(), wideCache.c_str()) && mesh.GetSource() == MeshCache::Source::Text)
+		{
+			cout << "    the cache was rebuilt for an unchanged text" << endl;
+			ok = false;
+		}
+		ok &= Expect("open after restamping", mesh, wideCopy, wideCache, MeshCache::Source::Cache);
+
+		// A changed text is parsed again.
+		mesh.Close();
+		string changed = contents;
+		changed.insert(changed.find_first_of("0123456789", changed.find('{')), "7");
+		WriteFile(copyFile, changed);
+		ok &= Expect("open after changing the text", mesh, wideCopy, wideCache, MeshCache::Source::Text);
+		if(mesh.VertexCount() > 0 && SameFloat(mesh.Vertices()[0].Pos.x, parsedVertices[0].Pos.x))
+		{
+			cout << "    the changed text was not reparsed" << endl;
+			ok = false;
+		}
+
+		// Without the text the cache is used as it is.
+		mesh.Close();
+		remove(copyFile.c_str());
+		ok &= Expect("open without the text", mesh, wideCopy, wideCache, MeshCache::Source::Cache);
+
+		// A truncated cache is rebuilt.
+		mesh.Close();
+		WriteFile(copyFile, contents);
+		string cache = ReadFile(cacheFile);
+		WriteFile(cacheFile, cache.substr(0, cache.size() / 2));
+		ok &= Expect("open after truncating the cache", mesh, wideCopy, wideCache, MeshCache::Source::Text);
+		if(!Matches(mesh, parsedVertices, parsedIndices))
+		{
+			cout << "    the rebuilt cache does not hold what the text parses to" << endl;
+			ok = false;
+		}
+
+		// So is one whose last index is past the vertices.
+		mesh.Close();
+		cache = ReadFile(cacheFile);
+		cache.replace(cache.size() - 4, 4, 4, '\xff');
+		WriteFile(cacheFile, cache);
+		ok &= Expect("open after corrupting an index", mesh, wideCopy, wideCache, MeshCache::Source::Text);
+		if(!Matches(mesh, parsedVertices, parsedIndices))
+		{
+			cout << "    the rebuilt cache does not hold what the text parses to" << endl;
+			ok = false;
+		}
+
+		ok &= RunParallel(contents);
+
+		// Malformed text is rejected rather than loaded with zeros.
+		vector<MeshCache::Vertex> badVertices;
+		vector<uint32_t> badIndices;
+		string truncated = contents.substr(0, contents.size() / 2);
+		string badIndex = contents;
+		badIndex.replace(badIndex.rfind("TriangleList"), string::npos, "TriangleList\n{\n\t0 1 4000000000\n}\n");
+		string badFloat = contents;
+		badFloat[badFloat.find_first_of("0123456789", badFloat.find('{'))] = 'x';
+
+		if(MeshCache::ParseText(truncated.data(), truncated.size(), badVertices, badIndices) ||
+			MeshCache::ParseText(badIndex.data(), badIndex.size(), badVertices, badIndices) ||
+			MeshCache::ParseText(badFloat.data(), badFloat.size(), badVertices, badIndices))
+		{
+			cout << "    ParseText accepts a malformed model" << endl;
+			ok = false;
+		}
+
+		mesh.Close();
+		remove(copyFile.c_str());
+		remove(cacheFile.c_str());
+
+		return ok;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if(argc > 1 && strcmp(argv[1], "-convert") == 0)
+	{
+		bool ok = true;
+		for(int i = 2; i < argc; ++i)
+		{
+			wstring text = Widen(argv[i]);
+			if(MeshCache::Convert(text.c_str(), MeshCache::DefaultCacheFile(text.c_str()).c_str()))
+			{
+				cout << argv[i] << ".cache written" << endl;
+			}
+			else
+			{
+				cout << argv[i] << " could not be converted" << endl;
+				ok = false;
+			}
+		}
+
+		return ok ? 0 : 1;
+	}
+
+	string skullFile = argc > 1 ? argv[1] : "../../Chapter 8 Lighting/LitColumns/Models/skull.txt";
+	string carFile = argc > 2 ? argv[2] : "../../Chapter 8 Lighting/LitColumns/Models/car.txt";
+
+	bool ok = true;
+	ok &= RunModel("skull", skullFile);
+	ok &= RunModel("car", carFile);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+//***************************************************************************************
+// MeshOptimizerBenchmark.cpp
+//
+// Measures the post-transform cache efficiency (ACMR and ATVR) of the skull, the
+// soldier model and a few generated shapes before and after MeshOptimizer, for a
+// few cache sizes, with a simulated FIFO cache so no GPU is needed.
+//
+// The models come out of their exporter cache-optimized already, so for them the
+// overdraw pass trades a little of that for less overdraw; the generated shapes
+// show what the cache pass gains on a naively ordered mesh.  Exits with a non-zero
+// code if any ACMR gets worse by more than the overdraw pass allows, so it can be
+// run as a regression test.  The model paths can be given on the command line.
+//***************************************************************************************
+
+#include "../../Common/MeshOptimizer.h"
+#include "../../Common/GeometryGenerator.h"
+#include "../../Chapter 23 Character Animation/SkinnedMesh/LoadM3d.h"
+#include "../TextModelLoader.h"
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	// Optimize() uses MeshOptimizer's default overdraw threshold.
+	const float OverdrawThreshold = 1.05f;
+
+	const uint32_t CacheSizes[] = { 16, 32 };
+	const int CacheSizeCount = sizeof(CacheSizes) / sizeof(CacheSizes[0]);
+
+	struct Measurement
+	{
+		MeshOptimizer::CacheStats Stats[CacheSizeCount];
+	};
+
+	// Measures each subset on its own, as each is drawn with its own call, and sums.
+	template<typename Index>
+	Measurement Measure(const vector<Index>& indices, uint32_t vertexCount, const vector<M3DLoader::Subset>& subsets)
+	{
+		Measurement m;
+		for(int c = 0; c < CacheSizeCount; ++c)
+		{
+			uint32_t transforms = 0;
+			for(const auto& subset : subsets)
+			{
+				transforms += MeshOptimizer::AnalyzeVertexCache(&indices[subset.FaceStart * 3],
+					subset.FaceCount * 3, vertexCount, CacheSizes[c]).Transforms;
+			}
+
+			// The whole list gives the number of referenced vertices.
+			MeshOptimizer::CacheStats all = MeshOptimizer::AnalyzeVertexCache(
+				indices.data(), indices.size(), vertexCount, CacheSizes[c]);
+
+			m.Stats[c].Transforms = transforms;
+			m.Stats[c].Acmr = (float)transforms / (indices.size() / 3);
+			m.Stats[c].Atvr = all.Atvr * transforms / all.Transforms;
+		}
+
+		return m;
+	}
+
+	// Optimizes a mesh, prints before and after, and returns false on a regression.
+	template<typename Vertex, typename Index>
+	bool Run(const char* name, vector<Vertex>& vertices, vector<Index>& indices,
+		const vector<M3DLoader::Subset>& subsets, size_t positionOffset)
+	{
+		Measurement before = Measure(indices, (uint32_t)vertices.size(), subsets);
+
+		auto start = chrono::steady_clock::now();
+		for(const auto& subset : subsets)
+		{
+			MeshOptimizer::Optimize(&vertices[subset.VertexStart], sizeof(Vertex), subset.VertexCount,
+				positionOffset, &indices[subset.FaceStart * 3], subset.FaceCount * 3, subset.VertexStart);
+		}
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+		Measurement after = Measure(indices, (uint32_t)vertices.size(), subsets);
+
+		cout << name << ": " << vertices.size() << " vertices, " << indices.size() / 3
+			<< " triangles, optimized in " << fixed << setprecision(1) << ms << " ms" << endl;
+
+		bool ok = true;
+		for(int c = 0; c < CacheSizeCount; ++c)
+		{
+			cout << "  cache " << setw(2) << CacheSizes[c] << ":  ACMR "
+				<< setprecision(3) << before.Stats[c].Acmr << " -> " << after.Stats[c].Acmr
+				<< "   ATVR " << before.Stats[c].Atvr << " -> " << after.Stats[c].Atvr << endl;
+
+			if(after.Stats[c].Acmr > OverdrawThreshold*before.Stats[c].Acmr)
+				ok = false;
+		}
+
+		return ok;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	string skullFile = argc > 1 ? argv[1] : "../../Chapter 8 Lighting/LitColumns/Models/skull.txt";
+	string soldierFile = argc > 2 ? argv[2] : "../../Chapter 23 Character Animation/SkinnedMesh/Models/soldier.m3d";
+
+	bool ok = true;
+
+	vector<TextModelVertex> skullVertices;
+	vector<int32_t> skullIndices;
+	if(LoadTextModel(skullFile, skullVertices, skullIndices))
+	{
+		M3DLoader::Subset all;
+		all.VertexCount = (UINT)skullVertices.size();
+		all.FaceCount = (UINT)skullIndices.size() / 3;
+
+		ok &= Run("skull", skullVertices, skullIndices, { all }, offsetof(TextModelVertex, Pos));
+	}
+	else
+	{
+		cout << skullFile << " not found." << endl;
+		ok = false;
+	}
+
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData shapes[] =
+	{
+		geoGen.CreateSphere(1.0f, 64, 64),
+		geoGen.CreateGeosphere(1.0f, 5),
+		geoGen.CreateCylinder(1.0f, 0.5f, 3.0f, 64, 32)
+	};
+	const char* shapeNames[] = { "sphere", "geosphere", "cylinder" };
+
+	for(int i = 0; i < 3; ++i)
+	{
+		M3DLoader::Subset all;
+		all.VertexCount = (UINT)shapes[i].Vertices.size();
+		all.FaceCount = (UINT)shapes[i].Indices32.size() / 3;
+
+		ok &= Run(shapeNames[i], shapes[i].Vertices, shapes[i].Indices32, { all },
+			offsetof(GeometryGenerator::Vertex, Position));
+	}
+
+	vector<M3DLoader::SkinnedVertex> soldierVertices;
+	vector<UINT> soldierIndices;
+	vector<M3DLoader::Subset> soldierSubsets;
+	vector<M3DLoader::M3dMaterial> soldierMats;
+	SkinnedData soldierSkin;
+
+	M3DLoader m3dLoader;
+	if(m3dLoader.LoadM3d(soldierFile, soldierVertices, soldierIndices, soldierSubsets, soldierMats, soldierSkin))
+	{
+		ok &= Run("soldier", soldierVertices, soldierIndices, soldierSubsets,
+			offsetof(M3DLoader::SkinnedVertex, Pos));
+	}
+	else
+	{
+		cout << soldierFile << " not found." << endl;
+		ok = false;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+//***************************************************************************************
+// MeshletBenchmark.cpp
+//
+// Splits the skull and the soldier model (in its bind pose) into meshlets and
+// measures how many of them per-meshlet culling rejects from random views around
+// each model: how many face away from the eye by their normal cone and how many
+// are outside the view frustum by their bounding sphere.
+//
+// Also checks that the meshlets cover every triangle exactly once within the size
+// limits, and that every meshlet the cone rejects really has only back-facing
+// triangles.  Exits with a non-zero code if either check fails, so it can be run
+// as a regression test.  The model paths can be given on the command line.
+//***************************************************************************************
+
+#include "../../Common/MeshletBuilder.h"
+#include "../../Chapter 23 Character Animation/SkinnedMesh/LoadM3d.h"
+#include "../TextModelLoader.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	const int ViewCount = 1000;
+
+	// Meshlets are built without a cone limit and with one, to show the trade
+	// between meshlet size and back-face culling.
+	const float ConeLimits[] = { -1.0f, 0.5f };
+
+	// Checks the meshlets against the triangle list they were built from.
+	template<typename Index>
+	bool Validate(const MeshletBuilder::MeshletData& data, const vector<Index>& indices)
+	{
+		for(const auto& m : data.Meshlets)
+		{
+			if(m.VertexCount > MeshletBuilder::MaxVertices || m.TriangleCount > MeshletBuilder::MaxTriangles)
+				return false;
+		}
+
+		// The written index list has to hold the same triangles, in any order.
+		vector<Index> written(data.Triangles.size());
+		MeshletBuilder::WriteIndices(data, written.data());
+		if(written.size() != indices.size())
+			return false;
+
+		auto sortedTriangles = [](const vector<Index>& list)
+		{
+			vector<array<Index, 3>> triangles(list.size() / 3);
+			for(size_t t = 0; t < triangles.size(); ++t)
+			{
+				// Rotate so the smallest index comes first, keeping the winding.
+				size_t k = 0;
+				if(list[3*t + 1] < list[3*t + k]) k = 1;
+				if(list[3*t + 2] < list[3*t + k]) k = 2;
+				for(size_t j = 0; j < 3; ++j)
+					triangles[t][j] = list[3*t + (k + j) % 3];
+			}
+			sort(triangles.begin(), triangles.end());
+			return triangles;
+		};
+
+		return sortedTriangles(written) == sortedTriangles(indices);
+	}
+
+	// Culls the meshlets from random views, prints the averages and returns false if
+	// the cone culled a triangle that faces the eye.
+	template<typename Vertex, typename Index>
+	bool Run(const vector<Vertex>& vertices, const vector<Index>& indices, size_t positionOffset, float coneLimit)
+	{
+		auto start = chrono::steady_clock::now();
+		MeshletBuilder::MeshletData data = MeshletBuilder::Build(vertices.data(), sizeof(Vertex),
+			(uint32_t)vertices.size(), positionOffset, indices.data(), indices.size(),
+			MeshletBuilder::MaxVertices, MeshletBuilder::MaxTriangles, coneLimit);
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+		size_t meshletCount = data.Meshlets.size();
+		size_t triCount = indices.size() / 3;
+
+		cout << "  cone limit " << fixed << setprecision(1) << setw(4) << coneLimit << ": "
+			<< meshletCount << " meshlets, averaging "
+			<< (double)data.Vertices.size() / meshletCount << " vertices and "
+			<< (double)triCount / meshletCount << " triangles, built in " << ms << " ms" << endl;
+
+		if(!Validate(data, indices))
+		{
+			cout << "    meshlets do not match the input triangles" << endl;
+			return false;
+		}
+
+		auto position = [&](uint32_t v)
+		{
+			return *reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const uint8_t*>(&vertices[v]) + positionOffset);
+		};
+
+		// Views from 1.5 to 4 bounding radii away, looking somewhere near the model.
+		BoundingSphere modelBounds;
+		BoundingSphere::CreateFromPoints(modelBounds, vertices.size(),
+			reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const uint8_t*>(vertices.data()) + positionOffset),
+			sizeof(Vertex));
+
+		XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*XM_PI, 16.0f / 9.0f, 0.1f, 1000.0f);
+		BoundingFrustum viewFrustum(proj);
+
+		mt19937 rng(1234);
+		uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		uniform_real_distribution<float> distance(1.5f, 4.0f);
+
+		auto randomDirection = [&]()
+		{
+			XMVECTOR d;
+			do
+			{
+				d = XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f);
+			}
+			while(XMVectorGetX(XMVector3LengthSq(d)) > 1.0f || XMVectorGetX(XMVector3LengthSq(d)) < 1e-4f);
+			return XMVector3Normalize(d);
+		};
+
+		size_t backFacingMeshlets = 0;
+		size_t outsideMeshlets = 0;
+		size_t culledTriangles = 0;
+		size_t backFacingTriangles = 0;
+		bool ok = true;
+
+		for(int view = 0; view < ViewCount; ++view)
+		{
+			XMVECTOR center = XMLoadFloat3(&modelBounds.Center);
+			XMVECTOR eye = center + randomDirection()*distance(rng)*modelBounds.Radius;
+			XMVECTOR target = center + randomDirection()*0.75f*modelBounds.Radius;
+
+			XMMATRIX viewMatrix = XMMatrixLookAtLH(eye, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+			XMVECTOR det = XMMatrixDeterminant(viewMatrix);
+			BoundingFrustum worldFrustum;
+			viewFrustum.Transform(worldFrustum, XMMatrixInverse(&det, viewMatrix));
+
+			XMFLOAT3 eyePos;
+			XMStoreFloat3(&eyePos, eye);
+
+			for(size_t i = 0; i < meshletCount; ++i)
+			{
+				const auto& m = data.Meshlets[i];
+				const auto& b = data.MeshletBounds[i];
+
+				// Count the triangles that face away, to compare against and to
+				// check the cone is conservative.
+				size_t meshletBackFacing = 0;
+				for(uint32_t t = 0; t < m.TriangleCount; ++t)
+				{
+					const uint8_t* tri = &data.Triangles[3*(m.TriangleOffset + t)];
+					XMFLOAT3 p[3];
+					for(int k = 0; k < 3; ++k)
+						p[k] = position(data.Vertices[m.VertexOffset + tri[k]]);
+
+					XMVECTOR p0 = XMLoadFloat3(&p[0]);
+					XMVECTOR n = XMVector3Cross(XMLoadFloat3(&p[1]) - p0, XMLoadFloat3(&p[2]) - p0);
+					if(XMVectorGetX(XMVector3Dot(n, eye - p0)) <= 0.0f)
+						++meshletBackFacing;
+				}
+				backFacingTriangles += meshletBackFacing;
+
+				if(MeshletBuilder::IsBackFacing(b, eyePos))
+				{
+					++backFacingMeshlets;
+					culledTriangles += m.TriangleCount;
+
+					// Allow for rounding on triangles seen exactly edge on.
+					if(meshletBackFacing + 1 < m.TriangleCount)
+						ok = false;
+				}
+				else if(worldFrustum.Contains(b.Sphere) == DISJOINT)
+				{
+					++outsideMeshlets;
+					culledTriangles += m.TriangleCount;
+				}
+			}
+		}
+
+		double total = (double)meshletCount*ViewCount;
+		cout << "    per view: " << setprecision(1)
+			<< 100.0*backFacingMeshlets / total << "% of meshlets back-facing, "
+			<< 100.0*outsideMeshlets / total << "% outside the frustum, "
+			<< 100.0*culledTriangles / ((double)triCount*ViewCount) << "% of triangles culled ("
+			<< 100.0*backFacingTriangles / ((double)triCount*ViewCount) << "% face away)" << endl;
+
+		if(!ok)
+			cout << "    the normal cone culled a meshlet with front-facing triangles" << endl;
+
+		return ok;
+	}
+
+	template<typename Vertex, typename Index>
+	bool Run(const char* name, const vector<Vertex>& vertices, const vector<Index>& indices, size_t positionOffset)
+	{
+		cout << name << ": " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles" << endl;
+
+		bool ok = true;
+		for(float coneLimit : ConeLimits)
+			ok &= Run(vertices, indices, positionOffset, coneLimit);
+
+		return ok;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	string skullFile = argc > 1 ? argv[1] : "../../Chapter 8 Lighting/LitColumns/Models/skull.txt";
+	string soldierFile = argc > 2 ? argv[2] : "../../Chapter 23 Character Animation/SkinnedMesh/Models/soldier.m3d";
+
+	bool ok = true;
+
+	vector<TextModelVertex> skullVertices;
+	vector<int32_t> skullIndices;
+	if(LoadTextModel(skullFile, skullVertices, skullIndices))
+	{
+		ok &= Run("skull", skullVertices, skullIndices, offsetof(TextModelVertex, Pos));
+	}
+	else
+	{
+		cout << skullFile << " not found." << endl;
+		ok = false;
+	}
+
+	vector<M3DLoader::SkinnedVertex> soldierVertices;
+	vector<UINT> soldierIndices;
+	vector<M3DLoader::Subset> soldierSubsets;
+	vector<M3DLoader::M3dMaterial> soldierMats;
+	SkinnedData soldierSkin;
+
+	M3DLoader m3dLoader;
+	if(m3dLoader.LoadM3d(soldierFile, soldierVertices, soldierIndices, soldierSubsets, soldierMats, soldierSkin))
+	{
+		// The subsets are clustered together; their vertex ranges are disjoint, so
+		// only the few meshlets on subset borders mix materials.
+		ok &= Run("soldier", soldierVertices, soldierIndices, offsetof(M3DLoader::SkinnedVertex, Pos));
+	}
+	else
+	{
+		cout << soldierFile << " not found." << endl;
+		ok = false;
+	}
+
+	return ok ? 0 : 1;
+}
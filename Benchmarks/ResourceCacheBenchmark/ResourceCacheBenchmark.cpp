@@ -0,0 +1,383 @@
+//***************************************************************************************
+// ResourceCacheBenchmark.cpp
+//
+// Builds the scenes of several chapters in one process, each loading the skull and
+// a few textures, with and without ResourceCache, and times them.  The chapters
+// each ship their own copy of skull.txt, so with the cache the skull is parsed
+// once for all of them.
+//
+// Checks that the same file under other paths, its copies and a rewrite with the
+// same contents are all shared, that a changed file and another kind of resource
+// are made anew, that eviction takes the least recently acquired resources first
+// and never one still in use, that failures are reported, that threads acquiring
+// the same files get the same resources, and that the stats add up.  Exits with a
+// non-zero code if any check fails, so it can be run as a regression test.
+//
+// The files it writes go in the working directory.  Run as
+//
+//   ResourceCacheBenchmark [repository root]
+//***************************************************************************************
+
+#include "../../Common/ResourceCache.h"
+#include "../../Common/MeshCache.h"
+#include "../../Common/TaskSystem.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	// Stands in for a MeshGeometry: the parsed model, and what it costs.
+	struct Model
+	{
+		vector<MeshCache::Vertex> Vertices;
+		vector<uint32_t> Indices;
+	};
+
+	// Stands in for a Texture: a copy of the file.
+	struct Image
+	{
+		vector<uint8_t> Bytes;
+	};
+
+	// Tells apart another kind of resource made from a model file.
+	struct BoundsOnly {};
+
+	atomic<int> gModelsMade(0);
+
+	shared_ptr<Model> MakeModel(const MappedFile& file, uint64_t& bytes, string& error)
+	{
+		++gModelsMade;
+
+		auto model = make_shared<Model>();
+		if(!MeshCache::ParseText((const char*)file.Data(), file.Size(), model->Vertices, model->Indices, &error))
+			return nullptr;
+
+		bytes = model->Vertices.size()*sizeof(MeshCache::Vertex) + model->Indices.size()*sizeof(uint32_t);
+		return model;
+	}
+
+	shared_ptr<Image> MakeImage(const MappedFile& file, uint64_t& bytes, string& error)
+	{
+		auto image = make_shared<Image>();
+		image->Bytes.assign(file.Data(), file.Data() + file.Size());
+		bytes = file.Size();
+		return image;
+	}
+
+	// The model paths are ASCII.
+	wstring Widen(const string& s)
+	{
+		return wstring(s.begin(), s.end());
+	}
+
+	string ReadFile(const string& filename)
+	{
+		ifstream fin(filename, ios::binary);
+		ostringstream contents;
+		contents << fin.rdbuf();
+		return contents.str();
+	}
+
+	void WriteFile(const string& filename, const string& contents)
+	{
+		ofstream fout(filename, ios::binary | ios::trunc);
+		fout << contents;
+	}
+
+	double Milliseconds(chrono::steady_clock::time_point start)
+	{
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	// The chapters that draw the skull, each with its own copy of it.
+	const char* SkullChapters[] =
+	{
+		"Chapter 11 Stenciling/StencilDemo",
+		"Chapter 16 Instancing and Frustum Culling/InstancingAndCulling",
+		"Chapter 17 Picking/Picking",
+	};
+
+	const char* SceneTextures[] = { "bricks.dds", "bricks3.dds", "checkboard.dds", "ice.dds", "white1x1.dds" };
+
+	// What one scene holds on to.
+	struct Scene
+	{
+		shared_ptr<Model> Skull;
+		vector<shared_ptr<Image>> Textures;
+	};
+
+	Scene LoadScene(ResourceCache* cache, const string& root, const string& chapter)
+	{
+		Scene scene;
+		string error;
+
+		const wstring skullFile = Widen(root + "/" + chapter + "/Models/skull.txt");
+		if(cache != nullptr)
+		{
+			scene.Skull = cache->Acquire<Model>(skullFile, MakeModel, &error);
+		}
+		else
+		{
+			MappedFile file;
+			uint64_t bytes = 0;
+			if(file.Open(skullFile.c_str()))
+				scene.Skull = MakeModel(file, bytes, error);
+		}
+
+		for(const char* texture : SceneTextures)
+		{
+			const wstring textureFile = Widen(root + "/Textures/" + texture);
+			if(cache != nullptr)
+			{
+				scene.Textures.push_back(cache->Acquire<Image>(textureFile, MakeImage, &error));
+			}
+			else
+			{
+				MappedFile file;
+				uint64_t bytes = 0;
+				if(file.Open(textureFile.c_str()))
+					scene.Textures.push_back(MakeImage(file, bytes, error));
+			}
+		}
+
+		return scene;
+	}
+
+	bool Expect(const char* what, bool condition)
+	{
+		if(!condition)
+			cout << "    " << what << endl;
+		return condition;
+	}
+
+	bool RunScenes(const string& root)
+	{
+		bool ok = true;
+
+		ResourceCache cache;
+		gModelsMade = 0;
+
+		vector<Scene> scenes;
+		for(const char* chapter : SkullChapters)
+			scenes.push_back(LoadScene(&cache, root, chapter));
+
+		for(const Scene& scene : scenes)
+		{
+			ok &= Expect("a scene's skull did not load", scene.Skull != nullptr);
+			ok &= Expect("the chapters' skulls are not shared", scene.Skull == scenes[0].Skull);
+			ok &= Expect("the scenes' textures are not shared", scene.Textures == scenes[0].Textures);
+		}
+
+		ok &= Expect("the skull was parsed more than once", gModelsMade == 1);
+
+		// The same files again, by the same and by other paths.
+		auto again = cache.Acquire<Model>(Widen(root + "/" + SkullChapters[0] + "/Models/skull.txt"), MakeModel);
+		auto dotted = cache.Acquire<Model>(Widen(root + "/" + SkullChapters[0] + "/./Models/../Models/skull.txt"), MakeModel);
+		ok &= Expect("the skull was not found by its path", again == scenes[0].Skull && dotted == scenes[0].Skull);
+
+		// Another kind of resource from the same file is made separately.
+		auto other = cache.Acquire<Model, BoundsOnly>(Widen(root + "/" + SkullChapters[0] + "/Models/skull.txt"), MakeModel);
+		ok &= Expect("another kind of resource was given the cached one", other != nullptr && other != scenes[0].Skull);
+
+		const size_t chapters = sizeof(SkullChapters) / sizeof(SkullChapters[0]);
+		const size_t textures = sizeof(SceneTextures) / sizeof(SceneTextures[0]);
+		const size_t acquires = chapters*(1 + textures) + 3;
+
+		ResourceCache::Stats stats = cache.GetStats();
+		ok &= Expect("the stats do not add up", stats.Misses == 1 + textures + 1 &&
+			stats.Hits == acquires - stats.Misses && stats.SharedHits == chapters - 1 &&
+			stats.Failures == 0 && stats.Evictions == 0 && stats.Resources == stats.Misses);
+
+		cout << "  " << chapters << " scenes: " << stats.Misses << " made, " << stats.Hits << " hits, of which "
+			<< stats.SharedHits << " by contents, " << stats.Bytes / 1024 << " KB held" << endl;
+
+		// Nothing is evicted while the scenes hold it.
+		other.reset();
+		cache.Clear();
+		ok &= Expect("a resource in use was evicted", cache.GetStats().Resources == stats.Resources - 1);
+
+		scenes.clear();
+		again.reset();
+		dotted.reset();
+		cache.Clear();
+		ok &= Expect("an unreferenced resource was kept by Clear", cache.GetStats().Resources == 0 && cache.GetStats().Bytes == 0);
+
+		return ok;
+	}
+
+	bool RunChanges(const string& root)
+	{
+		bool ok = true;
+
+		ResourceCache cache;
+		string error;
+
+		const string contents = ReadFile(root + "/" + SkullChapters[0] + "/Models/skull.txt");
+		const string copyFile = "ResourceCacheBenchmark.skull.txt";
+		const wstring wideCopy = Widen(copyFile);
+
+		WriteFile(copyFile, contents);
+		auto first = cache.Acquire<Model>(wideCopy, MakeModel);
+
+		// Rewritten with the same contents: found by its hash.
+		WriteFile(copyFile, contents);
+		auto rewritten = cache.Acquire<Model>(wideCopy, MakeModel);
+		ok &= Expect("an unchanged rewrite was made again", rewritten == first && cache.GetStats().SharedHits == 1);
+
+		// Changed: made again, while the old one lives on with its holders.
+		string changed = contents;
+		changed.insert(changed.find_first_of("0123456789", changed.find('{')), "7");
+		WriteFile(copyFile, changed);
+		auto updated = cache.Acquire<Model>(wideCopy, MakeModel);
+		ok &= Expect("a changed file was not made again", updated != nullptr && updated != first &&
+			updated->Vertices[0].Pos.x != first->Vertices[0].Pos.x);
+
+		// Failures.
+		auto missing = cache.Acquire<Model>(L"ResourceCacheBenchmark.missing.txt", MakeModel, &error);
+		ok &= Expect("a missing file did not fail", missing == nullptr && !error.empty());
+		cout << "  missing file: " << error << endl;
+
+		error.clear();
+		WriteFile(copyFile, contents.substr(0, contents.size() / 2));
+		auto truncated = cache.Acquire<Model>(wideCopy, MakeModel, &error);
+		ok &= Expect("a malformed file did not fail", truncated == nullptr && !error.empty());
+		cout << "  malformed file: " << error << endl;
+
+		ok &= Expect("the failures were not counted", cache.GetStats().Failures == 2);
+
+		remove(copyFile.c_str());
+
+		return ok;
+	}
+
+	bool RunEviction(const string& root)
+	{
+		bool ok = true;
+
+		// Room for two of the 128 KB textures.
+		const uint64_t textureBytes = 131200;
+		ResourceCache cache(2*textureBytes);
+
+		const wstring bricks = Widen(root + "/Textures/bricks3.dds");
+		const wstring checkboard = Widen(root + "/Textures/checkboard.dds");
+		const wstring ice = Widen(root + "/Textures/ice.dds");
+
+		weak_ptr<Image> bricksImage = cache.Acquire<Image>(bricks, MakeImage);
+		weak_ptr<Image> checkboardImage = cache.Acquire<Image>(checkboard, MakeImage);
+
+		// bricks3 is now the more recently used, so checkboard goes first.
+		cache.Acquire<Image>(bricks, MakeImage);
+		weak_ptr<Image> iceImage = cache.Acquire<Image>(ice, MakeImage);
+
+		ok &= Expect("the least recently used was not evicted first",
+			!bricksImage.expired() && checkboardImage.expired() && !iceImage.expired());
+
+		// Held resources stay even over the budget.  Each of these evicts the least
+		// recently used of the others while it is not yet held.
+		auto held0 = cache.Acquire<Image>(checkboard, MakeImage);
+		auto held1 = cache.Acquire<Image>(bricks, MakeImage);
+		auto held2 = cache.Acquire<Image>(ice, MakeImage);
+		ok &= Expect("a resource in use was evicted", cache.GetStats().Resources == 3 &&
+			cache.GetStats().Bytes > cache.Budget());
+
+		// Dropping them and trimming gives the memory back.
+		held0.reset();
+		held1.reset();
+		held2.reset();
+		cache.Trim();
+
+		const ResourceCache::Stats stats = cache.GetStats();
+		ok &= Expect("Trim did not keep to the budget", stats.Bytes <= cache.Budget() && stats.Resources == 2);
+		ok &= Expect("the evictions were not counted", stats.Evictions == 4);
+
+		cache.SetBudget(0);
+		ok &= Expect("a budget of 0 kept something", cache.GetStats().Resources == 0);
+
+		return ok;
+	}
+
+	bool RunThreads(const string& root, TaskSystem& taskSystem)
+	{
+		ResourceCache cache;
+		vector<shared_ptr<Model>> skulls(64);
+		vector<shared_ptr<Image>> images(64);
+
+		taskSystem.ParallelFor(0, 64, 1, [&](int i)
+		{
+			const size_t chapters = sizeof(SkullChapters) / sizeof(SkullChapters[0]);
+			skulls[i] = cache.Acquire<Model>(Widen(root + "/" + SkullChapters[i % chapters] + "/Models/skull.txt"), MakeModel);
+			images[i] = cache.Acquire<Image>(Widen(root + "/Textures/" + SceneTextures[i % 2]), MakeImage);
+		});
+
+		bool ok = true;
+		for(int i = 0; i < 64; ++i)
+		{
+			ok &= skulls[i] != nullptr && skulls[i] == skulls[0];
+			ok &= images[i] != nullptr && images[i] == images[i % 2];
+		}
+
+		const ResourceCache::Stats stats = cache.GetStats();
+		ok &= stats.Misses == 3 && stats.Hits == 128 - 3 && stats.Resources == 3;
+
+		return Expect("threads acquiring the same files were given different resources", ok);
+	}
+
+	void RunTimings(const string& root)
+	{
+		const size_t chapters = sizeof(SkullChapters) / sizeof(SkullChapters[0]);
+
+		auto start = chrono::steady_clock::now();
+		for(const char* chapter : SkullChapters)
+			LoadScene(nullptr, root, chapter);
+		double uncachedMs = Milliseconds(start);
+
+		ResourceCache cache;
+		vector<Scene> scenes;
+
+		start = chrono::steady_clock::now();
+		scenes.push_back(LoadScene(&cache, root, SkullChapters[0]));
+		double firstMs = Milliseconds(start);
+
+		start = chrono::steady_clock::now();
+		for(size_t i = 1; i < chapters; ++i)
+			scenes.push_back(LoadScene(&cache, root, SkullChapters[i]));
+		double restMs = Milliseconds(start);
+
+		// Again with every scene's files unchanged since: answered by path alone.
+		start = chrono::steady_clock::now();
+		for(const char* chapter : SkullChapters)
+			scenes.push_back(LoadScene(&cache, root, chapter));
+		double repeatMs = Milliseconds(start);
+
+		cout << fixed << setprecision(3)
+			<< "  " << chapters << " scenes, uncached     " << setw(9) << uncachedMs << " ms" << endl
+			<< "  first scene, cached   " << setw(9) << firstMs << " ms" << endl
+			<< "  other scenes, cached  " << setw(9) << restMs << " ms (copies of the files, hashed)" << endl
+			<< "  all scenes again      " << setw(9) << repeatMs << " ms (unchanged files, by path)" << endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	string root = argc > 1 ? argv[1] : "../..";
+
+	TaskSystem fourWorkers(4);
+
+	bool ok = true;
+	ok &= RunScenes(root);
+	ok &= RunChanges(root);
+	ok &= RunEviction(root);
+	ok &= RunThreads(root, fourWorkers);
+	RunTimings(root);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+//***************************************************************************************
+// TangentGeneratorBenchmark.cpp
+//
+// Generates tangents with TangentGenerator and compares them with known ones:
+//
+//   - the GeometryGenerator shapes, whose tangents are analytic, and a grid with
+//     its texture mirrored in u, whose tangents point the other way and whose
+//     handedness is -1;
+//   - the soldier model, against the tangents stored in the file.
+//
+// Also times a large grid on the default task system against a single worker, and
+// checks that both give bit-identical results.  Exits with a non-zero code if the
+// shapes' tangents or handedness are off or the results depend on the thread
+// count, so it can be run as a regression test.  The model path can be given on
+// the command line.
+//***************************************************************************************
+
+#include "../../Common/TangentGenerator.h"
+#include "../../Common/GeometryGenerator.h"
+#include "../../Chapter 23 Character Animation/SkinnedMesh/LoadM3d.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	struct Vertex
+	{
+		XMFLOAT3 Pos;
+		XMFLOAT3 Normal;
+		XMFLOAT2 TexC;
+		XMFLOAT4 TangentU;
+	};
+
+	// Generated tangents may differ from the analytic ones by this much, in degrees,
+	// on average and at any vertex not on a pole.
+	const float MaxMeanError = 0.5f;
+	const float MaxVertexError = 5.0f;
+
+	float AngleBetween(FXMVECTOR a, FXMVECTOR b)
+	{
+		XMVECTOR na = XMVector3Normalize(a);
+		XMVECTOR nb = XMVector3Normalize(b);
+		return XMConvertToDegrees(atan2f(XMVectorGetX(XMVector3Length(XMVector3Cross(na, nb))),
+			XMVectorGetX(XMVector3Dot(na, nb))));
+	}
+
+	template<typename V>
+	TangentGenerator::VertexLayout Layout()
+	{
+		TangentGenerator::VertexLayout layout;
+		layout.Stride = sizeof(V);
+		layout.PositionOffset = offsetof(V, Pos);
+		layout.NormalOffset = offsetof(V, Normal);
+		layout.TexCOffset = offsetof(V, TexC);
+		layout.TangentOffset = offsetof(V, TangentU);
+		layout.HandednessOffset = offsetof(V, TangentU) + sizeof(float)*3;
+		return layout;
+	}
+
+	struct Comparison
+	{
+		float MeanError = 0.0f;
+		float MaxError = 0.0f;
+
+		// Vertices whose tangent is more than MaxVertexError off.
+		size_t BadVertices = 0;
+
+		// Vertices whose handedness differs.
+		size_t BadHandedness = 0;
+	};
+
+	template<typename V>
+	Comparison Compare(const vector<V>& generated, const vector<XMFLOAT4>& expected)
+	{
+		Comparison c;
+		double sum = 0.0;
+		for(size_t i = 0; i < generated.size(); ++i)
+		{
+			float error = AngleBetween(XMLoadFloat4(&generated[i].TangentU), XMLoadFloat4(&expected[i]));
+			sum += error;
+			c.MaxError = max(c.MaxError, error);
+			if(error > MaxVertexError)
+				++c.BadVertices;
+			if((generated[i].TangentU.w < 0.0f) != (expected[i].w < 0.0f))
+				++c.BadHandedness;
+		}
+
+		c.MeanError = generated.empty() ? 0.0f : (float)(sum / generated.size());
+		return c;
+	}
+
+	void Print(const string& name, size_t vertexCount, const Comparison& c)
+	{
+		cout << name << ": " << vertexCount << " vertices, tangent error mean " << fixed << setprecision(3)
+			<< c.MeanError << " max " << setprecision(1) << c.MaxError << " degrees, " << c.BadVertices
+			<< " over " << MaxVertexError << ", " << c.BadHandedness << " with the wrong handedness" << endl;
+	}
+
+	// GeometryGenerator has no handedness, so the expected one is +1 unless the
+	// texture is mirrored, which it is on the top cap of the cylinder: the cap has v
+	// increase along +z, the same as the bottom one, though it faces the other way.
+	vector<Vertex> ToVertices(const GeometryGenerator::MeshData& meshData, bool mirrorU, bool mirroredTopCap,
+		vector<XMFLOAT4>& expected)
+	{
+		vector<Vertex> vertices(meshData.Vertices.size());
+		expected.resize(meshData.Vertices.size());
+		for(size_t i = 0; i < vertices.size(); ++i)
+		{
+			const auto& v = meshData.Vertices[i];
+			vertices[i].Pos = v.Position;
+			vertices[i].Normal = v.Normal;
+			vertices[i].TexC = v.TexC;
+			vertices[i].TangentU = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+
+			float sign = mirrorU ? -1.0f : 1.0f;
+			float handedness = sign;
+			if(mirroredTopCap && v.Normal.y == 1.0f)
+				handedness = -handedness;
+
+			expected[i] = XMFLOAT4(sign*v.TangentU.x, sign*v.TangentU.y, sign*v.TangentU.z, handedness);
+			if(mirrorU)
+				vertices[i].TexC.x = 1.0f - v.TexC.x;
+		}
+
+		return vertices;
+	}
+
+	bool RunShape(const string& name, const GeometryGenerator::MeshData& meshData, bool mirrorU = false,
+		bool mirroredTopCap = false)
+	{
+		vector<XMFLOAT4> expected;
+		vector<Vertex> vertices = ToVertices(meshData, mirrorU, mirroredTopCap, expected);
+
+		TangentGenerator::Generate(vertices.data(), Layout<Vertex>(), (uint32_t)vertices.size(),
+			meshData.Indices32.data(), meshData.Indices32.size());
+
+		Comparison c = Compare(vertices, expected);
+		Print(name, vertices.size(), c);
+
+		// The triangles around the poles of the sphere have texture space frames
+		// that cancel out, so a few vertices there are allowed to be off.
+		bool ok = c.MeanError <= MaxMeanError && c.BadVertices + c.BadHandedness <= vertices.size() / 100;
+		if(!ok)
+			cout << "  tangents differ from the analytic ones" << endl;
+
+		return ok;
+	}
+
+	bool RunThreads(const GeometryGenerator::MeshData& meshData)
+	{
+		vector<XMFLOAT4> expected;
+		vector<Vertex> parallel = ToVertices(meshData, false, false, expected);
+		vector<Vertex> serial = parallel;
+
+		auto start = chrono::steady_clock::now();
+		TangentGenerator::Generate(parallel.data(), Layout<Vertex>(), (uint32_t)parallel.size(),
+			meshData.Indices32.data(), meshData.Indices32.size());
+		double parallelMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+		TaskSystem oneWorker(1);
+		start = chrono::steady_clock::now();
+		TangentGenerator::Generate(serial.data(), Layout<Vertex>(), (uint32_t)serial.size(),
+			meshData.Indices32.data(), meshData.Indices32.size(), oneWorker);
+		double serialMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+		cout << "large grid: " << parallel.size() << " vertices, " << meshData.Indices32.size() / 3
+			<< " triangles in " << setprecision(1) << serialMs << " ms on one worker, " << parallelMs << " ms on "
+			<< TaskSystem::Default().WorkerCount() << " workers" << endl;
+
+		bool ok = memcmp(parallel.data(), serial.data(), parallel.size()*sizeof(Vertex)) == 0;
+		if(!ok)
+			cout << "  results depend on the number of threads" << endl;
+
+		return ok;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	string soldierFile = argc > 1 ? argv[1] : "../../Chapter 23 Character Animation/SkinnedMesh/Models/soldier.m3d";
+
+	bool ok = true;
+
+	GeometryGenerator geoGen;
+	ok &= RunShape("box", geoGen.CreateBox(1.0f, 2.0f, 3.0f, 2));
+	ok &= RunShape("grid", geoGen.CreateGrid(20.0f, 30.0f, 60, 40));
+	ok &= RunShape("mirrored grid", geoGen.CreateGrid(20.0f, 30.0f, 60, 40), true);
+	ok &= RunShape("sphere", geoGen.CreateSphere(0.5f, 40, 40));
+	ok &= RunShape("cylinder", geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 40, 20), false, true);
+
+	ok &= RunThreads(geoGen.CreateGrid(100.0f, 100.0f, 1000, 1000));
+
+	// The file's tangents come from the exporter rather than from the same rules, so
+	// they are only reported.
+	vector<M3DLoader::SkinnedVertex> soldierVertices;
+	vector<UINT> soldierIndices;
+	vector<M3DLoader::Subset> soldierSubsets;
+	vector<M3DLoader::M3dMaterial> soldierMats;
+	SkinnedData soldierSkin;
+
+	M3DLoader m3dLoader;
+	if(m3dLoader.LoadM3d(soldierFile, soldierVertices, soldierIndices, soldierSubsets, soldierMats, soldierSkin))
+	{
+		vector<XMFLOAT4> fileTangents(soldierVertices.size());
+		for(size_t i = 0; i < soldierVertices.size(); ++i)
+			fileTangents[i] = soldierVertices[i].TangentU;
+
+		auto start = chrono::steady_clock::now();
+		uint32_t fallbacks = TangentGenerator::Generate(soldierVertices.data(), Layout<M3DLoader::SkinnedVertex>(),
+			(uint32_t)soldierVertices.size(), soldierIndices.data(), soldierIndices.size());
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+		Print("soldier", soldierVertices.size(), Compare(soldierVertices, fileTangents));
+		cout << "  " << fallbacks << " vertices without a usable tangent, generated in " << setprecision(2) << ms
+			<< " ms" << endl;
+	}
+	else
+	{
+		cout << soldierFile << " not found." << endl;
+		ok = false;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,406 @@
+//***************************************************************************************
+// TerrainBenchmark.cpp
+//
+// Builds Terrains over the same rolling landscape sampled at one metre on
+// heightfields from 257x257 to 4097x4097, and for each reports how long the build
+// takes and how many chunks and triangles a view from the ground draws.  The count
+// grows with the part of the heightfield inside the far plane, and only slowly
+// beyond it: each doubling of the heightfield adds one coarse level.
+//
+// Also checks that:
+//
+//   - the chunks of a selection cover every quad exactly once, neighbours are at
+//     most one level apart and every vertex on the edge of a chunk lies on the
+//     edge of its neighbour, morphed as it is, so the surface has no cracks;
+//   - HeightAt and NormalAt are close to the analytic surface;
+//   - a heightfield saved as 16-bit raw loads back within one step;
+//   - a vertex budget is respected.
+//
+// Exits with a non-zero code if any check fails, so it can be run as a regression
+// test.
+//***************************************************************************************
+
+#include "../../Common/Terrain.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	const float FovY = 0.25f*XM_PI;
+	const float AspectRatio = 16.0f / 9.0f;
+	const float ViewportHeight = 1080.0f;
+	const float MaxPixelError = 2.0f;
+	const float FarZ = 1500.0f;
+
+	// Heights of the chunks either side of an edge may differ by this much.
+	const float CrackTolerance = 1.0e-3f;
+
+	// Octaves of (amplitude, frequency along x, frequency along z, phase).
+	const float Octaves[][4] =
+	{
+		{ 40.0f, 0.011f, 0.013f, 0.0f },
+		{ 12.0f, 0.037f, 0.041f, 0.5f },
+		{ 3.0f, 0.13f, 0.11f, 1.0f },
+		{ 0.8f, 0.47f, 0.31f, 2.0f },
+	};
+
+	float Landscape(float x, float z)
+	{
+		float h = 0.0f;
+		for(const auto& o : Octaves)
+			h += o[0]*sinf(o[1]*x + o[3])*cosf(o[2]*z);
+		return h;
+	}
+
+	XMFLOAT3 LandscapeNormal(float x, float z)
+	{
+		float dhdx = 0.0f;
+		float dhdz = 0.0f;
+		for(const auto& o : Octaves)
+		{
+			dhdx += o[0]*o[1]*cosf(o[1]*x + o[3])*cosf(o[2]*z);
+			dhdz -= o[0]*o[2]*sinf(o[1]*x + o[3])*sinf(o[2]*z);
+		}
+
+		XMFLOAT3 n;
+		XMStoreFloat3(&n, XMVector3Normalize(XMVectorSet(-dhdx, 1.0f, -dhdz, 0.0f)));
+		return n;
+	}
+
+	Heightfield MakeHeightfield(uint32_t size)
+	{
+		Heightfield heightfield(size, size, 1.0f);
+		heightfield.Generate(Landscape);
+		return heightfield;
+	}
+
+	double Milliseconds(chrono::steady_clock::time_point start)
+	{
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	BoundingFrustum ViewFrustum(const XMFLOAT3& eye, const XMFLOAT3& target)
+	{
+		XMMATRIX proj = XMMatrixPerspectiveFovLH(FovY, AspectRatio, 1.0f, FarZ);
+		XMMATRIX view = XMMatrixLookAtLH(XMLoadFloat3(&eye), XMLoadFloat3(&target), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+
+		XMVECTOR det = XMMatrixDeterminant(view);
+		XMMATRIX invView = XMMatrixInverse(&det, view);
+
+		BoundingFrustum frustum(proj);
+		frustum.Transform(frustum, invView);
+		return frustum;
+	}
+
+	vector<XMFLOAT3> WritePositions(const Terrain& terrain, const Terrain::Selection& selection, const XMFLOAT3& eye)
+	{
+		GeometryGenerator::VertexLayout layout;
+		layout.Stride = sizeof(XMFLOAT3);
+		layout.PositionOffset = 0;
+
+		vector<XMFLOAT3> positions(selection.VertexCount);
+		terrain.WriteVertices(selection, eye, positions.data(), layout);
+		return positions;
+	}
+
+	// Height of a chunk's mesh at a sample on or inside its edges.
+	float ChunkHeight(const Terrain::Chunk& chunk, const vector<XMFLOAT3>& positions, int row, int col)
+	{
+		const int step = 1 << chunk.Level;
+		const int n = chunk.QuadCount + 1;
+		const float fi = (float)(row - (int)chunk.Row) / step;
+		const float fj = (float)(col - (int)chunk.Column) / step;
+		const int i0 = min((int)fi, n - 2);
+		const int j0 = min((int)fj, n - 2);
+		const float fr = fi - i0;
+		const float fc = fj - j0;
+
+		auto h = [&](int i, int j) { return positions[chunk.BaseVertex + i*n + j].y; };
+
+		if(fr + fc <= 1.0f)
+			return h(i0, j0) + fc*(h(i0, j0 + 1) - h(i0, j0)) + fr*(h(i0 + 1, j0) - h(i0, j0));
+
+		return h(i0 + 1, j0 + 1) + (1.0f - fc)*(h(i0 + 1, j0) - h(i0 + 1, j0 + 1)) +
+			(1.0f - fr)*(h(i0, j0 + 1) - h(i0 + 1, j0 + 1));
+	}
+
+	// Checks a selection made without culling for gaps, overlaps and cracks.
+	bool CheckWatertight(const Terrain& terrain, const XMFLOAT3& eye, const string& name)
+	{
+		Terrain::Selection selection;
+		terrain.Select(eye, nullptr, selection);
+		vector<XMFLOAT3> positions = WritePositions(terrain, selection, eye);
+
+		const int quadRows = (int)terrain.GetHeightfield().RowCount() - 1;
+		const int quadCols = (int)terrain.GetHeightfield().ColumnCount() - 1;
+
+		size_t overlaps = 0;
+		vector<int> owner((size_t)quadRows*quadCols, -1);
+		for(size_t k = 0; k < selection.Chunks.size(); ++k)
+		{
+			const Terrain::Chunk& chunk = selection.Chunks[k];
+			int span = chunk.QuadCount << chunk.Level;
+			for(int r = chunk.Row; r < min((int)chunk.Row + span, quadRows); ++r)
+			{
+				for(int c = chunk.Column; c < min((int)chunk.Column + span, quadCols); ++c)
+				{
+					int& o = owner[(size_t)r*quadCols + c];
+					if(o >= 0)
+						++overlaps;
+					o = (int)k;
+				}
+			}
+		}
+
+		size_t gaps = count(owner.begin(), owner.end(), -1);
+
+		size_t cracks = 0;
+		size_t levelJumps = 0;
+		float worstCrack = 0.0f;
+		for(size_t k = 0; k < selection.Chunks.size(); ++k)
+		{
+			const Terrain::Chunk& chunk = selection.Chunks[k];
+			const int step = 1 << chunk.Level;
+			const int n = chunk.QuadCount + 1;
+
+			for(int i = 0; i < n; ++i)
+			{
+				for(int j = 0; j < n; ++j)
+				{
+					if(i != 0 && i != n - 1 && j != 0 && j != n - 1)
+						continue;
+
+					int row = chunk.Row + i*step;
+					int col = chunk.Column + j*step;
+					if(row > quadRows || col > quadCols)
+						continue;
+
+					float h = positions[chunk.BaseVertex + i*n + j].y;
+					for(int dr = -1; dr <= 0; ++dr)
+					{
+						for(int dc = -1; dc <= 0; ++dc)
+						{
+							int r = row + dr, c = col + dc;
+							if(r < 0 || c < 0 || r >= quadRows || c >= quadCols)
+								continue;
+
+							int other = owner[(size_t)r*quadCols + c];
+							if(other < 0 || other == (int)k)
+								continue;
+
+							const Terrain::Chunk& neighbour = selection.Chunks[other];
+							if(abs((int)neighbour.Level - (int)chunk.Level) > 1)
+								++levelJumps;
+
+							float error = fabsf(ChunkHeight(neighbour, positions, row, col) - h);
+							worstCrack = max(worstCrack, error);
+							if(error > CrackTolerance)
+								++cracks;
+						}
+					}
+				}
+			}
+		}
+
+		cout << "  " << name << ": " << selection.Chunks.size() << " chunks, " << gaps << " gaps, " << overlaps
+			<< " overlaps, " << levelJumps << " level jumps, " << cracks << " cracks (worst " << scientific
+			<< setprecision(1) << worstCrack << fixed << ")" << endl;
+
+		return gaps == 0 && overlaps == 0 && levelJumps == 0 && cracks == 0;
+	}
+
+	bool RunWatertight()
+	{
+		cout << "watertight:" << endl;
+
+		bool ok = true;
+		for(uint32_t size : { 1025u, 4097u })
+		{
+			Terrain terrain(MakeHeightfield(size));
+			terrain.SetScreenError(FovY, ViewportHeight, MaxPixelError);
+
+			float half = 0.5f*(size - 1);
+			const XMFLOAT3 eyes[] =
+			{
+				XMFLOAT3(0.0f, terrain.HeightAt(0.0f, 0.0f) + 2.0f, 0.0f),
+				XMFLOAT3(0.37f*half, terrain.HeightAt(0.37f*half, -0.21f*half) + 30.0f, -0.21f*half),
+				XMFLOAT3(-half, terrain.HeightAt(-half, half) + 1.0f, half),
+				XMFLOAT3(0.8f*half, 400.0f, 0.6f*half),
+				XMFLOAT3(3.0f*half, 50.0f, 0.0f),
+			};
+
+			for(const XMFLOAT3& eye : eyes)
+			{
+				char name[128];
+				snprintf(name, sizeof(name), "%u, eye at (%.0f, %.0f, %.0f)", size, eye.x, eye.y, eye.z);
+				ok &= CheckWatertight(terrain, eye, name);
+			}
+		}
+
+		if(!ok)
+			cout << "  the selection has holes or cracks" << endl;
+
+		return ok;
+	}
+
+	bool RunQueries()
+	{
+		Terrain terrain(MakeHeightfield(1025));
+
+		bool ok = true;
+		for(int r = 0; r < 1025; r += 37)
+		{
+			for(int c = 0; c < 1025; c += 41)
+			{
+				const Heightfield& h = terrain.GetHeightfield();
+				ok &= terrain.HeightAt(h.X(c), h.Z(r)) == h.Sample(r, c);
+			}
+		}
+
+		float worstHeight = 0.0f;
+		float worstNormal = 0.0f;
+		uint32_t seed = 1;
+		auto random = [&seed]() { seed = seed*1664525u + 1013904223u; return (seed >> 8) / 16777216.0f; };
+
+		for(int k = 0; k < 100000; ++k)
+		{
+			float x = 1000.0f*(random() - 0.5f);
+			float z = 1000.0f*(random() - 0.5f);
+
+			worstHeight = max(worstHeight, fabsf(terrain.HeightAt(x, z) - Landscape(x, z)));
+
+			XMFLOAT3 n = terrain.NormalAt(x, z);
+			XMFLOAT3 expected = LandscapeNormal(x, z);
+			float cosAngle = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&n), XMLoadFloat3(&expected)));
+			worstNormal = max(worstNormal, XMConvertToDegrees(acosf(min(cosAngle, 1.0f))));
+		}
+
+		cout << "queries: HeightAt off by at most " << setprecision(3) << worstHeight << ", NormalAt by "
+			<< setprecision(2) << worstNormal << " degrees" << endl;
+
+		ok &= worstHeight <= 0.1f && worstNormal <= 2.0f;
+		if(!ok)
+			cout << "  queries differ from the surface" << endl;
+
+		return ok;
+	}
+
+	bool RunRaw16()
+	{
+		const uint32_t size = 257;
+		const float scale = 120.0f;
+		const float offset = -60.0f;
+		const string filename = "TerrainBenchmark.raw";
+
+		Heightfield source = MakeHeightfield(size);
+		{
+			ofstream fout(filename, ios::binary);
+			for(uint32_t r = 0; r < size; ++r)
+			{
+				for(uint32_t c = 0; c < size; ++c)
+				{
+					float t = (source.Sample(r, c) - offset) / scale;
+					uint16_t v = (uint16_t)lroundf(min(max(t, 0.0f), 1.0f)*65535.0f);
+					char bytes[2] = { (char)(v & 0xff), (char)(v >> 8) };
+					fout.write(bytes, 2);
+				}
+			}
+		}
+
+		Heightfield loaded;
+		bool ok = loaded.LoadRaw16(filename, size, size, 1.0f, scale, offset);
+		ok &= !loaded.LoadRaw16(filename, size + 1, size, 1.0f, scale, offset);
+		remove(filename.c_str());
+
+		float worst = 0.0f;
+		for(uint32_t r = 0; ok && r < size; ++r)
+			for(uint32_t c = 0; c < size; ++c)
+				worst = max(worst, fabsf(loaded.Sample(r, c) - source.Sample(r, c)));
+
+		cout << "raw16: loaded " << (ok ? "" : "in") << "correctly, off by at most " << scientific << setprecision(1)
+			<< worst << fixed << endl;
+
+		ok &= worst <= scale / 65535.0f;
+		if(!ok)
+			cout << "  16-bit raw round trip failed" << endl;
+
+		return ok;
+	}
+
+	bool RunScaling()
+	{
+		cout << "scaling, " << setprecision(0) << MaxPixelError << " pixels of error at " << ViewportHeight << "p, "
+			<< FarZ << " m far plane:" << endl;
+
+		bool ok = true;
+		for(uint32_t size : { 257u, 513u, 1025u, 2049u, 4097u })
+		{
+			auto start = chrono::steady_clock::now();
+			Heightfield heightfield = MakeHeightfield(size);
+			double generateMs = Milliseconds(start);
+
+			start = chrono::steady_clock::now();
+			Terrain terrain(move(heightfield));
+			terrain.SetScreenError(FovY, ViewportHeight, MaxPixelError);
+			double buildMs = Milliseconds(start);
+
+			// Standing on the ground looking across the terrain.
+			XMFLOAT3 eye(0.0f, terrain.HeightAt(0.0f, 0.0f) + 2.0f, 0.0f);
+			XMFLOAT3 target(100.0f, eye.y - 5.0f, 30.0f);
+			BoundingFrustum frustum = ViewFrustum(eye, target);
+
+			Terrain::Selection selection;
+			start = chrono::steady_clock::now();
+			terrain.Select(eye, &frustum, selection);
+			double selectMs = Milliseconds(start);
+
+			start = chrono::steady_clock::now();
+			vector<XMFLOAT3> positions = WritePositions(terrain, selection, eye);
+			double writeMs = Milliseconds(start);
+
+			Terrain::Selection all;
+			terrain.Select(eye, nullptr, all);
+
+			cout << "  " << setw(4) << size << "^2: " << terrain.LevelCount() << " levels, built in " << setprecision(1)
+				<< buildMs << " ms (+" << generateMs << " ms sampling); " << setw(3) << selection.Chunks.size()
+				<< " chunks, " << setw(6) << selection.TriangleCount << " triangles in view ("
+				<< all.TriangleCount << " all around), selected in " << setprecision(3) << selectMs
+				<< " ms, written in " << writeMs << " ms" << endl;
+
+			// Over-budget selections drop their farthest chunks.
+			Terrain::Selection budgeted;
+			uint32_t budget = selection.VertexCount / 2;
+			terrain.Select(eye, &frustum, budgeted, budget);
+			ok &= budgeted.VertexCount <= budget && budgeted.DroppedChunks > 0 &&
+				budgeted.Chunks.size() + budgeted.DroppedChunks == selection.Chunks.size();
+		}
+
+		if(!ok)
+			cout << "  the vertex budget was not respected" << endl;
+
+		return ok;
+	}
+}
+
+int main()
+{
+	cout << fixed;
+
+	bool ok = true;
+	ok &= RunScaling();
+	ok &= RunWatertight();
+	ok &= RunQueries();
+	ok &= RunRaw16();
+
+	return ok ? 0 : 1;
+}
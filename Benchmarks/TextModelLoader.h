@@ -0,0 +1,68 @@
+//***************************************************************************************
+// TextModelLoader.h
+//
+// The benchmarks' reader for the book's text models (Models/skull.txt,
+// Models/car.txt), parsed with ifstream the way the demos parsed them before
+// MeshCache.  Benchmarks that need another vertex layout copy out of TextModelVertex.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct TextModelVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT3 Normal;
+};
+
+///<summary>
+/// Reads the vertices and triangle list of a text model.  Returns false if the file
+/// cannot be opened.
+///</summary>
+inline bool LoadTextModel(const std::string& filename, std::vector<TextModelVertex>& vertices,
+	std::vector<std::int32_t>& indices)
+{
+	std::ifstream fin(filename);
+	if(!fin)
+		return false;
+
+	std::uint32_t vcount = 0;
+	std::uint32_t tcount = 0;
+	std::string ignore;
+
+	fin >> ignore >> vcount;
+	fin >> ignore >> tcount;
+	fin >> ignore >> ignore >> ignore >> ignore;
+
+	vertices.resize(vcount);
+	for(std::uint32_t i = 0; i < vcount; ++i)
+	{
+		fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
+		fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
+	}
+
+	fin >> ignore;
+	fin >> ignore;
+	fin >> ignore;
+
+	indices.resize(3 * (std::size_t)tcount);
+	for(std::uint32_t i = 0; i < tcount; ++i)
+	{
+		fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
+	}
+
+	return true;
+}
+
+// For benchmarks that only use the vertices.
+inline bool LoadTextModel(const std::string& filename, std::vector<TextModelVertex>& vertices)
+{
+	std::vector<std::int32_t> indices;
+	return LoadTextModel(filename, vertices, indices);
+}
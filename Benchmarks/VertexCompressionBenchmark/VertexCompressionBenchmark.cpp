@@ -0,0 +1,318 @@
+//***************************************************************************************
+// VertexCompressionBenchmark.cpp
+//
+// Checks the error bounds of VertexCompression: first on random unit vectors,
+// texture coordinates and bone weights, then on real meshes (generated shapes
+// through the MeshData path, the skull, and the soldier model through the M3D
+// path), and prints how much smaller each vertex buffer gets.
+//
+// Exits with a non-zero code if any decoded value is further from its input than
+// the documented bound, or a tangent's sign is lost, so it can be run as a
+// regression test.  The model paths
+// can be given on the command line.
+//***************************************************************************************
+
+#include "../../Common/VertexCompression.h"
+#include "../../Chapter 23 Character Animation/SkinnedMesh/LoadM3d.h"
+#include "../TextModelLoader.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	const int RandomSampleCount = 1000000;
+
+	// Float rounding allowed on top of the quantisation bounds.
+	const float Epsilon = 1.0e-6f;
+
+	// Largest errors seen, each as a fraction of its bound, so 1 is on the bound.
+	struct Errors
+	{
+		float Position = 0.0f;
+		float UnitVector = 0.0f;
+		float TexC = 0.0f;
+		float BoneWeight = 0.0f;
+
+		// Tangent signs that did not survive; there is no rounding to allow for.
+		size_t TangentSigns = 0;
+
+		bool Ok()const
+		{
+			return Position <= 1.0f && UnitVector <= 1.0f && TexC <= 1.0f && BoneWeight <= 1.0f &&
+				TangentSigns == 0;
+		}
+	};
+
+	// atan2 rather than acos, which loses all precision for small angles.
+	float AngleBetween(FXMVECTOR a, FXMVECTOR b)
+	{
+		XMVECTOR na = XMVector3Normalize(a);
+		XMVECTOR nb = XMVector3Normalize(b);
+		return atan2f(XMVectorGetX(XMVector3Length(XMVector3Cross(na, nb))), XMVectorGetX(XMVector3Dot(na, nb)));
+	}
+
+	void CheckUnitVector(FXMVECTOR v, XMSHORTN2 e, Errors& errors)
+	{
+		// Zero vectors are not directions; they only need to stay finite.
+		if(XMVectorGetX(XMVector3LengthSq(v)) == 0.0f)
+			return;
+
+		float angle = AngleBetween(v, VertexCompression::DecodeUnitVector(e));
+		errors.UnitVector = max(errors.UnitVector, angle / (VertexCompression::MaxUnitVectorError + Epsilon));
+	}
+
+	void CheckTangentSign(float sign, XMUSHORTN4 e, Errors& errors)
+	{
+		if(VertexCompression::DecodeTangentSign(e) != (sign >= 0.0f ? 1.0f : -1.0f))
+			++errors.TangentSigns;
+	}
+
+	void CheckTexC(const XMFLOAT2& uv, XMHALF2 e, Errors& errors)
+	{
+		float in[2] = { uv.x, uv.y };
+		HALF out[2] = { e.x, e.y };
+		for(int i = 0; i < 2; ++i)
+		{
+			// Below 2^-14 halfs are denormal, with a fixed step of 2^-24.
+			float bound = VertexCompression::MaxTexCRelativeError*max(fabsf(in[i]), 1.0f / 16384.0f);
+			errors.TexC = max(errors.TexC, fabsf(XMConvertHalfToFloat(out[i]) - in[i]) / bound);
+		}
+	}
+
+	void CheckBoneWeights(const XMFLOAT3& w, XMUBYTEN4 e, Errors& errors)
+	{
+		if(e.x + e.y + e.z + e.w != 255)
+		{
+			errors.BoneWeight = max(errors.BoneWeight, 2.0f);
+			return;
+		}
+
+		XMFLOAT4 d = VertexCompression::DecodeBoneWeights(e);
+		float in[4] = { w.x, w.y, w.z, 1.0f - w.x - w.y - w.z };
+		float out[4] = { d.x, d.y, d.z, d.w };
+		for(int i = 0; i < 4; ++i)
+		{
+			float bound = VertexCompression::MaxBoneWeightError + Epsilon;
+			errors.BoneWeight = max(errors.BoneWeight, fabsf(out[i] - in[i]) / bound);
+		}
+	}
+
+	void CheckPosition(FXMVECTOR p, XMUSHORTN4 e, const BoundingBox& bounds, Errors& errors)
+	{
+		XMFLOAT3 bound = VertexCompression::MaxPositionError(bounds);
+		float scale = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Center))) +
+			XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Extents)));
+
+		XMFLOAT3 diff;
+		XMStoreFloat3(&diff, XMVectorAbs(VertexCompression::DecodePosition(e, bounds) - p));
+
+		errors.Position = max(errors.Position, diff.x / (bound.x + Epsilon*scale));
+		errors.Position = max(errors.Position, diff.y / (bound.y + Epsilon*scale));
+		errors.Position = max(errors.Position, diff.z / (bound.z + Epsilon*scale));
+	}
+
+	bool Report(const char* name, size_t vertexCount, size_t rawSize, size_t compressedSize, const Errors& errors)
+	{
+		cout << name << ": " << vertexCount << " vertices";
+		if(rawSize > 0)
+			cout << ", " << rawSize << " -> " << compressedSize << " bytes per vertex";
+		cout << endl;
+		cout << "  largest error as a fraction of its bound: position " << fixed << setprecision(3) << errors.Position
+			<< ", normal/tangent " << errors.UnitVector << ", uv " << errors.TexC
+			<< ", bone weight " << errors.BoneWeight << endl;
+		if(errors.TangentSigns > 0)
+			cout << "  " << errors.TangentSigns << " tangent signs flipped" << endl;
+
+		if(!errors.Ok())
+			cout << "  error bound exceeded" << endl;
+
+		return errors.Ok();
+	}
+
+	bool RunRandom()
+	{
+		mt19937 rng(1234);
+		uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		uniform_real_distribution<float> uv(-4.0f, 4.0f);
+		uniform_real_distribution<float> positive(0.0f, 1.0f);
+
+		Errors errors;
+		for(int i = 0; i < RandomSampleCount; ++i)
+		{
+			XMVECTOR v = XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f);
+			CheckUnitVector(v, VertexCompression::EncodeUnitVector(v), errors);
+
+			XMFLOAT2 texC(uv(rng), uv(rng));
+			XMHALF2 h;
+			h.x = XMConvertFloatToHalf(texC.x);
+			h.y = XMConvertFloatToHalf(texC.y);
+			CheckTexC(texC, h, errors);
+
+			// Random weights summing to at most one.
+			float a = positive(rng), b = positive(rng), c = positive(rng), d = positive(rng);
+			float sum = a + b + c + d;
+			XMFLOAT3 weights(a / sum, b / sum, c / sum);
+			CheckBoneWeights(weights, VertexCompression::EncodeBoneWeights(weights), errors);
+		}
+
+		// The axes and the octahedron's folds are where encodings usually break.
+		const float special[] = { -1.0f, -0.5f, 0.0f, 0.5f, 1.0f };
+		for(float x : special)
+		{
+			for(float y : special)
+			{
+				for(float z : special)
+				{
+					XMVECTOR v = XMVectorSet(x, y, z, 0.0f);
+					CheckUnitVector(v, VertexCompression::EncodeUnitVector(v), errors);
+				}
+			}
+		}
+
+		return Report("random", RandomSampleCount, 0, 0, errors);
+	}
+
+	bool RunShapes()
+	{
+		GeometryGenerator geoGen;
+		GeometryGenerator::MeshData shapes[] =
+		{
+			geoGen.CreateBox(1.0f, 2.0f, 3.0f, 3),
+			geoGen.CreateSphere(0.5f, 20, 20),
+			geoGen.CreateGeosphere(0.5f, 3),
+			geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20),
+			geoGen.CreateGrid(160.0f, 160.0f, 50, 50)
+		};
+		const char* shapeNames[] = { "box", "sphere", "geosphere", "cylinder", "grid" };
+
+		bool ok = true;
+		for(int s = 0; s < 5; ++s)
+		{
+			const auto& meshData = shapes[s];
+
+			vector<VertexCompression::Vertex> compressed;
+			BoundingBox bounds = VertexCompression::Compress(meshData, compressed);
+
+			Errors errors;
+			for(size_t i = 0; i < meshData.Vertices.size(); ++i)
+			{
+				const auto& v = meshData.Vertices[i];
+				const auto& c = compressed[i];
+
+				CheckPosition(XMLoadFloat3(&v.Position), c.Position, bounds, errors);
+				CheckUnitVector(XMLoadFloat3(&v.Normal), c.Normal, errors);
+				CheckUnitVector(XMLoadFloat3(&v.TangentU), c.TangentU, errors);
+				CheckTangentSign(1.0f, c.Position, errors);
+				CheckTexC(v.TexC, c.TexC, errors);
+			}
+
+			ok &= Report(shapeNames[s], meshData.Vertices.size(), sizeof(GeometryGenerator::Vertex),
+				sizeof(VertexCompression::Vertex), errors);
+		}
+
+		return ok;
+	}
+
+	bool RunSkull(const string& filename)
+	{
+		vector<TextModelVertex> vertices;
+		if(!LoadTextModel(filename, vertices))
+		{
+			cout << filename << " not found." << endl;
+			return false;
+		}
+
+		VertexCompression::SourceLayout layout;
+		layout.Stride = sizeof(TextModelVertex);
+		layout.PositionOffset = offsetof(TextModelVertex, Pos);
+		layout.NormalOffset = offsetof(TextModelVertex, Normal);
+
+		BoundingBox bounds = VertexCompression::ComputeBounds(vertices.data(), layout, (uint32_t)vertices.size());
+		vector<VertexCompression::Vertex> compressed(vertices.size());
+		VertexCompression::Compress(vertices.data(), layout, (uint32_t)vertices.size(), bounds, compressed.data());
+
+		Errors errors;
+		for(size_t i = 0; i < vertices.size(); ++i)
+		{
+			CheckPosition(XMLoadFloat3(&vertices[i].Pos), compressed[i].Position, bounds, errors);
+			CheckUnitVector(XMLoadFloat3(&vertices[i].Normal), compressed[i].Normal, errors);
+		}
+
+		return Report("skull", vertices.size(), sizeof(TextModelVertex), sizeof(VertexCompression::Vertex), errors);
+	}
+
+	bool RunSoldier(const string& filename)
+	{
+		vector<M3DLoader::SkinnedVertex> vertices;
+		vector<UINT> indices;
+		vector<M3DLoader::Subset> subsets;
+		vector<M3DLoader::M3dMaterial> mats;
+		SkinnedData skin;
+
+		M3DLoader m3dLoader;
+		if(!m3dLoader.LoadM3d(filename, vertices, indices, subsets, mats, skin))
+		{
+			cout << filename << " not found." << endl;
+			return false;
+		}
+
+		VertexCompression::SourceLayout layout;
+		layout.Stride = sizeof(M3DLoader::SkinnedVertex);
+		layout.PositionOffset = offsetof(M3DLoader::SkinnedVertex, Pos);
+		layout.NormalOffset = offsetof(M3DLoader::SkinnedVertex, Normal);
+		layout.TangentOffset = offsetof(M3DLoader::SkinnedVertex, TangentU);
+		layout.TangentSignOffset = offsetof(M3DLoader::SkinnedVertex, TangentU) + offsetof(XMFLOAT4, w);
+		layout.TexCOffset = offsetof(M3DLoader::SkinnedVertex, TexC);
+		layout.BoneWeightsOffset = offsetof(M3DLoader::SkinnedVertex, BoneWeights);
+		layout.BoneIndicesOffset = offsetof(M3DLoader::SkinnedVertex, BoneIndices);
+
+		BoundingBox bounds = VertexCompression::ComputeBounds(vertices.data(), layout, (uint32_t)vertices.size());
+		vector<VertexCompression::SkinnedVertex> compressed(vertices.size());
+		VertexCompression::Compress(vertices.data(), layout, (uint32_t)vertices.size(), bounds, compressed.data());
+
+		Errors errors;
+		bool indicesOk = true;
+		for(size_t i = 0; i < vertices.size(); ++i)
+		{
+			const auto& v = vertices[i];
+			const auto& c = compressed[i];
+
+			CheckPosition(XMLoadFloat3(&v.Pos), c.Position, bounds, errors);
+			CheckUnitVector(XMLoadFloat3(&v.Normal), c.Normal, errors);
+			CheckUnitVector(XMLoadFloat4(&v.TangentU), c.TangentU, errors);
+			CheckTangentSign(v.TangentU.w, c.Position, errors);
+			CheckTexC(v.TexC, c.TexC, errors);
+			CheckBoneWeights(v.BoneWeights, c.BoneWeights, errors);
+
+			indicesOk &= equal(v.BoneIndices, v.BoneIndices + 4, c.BoneIndices);
+		}
+
+		if(!indicesOk)
+			cout << "soldier: bone indices changed" << endl;
+
+		return Report("soldier", vertices.size(), sizeof(M3DLoader::SkinnedVertex),
+			sizeof(VertexCompression::SkinnedVertex), errors) && indicesOk;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	string skullFile = argc > 1 ? argv[1] : "../../Chapter 8 Lighting/LitColumns/Models/skull.txt";
+	string soldierFile = argc > 2 ? argv[2] : "../../Chapter 23 Character Animation/SkinnedMesh/Models/soldier.m3d";
+
+	bool ok = true;
+	ok &= RunRandom();
+	ok &= RunShapes();
+	ok &= RunSkull(skullFile);
+	ok &= RunSoldier(soldierFile);
+
+	return ok ? 0 : 1;
+}
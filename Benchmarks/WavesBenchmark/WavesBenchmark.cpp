@@ -0,0 +1,354 @@
+//***************************************************************************************
+// WavesBenchmark.cpp
+//
+// Measures the CPU cost of one update of the finite-difference Waves solver and of
+// the spectral ocean, in nanoseconds per grid vertex, over a range of grid sizes.
+//
+// Waves is measured with every tile kept active, i.e. its worst case; with only a
+// few splashes active-region tracking makes it much cheaper.  The spectral ocean
+// costs the same every update, so it is measured with and without choppy waves
+// (three and five real transforms respectively).
+//
+// ClipmapWaves is run as the viewer moves across the water, splashing as it goes,
+// and checked: it must stay stable, each level's boundary must lie on the surface
+// of the level around it after every update and every recentring, and each level
+// must leave out exactly the quads the finer level draws.  Then a lake a kilometre
+// across is timed as a clipmap, as one grid of the same extent and spacing, and
+// against the demo's 200x200 grid.  Exits with a non-zero code if a check fails.
+//***************************************************************************************
+
+#include "../../Chapter 8 Lighting/LitWaves/Waves.h"
+#include "../../Chapter 8 Lighting/LitWaves/ClipmapWaves.h"
+#include "../../Common/SpectralOcean.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	// Average time of one call to f in nanoseconds.
+	template<typename F>
+	double TimeCall(const F& f)
+	{
+		// Warm up caches and the task system's threads.
+		for(int i = 0; i < 5; ++i)
+			f();
+
+		int iterations = 0;
+		auto start = chrono::steady_clock::now();
+		auto elapsed = chrono::steady_clock::duration::zero();
+		while(iterations < 20 || elapsed < chrono::milliseconds(500))
+		{
+			f();
+			++iterations;
+			elapsed = chrono::steady_clock::now() - start;
+		}
+
+		return chrono::duration<double, nano>(elapsed).count() / iterations;
+	}
+
+	void Report(const char* name, int size, double nsPerCall)
+	{
+		cout << setw(24) << left << name
+			<< setw(6) << right << size
+			<< setw(14) << fixed << setprecision(1) << nsPerCall / 1000.0
+			<< setw(14) << setprecision(2) << nsPerCall / (size*size) << endl;
+	}
+
+	// Grid coordinates of a world-space point in a clipmap level, as fractions.
+	void ToLevelGrid(const ClipmapWaves& clipmap, int level, float x, float z, float& i, float& j)
+	{
+		// Row 0, column 0 is the -x, +z corner.
+		const XMFLOAT3 corner = clipmap.Position(level, 0);
+		const float dx = clipmap.Position(level, 1).x - corner.x;
+
+		j = (x - corner.x) / dx;
+		i = (corner.z - z) / dx;
+	}
+
+	// Largest difference between the boundary heights of each level and the surface
+	// of the level around it, which the coarse level draws as straight edges between
+	// its grid points.
+	float SeamError(const ClipmapWaves& clipmap)
+	{
+		float maxError = 0.0f;
+		for(int l = 0; l + 1 < clipmap.LevelCount(); ++l)
+		{
+			const int n = clipmap.Level(l).ColumnCount();
+			const int coarseN = clipmap.Level(l + 1).ColumnCount();
+
+			for(int k = 0; k < 4*(n - 1); ++k)
+			{
+				// Walk the boundary: top row, right column, bottom row, left column.
+				int side = k / (n - 1), t = k % (n - 1);
+				int i = side == 0 ? 0 : side == 1 ? t : side == 2 ? n - 1 : n - 1 - t;
+				int j = side == 0 ? t : side == 1 ? n - 1 : side == 2 ? n - 1 - t : 0;
+
+				XMFLOAT3 p = clipmap.Position(l, i*n + j);
+
+				float ci, cj;
+				ToLevelGrid(clipmap, l + 1, p.x, p.z, ci, cj);
+
+				// On a coarse grid line; interpolate along it.
+				int i0 = min((int)floor(ci), coarseN - 2);
+				int j0 = min((int)floor(cj), coarseN - 2);
+				float s = ci - i0, u = cj - j0;
+				float h00 = clipmap.Position(l + 1, i0*coarseN + j0).y;
+				float h01 = clipmap.Position(l + 1, i0*coarseN + j0 + 1).y;
+				float h10 = clipmap.Position(l + 1, (i0 + 1)*coarseN + j0).y;
+				float h11 = clipmap.Position(l + 1, (i0 + 1)*coarseN + j0 + 1).y;
+				float h = (1.0f - s)*((1.0f - u)*h00 + u*h01) + s*((1.0f - u)*h10 + u*h11);
+
+				bool onLine = fabsf(ci - roundf(ci)) < 1e-3f || fabsf(cj - roundf(cj)) < 1e-3f;
+				maxError = max(maxError, onLine ? fabsf(p.y - h) : 1e9f);
+			}
+		}
+
+		return maxError;
+	}
+
+	// Whether every coarse level leaves out exactly the quads inside the footprint of
+	// the finer level, and draws every other quad once.
+	bool HolesMatchFootprints(const ClipmapWaves& clipmap)
+	{
+		vector<uint32_t> indices;
+		for(int l = 0; l < clipmap.LevelCount(); ++l)
+		{
+			const int n = clipmap.Level(l).ColumnCount();
+			clipmap.BuildIndices(l, indices);
+
+			vector<int> drawn((n - 1)*(n - 1), 0);
+			for(size_t t = 0; t < indices.size(); t += 6)
+			{
+				int quad = (int)indices[t];
+				drawn[(quad / n)*(n - 1) + quad % n]++;
+			}
+
+			for(int i = 0; i < n - 1; ++i)
+			{
+				for(int j = 0; j < n - 1; ++j)
+				{
+					bool inHole = false;
+					if(l > 0)
+					{
+						XMFLOAT3 a = clipmap.Position(l, i*n + j);
+						XMFLOAT3 b = clipmap.Position(l, (i + 1)*n + j + 1);
+
+						float fi, fj;
+						ToLevelGrid(clipmap, l - 1, 0.5f*(a.x + b.x), 0.5f*(a.z + b.z), fi, fj);
+						inHole = fi > 0.0f && fi < n - 1 && fj > 0.0f && fj < n - 1;
+					}
+
+					if(drawn[i*(n - 1) + j] != (inHole ? 0 : 1))
+						return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	float MaxHeight(const ClipmapWaves& clipmap)
+	{
+		float maxHeight = 0.0f;
+		for(int l = 0; l < clipmap.LevelCount(); ++l)
+		{
+			for(int i = 0; i < clipmap.Level(l).VertexCount(); ++i)
+			{
+				float h = clipmap.Position(l, i).y;
+				maxHeight = isfinite(h) ? max(maxHeight, fabsf(h)) : 1e9f;
+			}
+		}
+
+		return maxHeight;
+	}
+
+	bool CheckClipmap()
+	{
+		const float dt = 0.03f;
+		const int levels = 4, n = 65;
+		ClipmapWaves clipmap(levels, n, 1.0f, dt, 3.25f, 0.4f);
+
+		// One grid over the clipmap's whole extent, splashed the same way, for what
+		// heights to expect.
+		const int extent = (n - 1) << (levels - 1);
+		Waves reference(extent + 1, extent + 1, 1.0f, dt, 3.25f, 0.4f);
+
+		bool holesOk = true;
+		float seamError = 0.0f;
+		float peak = 0.0f;
+		float referencePeak = 0.0f;
+		int recentrings = 0;
+
+		// Peak heights over each stretch of 100 frames once the splashing stops.
+		vector<float> windows;
+
+		// The viewer crosses the water diagonally, splashing beside itself, and then
+		// stands still while the waves die down.
+		for(int frame = 0; frame < 1600; ++frame)
+		{
+			if(frame < 1000)
+			{
+				float x = 0.15f*frame, z = -0.1f*frame;
+				if(clipmap.SetViewerPosition(x, z))
+				{
+					++recentrings;
+					seamError = max(seamError, SeamError(clipmap));
+					holesOk &= HolesMatchFootprints(clipmap);
+				}
+
+				if(frame % 10 == 0)
+				{
+					float sx = x + (float)(frame % 70) - 35.0f;
+					float sz = z + (float)(frame % 110) - 55.0f;
+					clipmap.Disturb(sx, sz, 0.5f);
+					reference.Disturb((int)lround(0.5f*extent - sz), (int)lround(sx + 0.5f*extent), 0.5f);
+				}
+			}
+
+			clipmap.Update(dt);
+			reference.Update(dt);
+			seamError = max(seamError, SeamError(clipmap));
+
+			float height = MaxHeight(clipmap);
+			peak = max(peak, height);
+			for(int i = 0; i < reference.VertexCount(); ++i)
+				referencePeak = max(referencePeak, fabsf(reference.Position(i).y));
+
+			if(frame >= 1000)
+			{
+				if((frame - 1000) % 100 == 0)
+					windows.push_back(0.0f);
+				windows.back() = max(windows.back(), height);
+			}
+		}
+
+		bool decays = true;
+		for(size_t w = 1; w < windows.size(); ++w)
+			decays &= windows[w] < windows[w - 1];
+
+		const bool stable = peak < 2.0f*referencePeak && decays;
+
+		cout << "ClipmapWaves: " << recentrings << " recentrings, peak height " << setprecision(3) << peak
+			<< " (one grid: " << referencePeak << "), " << windows.back() << " after settling, seam error "
+			<< scientific << seamError << fixed << endl;
+
+		if(!holesOk)
+			cout << "  a level's hole does not match the finer level's footprint" << endl;
+		if(seamError > 1e-5f)
+			cout << "  a level's boundary leaves the surface of the level around it" << endl;
+		if(!stable)
+			cout << "  the clipmap is unstable" << endl;
+
+		return holesOk && seamError <= 1e-5f && stable;
+	}
+
+	// Rain over the whole of a square of the given extent, centred on the origin.
+	template<typename F>
+	void Rain(float extent, int frame, const F& disturb)
+	{
+		const float spacing = extent / 8.0f;
+		for(int k = 0; k < 4; ++k)
+		{
+			int cell = (frame*4 + k)*37 % 64;
+			disturb(((cell % 8) + 0.5f)*spacing - 0.5f*extent, ((cell / 8) + 0.5f)*spacing - 0.5f*extent);
+		}
+	}
+
+	void TimeLake()
+	{
+		const float dt = 0.03f;
+
+		// Four levels of 129 points, one metre apart at the finest: 1024 m across.
+		const int levels = 4, n = 129;
+		const float extent = (float)((n - 1) << (levels - 1));
+
+		ClipmapWaves clipmap(levels, n, 1.0f, dt, 3.25f, 0.4f);
+		int frame = 0;
+		double clipmapNs = TimeCall([&]()
+		{
+			Rain(extent, frame++, [&](float x, float z) { clipmap.Disturb(x, z, 0.5f); });
+			clipmap.Update(dt);
+		});
+
+		const int single = (int)extent + 1;
+		Waves lake(single, single, 1.0f, dt, 3.25f, 0.4f);
+		frame = 0;
+		double lakeNs = TimeCall([&]()
+		{
+			Rain(extent, frame++, [&](float x, float z)
+			{
+				lake.Disturb((int)(0.5f*extent - z), (int)(x + 0.5f*extent), 0.5f);
+			});
+			lake.Update(dt);
+		});
+
+		Waves demo(200, 200, 0.8f, dt, 3.25f, 0.4f);
+		frame = 0;
+		double demoNs = TimeCall([&]()
+		{
+			Rain(150.0f, frame++, [&](float x, float z)
+			{
+				demo.Disturb((int)((75.0f - z) / 0.8f), (int)((x + 75.0f) / 0.8f), 0.5f);
+			});
+			demo.Update(dt);
+		});
+
+		cout << "a " << (int)extent << " m lake in rain" << endl
+			<< "  ClipmapWaves " << levels << "x" << n << "x" << n << setw(14) << clipmapNs / 1000.0 << " us/update" << endl
+			<< "  one " << single << "x" << single << " grid   " << setw(14) << lakeNs / 1000.0 << " us/update" << endl
+			<< "  the demo's 200x200 grid" << setw(11) << demoNs / 1000.0 << " us/update" << endl;
+	}
+}
+
+int main()
+{
+	cout << setw(24) << left << "solver" << setw(6) << right << "n"
+		<< setw(14) << "us/update" << setw(14) << "ns/vertex" << endl;
+
+	const int sizes[] = { 128, 256, 512, 1024 };
+	for(int n : sizes)
+	{
+		const float dt = 0.03f;
+
+		{
+			Waves waves(n, n, 1.0f, dt, 3.25f, 0.4f);
+
+			// Splash all over the grid and never let a tile go quiet.
+			waves.SetQuiescenceThreshold(0.0f);
+			for(int i = 4; i < n - 4; i += 16)
+			{
+				for(int j = 4; j < n - 4; j += 16)
+					waves.Disturb(i, j, 0.5f);
+			}
+			waves.Update(dt);
+
+			Report("Waves (all active)", n, TimeCall([&]() { waves.Update(dt); }));
+		}
+
+		{
+			SpectralOcean::Desc desc;
+			desc.Resolution = n;
+			desc.PatchSize = (float)n;
+			SpectralOcean ocean(desc);
+
+			Report("SpectralOcean", n, TimeCall([&]() { ocean.Update(dt); }));
+
+			desc.Choppiness = 1.0f;
+			SpectralOcean choppy(desc);
+
+			Report("SpectralOcean (choppy)", n, TimeCall([&]() { choppy.Update(dt); }));
+		}
+	}
+
+	bool ok = CheckClipmap();
+	TimeLake();
+
+	return ok ? 0 : 1;
+}
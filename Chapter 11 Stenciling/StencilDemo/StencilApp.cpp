@@ -6,6 +6,9 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/MeshCache.h"
+#include "../../Common/D3DAssetUploader.h"
+#include "../../Common/D3DResourceCache.h"
 #include "FrameResource.h"
 
 using Microsoft::WRL::ComPtr;
@@ -89,6 +92,9 @@ private:
 	void UpdateReflectedPassCB(const GameTimer& gt);
 
 	void LoadTextures();
+	void LoadTextureAsync(const std::string& name, const std::wstring& filename, UINT srvHeapIndex,
+		const std::string& material);
+	void SetSkullGeometry(MeshGeometry* geo);
     void BuildRootSignature();
 	void BuildDescriptorHeaps();
     void BuildShadersAndInputLayout();
@@ -116,7 +122,15 @@ private:
 
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
 	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
-	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
+	std::unordered_map<std::string, std::shared_ptr<Texture>> mTextures;
+
+	// The skull and the textures other than white1x1 are loaded in the background;
+	// until they arrive the skull is drawn as a sphere and the textured surfaces
+	// with white1x1.
+	std::unique_ptr<D3DAssetUploader> mAssetUploader;
+	std::unique_ptr<AssetLoader> mAssets;
+	AssetHandle<MeshGeometry> mSkullGeo;
+	std::unordered_map<std::string, AssetHandle<Texture>> mTextureLoads;
 	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
 	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
 
@@ -180,7 +194,12 @@ StencilApp::StencilApp(HINSTANCE hInstance)
 StencilApp::~StencilApp()
 {
     if(md3dDevice != nullptr)
+    {
         FlushCommandQueue();
+
+        // Drops the device's texture cache; its textures go with mTextures.
+        D3DResourceCache::ReleaseDevice(md3dDevice.Get());
+    }
 }
 
 bool StencilApp::Initialize()
@@ -195,6 +214,9 @@ bool StencilApp::Initialize()
 	// so we have to query this information.
     mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
+	mAssetUploader = std::make_unique<D3DAssetUploader>(md3dDevice.Get(), mCommandQueue.Get());
+	mAssets = std::make_unique<AssetLoader>(*mAssetUploader);
+
 	LoadTextures();
     BuildRootSignature();
 	BuildDescriptorHeaps();
@@ -245,6 +267,10 @@ void StencilApp::Update(const GameTimer& gt)
         CloseHandle(eventHandle);
     }
 
+	// Upload whatever has finished loading, a few megabytes a frame at most, ahead
+	// of this frame's commands.
+	mAssets->Update(8*1024*1024);
+
 	AnimateMaterials(gt);
 	UpdateObjectCBs(gt);
 	UpdateMaterialCBs(gt);
@@ -556,38 +582,46 @@ void StencilApp::UpdateReflectedPassCB(const GameTimer& gt)
 
 void StencilApp::LoadTextures()
 {
-	auto bricksTex = std::make_unique<Texture>();
-	bricksTex->Name = "bricksTex";
-	bricksTex->Filename = L"../../Textures/bricks3.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), bricksTex->Filename.c_str(),
-		bricksTex->Resource, bricksTex->UploadHeap));
-
-	auto checkboardTex = std::make_unique<Texture>();
-	checkboardTex->Name = "checkboardTex";
-	checkboardTex->Filename = L"../../Textures/checkboard.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), checkboardTex->Filename.c_str(),
-		checkboardTex->Resource, checkboardTex->UploadHeap));
-
-	auto iceTex = std::make_unique<Texture>();
-	iceTex->Name = "iceTex";
-	iceTex->Filename = L"../../Textures/ice.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), iceTex->Filename.c_str(),
-		iceTex->Resource, iceTex->UploadHeap));
-
-	auto white1x1Tex = std::make_unique<Texture>();
-	white1x1Tex->Name = "white1x1Tex";
-	white1x1Tex->Filename = L"../../Textures/white1x1.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), white1x1Tex->Filename.c_str(),
-		white1x1Tex->Resource, white1x1Tex->UploadHeap));
-
-	mTextures[bricksTex->Name] = std::move(bricksTex);
-	mTextures[checkboardTex->Name] = std::move(checkboardTex);
-	mTextures[iceTex->Name] = std::move(iceTex);
-	mTextures[white1x1Tex->Name] = std::move(white1x1Tex);
+	// white1x1 stands in for the other textures until they arrive, so it is loaded
+	// up front.  It is shared with any other scene on the device that uses it.
+	mTextures["white1x1Tex"] = D3DResourceCache::LoadTexture(md3dDevice.Get(),
+		mCommandList.Get(), "white1x1Tex", L"../../Textures/white1x1.dds");
+
+	LoadTextureAsync("bricksTex", L"../../Textures/bricks3.dds", 0, "bricks");
+	LoadTextureAsync("checkboardTex", L"../../Textures/checkboard.dds", 1, "checkertile");
+	LoadTextureAsync("iceTex", L"../../Textures/ice.dds", 2, "icemirror");
+}
+
+void StencilApp::LoadTextureAsync(const std::string& name, const std::wstring& filename, UINT srvHeapIndex,
+	const std::string& material)
+{
+	mTextureLoads[name] = mAssets->LoadTexture(name, filename, mTextures["white1x1Tex"].get(),
+		[this, name, srvHeapIndex, material](bool loaded)
+	{
+		const AssetHandle<Texture>& tex = mTextureLoads[name];
+		if(!loaded)
+		{
+			::OutputDebugStringA((tex.Error() + "\n").c_str());
+			return;
+		}
+
+		// No frame has used this descriptor yet: the material has been drawing with
+		// white1x1 until now.
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+		hDescriptor.Offset(srvHeapIndex, mCbvSrvDescriptorSize);
+
+		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.Format = tex->Resource->GetDesc().Format;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		srvDesc.Texture2D.MipLevels = -1;
+		md3dDevice->CreateShaderResourceView(tex->Resource.Get(), &srvDesc, hDescriptor);
+
+		Material* mat = mMaterials[material].get();
+		mat->DiffuseSrvHeapIndex = srvHeapIndex;
+		mat->NumFramesDirty = gNumFrameResources;
+	});
 }
 
 void StencilApp::BuildRootSignature()
@@ -644,37 +678,19 @@ void StencilApp::BuildDescriptorHeaps()
 	//
 	// Fill out the heap with actual descriptors.
 	//
+	// The bricks, checkboard and ice descriptors (0, 1 and 2) are written as their
+	// textures arrive; see LoadTextureAsync.
 	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+	hDescriptor.Offset(3, mCbvSrvDescriptorSize);
 
-	auto bricksTex = mTextures["bricksTex"]->Resource;
-	auto checkboardTex = mTextures["checkboardTex"]->Resource;
-	auto iceTex = mTextures["iceTex"]->Resource;
 	auto white1x1Tex = mTextures["white1x1Tex"]->Resource;
 
 	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	srvDesc.Format = bricksTex->GetDesc().Format;
+	srvDesc.Format = white1x1Tex->GetDesc().Format;
 	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
 	srvDesc.Texture2D.MostDetailedMip = 0;
 	srvDesc.Texture2D.MipLevels = -1;
-	md3dDevice->CreateShaderResourceView(bricksTex.Get(), &srvDesc, hDescriptor);
-
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-
-	srvDesc.Format = checkboardTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(checkboardTex.Get(), &srvDesc, hDescriptor);
-
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-
-	srvDesc.Format = iceTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(iceTex.Get(), &srvDesc, hDescriptor);
-
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-
-	srvDesc.Format = white1x1Tex->GetDesc().Format;
 	md3dDevice->CreateShaderResourceView(white1x1Tex.Get(), &srvDesc, hDescriptor);
 }
 
@@ -820,54 +836,28 @@ void StencilApp::BuildRoomGeometry()
 
 void StencilApp::BuildSkullGeometry()
 {
-	std::ifstream fin("Models/skull.txt");
-	
-	if(!fin)
-	{
-		MessageBox(0, L"Models/skull.txt not found.", 0, 0);
-		return;
-	}
+	//
+	// A sphere about the skull's size is drawn until the skull has loaded.
+	//
 
-	UINT vcount = 0;
-	UINT tcount = 0;
-	std::string ignore;
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(3.0f, 20, 20);
 
-	fin >> ignore >> vcount;
-	fin >> ignore >> tcount;
-	fin >> ignore >> ignore >> ignore >> ignore;
-	
-	std::vector<Vertex> vertices(vcount);
-	for(UINT i = 0; i < vcount; ++i)
+	std::vector<Vertex> vertices(sphere.Vertices.size());
+	for(size_t i = 0; i < sphere.Vertices.size(); ++i)
 	{
-		fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-		fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
-
-		// Model does not have texture coordinates, so just zero them out.
-		vertices[i].TexC = { 0.0f, 0.0f };
+		vertices[i].Pos = sphere.Vertices[i].Position;
+		vertices[i].Normal = sphere.Vertices[i].Normal;
+		vertices[i].TexC = sphere.Vertices[i].TexC;
 	}
 
-	fin >> ignore;
-	fin >> ignore;
-	fin >> ignore;
-
-	std::vector<std::int32_t> indices(3 * tcount);
-	for(UINT i = 0; i < tcount; ++i)
-	{
-		fin >> indices[i*3+0] >> indices[i*3+1] >> indices[i*3+2];
-	}
+	std::vector<std::uint16_t> indices = sphere.GetIndices16();
 
-	fin.close();
- 
-	//
-	// Pack the indices of all the meshes into one index buffer.
-	//
- 
 	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::int32_t);
+	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
 	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "skullGeo";
+	geo->Name = "skullPlaceholderGeo";
 
 	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
 	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
@@ -883,7 +873,7 @@ void StencilApp::BuildSkullGeometry()
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
 	SubmeshGeometry submesh;
@@ -893,7 +883,59 @@ void StencilApp::BuildSkullGeometry()
 
 	geo->DrawArgs["skull"] = submesh;
 
+	MeshGeometry* placeholder = geo.get();
 	mGeometries[geo->Name] = std::move(geo);
+
+	//
+	// The skull itself is read on a worker.
+	//
+
+	auto decodeSkull = [](MeshData& mesh, std::string& error)
+	{
+		MeshCache skull;
+		if(!skull.Open(L"Models/skull.txt"))
+		{
+			error = "Models/skull.txt: " + skull.Error();
+			return false;
+		}
+
+		UINT vcount = skull.VertexCount();
+
+		std::vector<Vertex> vertices(vcount);
+		for(UINT i = 0; i < vcount; ++i)
+		{
+			vertices[i].Pos = skull.Vertices()[i].Pos;
+			vertices[i].Normal = skull.Vertices()[i].Normal;
+
+			// Model does not have texture coordinates, so just zero them out.
+			vertices[i].TexC = { 0.0f, 0.0f };
+		}
+
+		mesh.SetVertices(vertices);
+		mesh.Indices.assign(skull.Indices(), skull.Indices() + skull.IndexCount());
+		return true;
+	};
+
+	mSkullGeo = mAssets->LoadMesh("skull", decodeSkull, placeholder, [this](bool loaded)
+	{
+		if(loaded)
+			SetSkullGeometry(mSkullGeo.Get());
+		else
+			MessageBoxA(0, mSkullGeo.Error().c_str(), 0, 0);
+	});
+}
+
+void StencilApp::SetSkullGeometry(MeshGeometry* geo)
+{
+	const SubmeshGeometry& submesh = geo->DrawArgs["skull"];
+
+	for(RenderItem* ri : { mSkullRitem, mReflectedSkullRitem, mShadowedSkullRitem })
+	{
+		ri->Geo = geo;
+		ri->IndexCount = submesh.IndexCount;
+		ri->StartIndexLocation = submesh.StartIndexLocation;
+		ri->BaseVertexLocation = submesh.BaseVertexLocation;
+	}
 }
 
 void StencilApp::BuildPSOs()
@@ -1052,7 +1094,7 @@ void StencilApp::BuildMaterials()
 	auto bricks = std::make_unique<Material>();
 	bricks->Name = "bricks";
 	bricks->MatCBIndex = 0;
-	bricks->DiffuseSrvHeapIndex = 0;
+	bricks->DiffuseSrvHeapIndex = 3; // white1x1 until bricks3 has loaded
 	bricks->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
 	bricks->FresnelR0 = XMFLOAT3(0.05f, 0.05f, 0.05f);
 	bricks->Roughness = 0.25f;
@@ -1060,7 +1102,7 @@ void StencilApp::BuildMaterials()
 	auto checkertile = std::make_unique<Material>();
 	checkertile->Name = "checkertile";
 	checkertile->MatCBIndex = 1;
-	checkertile->DiffuseSrvHeapIndex = 1;
+	checkertile->DiffuseSrvHeapIndex = 3; // white1x1 until checkboard has loaded
 	checkertile->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
 	checkertile->FresnelR0 = XMFLOAT3(0.07f, 0.07f, 0.07f);
 	checkertile->Roughness = 0.3f;
@@ -1068,7 +1110,7 @@ void StencilApp::BuildMaterials()
 	auto icemirror = std::make_unique<Material>();
 	icemirror->Name = "icemirror";
 	icemirror->MatCBIndex = 2;
-	icemirror->DiffuseSrvHeapIndex = 2;
+	icemirror->DiffuseSrvHeapIndex = 3; // white1x1 until ice has loaded
 	icemirror->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 0.3f);
 	icemirror->FresnelR0 = XMFLOAT3(0.1f, 0.1f, 0.1f);
 	icemirror->Roughness = 0.5f;
@@ -1127,7 +1169,7 @@ void StencilApp::BuildRenderItems()
 	skullRitem->TexTransform = MathHelper::Identity4x4();
 	skullRitem->ObjCBIndex = 2;
 	skullRitem->Mat = mMaterials["skullMat"].get();
-	skullRitem->Geo = mGeometries["skullGeo"].get();
+	skullRitem->Geo = mSkullGeo.Get();
 	skullRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	skullRitem->IndexCount = skullRitem->Geo->DrawArgs["skull"].IndexCount;
 	skullRitem->StartIndexLocation = skullRitem->Geo->DrawArgs["skull"].StartIndexLocation;
@@ -6,6 +6,7 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/Terrain.h"
 #include "FrameResource.h"
 #include "Waves.h"
 
@@ -55,6 +56,7 @@ struct RenderItem
 enum class RenderLayer : int
 {
 	Opaque = 0,
+	Terrain,
 	Transparent,
 	AlphaTested,
 	AlphaTestedTreeSprites,
@@ -87,6 +89,7 @@ private:
 	void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateWaves(const GameTimer& gt); 
+	void UpdateTerrain(const GameTimer& gt);
 
 	void LoadTextures();
     void BuildRootSignature();
@@ -105,7 +108,6 @@ private:
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
 
     float GetHillsHeight(float x, float z)const;
-    XMFLOAT3 GetHillsNormal(float x, float z)const;
 
 private:
 
@@ -130,6 +132,11 @@ private:
 
     RenderItem* mWavesRitem = nullptr;
 
+	// Holds the land's constants and material; the chunks drawn each frame are
+	// copies of it.
+	RenderItem* mLandRitem = nullptr;
+	std::vector<std::unique_ptr<RenderItem>> mTerrainChunkRitems;
+
 	// List of all the render items.
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 
@@ -138,12 +145,17 @@ private:
 
 	std::unique_ptr<Waves> mWaves;
 
+	std::unique_ptr<Terrain> mTerrain;
+	Terrain::Selection mTerrainSelection;
+
     PassConstants mMainPassCB;
 
 	XMFLOAT3 mEyePos = { 0.0f, 0.0f, 0.0f };
 	XMFLOAT4X4 mView = MathHelper::Identity4x4();
 	XMFLOAT4X4 mProj = MathHelper::Identity4x4();
 
+	BoundingFrustum mCamFrustum;
+
     float mTheta = 1.5f*XM_PI;
     float mPhi = XM_PIDIV2 - 0.1f;
     float mRadius = 50.0f;
@@ -230,6 +242,12 @@ void TreeBillboardsApp::OnResize()
     // The window resized, so update the aspect ratio and recompute the projection matrix.
     XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
     XMStoreFloat4x4(&mProj, P);
+
+	BoundingFrustum::CreateFromMatrix(mCamFrustum, P);
+
+	// The terrain's level of detail is chosen in pixels.
+	if(mTerrain != nullptr)
+		mTerrain->SetScreenError(0.25f*MathHelper::Pi, (float)mClientHeight, 2.0f);
 }
 
 void TreeBillboardsApp::Update(const GameTimer& gt)
@@ -256,6 +274,7 @@ void TreeBillboardsApp::Update(const GameTimer& gt)
 	UpdateMaterialCBs(gt);
 	UpdateMainPassCB(gt);
     UpdateWaves(gt);
+	UpdateTerrain(gt);
 }
 
 void TreeBillboardsApp::Draw(const GameTimer& gt)
@@ -293,6 +312,7 @@ void TreeBillboardsApp::Draw(const GameTimer& gt)
 	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
 
     DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Terrain]);
 
 	mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
 	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTested]);
@@ -520,27 +540,59 @@ void TreeBillboardsApp::UpdateWaves(const GameTimer& gt)
 	// Update the wave simulation.
 	mWaves->Update(gt.DeltaTime());
 
-	// Update the wave vertex buffer with the new solution.
+	// Update the wave vertex buffer with the new solution.  The vertices that changed
+	// since this frame resource's buffer was last written go straight into it.
 	auto currWavesVB = mCurrFrameResource->WavesVB.get();
-	for(int i = 0; i < mWaves->VertexCount(); ++i)
-	{
-		Vertex v;
-
-		v.Pos = mWaves->Position(i);
-		v.Normal = mWaves->Normal(i);
-		
-		// Derive tex-coords from position by 
-		// mapping [-w/2,w/2] --> [0,1]
-		v.TexC.x = 0.5f + v.Pos.x / mWaves->Width();
-		v.TexC.y = 0.5f - v.Pos.z / mWaves->Depth();
-
-		currWavesVB->CopyData(i, v);
-	}
+	Waves::VertexLayout layout;
+	layout.Stride = sizeof(Vertex);
+	layout.PositionOffset = offsetof(Vertex, Pos);
+	layout.NormalOffset = offsetof(Vertex, Normal);
+	layout.TexCOffset = offsetof(Vertex, TexC);
+	mWaves->WriteVertices(currWavesVB->MappedData(), layout, mCurrFrameResource->WavesVersion);
+	mCurrFrameResource->WavesVersion = mWaves->Version();
 
 	// Set the dynamic VB of the wave renderitem to the current frame VB.
 	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
 }
 
+void TreeBillboardsApp::UpdateTerrain(const GameTimer& gt)
+{
+	// Select the chunks of land in view, at a level of detail that depends on their
+	// distance, and write them straight into this frame's vertex buffer.
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+
+	BoundingFrustum worldSpaceFrustum;
+	mCamFrustum.Transform(worldSpaceFrustum, invView);
+
+	mTerrain->Select(mEyePos, &worldSpaceFrustum, mTerrainSelection, mTerrain->MaxVertexCount());
+
+	auto currTerrainVB = mCurrFrameResource->TerrainVB.get();
+	GeometryGenerator::VertexLayout layout;
+	layout.Stride = sizeof(Vertex);
+	layout.PositionOffset = offsetof(Vertex, Pos);
+	layout.NormalOffset = offsetof(Vertex, Normal);
+	layout.TexCOffset = offsetof(Vertex, TexC);
+	mTerrain->WriteVertices(mTerrainSelection, mEyePos, currTerrainVB->MappedData(), layout);
+
+	mLandRitem->Geo->VertexBufferGPU = currTerrainVB->Resource();
+
+	// One render item per chunk, all with the land's constants and material.
+	auto& chunkRitems = mRitemLayer[(int)RenderLayer::Terrain];
+	chunkRitems.clear();
+	for(const auto& chunk : mTerrainSelection.Chunks)
+	{
+		if(chunkRitems.size() == mTerrainChunkRitems.size())
+			mTerrainChunkRitems.push_back(std::make_unique<RenderItem>(*mLandRitem));
+
+		RenderItem* ri = mTerrainChunkRitems[chunkRitems.size()].get();
+		ri->IndexCount = chunk.IndexCount;
+		ri->StartIndexLocation = chunk.StartIndex;
+		ri->BaseVertexLocation = chunk.BaseVertex;
+		chunkRitems.push_back(ri);
+	}
+}
+
 void TreeBillboardsApp::LoadTextures()
 {
 	auto grassTex = std::make_unique<Texture>();
@@ -710,42 +762,33 @@ void TreeBillboardsApp::BuildShadersAndInputLayouts()
 
 void TreeBillboardsApp::BuildLandGeometry()
 {
-    GeometryGenerator geoGen;
-    GeometryGenerator::MeshData grid = geoGen.CreateGrid(160.0f, 160.0f, 50, 50);
-
     //
-    // Extract the vertex elements we are interested and apply the height function to
-    // each vertex.  In addition, color the vertices based on their height so we have
-    // sandy looking beaches, grassy low hills, and snow mountain peaks.
+    // Sample the hills into a heightfield and draw it as a Terrain: each frame only
+    // the chunks in view are written to a dynamic vertex buffer (see UpdateTerrain),
+    // all drawn with the same small index buffer.
     //
 
-    std::vector<Vertex> vertices(grid.Vertices.size());
-    for(size_t i = 0; i < grid.Vertices.size(); ++i)
-    {
-        auto& p = grid.Vertices[i].Position;
-        vertices[i].Pos = p;
-        vertices[i].Pos.y = GetHillsHeight(p.x, p.z);
-        vertices[i].Normal = GetHillsNormal(p.x, p.z);
-		vertices[i].TexC = grid.Vertices[i].TexC;
-    }
+	Heightfield heightfield(257, 257, 0.625f);
+	heightfield.Generate([this](float x, float z) { return GetHillsHeight(x, z); });
 
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	mTerrain = std::make_unique<Terrain>(std::move(heightfield), 16);
+	mTerrain->SetScreenError(0.25f*MathHelper::Pi, (float)mClientHeight, 2.0f);
 
-    std::vector<std::uint16_t> indices = grid.GetIndices16();
+    const UINT vbByteSize = mTerrain->MaxVertexCount()*sizeof(Vertex);
+
+    const std::vector<std::uint16_t>& indices = mTerrain->Indices();
     const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "landGeo";
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	// Set dynamically.
+	geo->VertexBufferCPU = nullptr;
+	geo->VertexBufferGPU = nullptr;
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
 		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
@@ -754,20 +797,12 @@ void TreeBillboardsApp::BuildLandGeometry()
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["grid"] = submesh;
-
 	mGeometries["landGeo"] = std::move(geo);
 }
 
 void TreeBillboardsApp::BuildWavesGeometry()
 {
-    std::vector<std::uint16_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
-	assert(mWaves->VertexCount() < 0x0000ffff);
+    std::vector<std::uint32_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
 
     // Iterate over each quad.
     int m = mWaves->RowCount();
@@ -790,7 +825,12 @@ void TreeBillboardsApp::BuildWavesGeometry()
     }
 
 	UINT vbByteSize = mWaves->VertexCount()*sizeof(Vertex);
-	UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint16_t);
+	// The vertices are rewritten in place every frame, so the grid cannot be
+	// split; one too large for 16-bit indices gets 32-bit ones.
+	IndexBuilder::IndexData indexData = IndexBuilder::Build(indices.data(), indices.size(),
+		(UINT)mWaves->VertexCount(), IndexBuilder::SplitMode::None);
+
+	UINT ibByteSize = (UINT)indexData.ByteSize();
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "waterGeo";
@@ -800,20 +840,17 @@ void TreeBillboardsApp::BuildWavesGeometry()
 	geo->VertexBufferGPU = nullptr;
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indexData.Data(), ibByteSize);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		mCommandList.Get(), indexData.Data(), ibByteSize, geo->IndexBufferUploader);
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexFormat = IndexFormat(indexData);
 	geo->IndexBufferByteSize = ibByteSize;
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+	SubmeshGeometry submesh = BuildSubmeshes(indexData, 0)[0];
 
 	geo->DrawArgs["grid"] = submesh;
 
@@ -883,7 +920,7 @@ void TreeBillboardsApp::BuildTreeSpritesGeometry()
 	{
 		float x = MathHelper::RandF(-45.0f, 45.0f);
 		float z = MathHelper::RandF(-45.0f, 45.0f);
-		float y = GetHillsHeight(x, z);
+		float y = mTerrain->HeightAt(x, z);
 
 		// Move tree slightly above land height.
 		y += 8.0f;
@@ -1028,7 +1065,8 @@ void TreeBillboardsApp::BuildFrameResources()
     for(int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount()));
+            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount(),
+            mTerrain->MaxVertexCount()));
     }
 }
 
@@ -1091,6 +1129,7 @@ void TreeBillboardsApp::BuildRenderItems()
 
 	mRitemLayer[(int)RenderLayer::Transparent].push_back(wavesRitem.get());
 
+	// The land is drawn a chunk at a time by copies of this item; see UpdateTerrain.
     auto gridRitem = std::make_unique<RenderItem>();
     gridRitem->World = MathHelper::Identity4x4();
 	XMStoreFloat4x4(&gridRitem->TexTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
@@ -1098,11 +1137,8 @@ void TreeBillboardsApp::BuildRenderItems()
 	gridRitem->Mat = mMaterials["grass"].get();
 	gridRitem->Geo = mGeometries["landGeo"].get();
 	gridRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-    gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-    gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
 
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
+	mLandRitem = gridRitem.get();
 
 	auto boxRitem = std::make_unique<RenderItem>();
 	XMStoreFloat4x4(&boxRitem->World, XMMatrixTranslation(3.0f, 2.0f, -9.0f));
@@ -1226,17 +1262,3 @@ float TreeBillboardsApp::GetHillsHeight(float x, float z)const
 {
     return 0.3f*(z*sinf(0.1f*x) + x*cosf(0.1f*z));
 }
-
-XMFLOAT3 TreeBillboardsApp::GetHillsNormal(float x, float z)const
-{
-    // n = (-df/dx, 1, -df/dz)
-    XMFLOAT3 n(
-        -0.03f*z*cosf(0.1f*x) - 0.3f*cosf(0.1f*z),
-        1.0f,
-        -0.3f*sinf(0.1f*x) + 0.03f*x*sinf(0.1f*z));
-
-    XMVECTOR unitNormal = XMVector3Normalize(XMLoadFloat3(&n));
-    XMStoreFloat3(&n, unitNormal);
-
-    return n;
-}
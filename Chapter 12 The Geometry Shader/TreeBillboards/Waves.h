@@ -9,12 +9,34 @@
 #ifndef WAVES_H
 #define WAVES_H
 
+#include <cstdint>
+#include <mutex>
 #include <vector>
 #include <DirectXMath.h>
 
 class Waves
 {
 public:
+    // A splash centred on grid point (Row, Col).  A point at distance d <= Radius
+    // (in grid points) is raised by Magnitude*2^(-Falloff*(d/Radius)^2), so the
+    // defaults give the classic splat: full magnitude at the centre and half at
+    // the four direct neighbours.
+    struct Impulse
+    {
+        int Row = 0;
+        int Col = 0;
+        float Magnitude = 0.0f;
+        float Radius = 1.0f;
+        float Falloff = 1.0f;
+    };
+
+    // A run of consecutive vertices [First, First+Count).
+    struct VertexRange
+    {
+        int First = 0;
+        int Count = 0;
+    };
+
     Waves(int m, int n, float dx, float dt, float speed, float damping);
     Waves(const Waves& rhs) = delete;
     Waves& operator=(const Waves& rhs) = delete;
@@ -27,19 +49,143 @@ public:
 	float Width()const;
 	float Depth()const;
 
-	// Returns the solution at the ith grid point.
-    const DirectX::XMFLOAT3& Position(int i)const { return mCurrSolution[i]; }
+	// Returns the solution at the ith grid point.  Only the heights are stored, so
+	// the x- and z-coordinates are rebuilt from the fixed grid layout.  With
+	// interpolation enabled the height is blended between the last two solutions.
+    DirectX::XMFLOAT3 Position(int i)const
+    {
+        int row = i / mNumCols;
+        int col = i - row*mNumCols;
+        return DirectX::XMFLOAT3(-mHalfWidth + col*mSpatialStep, Height(i), mHalfDepth - row*mSpatialStep);
+    }
 
-	// Returns the solution normal at the ith grid point.
-    const DirectX::XMFLOAT3& Normal(int i)const { return mNormals[i]; }
+	// Returns the solution normal at the ith grid point.  Normals are not stored;
+	// this evaluates the finite difference on the spot.
+	DirectX::XMFLOAT3 Normal(int i)const;
 
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
-    const DirectX::XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
+	DirectX::XMFLOAT3 TangentX(int i)const;
+
+	// Byte offsets of the vertex attributes WriteVertices() fills in.  An offset of -1
+	// leaves that attribute alone.  Offsets and stride must be multiples of 4.
+	struct VertexLayout
+	{
+		int Stride = 0;
+		int PositionOffset = 0;
+		int NormalOffset = -1;
+		int TangentOffset = -1;
+		int TexCOffset = -1;
+	};
 
+	// Writes the vertices that changed after sinceVersion (see GetChangedVertexRanges)
+	// into dst, which holds VertexCount() vertices laid out as described.  Positions,
+	// normals and tangents are produced in a single parallel pass and written with
+	// streaming stores, so dst is meant to be a mapped upload buffer; it is never read.
+	// Texture coordinates map the grid's [-w/2,w/2] extent to [0,1].
+	void WriteVertices(void* dst, const VertexLayout& layout, std::uint64_t sinceVersion)const;
+
+	// Accumulates dt and runs as many fixed time steps as it covers, but no more
+	// than the catch-up budget; any time beyond that is dropped.
 	void Update(float dt);
+
+	// Queues a classic splat at grid point (i, j); same as AddImpulse({ i, j, magnitude }).
 	void Disturb(int i, int j, float magnitude);
 
+	// Queue impulses to be added to the height field at the start of the next time
+	// step.  Safe to call from any thread, including while another thread updates
+	// the simulation; impulses that arrive during an update wait for the next one.
+	// Parts of an impulse that fall outside the grid interior are clipped.
+	void AddImpulse(const Impulse& impulse);
+	void AddImpulses(const Impulse* impulses, int count);
+
+	// Maximum number of time steps one Update() may run.  Bounds the simulation
+	// cost per frame, so a frame-time spike cannot snowball into ever longer frames.
+	void SetMaxCatchUpSteps(int maxSteps);
+
+	// If enabled, Position() blends between the previous and current solutions by the
+	// fraction of a time step left in the accumulator, so motion stays smooth when
+	// the frame rate and the simulation rate differ.  The result lags by up to one step.
+	void SetInterpolation(bool enable);
+
+	// Blend factor in [0,1] that Position() currently applies.
+	float InterpolationFactor()const;
+
+	// Advances the simulation numSteps time steps right away, independent of the
+	// elapsed time.  Runs of steps are temporally blocked, so catching up or
+	// pre-rolling many steps costs far less memory traffic than repeated updates.
+	void Advance(int numSteps);
+
+	//
+	// Active-region tracking.  The grid is split into TileSize x TileSize tiles.  A
+	// tile is active while it was disturbed recently or any of its heights exceeds
+	// the quiescence threshold; otherwise it is dormant and held at exactly zero.
+	// Only active tiles and their neighbours are stepped and have their vertices
+	// rewritten, so the cost follows the disturbed area rather than the grid size.
+	//
+
+	// Heights below this magnitude are treated as calm water.
+	void SetQuiescenceThreshold(float epsilon);
+
+	int ActiveTileCount()const;
+
+	// Counter that increases whenever vertex data changes.  Remember the value
+	// after copying the vertices out and pass it to GetChangedVertexRanges() next
+	// time to find out what needs copying again.
+	std::uint64_t Version()const;
+
+	// Fills ranges with the vertices whose position or normal changed after
+	// sinceVersion, merging neighbouring ranges.  Passing 0 returns every vertex.
+	void GetChangedVertexRanges(std::uint64_t sinceVersion, std::vector<VertexRange>& ranges)const;
+
+	//
+	// Coupling with other grids, e.g. the levels of a clipmap.  Heights are
+	// addressed by row i and column j and cover both time levels of the solution.
+	//
+
+	void GetHeights(int i, int j, float& prev, float& curr)const;
+
+	// Overwrites both time levels at (i, j), boundary points included.  A boundary
+	// point keeps the value until it is overwritten again.
+	void SetHeights(int i, int j, float prev, float curr);
+
+	// Scrolls the solution so that the new (i, j) holds the old (i+di, j+dj).  Points
+	// scrolled in from outside the grid start out flat and the boundary is cleared.
+	void Shift(int di, int dj);
+
 private:
+	// Columns [First, Last) of a row that a pass has to compute.
+	struct ColumnSpan
+	{
+		int First;
+		int Last;
+	};
+
+	float Height(int i)const
+	{
+		return (1.0f - mAlpha)*mPrevSolution[i] + mAlpha*mCurrSolution[i];
+	}
+
+	void ComputeNormalAndTangent(int i, int j, DirectX::XMFLOAT3& normal, DirectX::XMFLOAT3& tangent)const;
+
+	void Step();
+	void StepBlocked(int numSteps);
+	void UpdateInterpolationFactor();
+
+	void BuildComputeSet();
+	void UpdateTileActivity();
+	void ApplyImpulses();
+
+private:
+	// Steps fused into one temporally blocked pass.  More steps mean more
+	// redundant halo rows per tile, so there is little gain beyond this.
+	static const int MaxStepsPerPass = 8;
+
+	static const int TileSize = 32;
+
+	// A disturbance travels at most one grid point per step, so within one pass it
+	// cannot cross more than a single tile.
+	static_assert(MaxStepsPerPass <= TileSize, "Tiles must be at least as wide as a blocked pass.");
+
     int mNumRows = 0;
     int mNumCols = 0;
 
@@ -54,10 +200,47 @@ private:
     float mTimeStep = 0.0f;
     float mSpatialStep = 0.0f;
 
-    std::vector<DirectX::XMFLOAT3> mPrevSolution;
-    std::vector<DirectX::XMFLOAT3> mCurrSolution;
-    std::vector<DirectX::XMFLOAT3> mNormals;
-    std::vector<DirectX::XMFLOAT3> mTangentX;
+    // Simulation time not yet consumed by a time step.
+    float mAccumulatedTime = 0.0f;
+    int mMaxCatchUpSteps = MaxStepsPerPass;
+
+    bool mInterpolate = false;
+    float mAlpha = 1.0f;
+
+    float mHalfWidth = 0.0f;
+    float mHalfDepth = 0.0f;
+
+    // Heights of the previous and current solutions, stored as contiguous
+    // planes (structure of arrays) so the stencil can process several
+    // columns per SIMD instruction.
+    std::vector<float> mPrevSolution;
+    std::vector<float> mCurrSolution;
+
+    // Output of a temporally blocked pass before it is copied back.
+    std::vector<float> mNextPrevSolution;
+    std::vector<float> mNextCurrSolution;
+
+    int mTileRows = 0;
+    int mTileCols = 0;
+    float mQuiescenceThreshold = 1.0e-4f;
+
+    std::vector<std::uint8_t> mTileActive;
+
+    // Version at which each tile's vertices last changed.
+    std::vector<std::uint64_t> mTileVersion;
+    std::uint64_t mVersion = 1;
+
+    // Tiles the current pass computes (active tiles and their neighbours), and the
+    // same set as merged column spans per tile row.
+    std::vector<int> mComputeTiles;
+    std::vector<std::vector<ColumnSpan>> mComputeSpans;
+
+    // Impulses queued since the last step, guarded by mImpulseMutex.  They are
+    // moved into mImpulses and sorted into per-tile-row buckets when applied.
+    std::mutex mImpulseMutex;
+    std::vector<Impulse> mPendingImpulses;
+    std::vector<Impulse> mImpulses;
+    std::vector<std::vector<int>> mImpulseBuckets;
 };
 
-#endif // WAVES_H
\ No newline at end of file
+#endif // WAVES_H
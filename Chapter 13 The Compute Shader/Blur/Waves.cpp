@@ -3,13 +3,108 @@
 //***************************************************************************************
 
 #include "Waves.h"
-#include <ppl.h>
+#include "../../Common/TaskSystem.h"
 #include <algorithm>
 #include <vector>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 using namespace DirectX;
 
+namespace
+{
+	// Updates count consecutive interior points of a grid row in place:
+	//
+	//   prev[j] = k1*prev[j] + k2*curr[j] + k3*(down[j] + up[j] + curr[j+1] + curr[j-1])
+	//
+	// where up/down are the current solution rows above and below.  All pointers
+	// point at the first column to update, so curr[-1] and curr[count] must be
+	// readable.  The bulk of the run is done 8 (AVX2) or 4 (SSE) columns at a
+	// time, and any leftover columns are done scalar.
+	void UpdateRow(float* prev, const float* curr, const float* up, const float* down,
+		int count, float k1, float k2, float k3)
+	{
+		int j = 0;
+
+#if defined(__AVX2__)
+		const __m256 k1x8 = _mm256_set1_ps(k1);
+		const __m256 k2x8 = _mm256_set1_ps(k2);
+		const __m256 k3x8 = _mm256_set1_ps(k3);
+		for(; j + 8 <= count; j += 8)
+		{
+			__m256 sum = _mm256_add_ps(
+				_mm256_add_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j)),
+				_mm256_add_ps(_mm256_loadu_ps(curr + j + 1), _mm256_loadu_ps(curr + j - 1)));
+
+			__m256 h = _mm256_mul_ps(k1x8, _mm256_loadu_ps(prev + j));
+			h = _mm256_fmadd_ps(k2x8, _mm256_loadu_ps(curr + j), h);
+			h = _mm256_fmadd_ps(k3x8, sum, h);
+
+			_mm256_storeu_ps(prev + j, h);
+		}
+#endif
+
+#if defined(_XM_SSE_INTRINSICS_)
+		const __m128 k1x4 = _mm_set1_ps(k1);
+		const __m128 k2x4 = _mm_set1_ps(k2);
+		const __m128 k3x4 = _mm_set1_ps(k3);
+		for(; j + 4 <= count; j += 4)
+		{
+			__m128 sum = _mm_add_ps(
+				_mm_add_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j)),
+				_mm_add_ps(_mm_loadu_ps(curr + j + 1), _mm_loadu_ps(curr + j - 1)));
+
+			__m128 h = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(k1x4, _mm_loadu_ps(prev + j)), _mm_mul_ps(k2x4, _mm_loadu_ps(curr + j))),
+				_mm_mul_ps(k3x4, sum));
+
+			_mm_storeu_ps(prev + j, h);
+		}
+#endif
+
+		for(; j < count; ++j)
+		{
+			prev[j] = k1*prev[j] + k2*curr[j] + k3*(down[j] + up[j] + curr[j+1] + curr[j-1]);
+		}
+	}
+
+	// Writes count floats to dst with non-temporal stores.  Upload heaps are
+	// write-combined memory, so bypassing the cache avoids polluting it with data
+	// the CPU never reads back.
+	void StreamFloats(std::uint8_t* dst, const float* src, int count)
+	{
+#if defined(_XM_SSE_INTRINSICS_)
+		for(int k = 0; k < count; ++k)
+			_mm_stream_si32(reinterpret_cast<int*>(dst) + k, _mm_cvtsi128_si32(_mm_castps_si128(_mm_load_ss(src + k))));
+#else
+		std::memcpy(dst, src, count*sizeof(float));
+#endif
+	}
+
+	void StreamFence()
+	{
+#if defined(_XM_SSE_INTRINSICS_)
+		_mm_sfence();
+#endif
+	}
+
+	// Rows handed to each task.  A single row is far too little work to be worth
+	// scheduling, so batch rows until a task covers roughly 16K grid points.
+	int RowGrain(int numCols)
+	{
+		return std::max(1, 16384 / std::max(1, numCols));
+	}
+}
+
+// Definitions for the constants that std::min/std::max bind by reference.
+const int Waves::MaxStepsPerPass;
+const int Waves::TileSize;
+
 Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
 {
     mNumRows = m;
@@ -27,28 +122,23 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
     mK2 = (4.0f - 8.0f*e) / d;
     mK3 = (2.0f*e) / d;
 
-    mPrevSolution.resize(m*n);
-    mCurrSolution.resize(m*n);
-    mNormals.resize(m*n);
-    mTangentX.resize(m*n);
-
-    // Generate grid vertices in system memory.
+    // The grid x/z-coordinates are fixed; Position() derives them from these.
+    mHalfWidth = (n - 1)*dx*0.5f;
+    mHalfDepth = (m - 1)*dx*0.5f;
 
-    float halfWidth = (n - 1)*dx*0.5f;
-    float halfDepth = (m - 1)*dx*0.5f;
-    for(int i = 0; i < m; ++i)
-    {
-        float z = halfDepth - i*dx;
-        for(int j = 0; j < n; ++j)
-        {
-            float x = -halfWidth + j*dx;
+    mPrevSolution.assign(m*n, 0.0f);
+    mCurrSolution.assign(m*n, 0.0f);
+    mNextPrevSolution.resize(m*n);
+    mNextCurrSolution.resize(m*n);
 
-            mPrevSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mCurrSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mNormals[i*n + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            mTangentX[i*n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
-        }
-    }
+    // The water starts out flat, so every tile is dormant.  Stamp them all with the
+    // initial version so clients copy the whole grid the first time.
+    mTileRows = (m + TileSize - 1) / TileSize;
+    mTileCols = (n + TileSize - 1) / TileSize;
+    mTileActive.assign(mTileRows*mTileCols, 0);
+    mTileVersion.assign(mTileRows*mTileCols, mVersion);
+    mComputeSpans.resize(mTileRows);
+    mImpulseBuckets.resize(mTileRows);
 }
 
 Waves::~Waves()
@@ -87,86 +177,608 @@ float Waves::Depth()const
 
 void Waves::Update(float dt)
 {
-	static float t = 0;
-
 	// Accumulate time.
-	t += dt;
+	mAccumulatedTime += dt;
+
+	// Only update the simulation in multiples of the specified time step.
+	int numSteps = (int)(mAccumulatedTime / mTimeStep);
+	mAccumulatedTime -= numSteps*mTimeStep;
+
+	// Past the budget we fall behind real time rather than spend more per frame.
+	numSteps = std::min(numSteps, mMaxCatchUpSteps);
+
+	Advance(numSteps);
+
+	float oldAlpha = mAlpha;
+	UpdateInterpolationFactor();
+
+	// Dormant tiles are flat in both solutions, so a new blend factor only moves
+	// the vertices of active tiles.  The normals along a dormant tile's edges take
+	// differences across into its active neighbours, though, so it is marked too:
+	// the same dilated set a step computes.
+	if(numSteps == 0 && mAlpha != oldAlpha)
+	{
+		++mVersion;
+		BuildComputeSet();
+		for(int tile : mComputeTiles)
+			mTileVersion[tile] = mVersion;
+	}
+}
+
+void Waves::SetMaxCatchUpSteps(int maxSteps)
+{
+	mMaxCatchUpSteps = std::max(1, maxSteps);
+}
+
+void Waves::SetInterpolation(bool enable)
+{
+	mInterpolate = enable;
+	UpdateInterpolationFactor();
+}
 
-	// Only update the simulation at the specified time step.
-	if( t >= mTimeStep )
+float Waves::InterpolationFactor()const
+{
+	return mAlpha;
+}
+
+void Waves::UpdateInterpolationFactor()
+{
+	// An alpha of exactly 1 makes Position() return the current solution unchanged.
+	mAlpha = 1.0f;
+	if(mInterpolate)
+		mAlpha = std::min(std::max(mAccumulatedTime / mTimeStep, 0.0f), 1.0f);
+}
+
+void Waves::Advance(int numSteps)
+{
+	if(numSteps <= 0)
+		return;
+
+	++mVersion;
+
+	ApplyImpulses();
+
+	// Several steps at once are done in temporally blocked passes, each advancing
+	// up to MaxStepsPerPass steps while the data stays in cache.
+	while(numSteps > 0)
 	{
-		// Only update interior points; we use zero boundary conditions.
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows-1; ++i)
+		BuildComputeSet();
+		if(mComputeTiles.empty())
+			break; // All calm; nothing can change.
+
+		int k = std::min(numSteps, MaxStepsPerPass);
+		if(k == 1)
+			Step();
+		else
+			StepBlocked(k);
+
+		UpdateTileActivity();
+
+		numSteps -= k;
+	}
+}
+
+void Waves::Step()
+{
+	const int n = mNumCols;
+
+	// Only update interior points; we use zero boundary conditions.
+	TaskSystem::Default().ParallelFor(1, mNumRows - 1, RowGrain(mNumCols), [this, n](int i)
+	//for(int i = 1; i < mNumRows-1; ++i)
+	{
+		// After this update we will be discarding the old previous
+		// buffer, so overwrite that buffer with the new update.
+		// Note how we can do this inplace (read/write to same element)
+		// because we won't need prev_ij again and the assignment happens last.
+
+		// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+		// Moreover, our +z axis goes "down"; this is just to
+		// keep consistent with our row indices going down.
+		for(const ColumnSpan& span : mComputeSpans[i / TileSize])
+		{
+			int first = std::max(span.First, 1);
+			int last = std::min(span.Last, n - 1);
+			if(first >= last)
+				continue;
+
+			const float* curr = &mCurrSolution[i*n + first];
+			UpdateRow(&mPrevSolution[i*n + first], curr, curr - n, curr + n,
+				last - first, mK1, mK2, mK3);
+		}
+	});
+
+	// We just overwrote the previous buffer with the new data, so
+	// this data needs to become the current solution and the old
+	// current solution becomes the new previous solution.  Points
+	// outside the compute set are zero in both, so swapping is safe.
+	std::swap(mPrevSolution, mCurrSolution);
+}
+
+void Waves::StepBlocked(int numSteps)
+{
+	//
+	// Overlapped (trapezoid) tiling.  The grid is cut into bands of rows.  Each band
+	// is copied into a small tile together with numSteps halo rows above and below,
+	// and all numSteps steps are run on the tile while it sits in L2.  Every step
+	// invalidates one more halo row on each side (those rows' neighbours are stale),
+	// so after numSteps steps exactly the band's own rows are still correct.  The
+	// halo rows are computed redundantly by neighbouring tiles; that is the price
+	// for streaming the full grid through memory once instead of numSteps times.
+	// Rows 0 and m-1 are fixed boundary rows, so the halo never shrinks there.
+	//
+	// Only the compute set is stepped; everything else is zero and stays zero for
+	// the whole pass.  Tiles read the old solution and write the new one to separate
+	// arrays, so they can run in parallel without seeing each other's results.
+	//
+
+	const int m = mNumRows;
+	const int n = mNumCols;
+
+	// Size bands so a tile (band plus halo, two solutions) is about 256KB.
+	const int tileBudgetRows = (int)(256*1024 / (2*sizeof(float)*n));
+	const int bandRows = std::max(numSteps, tileBudgetRows - 2*numSteps);
+	const int bandCount = (m + bandRows - 1) / bandRows;
+
+	TaskSystem::Default().ParallelFor(0, bandCount, 1, [&](int band)
+	{
+		const int r0 = band*bandRows;
+		const int r1 = std::min(m, r0 + bandRows);
+		const int lo = std::max(0, r0 - numSteps);
+		const int hi = std::min(m, r1 + numSteps);
+
+		// Columns touched by the compute spans of this band's rows, plus one on
+		// either side for the stencil.
+		int c0 = n;
+		int c1 = 0;
+		for(int ti = lo / TileSize; ti <= (hi - 1) / TileSize; ++ti)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
+			for(const ColumnSpan& span : mComputeSpans[ti])
 			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
+				c0 = std::min(c0, span.First);
+				c1 = std::max(c1, span.Last);
 			}
-		});
+		}
+
+		if(c0 >= c1)
+			return;
+
+		c0 = std::max(0, c0 - 1);
+		c1 = std::min(n, c1 + 1);
+		const int w = c1 - c0;
 
-		// We just overwrote the previous buffer with the new data, so
-		// this data needs to become the current solution and the old
-		// current solution becomes the new previous solution.
-		std::swap(mPrevSolution, mCurrSolution);
+		// Reused between passes so the tiles are not reallocated every time.
+		thread_local std::vector<float> tilePrev;
+		thread_local std::vector<float> tileCurr;
+		tilePrev.resize((hi - lo)*w);
+		tileCurr.resize((hi - lo)*w);
+		for(int i = lo; i < hi; ++i)
+		{
+			std::copy_n(&mPrevSolution[i*n + c0], w, &tilePrev[(i - lo)*w]);
+			std::copy_n(&mCurrSolution[i*n + c0], w, &tileCurr[(i - lo)*w]);
+		}
 
-		t = 0.0f; // reset time
+		float* prev = tilePrev.data();
+		float* curr = tileCurr.data();
 
-		//
-		// Compute normals using finite difference scheme.
-		//
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows - 1; ++i)
+		// Rows [validLo, validHi) hold correct values for the current step.
+		int validLo = lo;
+		int validHi = hi;
+		for(int s = 0; s < numSteps; ++s)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
+			int first = std::max(validLo + 1, 1);
+			int last = std::min(validHi - 1, m - 1);
+			for(int i = first; i < last; ++i)
 			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
+				for(const ColumnSpan& span : mComputeSpans[i / TileSize])
+				{
+					int a = std::max(span.First, 1);
+					int b = std::min(span.Last, n - 1);
+					if(a >= b)
+						continue;
+
+					const float* c = curr + (i - lo)*w + (a - c0);
+					UpdateRow(prev + (i - lo)*w + (a - c0), c, c - w, c + w, b - a, mK1, mK2, mK3);
+				}
 			}
-		});
+			std::swap(prev, curr);
+
+			if(validLo > 0) ++validLo;
+			if(validHi < m) --validHi;
+		}
+
+		for(int i = std::max(r0, 1); i < std::min(r1, m - 1); ++i)
+		{
+			for(const ColumnSpan& span : mComputeSpans[i / TileSize])
+			{
+				int a = std::max(span.First, 1);
+				int b = std::min(span.Last, n - 1);
+				if(a >= b)
+					continue;
+
+				std::copy(prev + (i - lo)*w + (a - c0), prev + (i - lo)*w + (b - c0), &mNextPrevSolution[i*n + a]);
+				std::copy(curr + (i - lo)*w + (a - c0), curr + (i - lo)*w + (b - c0), &mNextCurrSolution[i*n + a]);
+			}
+		}
+	});
+
+	// All tiles are done reading the old solution; move the new one into place.
+	TaskSystem::Default().ParallelFor(1, m - 1, RowGrain(n), [&](int i)
+	{
+		for(const ColumnSpan& span : mComputeSpans[i / TileSize])
+		{
+			int a = std::max(span.First, 1);
+			int b = std::min(span.Last, n - 1);
+			if(a >= b)
+				continue;
+
+			std::copy(&mNextPrevSolution[i*n + a], &mNextPrevSolution[i*n + b], &mPrevSolution[i*n + a]);
+			std::copy(&mNextCurrSolution[i*n + a], &mNextCurrSolution[i*n + b], &mCurrSolution[i*n + a]);
+		}
+	});
+}
+
+void Waves::BuildComputeSet()
+{
+	// A tile is computed if it or any of its eight neighbours is active: within one
+	// pass a disturbance can spread into, but not across, a neighbouring tile.
+	mComputeTiles.clear();
+	for(int ti = 0; ti < mTileRows; ++ti)
+	{
+		mComputeSpans[ti].clear();
+		for(int tj = 0; tj < mTileCols; ++tj)
+		{
+			bool compute = false;
+			for(int di = std::max(ti - 1, 0); di <= std::min(ti + 1, mTileRows - 1) && !compute; ++di)
+			{
+				for(int dj = std::max(tj - 1, 0); dj <= std::min(tj + 1, mTileCols - 1) && !compute; ++dj)
+					compute = mTileActive[di*mTileCols + dj] != 0;
+			}
+
+			if(!compute)
+				continue;
+
+			mComputeTiles.push_back(ti*mTileCols + tj);
+
+			int first = tj*TileSize;
+			int last = std::min(mNumCols, first + TileSize);
+			auto& spans = mComputeSpans[ti];
+			if(!spans.empty() && spans.back().Last == first)
+				spans.back().Last = last;
+			else
+				spans.push_back({ first, last });
+		}
+	}
+}
+
+void Waves::UpdateTileActivity()
+{
+	const int n = mNumCols;
+	const float epsilon = mQuiescenceThreshold;
+
+	TaskSystem::Default().ParallelFor(0, (int)mComputeTiles.size(), 4, [&](int k)
+	{
+		int tile = mComputeTiles[k];
+		int i0 = (tile / mTileCols)*TileSize;
+		int j0 = (tile % mTileCols)*TileSize;
+		int i1 = std::min(mNumRows, i0 + TileSize);
+		int j1 = std::min(n, j0 + TileSize);
+
+		float maxAbs = 0.0f;
+		for(int i = i0; i < i1; ++i)
+		{
+			for(int j = j0; j < j1; ++j)
+			{
+				maxAbs = std::max(maxAbs, std::fabs(mPrevSolution[i*n + j]));
+				maxAbs = std::max(maxAbs, std::fabs(mCurrSolution[i*n + j]));
+			}
+		}
+
+		// Settle calm tiles to exactly zero, which is what lets later passes skip
+		// them without changing the result.
+		bool active = maxAbs > epsilon;
+		if(!active)
+		{
+			for(int i = i0; i < i1; ++i)
+			{
+				std::fill(&mPrevSolution[i*n + j0], &mPrevSolution[i*n + j0] + (j1 - j0), 0.0f);
+				std::fill(&mCurrSolution[i*n + j0], &mCurrSolution[i*n + j0] + (j1 - j0), 0.0f);
+			}
+		}
+
+		mTileActive[tile] = active ? 1 : 0;
+		mTileVersion[tile] = mVersion;
+	});
+}
+
+XMFLOAT3 Waves::Normal(int i)const
+{
+	XMFLOAT3 normal, tangent;
+	ComputeNormalAndTangent(i / mNumCols, i % mNumCols, normal, tangent);
+	return normal;
+}
+
+XMFLOAT3 Waves::TangentX(int i)const
+{
+	XMFLOAT3 normal, tangent;
+	ComputeNormalAndTangent(i / mNumCols, i % mNumCols, normal, tangent);
+	return tangent;
+}
+
+void Waves::ComputeNormalAndTangent(int i, int j, XMFLOAT3& normal, XMFLOAT3& tangent)const
+{
+	// The boundary is held flat.
+	if(i == 0 || j == 0 || i == mNumRows - 1 || j == mNumCols - 1)
+	{
+		normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+		tangent = XMFLOAT3(1.0f, 0.0f, 0.0f);
+		return;
 	}
+
+	//
+	// Compute normals using finite difference scheme.
+	//
+	float l = Height(i*mNumCols+j-1);
+	float r = Height(i*mNumCols+j+1);
+	float t = Height((i-1)*mNumCols+j);
+	float b = Height((i+1)*mNumCols+j);
+
+	XMVECTOR N = XMVector3Normalize(XMVectorSet(-r+l, 2.0f*mSpatialStep, b-t, 0.0f));
+	XMStoreFloat3(&normal, N);
+
+	XMVECTOR T = XMVector3Normalize(XMVectorSet(2.0f*mSpatialStep, r-l, 0.0f, 0.0f));
+	XMStoreFloat3(&tangent, T);
+}
+
+void Waves::WriteVertices(void* dst, const VertexLayout& layout, std::uint64_t sinceVersion)const
+{
+	assert(layout.Stride % 4 == 0);
+	assert(layout.PositionOffset % 4 == 0);
+	assert(layout.NormalOffset < 0 || layout.NormalOffset % 4 == 0);
+	assert(layout.TangentOffset < 0 || layout.TangentOffset % 4 == 0);
+	assert(layout.TexCOffset < 0 || layout.TexCOffset % 4 == 0);
+
+	std::uint8_t* vertices = static_cast<std::uint8_t*>(dst);
+	const int n = mNumCols;
+	const float width = Width();
+	const float depth = Depth();
+
+	TaskSystem::Default().ParallelForRange(0, mNumRows, RowGrain(n), [&](int begin, int end)
+	{
+		for(int i = begin; i < end; ++i)
+		{
+			const std::uint64_t* versions = &mTileVersion[(i / TileSize)*mTileCols];
+			for(int tj = 0; tj < mTileCols; ++tj)
+			{
+				if(versions[tj] <= sinceVersion)
+					continue;
+
+				int last = std::min(n, (tj + 1)*TileSize);
+				for(int j = tj*TileSize; j < last; ++j)
+				{
+					std::uint8_t* v = vertices + (size_t)(i*n + j)*layout.Stride;
+
+					XMFLOAT3 pos = Position(i*n + j);
+					if(layout.PositionOffset >= 0)
+						StreamFloats(v + layout.PositionOffset, &pos.x, 3);
+
+					if(layout.NormalOffset >= 0 || layout.TangentOffset >= 0)
+					{
+						XMFLOAT3 normal, tangent;
+						ComputeNormalAndTangent(i, j, normal, tangent);
+						if(layout.NormalOffset >= 0)
+							StreamFloats(v + layout.NormalOffset, &normal.x, 3);
+						if(layout.TangentOffset >= 0)
+							StreamFloats(v + layout.TangentOffset, &tangent.x, 3);
+					}
+
+					if(layout.TexCOffset >= 0)
+					{
+						float texC[2] = { 0.5f + pos.x / width, 0.5f - pos.z / depth };
+						StreamFloats(v + layout.TexCOffset, texC, 2);
+					}
+				}
+			}
+		}
+
+		// Streaming stores are weakly ordered; make them visible before the
+		// caller goes on to submit GPU work that reads the buffer.
+		StreamFence();
+	});
+}
+
+void Waves::SetQuiescenceThreshold(float epsilon)
+{
+	mQuiescenceThreshold = epsilon;
+}
+
+int Waves::ActiveTileCount()const
+{
+	return (int)std::count(mTileActive.begin(), mTileActive.end(), 1);
+}
+
+std::uint64_t Waves::Version()const
+{
+	return mVersion;
+}
+
+void Waves::GetChangedVertexRanges(std::uint64_t sinceVersion, std::vector<VertexRange>& ranges)const
+{
+	ranges.clear();
+
+	for(int i = 0; i < mNumRows; ++i)
+	{
+		const std::uint64_t* versions = &mTileVersion[(i / TileSize)*mTileCols];
+		for(int tj = 0; tj < mTileCols; ++tj)
+		{
+			if(versions[tj] <= sinceVersion)
+				continue;
+
+			int first = i*mNumCols + tj*TileSize;
+			int count = std::min(TileSize, mNumCols - tj*TileSize);
+
+			// Extend the previous range if this one continues it, which also joins
+			// ranges across rows when whole rows changed.
+			if(!ranges.empty() && ranges.back().First + ranges.back().Count == first)
+				ranges.back().Count += count;
+			else
+				ranges.push_back({ first, count });
+		}
+	}
+}
+
+void Waves::GetHeights(int i, int j, float& prev, float& curr)const
+{
+	prev = mPrevSolution[i*mNumCols + j];
+	curr = mCurrSolution[i*mNumCols + j];
+}
+
+void Waves::SetHeights(int i, int j, float prev, float curr)
+{
+	mPrevSolution[i*mNumCols + j] = prev;
+	mCurrSolution[i*mNumCols + j] = curr;
+
+	// Keep the tile stepping while it holds the imposed values.
+	int tile = (i / TileSize)*mTileCols + (j / TileSize);
+	mTileActive[tile] = 1;
+	mTileVersion[tile] = ++mVersion;
+}
+
+void Waves::Shift(int di, int dj)
+{
+	if(di == 0 && dj == 0)
+		return;
+
+	const int m = mNumRows;
+	const int n = mNumCols;
+
+	// The blocked pass output arrays double as scratch space.
+	auto shift = [&](std::vector<float>& solution, std::vector<float>& scratch)
+	{
+		TaskSystem::Default().ParallelFor(0, m, RowGrain(n), [&](int i)
+		{
+			float* dst = &scratch[i*n];
+			std::fill(dst, dst + n, 0.0f);
+
+			int si = i + di;
+			if(si <= 0 || si >= m - 1 || i == 0 || i == m - 1)
+				return;
+
+			int first = std::max(1, 1 - dj);
+			int last = std::min(n - 1, n - 1 - dj);
+			if(first < last)
+				std::copy(&solution[si*n + first + dj], &solution[si*n + last + dj], dst + first);
+		});
+
+		solution.swap(scratch);
+	};
+
+	shift(mPrevSolution, mNextPrevSolution);
+	shift(mCurrSolution, mNextCurrSolution);
+
+	// The next pass sorts out which tiles are really active.
+	++mVersion;
+	std::fill(mTileActive.begin(), mTileActive.end(), 1);
+	std::fill(mTileVersion.begin(), mTileVersion.end(), mVersion);
 }
 
 void Waves::Disturb(int i, int j, float magnitude)
 {
-	// Don't disturb boundaries.
-	assert(i > 1 && i < mNumRows-2);
-	assert(j > 1 && j < mNumCols-2);
+	Impulse impulse;
+	impulse.Row = i;
+	impulse.Col = j;
+	impulse.Magnitude = magnitude;
+
+	AddImpulse(impulse);
+}
+
+void Waves::AddImpulse(const Impulse& impulse)
+{
+	std::lock_guard<std::mutex> lock(mImpulseMutex);
+	mPendingImpulses.push_back(impulse);
+}
+
+void Waves::AddImpulses(const Impulse* impulses, int count)
+{
+	std::lock_guard<std::mutex> lock(mImpulseMutex);
+	mPendingImpulses.insert(mPendingImpulses.end(), impulses, impulses + count);
+}
+
+void Waves::ApplyImpulses()
+{
+	{
+		std::lock_guard<std::mutex> lock(mImpulseMutex);
+		mImpulses.swap(mPendingImpulses);
+	}
+
+	if(mImpulses.empty())
+		return;
+
+	// Footprint of an impulse clipped to the grid interior; the boundary stays at zero.
+	auto footprint = [this](const Impulse& impulse, int& i0, int& i1, int& j0, int& j1)
+	{
+		int r = std::max(0, (int)impulse.Radius);
+		i0 = std::max(impulse.Row - r, 1);
+		i1 = std::min(impulse.Row + r + 1, mNumRows - 1);
+		j0 = std::max(impulse.Col - r, 1);
+		j1 = std::min(impulse.Col + r + 1, mNumCols - 1);
+		return i0 < i1 && j0 < j1;
+	};
+
+	// Bucket the impulses by the tile rows they cover.  Each task then owns one tile
+	// row, so impulses can be rasterised in parallel without two tasks ever writing
+	// the same height, and overlapping impulses still add up in submission order.
+	for(auto& bucket : mImpulseBuckets)
+		bucket.clear();
+
+	for(int k = 0; k < (int)mImpulses.size(); ++k)
+	{
+		int i0, i1, j0, j1;
+		if(!footprint(mImpulses[k], i0, i1, j0, j1))
+			continue;
 
-	float halfMag = 0.5f*magnitude;
+		for(int ti = i0 / TileSize; ti <= (i1 - 1) / TileSize; ++ti)
+			mImpulseBuckets[ti].push_back(k);
+	}
+
+	const int n = mNumCols;
+	TaskSystem::Default().ParallelFor(0, mTileRows, 1, [&](int ti)
+	{
+		const int rowFirst = ti*TileSize;
+		const int rowLast = std::min(mNumRows, rowFirst + TileSize);
+
+		for(int k : mImpulseBuckets[ti])
+		{
+			const Impulse& impulse = mImpulses[k];
+
+			int i0, i1, j0, j1;
+			footprint(impulse, i0, i1, j0, j1);
+			i0 = std::max(i0, rowFirst);
+			i1 = std::min(i1, rowLast);
+
+			float radiusSq = impulse.Radius*impulse.Radius;
+			for(int i = i0; i < i1; ++i)
+			{
+				for(int j = j0; j < j1; ++j)
+				{
+					float di = (float)(i - impulse.Row);
+					float dj = (float)(j - impulse.Col);
+					float distSq = di*di + dj*dj;
+					if(distSq > radiusSq)
+						continue;
+
+					float weight = radiusSq > 0.0f ? std::exp2(-impulse.Falloff*distSq/radiusSq) : 1.0f;
+					mCurrSolution[i*n + j] += impulse.Magnitude*weight;
+				}
+			}
+
+			// Wake the tiles the impulse landed in.
+			for(int tj = j0 / TileSize; tj <= (j1 - 1) / TileSize; ++tj)
+			{
+				mTileActive[ti*mTileCols + tj] = 1;
+				mTileVersion[ti*mTileCols + tj] = mVersion;
+			}
+		}
+	});
 
-	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+	mImpulses.clear();
 }
-	
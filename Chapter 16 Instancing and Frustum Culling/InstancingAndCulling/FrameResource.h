@@ -9,9 +9,10 @@ struct InstanceData
 	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 	UINT MaterialIndex;
-	UINT InstancePad0;
-	UINT InstancePad1;
-	UINT InstancePad2;
+
+	// Scales the decoded normal so that World, which has the position decode
+	// folded in, maps it back to the right direction.
+	DirectX::XMFLOAT3 NormalScale = { 1.0f, 1.0f, 1.0f };
 };
 
 struct PassConstants
@@ -7,6 +7,10 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/BoundsBuilder.h"
+#include "../../Common/MeshSimplifier.h"
+#include "../../Common/VertexCompression.h"
+#include "../../Common/MeshCache.h"
 #include "FrameResource.h"
 
 using Microsoft::WRL::ComPtr;
@@ -18,6 +22,9 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
+// Levels of detail built for the skull, including the full mesh.
+const int gSkullLodCount = 5;
+
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
 struct RenderItem
@@ -48,13 +55,28 @@ struct RenderItem
     D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
 	BoundingBox Bounds;
+	BoundingSphere Sphere;
 	std::vector<InstanceData> Instances;
 
+	// World space bounds of each instance, for culling without inverting its world
+	// matrix.  The instances never move, so these are computed once.
+	std::vector<BoundingBox> InstanceBounds;
+
+	// The vertex positions are quantised to Bounds; this maps them back to local
+	// space and is folded into each instance's world matrix.
+	XMFLOAT4X4 PositionDecode = MathHelper::Identity4x4();
+	XMFLOAT3 NormalScale = { 1.0f, 1.0f, 1.0f };
+
     // DrawIndexedInstanced parameters.
     UINT IndexCount = 0;
 	UINT InstanceCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+	// Levels of detail, finest first.  The visible instances are grouped by level
+	// in the instance buffer, and each level is drawn with its own call.
+	std::vector<SubmeshGeometry> Lods;
+	std::vector<UINT> LodInstanceCounts;
 };
 
 class InstancingAndCullingApp : public D3DApp
@@ -124,6 +146,10 @@ private:
 	UINT mInstanceCount = 0;
 
 	bool mFrustumCullingEnabled = true;
+	bool mLodEnabled = true;
+
+	// Largest screen-space error, in pixels, allowed when picking a level of detail.
+	float mMaxPixelError = 1.0f;
 
 	BoundingFrustum mCamFrustum;
 
@@ -355,6 +381,12 @@ void InstancingAndCullingApp::OnKeyboardInput(const GameTimer& gt)
 	if(GetAsyncKeyState('2') & 0x8000)
 		mFrustumCullingEnabled = false;
 
+	if(GetAsyncKeyState('3') & 0x8000)
+		mLodEnabled = true;
+
+	if(GetAsyncKeyState('4') & 0x8000)
+		mLodEnabled = false;
+
 	mCamera.UpdateViewMatrix();
 }
  
@@ -368,47 +400,97 @@ void InstancingAndCullingApp::UpdateInstanceData(const GameTimer& gt)
 	XMMATRIX view = mCamera.GetView();
 	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
 
+	// Transform the camera frustum from view space to world space once, and test it
+	// against each instance's world space bounds.
+	BoundingFrustum worldSpaceFrustum;
+	mCamFrustum.Transform(worldSpaceFrustum, invView);
+
+	// Model units at distance 1 to pixels.
+	const float unitsToPixels = mClientHeight / (2.0f*tanf(0.5f*mCamera.GetFovY()));
+	XMVECTOR eyePos = mCamera.GetPosition();
+
 	auto currInstanceBuffer = mCurrFrameResource->InstanceBuffer.get();
 	for(auto& e : mAllRitems)
 	{
 		const auto& instanceData = e->Instances;
 
-		int visibleInstanceCount = 0;
+		const int lodCount = (int)e->Lods.size();
+		std::vector<float> lodErrors(lodCount);
+		for(int lod = 0; lod < lodCount; ++lod)
+			lodErrors[lod] = e->Lods[lod].GeometricError;
+
+		// Level of detail of each instance, or -1 if it is culled.
+		std::vector<int> instanceLods(instanceData.size(), -1);
+		e->LodInstanceCounts.assign(lodCount, 0);
 
 		for(UINT i = 0; i < (UINT)instanceData.size(); ++i)
 		{
 			XMMATRIX world = XMLoadFloat4x4(&instanceData[i].World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&instanceData[i].TexTransform);
 
-			XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(world), world);
+			if((worldSpaceFrustum.Contains(e->InstanceBounds[i]) != DirectX::DISJOINT) || (mFrustumCullingEnabled==false))
+			{
+				int lod = 0;
+				if(mLodEnabled)
+				{
+					// Project the error from the point of the bounds nearest the camera.
+					const BoundingSphere& sphere = e->Sphere;
+
+					float scale = XMVectorGetX(XMVectorMax(XMVector3Length(world.r[0]),
+						XMVectorMax(XMVector3Length(world.r[1]), XMVector3Length(world.r[2]))));
+					XMVECTOR center = XMVector3TransformCoord(XMLoadFloat3(&sphere.Center), world);
+					float distance = XMVectorGetX(XMVector3Length(center - eyePos)) - scale*sphere.Radius;
+					distance = MathHelper::Max(distance, mCamera.GetNearZ());
+
+					lod = MeshSimplifier::SelectLod(lodErrors.data(), lodCount,
+						scale*unitsToPixels/distance, mMaxPixelError);
+				}
+
+				instanceLods[i] = lod;
+				e->LodInstanceCounts[lod]++;
+			}
+		}
+
+		// Write the instance data to structured buffer for the visible objects,
+		// grouped by level of detail.
+		std::vector<UINT> lodOffsets(lodCount, 0);
+		for(int lod = 1; lod < lodCount; ++lod)
+			lodOffsets[lod] = lodOffsets[lod - 1] + e->LodInstanceCounts[lod - 1];
 
-			// View space to the object's local space.
-			XMMATRIX viewToLocal = XMMatrixMultiply(invView, invWorld);
- 
-			// Transform the camera frustum from view space to the object's local space.
-			BoundingFrustum localSpaceFrustum;
-			mCamFrustum.Transform(localSpaceFrustum, viewToLocal);
+		XMMATRIX positionDecode = XMLoadFloat4x4(&e->PositionDecode);
 
-			// Perform the box/frustum intersection test in local space.
-			if((localSpaceFrustum.Contains(e->Bounds) != DirectX::DISJOINT) || (mFrustumCullingEnabled==false))
-			{
-				InstanceData data;
-				XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
-				XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(texTransform));
-				data.MaterialIndex = instanceData[i].MaterialIndex;
+		for(UINT i = 0; i < (UINT)instanceData.size(); ++i)
+		{
+			if(instanceLods[i] < 0)
+				continue;
 
-				// Write the instance data to structured buffer for the visible objects.
-				currInstanceBuffer->CopyData(visibleInstanceCount++, data);
-			}
+			XMMATRIX world = XMLoadFloat4x4(&instanceData[i].World);
+			XMMATRIX texTransform = XMLoadFloat4x4(&instanceData[i].TexTransform);
+
+			InstanceData data;
+			XMStoreFloat4x4(&data.World, XMMatrixTranspose(positionDecode*world));
+			XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(texTransform));
+			data.MaterialIndex = instanceData[i].MaterialIndex;
+			data.NormalScale = e->NormalScale;
+
+			currInstanceBuffer->CopyData(lodOffsets[instanceLods[i]]++, data);
 		}
 
-		e->InstanceCount = visibleInstanceCount;
+		e->InstanceCount = 0;
+		for(UINT count : e->LodInstanceCounts)
+			e->InstanceCount += count;
 
 		std::wostringstream outs;
 		outs.precision(6);
 		outs << L"Instancing and Culling Demo" <<
 			L"    " << e->InstanceCount <<
 			L" objects visible out of " << e->Instances.size();
+
+		if(mLodEnabled)
+		{
+			outs << L", per level of detail";
+			for(UINT count : e->LodInstanceCounts)
+				outs << L" " << count;
+		}
 		mMainWndCaption = outs.str();
 	}
 }
@@ -662,43 +744,32 @@ void InstancingAndCullingApp::BuildShadersAndInputLayout()
 	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
 	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "PS", "ps_5_1");
 	
+	// VertexCompression::Vertex; the tangent is not used.
     mInputLayout =
     {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
     };
 }
 
 void InstancingAndCullingApp::BuildSkullGeometry()
 {
-	std::ifstream fin("Models/skull.txt");
+	MeshCache skull;
 
-	if(!fin)
+	if(!skull.Open(L"Models/skull.txt"))
 	{
-		MessageBox(0, L"Models/skull.txt not found.", 0, 0);
+		MessageBox(0, AnsiToWString("Models/skull.txt: " + skull.Error()).c_str(), 0, 0);
 		return;
 	}
 
-	UINT vcount = 0;
-	UINT tcount = 0;
-	std::string ignore;
-
-	fin >> ignore >> vcount;
-	fin >> ignore >> tcount;
-	fin >> ignore >> ignore >> ignore >> ignore;
-
-	XMFLOAT3 vMinf3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
-	XMFLOAT3 vMaxf3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
-
-	XMVECTOR vMin = XMLoadFloat3(&vMinf3);
-	XMVECTOR vMax = XMLoadFloat3(&vMaxf3);
+	UINT vcount = skull.VertexCount();
 
 	std::vector<Vertex> vertices(vcount);
 	for(UINT i = 0; i < vcount; ++i)
 	{
-		fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-		fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
+		vertices[i].Pos = skull.Vertices()[i].Pos;
+		vertices[i].Normal = skull.Vertices()[i].Normal;
 
 		XMVECTOR P = XMLoadFloat3(&vertices[i].Pos);
 
@@ -718,32 +789,54 @@ void InstancingAndCullingApp::BuildSkullGeometry()
 		float v = phi / XM_PI;
 
 		vertices[i].TexC = { u, v };
-
-		vMin = XMVectorMin(vMin, P);
-		vMax = XMVectorMax(vMax, P);
 	}
 
-	BoundingBox bounds;
-	XMStoreFloat3(&bounds.Center, 0.5f*(vMin + vMax));
-	XMStoreFloat3(&bounds.Extents, 0.5f*(vMax - vMin));
+	// The box is what the positions are quantised to; the tighter sphere is used to
+	// pick levels of detail.
+	BoundingBox bounds = skull.Box();
+	BoundingSphere sphere = skull.Sphere();
+
+	std::vector<std::int32_t> indices(skull.Indices(), skull.Indices() + skull.IndexCount());
+
+	//
+	// Build the levels of detail, each with about half the triangles of the one
+	// before, and pack their indices into one index buffer after the full mesh.
+	//
 
-	fin >> ignore;
-	fin >> ignore;
-	fin >> ignore;
+	std::vector<MeshSimplifier::Lod> lods = MeshSimplifier::BuildLodChain(vertices.data(), sizeof(Vertex),
+		vcount, offsetof(Vertex, Pos), indices.data(), indices.size(), gSkullLodCount);
 
-	std::vector<std::int32_t> indices(3 * tcount);
-	for(UINT i = 0; i < tcount; ++i)
+	std::vector<SubmeshGeometry> lodSubmeshes;
+	for(const auto& lod : lods)
 	{
-		fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
+		SubmeshGeometry submesh;
+		submesh.IndexCount = (UINT)lod.Indices.size();
+		submesh.StartIndexLocation = (UINT)indices.size();
+		submesh.BaseVertexLocation = 0;
+		submesh.Bounds = bounds;
+		submesh.Sphere = sphere;
+		submesh.GeometricError = lod.Error;
+		lodSubmeshes.push_back(submesh);
+
+		if(lodSubmeshes.size() > 1)
+			indices.insert(indices.end(), lod.Indices.begin(), lod.Indices.end());
 	}
 
-	fin.close();
-
 	//
-	// Pack the indices of all the meshes into one index buffer.
+	// Compress the vertices for the GPU, quantising the positions to the bounds
+	// used for culling.
 	//
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	VertexCompression::SourceLayout layout;
+	layout.Stride = sizeof(Vertex);
+	layout.PositionOffset = offsetof(Vertex, Pos);
+	layout.NormalOffset = offsetof(Vertex, Normal);
+	layout.TexCOffset = offsetof(Vertex, TexC);
+
+	std::vector<VertexCompression::Vertex> compressedVertices(vcount);
+	VertexCompression::Compress(vertices.data(), layout, vcount, bounds, compressedVertices.data());
+
+	const UINT vbByteSize = (UINT)compressedVertices.size() * sizeof(VertexCompression::Vertex);
 
 	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::int32_t);
 
@@ -751,29 +844,28 @@ void InstancingAndCullingApp::BuildSkullGeometry()
 	geo->Name = "skullGeo";
 
 	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), compressedVertices.data(), vbByteSize);
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
 	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+		mCommandList.Get(), compressedVertices.data(), vbByteSize, geo->VertexBufferUploader);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
 		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
-	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexByteStride = sizeof(VertexCompression::Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-	submesh.Bounds = bounds;
+	// Level 0 is the input mesh at the start of the buffer.
+	lodSubmeshes[0].StartIndexLocation = 0;
 
-	geo->DrawArgs["skull"] = submesh;
+	geo->DrawArgs["skull"] = lodSubmeshes[0];
+	for(size_t lod = 1; lod < lodSubmeshes.size(); ++lod)
+		geo->DrawArgs["skull_lod" + std::to_string(lod)] = lodSubmeshes[lod];
 
 	mGeometries[geo->Name] = std::move(geo);
 }
@@ -901,6 +993,20 @@ void InstancingAndCullingApp::BuildRenderItems()
 	skullRitem->StartIndexLocation = skullRitem->Geo->DrawArgs["skull"].StartIndexLocation;
 	skullRitem->BaseVertexLocation = skullRitem->Geo->DrawArgs["skull"].BaseVertexLocation;
 	skullRitem->Bounds = skullRitem->Geo->DrawArgs["skull"].Bounds;
+	skullRitem->Sphere = skullRitem->Geo->DrawArgs["skull"].Sphere;
+	XMStoreFloat4x4(&skullRitem->PositionDecode, VertexCompression::PositionDecodeTransform(skullRitem->Bounds));
+
+	// Normals go through World as well, so undo the decode's scaling on them.
+	const XMFLOAT3& extents = skullRitem->Bounds.Extents;
+	skullRitem->NormalScale = XMFLOAT3(1.0f / extents.x, 1.0f / extents.y, 1.0f / extents.z);
+
+	skullRitem->Lods.push_back(skullRitem->Geo->DrawArgs["skull"]);
+	for(int lod = 1; lod < gSkullLodCount; ++lod)
+	{
+		auto it = skullRitem->Geo->DrawArgs.find("skull_lod" + std::to_string(lod));
+		if(it != skullRitem->Geo->DrawArgs.end())
+			skullRitem->Lods.push_back(it->second);
+	}
 
 	// Generate instance data.
 	const int n = 5;
@@ -938,6 +1044,9 @@ void InstancingAndCullingApp::BuildRenderItems()
 		}
 	}
 
+	skullRitem->InstanceBounds.resize(mInstanceCount);
+	BoundsBuilder::TransformBoxes(skullRitem->Bounds, &skullRitem->Instances[0].World, sizeof(InstanceData),
+		mInstanceCount, skullRitem->InstanceBounds.data());
 
 	mAllRitems.push_back(std::move(skullRitem));
 	
@@ -960,9 +1069,24 @@ void InstancingAndCullingApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList
 		// Set the instance buffer to use for this render-item.  For structured buffers, we can bypass 
 		// the heap and set as a root descriptor.
 		auto instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
-		mCommandList->SetGraphicsRootShaderResourceView(0, instanceBuffer->GetGPUVirtualAddress());
+		D3D12_GPU_VIRTUAL_ADDRESS instanceAddress = instanceBuffer->GetGPUVirtualAddress();
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, ri->InstanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+		// One draw per level of detail.  SV_InstanceID does not include the start
+		// instance, so each draw points the root descriptor at its own instances.
+		for(size_t lod = 0; lod < ri->Lods.size(); ++lod)
+		{
+			const SubmeshGeometry& submesh = ri->Lods[lod];
+			UINT instanceCount = ri->LodInstanceCounts[lod];
+
+			if(instanceCount > 0)
+			{
+				mCommandList->SetGraphicsRootShaderResourceView(0, instanceAddress);
+				cmdList->DrawIndexedInstanced(submesh.IndexCount, instanceCount,
+					submesh.StartIndexLocation, submesh.BaseVertexLocation, 0);
+			}
+
+			instanceAddress += instanceCount*sizeof(InstanceData);
+		}
     }
 }
 
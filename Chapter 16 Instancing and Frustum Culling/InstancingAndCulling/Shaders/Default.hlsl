@@ -23,9 +23,7 @@ struct InstanceData
 	float4x4 World;
 	float4x4 TexTransform;
 	uint     MaterialIndex;
-	uint     InstPad0;
-	uint     InstPad1;
-	uint     InstPad2;
+	float3   NormalScale;
 };
 
 struct MaterialData
@@ -82,13 +80,24 @@ cbuffer cbPass : register(b0)
     Light gLights[MaxLights];
 };
 
+// Positions are 16-bit unorms within the mesh bounds, which World maps back to
+// model space.  Normals are octahedral encoded (see Common/VertexCompression.h).
 struct VertexIn
 {
 	float3 PosL    : POSITION;
-    float3 NormalL : NORMAL;
+    float2 NormalL : NORMAL;
 	float2 TexC    : TEXCOORD;
 };
 
+float3 OctahedralDecode(float2 e)
+{
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    if(n.z < 0.0f)
+        n.xy = (1.0f - abs(n.yx))*(n.xy >= 0.0f ? 1.0f : -1.0f);
+
+    return normalize(n);
+}
+
 struct VertexOut
 {
 	float4 PosH    : SV_POSITION;
@@ -121,7 +130,7 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)world);
+    vout.NormalW = mul(OctahedralDecode(vin.NormalL)*instData.NormalScale, (float3x3)world);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
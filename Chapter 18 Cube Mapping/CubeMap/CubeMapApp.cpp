@@ -7,6 +7,7 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/MeshCache.h"
 #include "FrameResource.h"
 
 using Microsoft::WRL::ComPtr;
@@ -736,57 +737,28 @@ void CubeMapApp::BuildShapeGeometry()
 
 void CubeMapApp::BuildSkullGeometry()
 {
-    std::ifstream fin("Models/skull.txt");
+    MeshCache skull;
 
-    if (!fin)
+    if (!skull.Open(L"Models/skull.txt"))
     {
-        MessageBox(0, L"Models/skull.txt not found.", 0, 0);
+        MessageBox(0, AnsiToWString("Models/skull.txt: " + skull.Error()).c_str(), 0, 0);
         return;
     }
 
-    UINT vcount = 0;
-    UINT tcount = 0;
-    std::string ignore;
-
-    fin >> ignore >> vcount;
-    fin >> ignore >> tcount;
-    fin >> ignore >> ignore >> ignore >> ignore;
-
-    XMFLOAT3 vMinf3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
-    XMFLOAT3 vMaxf3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
-
-    XMVECTOR vMin = XMLoadFloat3(&vMinf3);
-    XMVECTOR vMax = XMLoadFloat3(&vMaxf3);
+    UINT vcount = skull.VertexCount();
 
     std::vector<Vertex> vertices(vcount);
     for (UINT i = 0; i < vcount; ++i)
     {
-        fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-        fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
+        vertices[i].Pos = skull.Vertices()[i].Pos;
+        vertices[i].Normal = skull.Vertices()[i].Normal;
 
         vertices[i].TexC = { 0.0f, 0.0f };
-
-        XMVECTOR P = XMLoadFloat3(&vertices[i].Pos);
-
-        vMin = XMVectorMin(vMin, P);
-        vMax = XMVectorMax(vMax, P);
     }
 
-    BoundingBox bounds;
-    XMStoreFloat3(&bounds.Center, 0.5f*(vMin + vMax));
-    XMStoreFloat3(&bounds.Extents, 0.5f*(vMax - vMin));
-
-    fin >> ignore;
-    fin >> ignore;
-    fin >> ignore;
-
-    std::vector<std::int32_t> indices(3 * tcount);
-    for (UINT i = 0; i < tcount; ++i)
-    {
-        fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
-    }
+    BoundingBox bounds = skull.Box();
 
-    fin.close();
+    std::vector<std::int32_t> indices(skull.Indices(), skull.Indices() + skull.IndexCount());
 
     //
     // Pack the indices of all the meshes into one index buffer.
@@ -7,6 +7,8 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/TangentGenerator.h"
+#include "../../Common/MeshCache.h"
 #include "FrameResource.h"
 #include "ShadowMap.h"
 
@@ -950,76 +952,58 @@ void ShadowMapApp::BuildShapeGeometry()
 
 void ShadowMapApp::BuildSkullGeometry()
 {
-    std::ifstream fin("Models/skull.txt");
+    MeshCache skull;
 
-    if (!fin)
+    if (!skull.Open(L"Models/skull.txt"))
     {
-        MessageBox(0, L"Models/skull.txt not found.", 0, 0);
+        MessageBox(0, AnsiToWString("Models/skull.txt: " + skull.Error()).c_str(), 0, 0);
         return;
     }
 
-    UINT vcount = 0;
-    UINT tcount = 0;
-    std::string ignore;
-
-    fin >> ignore >> vcount;
-    fin >> ignore >> tcount;
-    fin >> ignore >> ignore >> ignore >> ignore;
-
-    XMFLOAT3 vMinf3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
-    XMFLOAT3 vMaxf3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
-
-    XMVECTOR vMin = XMLoadFloat3(&vMinf3);
-    XMVECTOR vMax = XMLoadFloat3(&vMaxf3);
+    UINT vcount = skull.VertexCount();
 
     std::vector<Vertex> vertices(vcount);
     for (UINT i = 0; i < vcount; ++i)
     {
-        fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-        fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
-
-        vertices[i].TexC = { 0.0f, 0.0f };
+        vertices[i].Pos = skull.Vertices()[i].Pos;
+        vertices[i].Normal = skull.Vertices()[i].Normal;
 
         XMVECTOR P = XMLoadFloat3(&vertices[i].Pos);
 
-        XMVECTOR N = XMLoadFloat3(&vertices[i].Normal);
-
-        // Generate a tangent vector so normal mapping works.  We aren't applying
-        // a texture map to the skull, so we just need any tangent vector so that
-        // the math works out to give us the original interpolated vertex normal.
-        XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-        if(fabsf(XMVectorGetX(XMVector3Dot(N, up))) < 1.0f - 0.001f)
-        {
-            XMVECTOR T = XMVector3Normalize(XMVector3Cross(up, N));
-            XMStoreFloat3(&vertices[i].TangentU, T);
-        }
-        else
-        {
-            up = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
-            XMVECTOR T = XMVector3Normalize(XMVector3Cross(N, up));
-            XMStoreFloat3(&vertices[i].TangentU, T);
-        }
-        
-
-        vMin = XMVectorMin(vMin, P);
-        vMax = XMVectorMax(vMax, P);
-    }
+        // Project point onto unit sphere and generate spherical texture coordinates,
+        // so the skull can be given tangents and normal mapped.
+        XMFLOAT3 spherePos;
+        XMStoreFloat3(&spherePos, XMVector3Normalize(P));
 
-    BoundingBox bounds;
-    XMStoreFloat3(&bounds.Center, 0.5f*(vMin + vMax));
-    XMStoreFloat3(&bounds.Extents, 0.5f*(vMax - vMin));
+        float theta = atan2f(spherePos.z, spherePos.x);
 
-    fin >> ignore;
-    fin >> ignore;
-    fin >> ignore;
+        // Put in [0, 2pi].
+        if(theta < 0.0f)
+            theta += XM_2PI;
 
-    std::vector<std::int32_t> indices(3 * tcount);
-    for (UINT i = 0; i < tcount; ++i)
-    {
-        fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
+        float phi = acosf(spherePos.y);
+
+        float u = theta / (2.0f*XM_PI);
+        float v = phi / XM_PI;
+
+        vertices[i].TexC = { u, v };
     }
 
-    fin.close();
+    BoundingBox bounds = skull.Box();
+
+    std::vector<std::int32_t> indices(skull.Indices(), skull.Indices() + skull.IndexCount());
+
+    // The skull file has no tangents, so generate them from the texture
+    // coordinates.  Triangles across the seam where u wraps around are stretched
+    // over the whole texture, so the vertices along it only get rough tangents.
+    TangentGenerator::VertexLayout layout;
+    layout.Stride = sizeof(Vertex);
+    layout.PositionOffset = offsetof(Vertex, Pos);
+    layout.NormalOffset = offsetof(Vertex, Normal);
+    layout.TexCOffset = offsetof(Vertex, TexC);
+    layout.TangentOffset = offsetof(Vertex, TangentU);
+
+    TangentGenerator::Generate(vertices.data(), layout, vcount, indices.data(), indices.size());
 
     //
     // Pack the indices of all the meshes into one index buffer.
@@ -94,7 +94,7 @@ struct SkinnedVertex
     DirectX::XMFLOAT3 Pos;
     DirectX::XMFLOAT3 Normal;
     DirectX::XMFLOAT2 TexC;
-    DirectX::XMFLOAT3 TangentU;
+    DirectX::XMFLOAT4 TangentU;
     DirectX::XMFLOAT3 BoneWeights;
     BYTE BoneIndices[4];
 };
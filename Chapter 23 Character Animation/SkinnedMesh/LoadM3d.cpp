@@ -1,14 +1,183 @@
 #include "LoadM3d.h"
- 
+#include "../../Common/ParallelTextReader.h"
+#include "../../Common/TextScanner.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
 using namespace DirectX;
 
-bool M3DLoader::LoadM3d(const std::string& filename, 
+namespace
+{
+	const std::uint32_t M3bMagic = 0x4244334D; // "M3DB"
+	const std::uint32_t M3bVersion = 1;
+
+	enum M3bSectionId
+	{
+		StringSection,
+		MaterialSection,
+		SubsetSection,
+		VertexSection,
+		IndexSection,
+		BoneOffsetSection,
+		BoneHierarchySection,
+		ClipSection,
+		TrackSection,
+		KeyframeSection,
+		M3bSectionCount
+	};
+
+	struct M3bSection
+	{
+		std::uint64_t Offset;
+		std::uint64_t Size;
+	};
+
+	struct M3bHeader
+	{
+		std::uint32_t Magic;
+		std::uint32_t Version;
+
+		// The .m3d the file was compiled from.
+		std::uint64_t SourceSize;
+		std::uint64_t SourceWriteTime;
+
+		// There is a subset for each material.
+		std::uint32_t MaterialCount;
+		std::uint32_t VertexCount;
+		std::uint32_t IndexCount;
+		std::uint32_t BoneCount;
+		std::uint32_t ClipCount;
+		std::uint32_t KeyframeCount;
+		std::uint32_t VertexStride;
+		std::uint32_t Reserved[3];
+
+		M3bSection Sections[M3bSectionCount];
+	};
+
+	struct M3bMaterial
+	{
+		// Offsets into the string section.
+		std::uint32_t Name;
+		std::uint32_t MaterialTypeName;
+		std::uint32_t DiffuseMapName;
+		std::uint32_t NormalMapName;
+
+		XMFLOAT4 DiffuseAlbedo;
+		XMFLOAT3 FresnelR0;
+		float Roughness;
+		std::uint32_t AlphaClip;
+		std::uint32_t Reserved[3];
+	};
+
+	struct M3bTrack
+	{
+		std::uint32_t FirstKeyframe;
+		std::uint32_t KeyframeCount;
+	};
+
+	// The sections hold these exactly as they are in memory.
+	static_assert(sizeof(M3bHeader) == 224, "The .m3b header must be packed.");
+	static_assert(sizeof(M3bMaterial) == 64, "The .m3b material must be packed.");
+	static_assert(sizeof(M3DLoader::Vertex) == 48, "Vertex must be packed.");
+	static_assert(sizeof(M3DLoader::SkinnedVertex) == 64, "SkinnedVertex must be packed.");
+	static_assert(sizeof(M3DLoader::Subset) == 20, "Subset must be packed.");
+	static_assert(sizeof(Keyframe) == 44, "Keyframe must be packed.");
+	static_assert(std::is_trivially_copyable<Keyframe>::value, "Keyframes are viewed in place in .m3b files.");
+
+	// Appends size bytes as section, starting on a 16-byte boundary.
+	void AppendSection(std::vector<std::uint8_t>& image, M3bSection& section, const void* data, std::size_t size)
+	{
+		image.resize((image.size() + 15) & ~(std::size_t)15, 0);
+
+		section.Offset = image.size();
+		section.Size = size;
+
+		const std::uint8_t* bytes = (const std::uint8_t*)data;
+		image.insert(image.end(), bytes, bytes + size);
+	}
+
+	const M3bHeader* HeaderOf(const std::shared_ptr<MappedFile>& file)
+	{
+		return file != nullptr ? (const M3bHeader*)file->Data() : nullptr;
+	}
+
+	// The records of the long lists, shared by the serial and parallel readers.
+	void ReadVertex(TextScanner& in, M3DLoader::Vertex& vertex)
+	{
+		in.Skip(); in.Read(&vertex.Pos.x, 3);
+		in.Skip(); in.Read(&vertex.TangentU.x, 4);
+		in.Skip(); in.Read(&vertex.Normal.x, 3);
+		in.Skip(); in.Read(&vertex.TexC.x, 2);
+	}
+
+	void ReadSkinnedVertex(TextScanner& in, M3DLoader::SkinnedVertex& vertex)
+	{
+		std::int32_t boneIndices[4] = { 0, 0, 0, 0 };
+		float weights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+		in.Skip(); in.Read(&vertex.Pos.x, 3);
+		in.Skip(); in.Read(&vertex.TangentU.x, 4);
+		in.Skip(); in.Read(&vertex.Normal.x, 3);
+		in.Skip(); in.Read(&vertex.TexC.x, 2);
+		in.Skip(); in.Read(weights, 4);
+		in.Skip(); in.Read(boneIndices[0]); in.Read(boneIndices[1]); in.Read(boneIndices[2]); in.Read(boneIndices[3]);
+
+		vertex.BoneWeights.x = weights[0];
+		vertex.BoneWeights.y = weights[1];
+		vertex.BoneWeights.z = weights[2];
+
+		vertex.BoneIndices[0] = (BYTE)boneIndices[0];
+		vertex.BoneIndices[1] = (BYTE)boneIndices[1];
+		vertex.BoneIndices[2] = (BYTE)boneIndices[2];
+		vertex.BoneIndices[3] = (BYTE)boneIndices[3];
+	}
+
+	void ReadTriangle(TextScanner& in, UINT numVertices, UINT* indices)
+	{
+		for(int i = 0; i < 3; ++i)
+		{
+			if(in.Read(indices[i]) && indices[i] >= numVertices)
+				in.Fail("vertex index out of range");
+		}
+	}
+
+	// "BoneN #Keyframes: k"
+	bool ReadKeyframeCount(TextScanner& in, UINT& numKeyframes)
+	{
+		numKeyframes = 0;
+		in.Skip(2); in.Read(numKeyframes);
+
+		// "Time: t Pos: x y z Scale: x y z Quat: x y z w" takes at least 48 characters.
+		return in.CheckCount(numKeyframes, 48);
+	}
+
+	void ReadKeyframe(TextScanner& in, Keyframe& key)
+	{
+		in.Skip(); in.Read(key.TimePos);
+		in.Skip(); in.Read(&key.Translation.x, 3);
+		in.Skip(); in.Read(&key.Scale.x, 3);
+		in.Skip(); in.Read(&key.RotationQuat.x, 4);
+	}
+}
+
+bool M3DLoader::LoadM3d(const std::string& filename,
 						std::vector<Vertex>& vertices,
-						std::vector<USHORT>& indices,
+						std::vector<UINT>& indices,
 						std::vector<Subset>& subsets,
 						std::vector<M3dMaterial>& mats)
 {
-	std::ifstream fin(filename);
+	mError.clear();
+
+	MappedFile file;
+	if(!file.Open(AnsiToWString(filename).c_str()))
+	{
+		mError = filename + " not found.";
+		return false;
+	}
+
+	TextScanner in((const char*)file.Data(), file.Size());
 
 	UINT numMaterials = 0;
 	UINT numVertices  = 0;
@@ -16,35 +185,34 @@ bool M3DLoader::LoadM3d(const std::string& filename,
 	UINT numBones     = 0;
 	UINT numAnimationClips = 0;
 
-	std::string ignore;
-
-	if( fin )
-	{
-		fin >> ignore; // file header text
-		fin >> ignore >> numMaterials;
-		fin >> ignore >> numVertices;
-		fin >> ignore >> numTriangles;
-		fin >> ignore >> numBones;
-		fin >> ignore >> numAnimationClips;
- 
-		ReadMaterials(fin, numMaterials, mats);
-		ReadSubsetTable(fin, numMaterials, subsets);
-	    ReadVertices(fin, numVertices, vertices);
-	    ReadTriangles(fin, numTriangles, indices);
- 
-		return true;
-	 }
-    return false;
+	if(ReadHeader(in, numMaterials, numVertices, numTriangles, numBones, numAnimationClips))
+	{
+		ReadMaterials(in, numMaterials, mats);
+		ReadSubsetTable(in, numMaterials, subsets);
+		ReadVertices(in, numVertices, vertices);
+		ReadTriangles(in, numTriangles, numVertices, indices);
+	}
+
+	return Finish(in, filename);
 }
 
-bool M3DLoader::LoadM3d(const std::string& filename, 
+bool M3DLoader::LoadM3d(const std::string& filename,
 						std::vector<SkinnedVertex>& vertices,
-						std::vector<USHORT>& indices,
+						std::vector<UINT>& indices,
 						std::vector<Subset>& subsets,
 						std::vector<M3dMaterial>& mats,
 						SkinnedData& skinInfo)
 {
-    std::ifstream fin(filename);
+	mError.clear();
+
+	MappedFile file;
+	if(!file.Open(AnsiToWString(filename).c_str()))
+	{
+		mError = filename + " not found.";
+		return false;
+	}
+
+	TextScanner in((const char*)file.Data(), file.Size());
 
 	UINT numMaterials = 0;
 	UINT numVertices  = 0;
@@ -52,206 +220,774 @@ bool M3DLoader::LoadM3d(const std::string& filename,
 	UINT numBones     = 0;
 	UINT numAnimationClips = 0;
 
-	std::string ignore;
-
-	if( fin )
+	if(ReadHeader(in, numMaterials, numVertices, numTriangles, numBones, numAnimationClips))
 	{
-		fin >> ignore; // file header text
-		fin >> ignore >> numMaterials;
-		fin >> ignore >> numVertices;
-		fin >> ignore >> numTriangles;
-		fin >> ignore >> numBones;
-		fin >> ignore >> numAnimationClips;
- 
 		std::vector<XMFLOAT4X4> boneOffsets;
 		std::vector<int> boneIndexToParentIndex;
 		std::unordered_map<std::string, AnimationClip> animations;
 
-		ReadMaterials(fin, numMaterials, mats);
-		ReadSubsetTable(fin, numMaterials, subsets);
-	    ReadSkinnedVertices(fin, numVertices, vertices);
-	    ReadTriangles(fin, numTriangles, indices);
-		ReadBoneOffsets(fin, numBones, boneOffsets);
-	    ReadBoneHierarchy(fin, numBones, boneIndexToParentIndex);
-	    ReadAnimationClips(fin, numBones, numAnimationClips, animations);
- 
-		skinInfo.Set(boneIndexToParentIndex, boneOffsets, animations);
+		ReadMaterials(in, numMaterials, mats);
+		ReadSubsetTable(in, numMaterials, subsets);
+		ReadSkinnedVertices(in, numVertices, vertices);
+		ReadTriangles(in, numTriangles, numVertices, indices);
+		ReadBoneOffsets(in, numBones, boneOffsets);
+		ReadBoneHierarchy(in, numBones, boneIndexToParentIndex);
+		ReadAnimationClips(in, numBones, numAnimationClips, animations);
 
-	    return true;
+		if(!in.Failed())
+			skinInfo.Set(boneIndexToParentIndex, boneOffsets, animations);
 	}
-    return false;
+
+	return Finish(in, filename);
+}
+
+bool M3DLoader::ReadHeader(TextScanner& in, UINT& numMaterials, UINT& numVertices, UINT& numTriangles,
+	UINT& numBones, UINT& numAnimationClips)
+{
+	// Each count is checked against the smallest text its items could take as soon
+	// as it is read, so a corrupt count fails on its own line rather than
+	// allocating gigabytes.
+	in.Skip(); // file header text
+	in.Skip(); in.Read(numMaterials);      in.CheckCount(numMaterials, 100);
+	in.Skip(); in.Read(numVertices);       in.CheckCount(numVertices, 48);
+	in.Skip(); in.Read(numTriangles);      in.CheckCount(numTriangles, 6);
+	in.Skip(); in.Read(numBones);          in.CheckCount(numBones, 40);
+	in.Skip(); in.Read(numAnimationClips); in.CheckCount(numAnimationClips, 20);
+
+	return !in.Failed();
 }
 
-void M3DLoader::ReadMaterials(std::ifstream& fin, UINT numMaterials, std::vector<M3dMaterial>& mats)
+bool M3DLoader::Finish(const TextScanner& in, const std::string& filename)
 {
-	 std::string ignore;
-     mats.resize(numMaterials);
+	if(!in.Failed())
+		return true;
 
-	 std::string diffuseMapName;
-	 std::string normalMapName;
+	// "line n: message" becomes "filename(n): message", as the compiler reports.
+	const std::string& error = in.Error();
+	std::size_t colon = error.find(':');
+	mError = filename + "(" + std::to_string(in.Line()) + ")" + error.substr(colon);
 
-     fin >> ignore; // materials header text
-	 for(UINT i = 0; i < numMaterials; ++i)
-	 {
-         fin >> ignore >> mats[i].Name;
-		 fin >> ignore >> mats[i].DiffuseAlbedo.x  >> mats[i].DiffuseAlbedo.y  >> mats[i].DiffuseAlbedo.z;
-		 fin >> ignore >> mats[i].FresnelR0.x >> mats[i].FresnelR0.y >> mats[i].FresnelR0.z;
-         fin >> ignore >> mats[i].Roughness;
-		 fin >> ignore >> mats[i].AlphaClip;
-		 fin >> ignore >> mats[i].MaterialTypeName;
-		 fin >> ignore >> mats[i].DiffuseMapName;
-		 fin >> ignore >> mats[i].NormalMapName;
-		}
+	return false;
 }
 
-void M3DLoader::ReadSubsetTable(std::ifstream& fin, UINT numSubsets, std::vector<Subset>& subsets)
+void M3DLoader::ReadMaterials(TextScanner& in, UINT numMaterials, std::vector<M3dMaterial>& mats)
+{
+	mats.resize(numMaterials);
+
+	in.Skip(); // materials header text
+	for(UINT i = 0; i < numMaterials && !in.Failed(); ++i)
+	{
+		in.Skip(); in.Read(mats[i].Name);
+		in.Skip(); in.Read(&mats[i].DiffuseAlbedo.x, 3);
+		in.Skip(); in.Read(&mats[i].FresnelR0.x, 3);
+		in.Skip(); in.Read(mats[i].Roughness);
+		in.Skip(); in.Read(mats[i].AlphaClip);
+		in.Skip(); in.Read(mats[i].MaterialTypeName);
+		in.Skip(); in.Read(mats[i].DiffuseMapName);
+		in.Skip(); in.Read(mats[i].NormalMapName);
+	}
+}
+
+void M3DLoader::ReadSubsetTable(TextScanner& in, UINT numSubsets, std::vector<Subset>& subsets)
 {
-    std::string ignore;
 	subsets.resize(numSubsets);
 
-	fin >> ignore; // subset header text
-	for(UINT i = 0; i < numSubsets; ++i)
+	in.Skip(); // subset header text
+	for(UINT i = 0; i < numSubsets && !in.Failed(); ++i)
 	{
-        fin >> ignore >> subsets[i].Id;
-		fin >> ignore >> subsets[i].VertexStart;
-		fin >> ignore >> subsets[i].VertexCount;
-		fin >> ignore >> subsets[i].FaceStart;
-		fin >> ignore >> subsets[i].FaceCount;
-    }
+		in.Skip(); in.Read(subsets[i].Id);
+		in.Skip(); in.Read(subsets[i].VertexStart);
+		in.Skip(); in.Read(subsets[i].VertexCount);
+		in.Skip(); in.Read(subsets[i].FaceStart);
+		in.Skip(); in.Read(subsets[i].FaceCount);
+	}
 }
 
-void M3DLoader::ReadVertices(std::ifstream& fin, UINT numVertices, std::vector<Vertex>& vertices)
+void M3DLoader::ReadVertices(TextScanner& in, UINT numVertices, std::vector<Vertex>& vertices)
 {
-	std::string ignore;
-    vertices.resize(numVertices);
+	vertices.resize(numVertices);
 
-    fin >> ignore; // vertices header text
-    for(UINT i = 0; i < numVertices; ++i)
-    {
-	    fin >> ignore >> vertices[i].Pos.x      >> vertices[i].Pos.y      >> vertices[i].Pos.z;
-		fin >> ignore >> vertices[i].TangentU.x >> vertices[i].TangentU.y >> vertices[i].TangentU.z >> vertices[i].TangentU.w;
-	    fin >> ignore >> vertices[i].Normal.x   >> vertices[i].Normal.y   >> vertices[i].Normal.z;
-	    fin >> ignore >> vertices[i].TexC.x     >> vertices[i].TexC.y;
-    }
+	in.Skip(); // vertices header text
+
+	auto readVertex = [&vertices](TextScanner& scanner, UINT i) { ReadVertex(scanner, vertices[i]); };
+	if(ParallelTextReader::ReadRecords(in, numVertices, readVertex, *mTaskSystem))
+		return;
+
+	for(UINT i = 0; i < numVertices && !in.Failed(); ++i)
+		ReadVertex(in, vertices[i]);
 }
 
-void M3DLoader::ReadSkinnedVertices(std::ifstream& fin, UINT numVertices, std::vector<SkinnedVertex>& vertices)
+void M3DLoader::ReadSkinnedVertices(TextScanner& in, UINT numVertices, std::vector<SkinnedVertex>& vertices)
 {
-	std::string ignore;
-    vertices.resize(numVertices);
+	vertices.resize(numVertices);
 
-    fin >> ignore; // vertices header text
-	int boneIndices[4];
-	float weights[4];
-    for(UINT i = 0; i < numVertices; ++i)
-    {
-        float blah;
-	    fin >> ignore >> vertices[i].Pos.x        >> vertices[i].Pos.y          >> vertices[i].Pos.z;
-		fin >> ignore >> vertices[i].TangentU.x   >> vertices[i].TangentU.y     >> vertices[i].TangentU.z >> blah /*vertices[i].TangentU.w*/;
-	    fin >> ignore >> vertices[i].Normal.x     >> vertices[i].Normal.y       >> vertices[i].Normal.z;
-	    fin >> ignore >> vertices[i].TexC.x       >> vertices[i].TexC.y;
-		fin >> ignore >> weights[0]     >> weights[1]     >> weights[2]     >> weights[3];
-		fin >> ignore >> boneIndices[0] >> boneIndices[1] >> boneIndices[2] >> boneIndices[3];
+	in.Skip(); // vertices header text
 
-		vertices[i].BoneWeights.x = weights[0];
-		vertices[i].BoneWeights.y = weights[1];
-		vertices[i].BoneWeights.z = weights[2];
+	auto readVertex = [&vertices](TextScanner& scanner, UINT i) { ReadSkinnedVertex(scanner, vertices[i]); };
+	if(ParallelTextReader::ReadRecords(in, numVertices, readVertex, *mTaskSystem))
+		return;
 
-		vertices[i].BoneIndices[0] = (BYTE)boneIndices[0]; 
-		vertices[i].BoneIndices[1] = (BYTE)boneIndices[1]; 
-		vertices[i].BoneIndices[2] = (BYTE)boneIndices[2]; 
-		vertices[i].BoneIndices[3] = (BYTE)boneIndices[3]; 
-    }
+	for(UINT i = 0; i < numVertices && !in.Failed(); ++i)
+		ReadSkinnedVertex(in, vertices[i]);
 }
 
-void M3DLoader::ReadTriangles(std::ifstream& fin, UINT numTriangles, std::vector<USHORT>& indices)
+void M3DLoader::ReadTriangles(TextScanner& in, UINT numTriangles, UINT numVertices, std::vector<UINT>& indices)
 {
-	std::string ignore;
-    indices.resize(numTriangles*3);
+	indices.resize(numTriangles*3);
+
+	in.Skip(); // triangles header text
+
+	auto readTriangle = [&indices, numVertices](TextScanner& scanner, UINT i) { ReadTriangle(scanner, numVertices, &indices[3*i]); };
+	if(ParallelTextReader::ReadRecords(in, numTriangles, readTriangle, *mTaskSystem))
+		return;
 
-    fin >> ignore; // triangles header text
-    for(UINT i = 0; i < numTriangles; ++i)
-    {
-        fin >> indices[i*3+0] >> indices[i*3+1] >> indices[i*3+2];
-    }
+	for(UINT i = 0; i < numTriangles && !in.Failed(); ++i)
+		ReadTriangle(in, numVertices, &indices[3*i]);
 }
- 
-void M3DLoader::ReadBoneOffsets(std::ifstream& fin, UINT numBones, std::vector<XMFLOAT4X4>& boneOffsets)
+
+void M3DLoader::ReadBoneOffsets(TextScanner& in, UINT numBones, std::vector<XMFLOAT4X4>& boneOffsets)
 {
-	std::string ignore;
-    boneOffsets.resize(numBones);
+	boneOffsets.resize(numBones);
 
-    fin >> ignore; // BoneOffsets header text
-    for(UINT i = 0; i < numBones; ++i)
-    {
-        fin >> ignore >> 
-            boneOffsets[i](0,0) >> boneOffsets[i](0,1) >> boneOffsets[i](0,2) >> boneOffsets[i](0,3) >>
-            boneOffsets[i](1,0) >> boneOffsets[i](1,1) >> boneOffsets[i](1,2) >> boneOffsets[i](1,3) >>
-            boneOffsets[i](2,0) >> boneOffsets[i](2,1) >> boneOffsets[i](2,2) >> boneOffsets[i](2,3) >>
-            boneOffsets[i](3,0) >> boneOffsets[i](3,1) >> boneOffsets[i](3,2) >> boneOffsets[i](3,3);
-    }
+	in.Skip(); // BoneOffsets header text
+	for(UINT i = 0; i < numBones && !in.Failed(); ++i)
+	{
+		in.Skip(); in.Read(&boneOffsets[i](0, 0), 16);
+	}
 }
 
-void M3DLoader::ReadBoneHierarchy(std::ifstream& fin, UINT numBones, std::vector<int>& boneIndexToParentIndex)
+void M3DLoader::ReadBoneHierarchy(TextScanner& in, UINT numBones, std::vector<int>& boneIndexToParentIndex)
 {
-	std::string ignore;
-    boneIndexToParentIndex.resize(numBones);
+	boneIndexToParentIndex.resize(numBones);
 
-    fin >> ignore; // BoneHierarchy header text
-	for(UINT i = 0; i < numBones; ++i)
+	in.Skip(); // BoneHierarchy header text
+	for(UINT i = 0; i < numBones && !in.Failed(); ++i)
 	{
-	    fin >> ignore >> boneIndexToParentIndex[i];
+		std::int32_t parent = -1;
+		in.Skip(); in.Read(parent);
+		boneIndexToParentIndex[i] = parent;
 	}
 }
 
-void M3DLoader::ReadAnimationClips(std::ifstream& fin, UINT numBones, UINT numAnimationClips, 
+void M3DLoader::ReadAnimationClips(TextScanner& in, UINT numBones, UINT numAnimationClips,
 								   std::unordered_map<std::string, AnimationClip>& animations)
 {
-	std::string ignore;
-    fin >> ignore; // AnimationClips header text
-    for(UINT clipIndex = 0; clipIndex < numAnimationClips; ++clipIndex)
-    {
-        std::string clipName;
-        fin >> ignore >> clipName;
-        fin >> ignore; // {
+	in.Skip(); // AnimationClips header text
+
+	const TextScanner start = in;
+	if(ReadAnimationClipsParallel(in, numBones, numAnimationClips, animations))
+		return;
+
+	in = start;
+	animations.clear();
+
+	for(UINT clipIndex = 0; clipIndex < numAnimationClips && !in.Failed(); ++clipIndex)
+	{
+		std::string clipName;
+		in.Skip(); in.Read(clipName);
+		in.Skip(); // {
 
 		AnimationClip clip;
 		clip.BoneAnimations.resize(numBones);
 
-        for(UINT boneIndex = 0; boneIndex < numBones; ++boneIndex)
-        {
-            ReadBoneKeyframes(fin, numBones, clip.BoneAnimations[boneIndex]);
-        }
-        fin >> ignore; // }
-
-        animations[clipName] = clip;
-    }
-}
-
-void M3DLoader::ReadBoneKeyframes(std::ifstream& fin, UINT numBones, BoneAnimation& boneAnimation)
-{
-	std::string ignore;
-    UINT numKeyframes = 0;
-    fin >> ignore >> ignore >> numKeyframes;
-    fin >> ignore; // {
-
-    boneAnimation.Keyframes.resize(numKeyframes);
-    for(UINT i = 0; i < numKeyframes; ++i)
-    {
-        float t    = 0.0f;
-        XMFLOAT3 p(0.0f, 0.0f, 0.0f);
-        XMFLOAT3 s(1.0f, 1.0f, 1.0f);
-        XMFLOAT4 q(0.0f, 0.0f, 0.0f, 1.0f);
-        fin >> ignore >> t;
-        fin >> ignore >> p.x >> p.y >> p.z;
-        fin >> ignore >> s.x >> s.y >> s.z;
-        fin >> ignore >> q.x >> q.y >> q.z >> q.w;
-
-	    boneAnimation.Keyframes[i].TimePos      = t;
-        boneAnimation.Keyframes[i].Translation  = p;
-	    boneAnimation.Keyframes[i].Scale        = s;
-	    boneAnimation.Keyframes[i].RotationQuat = q;
-    }
-
-    fin >> ignore; // }
-}
\ No newline at end of file
+		for(UINT boneIndex = 0; boneIndex < numBones && !in.Failed(); ++boneIndex)
+		{
+			ReadBoneKeyframes(in, numBones, clip.BoneAnimations[boneIndex]);
+		}
+		in.Skip(); // }
+
+		animations[clipName] = std::move(clip);
+	}
+}
+
+bool M3DLoader::ReadAnimationClipsParallel(TextScanner& in, UINT numBones, UINT numAnimationClips,
+										   std::unordered_map<std::string, AnimationClip>& animations)
+{
+	// Where each bone's keyframes start, and where the "}" after them should be.
+	struct KeyframeBlock
+	{
+		BoneAnimation* Animation;
+		TextScanner Start;
+		const char* End;
+	};
+
+	// The pre-scan reads the clip and bone headers as the serial reader does, but
+	// steps over the keyframes, one a line, without parsing them.
+	std::vector<std::pair<std::string, AnimationClip>> clips(numAnimationClips);
+	std::vector<KeyframeBlock> blocks;
+	blocks.reserve((std::size_t)numAnimationClips*numBones);
+
+	for(UINT clipIndex = 0; clipIndex < numAnimationClips && !in.Failed(); ++clipIndex)
+	{
+		in.Skip(); in.Read(clips[clipIndex].first);
+		in.Skip(); // {
+
+		AnimationClip& clip = clips[clipIndex].second;
+		clip.BoneAnimations.resize(numBones);
+
+		for(UINT boneIndex = 0; boneIndex < numBones && !in.Failed(); ++boneIndex)
+		{
+			UINT numKeyframes = 0;
+			if(!ReadKeyframeCount(in, numKeyframes))
+				return false;
+
+			in.Skip(); // {
+
+			BoneAnimation& boneAnimation = clip.BoneAnimations[boneIndex];
+			boneAnimation.Keyframes.resize(numKeyframes);
+
+			const TextScanner keyframes = in;
+
+			// The rest of the "{" line, then a line for each keyframe.
+			in.SkipLines((std::uint64_t)numKeyframes + 1);
+			in.SkipSpace();
+
+			blocks.push_back({ &boneAnimation, keyframes, in.Position() });
+
+			in.Skip(); // }
+		}
+		in.Skip(); // }
+	}
+
+	if(in.Failed())
+		return false;
+
+	std::vector<char> lined(blocks.size(), 0);
+	mTaskSystem->ParallelFor(0, (int)blocks.size(), 1, [&](int i)
+	{
+		TextScanner scanner = blocks[i].Start;
+
+		std::vector<Keyframe>& keys = blocks[i].Animation->Keyframes;
+		for(std::size_t k = 0; k < keys.size() && !scanner.Failed(); ++k)
+			ReadKeyframe(scanner, keys[k]);
+
+		scanner.SkipSpace();
+		lined[i] = !scanner.Failed() && scanner.Position() == blocks[i].End;
+	});
+
+	for(char ok : lined)
+	{
+		if(!ok)
+			return false;
+	}
+
+	for(auto& clip : clips)
+		animations[clip.first] = std::move(clip.second);
+
+	return true;
+}
+
+void M3DLoader::ReadBoneKeyframes(TextScanner& in, UINT numBones, BoneAnimation& boneAnimation)
+{
+	UINT numKeyframes = 0;
+	if(!ReadKeyframeCount(in, numKeyframes))
+		return;
+
+	in.Skip(); // {
+
+	boneAnimation.Keyframes.resize(numKeyframes);
+	for(UINT i = 0; i < numKeyframes && !in.Failed(); ++i)
+		ReadKeyframe(in, boneAnimation.Keyframes[i]);
+
+	in.Skip(); // }
+}
+
+bool M3DLoader::LoadM3b(const std::string& filename,
+						std::vector<Vertex>& vertices,
+						std::vector<UINT>& indices,
+						std::vector<Subset>& subsets,
+						std::vector<M3dMaterial>& mats)
+{
+	mError.clear();
+
+	M3bFile file;
+	if(!file.Open(filename))
+	{
+		mError = file.Error();
+		return false;
+	}
+
+	if(file.IsSkinned())
+	{
+		mError = filename + ": holds skinned vertices.";
+		return false;
+	}
+
+	vertices.assign(file.Vertices(), file.Vertices() + file.VertexCount());
+	indices.assign(file.Indices(), file.Indices() + file.IndexCount());
+	subsets.assign(file.Subsets(), file.Subsets() + file.SubsetCount());
+	file.GetMaterials(mats);
+
+	return true;
+}
+
+bool M3DLoader::LoadM3b(const std::string& filename,
+						std::vector<SkinnedVertex>& vertices,
+						std::vector<UINT>& indices,
+						std::vector<Subset>& subsets,
+						std::vector<M3dMaterial>& mats,
+						SkinnedData& skinInfo)
+{
+	mError.clear();
+
+	M3bFile file;
+	if(!file.Open(filename))
+	{
+		mError = file.Error();
+		return false;
+	}
+
+	if(!file.IsSkinned())
+	{
+		mError = filename + ": holds vertices without bone weights.";
+		return false;
+	}
+
+	vertices.assign(file.SkinnedVertices(), file.SkinnedVertices() + file.VertexCount());
+	indices.assign(file.Indices(), file.Indices() + file.IndexCount());
+	subsets.assign(file.Subsets(), file.Subsets() + file.SubsetCount());
+	file.GetMaterials(mats);
+	file.GetSkinnedData(skinInfo);
+
+	return true;
+}
+
+bool M3DLoader::LoadCompiled(const std::string& m3dFile,
+							 std::vector<SkinnedVertex>& vertices,
+							 std::vector<UINT>& indices,
+							 std::vector<Subset>& subsets,
+							 std::vector<M3dMaterial>& mats,
+							 SkinnedData& skinInfo)
+{
+	const std::string m3bFile = CompiledFile(m3dFile);
+
+	MappedFile::Stamp stamp;
+	const bool haveText = MappedFile::GetStamp(AnsiToWString(m3dFile).c_str(), stamp);
+
+	M3bFile file;
+	if(file.Open(m3bFile) && file.IsSkinned() &&
+		(!haveText || (file.SourceSize() == stamp.Size && file.SourceWriteTime() == stamp.LastWriteTime)))
+	{
+		file.Close();
+		if(LoadM3b(m3bFile, vertices, indices, subsets, mats, skinInfo))
+			return true;
+	}
+
+	if(!LoadM3d(m3dFile, vertices, indices, subsets, mats, skinInfo))
+		return false;
+
+	// Compile it for next time.  What was just read is used either way, so failing
+	// to write the .m3b, say in a read-only directory, only costs the next load.
+	WriteM3b(m3bFile, vertices.data(), sizeof(SkinnedVertex), (UINT)vertices.size(), indices, subsets, mats,
+		&skinInfo, stamp);
+	mError.clear();
+
+	return true;
+}
+
+bool M3DLoader::ConvertToM3b(const std::string& m3dFile, const std::string& m3bFile)
+{
+	mError.clear();
+
+	MappedFile::Stamp stamp;
+	UINT numBones = 0;
+	{
+		MappedFile file;
+		if(!MappedFile::GetStamp(AnsiToWString(m3dFile).c_str(), stamp) || !file.Open(AnsiToWString(m3dFile).c_str()))
+		{
+			mError = m3dFile + " not found.";
+			return false;
+		}
+
+		// Whether the vertices have bone weights depends on whether there are bones.
+		// A malformed header is reported by LoadM3d.
+		TextScanner in((const char*)file.Data(), file.Size());
+		UINT numMaterials, numVertices, numTriangles, numAnimationClips;
+		ReadHeader(in, numMaterials, numVertices, numTriangles, numBones, numAnimationClips);
+	}
+
+	std::vector<UINT> indices;
+	std::vector<Subset> subsets;
+	std::vector<M3dMaterial> mats;
+
+	if(numBones > 0)
+	{
+		std::vector<SkinnedVertex> vertices;
+		SkinnedData skinInfo;
+		if(!LoadM3d(m3dFile, vertices, indices, subsets, mats, skinInfo))
+			return false;
+
+		return WriteM3b(m3bFile, vertices.data(), sizeof(SkinnedVertex), (UINT)vertices.size(), indices, subsets,
+			mats, &skinInfo, stamp);
+	}
+
+	std::vector<Vertex> vertices;
+	if(!LoadM3d(m3dFile, vertices, indices, subsets, mats))
+		return false;
+
+	return WriteM3b(m3bFile, vertices.data(), sizeof(Vertex), (UINT)vertices.size(), indices, subsets, mats,
+		nullptr, stamp);
+}
+
+std::string M3DLoader::CompiledFile(const std::string& m3dFile)
+{
+	std::size_t dot = m3dFile.find_last_of("./\\");
+	if(dot == std::string::npos || m3dFile[dot] != '.')
+		return m3dFile + ".m3b";
+
+	return m3dFile.substr(0, dot) + ".m3b";
+}
+
+bool M3DLoader::WriteM3b(const std::string& m3bFile, const void* vertices, UINT vertexStride, UINT vertexCount,
+	const std::vector<UINT>& indices, const std::vector<Subset>& subsets, const std::vector<M3dMaterial>& mats,
+	const SkinnedData* skinInfo, const MappedFile::Stamp& sourceStamp)
+{
+	M3bHeader header = {};
+	header.Magic = M3bMagic;
+	header.Version = M3bVersion;
+	header.SourceSize = sourceStamp.Size;
+	header.SourceWriteTime = sourceStamp.LastWriteTime;
+	header.MaterialCount = (std::uint32_t)mats.size();
+	header.VertexCount = vertexCount;
+	header.IndexCount = (std::uint32_t)indices.size();
+	header.VertexStride = vertexStride;
+
+	std::string strings;
+	auto addString = [&strings](const std::string& s)
+	{
+		std::uint32_t offset = (std::uint32_t)strings.size();
+		strings.append(s.c_str(), s.size() + 1);
+		return offset;
+	};
+
+	std::vector<M3bMaterial> materials(mats.size());
+	for(size_t i = 0; i < mats.size(); ++i)
+	{
+		M3bMaterial& m = materials[i];
+		m = M3bMaterial();
+		m.Name = addString(mats[i].Name);
+		m.MaterialTypeName = addString(mats[i].MaterialTypeName);
+		m.DiffuseMapName = addString(mats[i].DiffuseMapName);
+		m.NormalMapName = addString(mats[i].NormalMapName);
+		m.DiffuseAlbedo = mats[i].DiffuseAlbedo;
+		m.FresnelR0 = mats[i].FresnelR0;
+		m.Roughness = mats[i].Roughness;
+		m.AlphaClip = mats[i].AlphaClip ? 1 : 0;
+	}
+
+	// The subset table has a row for each material.
+	if(subsets.size() != mats.size())
+	{
+		mError = m3bFile + ": there must be a subset for each material.";
+		return false;
+	}
+
+	std::vector<XMFLOAT4X4> boneOffsets;
+	std::vector<int> boneHierarchy;
+	std::vector<std::uint32_t> clips;
+	std::vector<M3bTrack> tracks;
+	std::vector<Keyframe> keyframes;
+
+	if(skinInfo != nullptr)
+	{
+		boneOffsets = skinInfo->BoneOffsets();
+		boneHierarchy = skinInfo->BoneHierarchy();
+
+		// In name order, so that the same model always compiles to the same file.
+		std::vector<const std::pair<const std::string, AnimationClip>*> sorted;
+		for(const auto& clip : skinInfo->Animations())
+			sorted.push_back(&clip);
+
+		std::sort(sorted.begin(), sorted.end(), [](const std::pair<const std::string, AnimationClip>* a,
+			const std::pair<const std::string, AnimationClip>* b) { return a->first < b->first; });
+
+		for(const auto* clip : sorted)
+		{
+			if(clip->second.BoneAnimations.size() != boneOffsets.size())
+			{
+				mError = m3bFile + ": clip " + clip->first + " does not animate every bone.";
+				return false;
+			}
+
+			clips.push_back(addString(clip->first));
+
+			for(const BoneAnimation& bone : clip->second.BoneAnimations)
+			{
+				if(bone.GetKeyframeCount() == 0)
+				{
+					mError = m3bFile + ": clip " + clip->first + " has a bone without keyframes.";
+					return false;
+				}
+
+				M3bTrack track;
+				track.FirstKeyframe = (std::uint32_t)keyframes.size();
+				track.KeyframeCount = bone.GetKeyframeCount();
+				tracks.push_back(track);
+
+				keyframes.insert(keyframes.end(), bone.GetKeyframes(), bone.GetKeyframes() + bone.GetKeyframeCount());
+			}
+		}
+	}
+
+	header.BoneCount = (std::uint32_t)boneOffsets.size();
+	header.ClipCount = (std::uint32_t)clips.size();
+	header.KeyframeCount = (std::uint32_t)keyframes.size();
+
+	std::vector<std::uint8_t> image(sizeof(M3bHeader));
+	AppendSection(image, header.Sections[StringSection], strings.data(), strings.size());
+	AppendSection(image, header.Sections[MaterialSection], materials.data(), materials.size() * sizeof(M3bMaterial));
+	AppendSection(image, header.Sections[SubsetSection], subsets.data(), subsets.size() * sizeof(Subset));
+	AppendSection(image, header.Sections[VertexSection], vertices, (std::size_t)vertexCount * vertexStride);
+	AppendSection(image, header.Sections[IndexSection], indices.data(), indices.size() * sizeof(UINT));
+	AppendSection(image, header.Sections[BoneOffsetSection], boneOffsets.data(), boneOffsets.size() * sizeof(XMFLOAT4X4));
+	AppendSection(image, header.Sections[BoneHierarchySection], boneHierarchy.data(), boneHierarchy.size() * sizeof(int));
+	AppendSection(image, header.Sections[ClipSection], clips.data(), clips.size() * sizeof(std::uint32_t));
+	AppendSection(image, header.Sections[TrackSection], tracks.data(), tracks.size() * sizeof(M3bTrack));
+	AppendSection(image, header.Sections[KeyframeSection], keyframes.data(), keyframes.size() * sizeof(Keyframe));
+	std::memcpy(image.data(), &header, sizeof(header));
+
+	// Written to a temporary file and moved over m3bFile, so that a failed write
+	// never leaves a truncated file behind.
+	const std::string tempFile = m3bFile + ".tmp";
+	bool ok;
+	{
+		std::ofstream fout(tempFile, std::ios::binary | std::ios::trunc);
+		fout.write((const char*)image.data(), image.size());
+		ok = fout.good();
+	}
+
+	if(ok)
+		ok = MoveFileExW(AnsiToWString(tempFile).c_str(), AnsiToWString(m3bFile).c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+
+	if(!ok)
+	{
+		DeleteFileW(AnsiToWString(tempFile).c_str());
+		mError = m3bFile + " could not be written.";
+	}
+
+	return ok;
+}
+
+template<typename T>
+const T* M3bFile::Section(int section)const
+{
+	return (const T*)(mFile->Data() + HeaderOf(mFile)->Sections[section].Offset);
+}
+
+const char* M3bFile::String(std::uint32_t offset)const
+{
+	return Section<char>(StringSection) + offset;
+}
+
+bool M3bFile::Open(const std::string& filename)
+{
+	Close();
+
+	mFile = std::make_shared<MappedFile>();
+	if(!mFile->Open(AnsiToWString(filename).c_str()))
+		return Fail(filename, "not found");
+
+	const std::uint64_t size = mFile->Size();
+	const M3bHeader* header = HeaderOf(mFile);
+	if(size < sizeof(M3bHeader) || header->Magic != M3bMagic)
+		return Fail(filename, "not an .m3b file");
+
+	if(header->Version != M3bVersion)
+		return Fail(filename, "written by a different version of the converter");
+
+	if(header->VertexStride != sizeof(M3DLoader::Vertex) && header->VertexStride != sizeof(M3DLoader::SkinnedVertex))
+		return Fail(filename, "unknown vertex format");
+
+	if(header->IndexCount % 3 != 0)
+		return Fail(filename, "index count is not a multiple of 3");
+
+	// Each section must lie inside the file and be exactly as big as its count says;
+	// the string section is as big as its strings.
+	const std::uint64_t tracks = (std::uint64_t)header->ClipCount * header->BoneCount;
+	const std::uint64_t sectionSizes[M3bSectionCount] =
+	{
+		header->Sections[StringSection].Size,
+		(std::uint64_t)header->MaterialCount * sizeof(M3bMaterial),
+		(std::uint64_t)header->MaterialCount * sizeof(M3DLoader::Subset),
+		(std::uint64_t)header->VertexCount * header->VertexStride,
+		(std::uint64_t)header->IndexCount * sizeof(UINT),
+		(std::uint64_t)header->BoneCount * sizeof(XMFLOAT4X4),
+		(std::uint64_t)header->BoneCount * sizeof(int),
+		(std::uint64_t)header->ClipCount * sizeof(std::uint32_t),
+		tracks * sizeof(M3bTrack),
+		(std::uint64_t)header->KeyframeCount * sizeof(Keyframe)
+	};
+
+	for(int i = 0; i < M3bSectionCount; ++i)
+	{
+		const M3bSection& section = header->Sections[i];
+		if(section.Offset % 16 != 0 || section.Offset < sizeof(M3bHeader) || section.Offset > size ||
+			section.Size > size - section.Offset || section.Size != sectionSizes[i])
+			return Fail(filename, "truncated or corrupt");
+	}
+
+	const M3bSection& strings = header->Sections[StringSection];
+	if(strings.Size > 0 && mFile->Data()[strings.Offset + strings.Size - 1] != '\0')
+		return Fail(filename, "unterminated string");
+
+	const M3bMaterial* materials = Section<M3bMaterial>(MaterialSection);
+	for(UINT i = 0; i < header->MaterialCount; ++i)
+	{
+		if(materials[i].Name >= strings.Size || materials[i].MaterialTypeName >= strings.Size ||
+			materials[i].DiffuseMapName >= strings.Size || materials[i].NormalMapName >= strings.Size)
+			return Fail(filename, "material name out of range");
+	}
+
+	const std::uint32_t* clips = Section<std::uint32_t>(ClipSection);
+	for(UINT i = 0; i < header->ClipCount; ++i)
+	{
+		if(clips[i] >= strings.Size)
+			return Fail(filename, "clip name out of range");
+	}
+
+	const UINT* indices = Indices();
+	for(UINT i = 0; i < header->IndexCount; ++i)
+	{
+		if(indices[i] >= header->VertexCount)
+			return Fail(filename, "vertex index out of range");
+	}
+
+	// Every bone but the root has a parent, which GetFinalTransforms looks up.
+	const int* parents = Section<int>(BoneHierarchySection);
+	for(UINT i = 0; i < header->BoneCount; ++i)
+	{
+		if(parents[i] < (i == 0 ? -1 : 0) || parents[i] >= (int)header->BoneCount)
+			return Fail(filename, "parent bone out of range");
+	}
+
+	const M3bTrack* trackTable = Section<M3bTrack>(TrackSection);
+	for(std::uint64_t i = 0; i < tracks; ++i)
+	{
+		if(trackTable[i].KeyframeCount == 0 ||
+			(std::uint64_t)trackTable[i].FirstKeyframe + trackTable[i].KeyframeCount > header->KeyframeCount)
+			return Fail(filename, "keyframes out of range");
+	}
+
+	return true;
+}
+
+void M3bFile::Close()
+{
+	mFile.reset();
+	mError.clear();
+}
+
+bool M3bFile::Fail(const std::string& filename, const char* message)
+{
+	Close();
+	mError = filename + ": " + message + ".";
+	return false;
+}
+
+bool M3bFile::IsSkinned()const
+{
+	return mFile != nullptr && HeaderOf(mFile)->VertexStride == sizeof(M3DLoader::SkinnedVertex);
+}
+
+const M3DLoader::Vertex* M3bFile::Vertices()const
+{
+	return mFile != nullptr && !IsSkinned() ? Section<M3DLoader::Vertex>(VertexSection) : nullptr;
+}
+
+const M3DLoader::SkinnedVertex* M3bFile::SkinnedVertices()const
+{
+	return IsSkinned() ? Section<M3DLoader::SkinnedVertex>(VertexSection) : nullptr;
+}
+
+const UINT* M3bFile::Indices()const
+{
+	return mFile != nullptr ? Section<UINT>(IndexSection) : nullptr;
+}
+
+const M3DLoader::Subset* M3bFile::Subsets()const
+{
+	return mFile != nullptr ? Section<M3DLoader::Subset>(SubsetSection) : nullptr;
+}
+
+UINT M3bFile::VertexCount()const
+{
+	return mFile != nullptr ? HeaderOf(mFile)->VertexCount : 0;
+}
+
+UINT M3bFile::IndexCount()const
+{
+	return mFile != nullptr ? HeaderOf(mFile)->IndexCount : 0;
+}
+
+UINT M3bFile::SubsetCount()const
+{
+	return mFile != nullptr ? HeaderOf(mFile)->MaterialCount : 0;
+}
+
+std::uint64_t M3bFile::SourceSize()const
+{
+	return mFile != nullptr ? HeaderOf(mFile)->SourceSize : 0;
+}
+
+std::uint64_t M3bFile::SourceWriteTime()const
+{
+	return mFile != nullptr ? HeaderOf(mFile)->SourceWriteTime : 0;
+}
+
+void M3bFile::GetMaterials(std::vector<M3DLoader::M3dMaterial>& mats)const
+{
+	const UINT count = SubsetCount();
+	mats.resize(count);
+
+	const M3bMaterial* materials = count > 0 ? Section<M3bMaterial>(MaterialSection) : nullptr;
+	for(UINT i = 0; i < count; ++i)
+	{
+		mats[i].Name = String(materials[i].Name);
+		mats[i].DiffuseAlbedo = materials[i].DiffuseAlbedo;
+		mats[i].FresnelR0 = materials[i].FresnelR0;
+		mats[i].Roughness = materials[i].Roughness;
+		mats[i].AlphaClip = materials[i].AlphaClip != 0;
+		mats[i].MaterialTypeName = String(materials[i].MaterialTypeName);
+		mats[i].DiffuseMapName = String(materials[i].DiffuseMapName);
+		mats[i].NormalMapName = String(materials[i].NormalMapName);
+	}
+}
+
+void M3bFile::GetSkinnedData(SkinnedData& skinInfo)const
+{
+	std::vector<int> boneIndexToParentIndex;
+	std::vector<XMFLOAT4X4> boneOffsets;
+	std::unordered_map<std::string, AnimationClip> animations;
+
+	if(mFile != nullptr)
+	{
+		const M3bHeader* header = HeaderOf(mFile);
+		const UINT numBones = header->BoneCount;
+
+		const int* parents = Section<int>(BoneHierarchySection);
+		const XMFLOAT4X4* offsets = Section<XMFLOAT4X4>(BoneOffsetSection);
+		boneIndexToParentIndex.assign(parents, parents + numBones);
+		boneOffsets.assign(offsets, offsets + numBones);
+
+		const std::uint32_t* clips = Section<std::uint32_t>(ClipSection);
+		const M3bTrack* tracks = Section<M3bTrack>(TrackSection);
+		const Keyframe* keyframes = Section<Keyframe>(KeyframeSection);
+
+		for(UINT clipIndex = 0; clipIndex < header->ClipCount; ++clipIndex)
+		{
+			AnimationClip clip;
+			clip.BoneAnimations.resize(numBones);
+
+			for(UINT boneIndex = 0; boneIndex < numBones; ++boneIndex)
+			{
+				const M3bTrack& track = tracks[clipIndex * numBones + boneIndex];
+				clip.BoneAnimations[boneIndex].MappedKeyframes = keyframes + track.FirstKeyframe;
+				clip.BoneAnimations[boneIndex].MappedKeyframeCount = track.KeyframeCount;
+			}
+
+			animations[String(clips[clipIndex])] = std::move(clip);
+		}
+	}
+
+	skinInfo.Set(boneIndexToParentIndex, boneOffsets, animations, mFile);
+}
@@ -2,6 +2,10 @@
 #define LOADM3D_H
 
 #include "SkinnedData.h"
+#include "../../Common/MappedFile.h"
+#include "../../Common/TaskSystem.h"
+
+class TextScanner;
 
 
 
@@ -21,7 +25,7 @@ public:
         DirectX::XMFLOAT3 Pos;
         DirectX::XMFLOAT3 Normal;
         DirectX::XMFLOAT2 TexC;
-        DirectX::XMFLOAT3 TangentU;
+        DirectX::XMFLOAT4 TangentU;
         DirectX::XMFLOAT3 BoneWeights;
         BYTE BoneIndices[4];
     };
@@ -49,28 +53,166 @@ public:
         std::string NormalMapName;
     };
 
+	// The vertex, triangle and keyframe lists of .m3d files are parsed on
+	// taskSystem's workers.
+	explicit M3DLoader(TaskSystem& taskSystem = TaskSystem::Default()) : mTaskSystem(&taskSystem) {}
+
+	///<summary>
+	/// Loads an .m3d file, mapping it and scanning it in place.  Returns false if the
+	/// file cannot be opened or is malformed, and Error() says where.
+	///
+	/// The long lists are split by lines and parsed in parallel, which gives the
+	/// same result as parsing them in order; a file whose records do not keep to
+	/// one shape is parsed in order instead.
+	///</summary>
 	bool LoadM3d(const std::string& filename, 
 		std::vector<Vertex>& vertices,
-		std::vector<USHORT>& indices,
+		std::vector<UINT>& indices,
 		std::vector<Subset>& subsets,
 		std::vector<M3dMaterial>& mats);
 	bool LoadM3d(const std::string& filename, 
 		std::vector<SkinnedVertex>& vertices,
-		std::vector<USHORT>& indices,
+		std::vector<UINT>& indices,
+		std::vector<Subset>& subsets,
+		std::vector<M3dMaterial>& mats,
+		SkinnedData& skinInfo);
+
+	///<summary>
+	/// Loads an .m3b file written by ConvertToM3b.  The vertices, indices and
+	/// subsets are copied out in one block each, and skinInfo views the keyframes
+	/// in place, keeping the file mapped for as long as it needs them.
+	///</summary>
+	bool LoadM3b(const std::string& filename, 
+		std::vector<Vertex>& vertices,
+		std::vector<UINT>& indices,
+		std::vector<Subset>& subsets,
+		std::vector<M3dMaterial>& mats);
+	bool LoadM3b(const std::string& filename, 
+		std::vector<SkinnedVertex>& vertices,
+		std::vector<UINT>& indices,
+		std::vector<Subset>& subsets,
+		std::vector<M3dMaterial>& mats,
+		SkinnedData& skinInfo);
+
+	///<summary>
+	/// Loads m3dFile through the .m3b compiled beside it, compiling it first if it is
+	/// missing or was compiled from a different version of m3dFile.  If the .m3b
+	/// cannot be written, m3dFile is loaded as text.
+	///</summary>
+	bool LoadCompiled(const std::string& m3dFile, 
+		std::vector<SkinnedVertex>& vertices,
+		std::vector<UINT>& indices,
 		std::vector<Subset>& subsets,
 		std::vector<M3dMaterial>& mats,
 		SkinnedData& skinInfo);
 
+	///<summary>
+	/// Compiles the text m3dFile to the binary m3bFile.  Models with bones are
+	/// written with SkinnedVertex vertices and the rest with Vertex.
+	///</summary>
+	bool ConvertToM3b(const std::string& m3dFile, const std::string& m3bFile);
+
+	// m3dFile with its extension replaced by ".m3b".
+	static std::string CompiledFile(const std::string& m3dFile);
+
+	// Why the last LoadM3d failed, such as "soldier.m3d(120): expected a number,
+	// found "x"".
+	const std::string& Error()const { return mError; }
+
+private:
+	bool ReadHeader(TextScanner& in, UINT& numMaterials, UINT& numVertices, UINT& numTriangles,
+		UINT& numBones, UINT& numAnimationClips);
+	void ReadMaterials(TextScanner& in, UINT numMaterials, std::vector<M3dMaterial>& mats);
+	void ReadSubsetTable(TextScanner& in, UINT numSubsets, std::vector<Subset>& subsets);
+	void ReadVertices(TextScanner& in, UINT numVertices, std::vector<Vertex>& vertices);
+	void ReadSkinnedVertices(TextScanner& in, UINT numVertices, std::vector<SkinnedVertex>& vertices);
+	void ReadTriangles(TextScanner& in, UINT numTriangles, UINT numVertices, std::vector<UINT>& indices);
+	void ReadBoneOffsets(TextScanner& in, UINT numBones, std::vector<DirectX::XMFLOAT4X4>& boneOffsets);
+	void ReadBoneHierarchy(TextScanner& in, UINT numBones, std::vector<int>& boneIndexToParentIndex);
+	void ReadAnimationClips(TextScanner& in, UINT numBones, UINT numAnimationClips, std::unordered_map<std::string, AnimationClip>& animations);
+	bool ReadAnimationClipsParallel(TextScanner& in, UINT numBones, UINT numAnimationClips, std::unordered_map<std::string, AnimationClip>& animations);
+	void ReadBoneKeyframes(TextScanner& in, UINT numBones, BoneAnimation& boneAnimation);
+
+	// Records the scanner's error, if it has one, against filename.
+	bool Finish(const TextScanner& in, const std::string& filename);
+
+	bool WriteM3b(const std::string& m3bFile, const void* vertices, UINT vertexStride, UINT vertexCount,
+		const std::vector<UINT>& indices, const std::vector<Subset>& subsets, const std::vector<M3dMaterial>& mats,
+		const SkinnedData* skinInfo, const MappedFile::Stamp& sourceStamp);
+
+private:
+	TaskSystem* mTaskSystem;
+	std::string mError;
+};
+
+///<summary>
+/// An .m3b file, mapped and used in place: the vertex, index and subset arrays are
+/// pointers into the mapping, valid until the next Open or Close, and nothing is
+/// read from disk until it is touched.
+///
+/// The file is versioned, and each section starts on a 16-byte boundary:
+///
+///   header         magic, version, size and last write time of the .m3d it was
+///                  compiled from, counts, vertex stride, and the offset and size
+///                  of each section
+///   strings        null terminated names, referred to by offset
+///   materials      M3dMaterial with its names as string offsets
+///   subsets        Subset
+///   vertices       Vertex or SkinnedVertex, as the stride says
+///   indices        UINT
+///   bone offsets   XMFLOAT4X4
+///   hierarchy      the parent of each bone, -1 for the root
+///   clips          the name of each clip
+///   tracks         for each clip and bone, its first keyframe and keyframe count
+///   keyframes      Keyframe
+///
+/// Open checks that every section lies inside the file and every index and offset
+/// in it is in range, so a truncated or corrupt file fails rather than crashes.
+///</summary>
+class M3bFile
+{
+public:
+	bool Open(const std::string& filename);
+	void Close();
+
+	// Why the last Open failed.
+	const std::string& Error()const { return mError; }
+
+	bool IsSkinned()const;
+
+	// Null unless the file holds vertices of that type.
+	const M3DLoader::Vertex* Vertices()const;
+	const M3DLoader::SkinnedVertex* SkinnedVertices()const;
+
+	const UINT* Indices()const;
+	const M3DLoader::Subset* Subsets()const;
+
+	UINT VertexCount()const;
+	UINT IndexCount()const;
+	UINT SubsetCount()const;
+
+	// The stamp of the .m3d the file was compiled from.
+	std::uint64_t SourceSize()const;
+	std::uint64_t SourceWriteTime()const;
+
+	void GetMaterials(std::vector<M3DLoader::M3dMaterial>& mats)const;
+
+	///<summary>
+	/// Fills skinInfo with views of the file's keyframes.  skinInfo shares the
+	/// mapping, so it stays valid after the file is closed.
+	///</summary>
+	void GetSkinnedData(SkinnedData& skinInfo)const;
+
+private:
+	bool Fail(const std::string& filename, const char* message);
+	const char* String(std::uint32_t offset)const;
+
+	template<typename T>
+	const T* Section(int section)const;
+
 private:
-	void ReadMaterials(std::ifstream& fin, UINT numMaterials, std::vector<M3dMaterial>& mats);
-	void ReadSubsetTable(std::ifstream& fin, UINT numSubsets, std::vector<Subset>& subsets);
-	void ReadVertices(std::ifstream& fin, UINT numVertices, std::vector<Vertex>& vertices);
-	void ReadSkinnedVertices(std::ifstream& fin, UINT numVertices, std::vector<SkinnedVertex>& vertices);
-	void ReadTriangles(std::ifstream& fin, UINT numTriangles, std::vector<USHORT>& indices);
-	void ReadBoneOffsets(std::ifstream& fin, UINT numBones, std::vector<DirectX::XMFLOAT4X4>& boneOffsets);
-	void ReadBoneHierarchy(std::ifstream& fin, UINT numBones, std::vector<int>& boneIndexToParentIndex);
-	void ReadAnimationClips(std::ifstream& fin, UINT numBones, UINT numAnimationClips, std::unordered_map<std::string, AnimationClip>& animations);
-	void ReadBoneKeyframes(std::ifstream& fin, UINT numBones, BoneAnimation& boneAnimation);
+	std::shared_ptr<MappedFile> mFile;
+	std::string mError;
 };
 
 
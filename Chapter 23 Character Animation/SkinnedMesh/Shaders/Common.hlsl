@@ -98,15 +98,15 @@ cbuffer cbPass : register(b2)
 //---------------------------------------------------------------------------------------
 // Transforms a normal map sample to world space.
 //---------------------------------------------------------------------------------------
-float3 NormalSampleToWorldSpace(float3 normalMapSample, float3 unitNormalW, float3 tangentW)
+float3 NormalSampleToWorldSpace(float3 normalMapSample, float3 unitNormalW, float4 tangentW)
 {
 	// Uncompress each component from [0,1] to [-1,1].
 	float3 normalT = 2.0f*normalMapSample - 1.0f;
 
-	// Build orthonormal basis.
+	// Build orthonormal basis.  tangentW.w is -1 where the texture is mirrored.
 	float3 N = unitNormalW;
-	float3 T = normalize(tangentW - dot(tangentW, N)*N);
-	float3 B = cross(N, T);
+	float3 T = normalize(tangentW.xyz - dot(tangentW.xyz, N)*N);
+	float3 B = tangentW.w*cross(N, T);
 
 	float3x3 TBN = float3x3(T, B, N);
 
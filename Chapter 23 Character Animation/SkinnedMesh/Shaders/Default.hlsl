@@ -23,7 +23,7 @@ struct VertexIn
 	float3 PosL    : POSITION;
     float3 NormalL : NORMAL;
 	float2 TexC    : TEXCOORD;
-	float3 TangentL : TANGENT;
+	float4 TangentL : TANGENT;
 #ifdef SKINNED
     float3 BoneWeights : WEIGHTS;
     uint4 BoneIndices  : BONEINDICES;
@@ -37,7 +37,7 @@ struct VertexOut
     float4 SsaoPosH   : POSITION1;
     float3 PosW    : POSITION2;
     float3 NormalW : NORMAL;
-	float3 TangentW : TANGENT;
+	float4 TangentW : TANGENT;
 	float2 TexC    : TEXCOORD;
 };
 
@@ -80,7 +80,9 @@ VertexOut VS(VertexIn vin)
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
     vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
 	
-	vout.TangentW = mul(vin.TangentL, (float3x3)gWorld);
+	// w is the handedness of the tangent frame; the static meshes' tangents have
+	// no w, which the input assembler fills in as 1.
+	vout.TangentW = float4(mul(vin.TangentL.xyz, (float3x3)gWorld), vin.TangentL.w);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
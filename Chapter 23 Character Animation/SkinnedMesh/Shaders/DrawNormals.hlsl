@@ -23,7 +23,7 @@ struct VertexIn
 	float3 PosL    : POSITION;
     float3 NormalL : NORMAL;
 	float2 TexC    : TEXCOORD;
-	float3 TangentL : TANGENT;
+	float4 TangentL : TANGENT;
 #ifdef SKINNED
     float3 BoneWeights : WEIGHTS;
     uint4 BoneIndices  : BONEINDICES;
@@ -34,7 +34,7 @@ struct VertexOut
 {
 	float4 PosH     : SV_POSITION;
     float3 NormalW  : NORMAL;
-	float3 TangentW : TANGENT;
+	float4 TangentW : TANGENT;
 	float2 TexC     : TEXCOORD;
 };
 
@@ -72,7 +72,7 @@ VertexOut VS(VertexIn vin)
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
     vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
-	vout.TangentW = mul(vin.TangentL, (float3x3)gWorld);
+	vout.TangentW = float4(mul(vin.TangentL.xyz, (float3x3)gWorld), vin.TangentL.w);
 
     // Transform to homogeneous clip space.
     float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
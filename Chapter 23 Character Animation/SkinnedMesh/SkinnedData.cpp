@@ -10,60 +10,72 @@ Keyframe::Keyframe()
 {
 }
 
-Keyframe::~Keyframe()
+const Keyframe* BoneAnimation::GetKeyframes()const
 {
+	return MappedKeyframes != nullptr ? MappedKeyframes : Keyframes.data();
+}
+
+UINT BoneAnimation::GetKeyframeCount()const
+{
+	return MappedKeyframes != nullptr ? MappedKeyframeCount : (UINT)Keyframes.size();
 }
  
 float BoneAnimation::GetStartTime()const
 {
 	// Keyframes are sorted by time, so first keyframe gives start time.
-	return Keyframes.front().TimePos;
+	return GetKeyframes()[0].TimePos;
 }
 
 float BoneAnimation::GetEndTime()const
 {
 	// Keyframes are sorted by time, so last keyframe gives end time.
-	float f = Keyframes.back().TimePos;
+	float f = GetKeyframes()[GetKeyframeCount()-1].TimePos;
 
 	return f;
 }
 
 void BoneAnimation::Interpolate(float t, XMFLOAT4X4& M)const
 {
-	if( t <= Keyframes.front().TimePos )
+	const Keyframe* keyframes = GetKeyframes();
+	const UINT keyframeCount = GetKeyframeCount();
+
+	const Keyframe& front = keyframes[0];
+	const Keyframe& back = keyframes[keyframeCount-1];
+
+	if( t <= front.TimePos )
 	{
-		XMVECTOR S = XMLoadFloat3(&Keyframes.front().Scale);
-		XMVECTOR P = XMLoadFloat3(&Keyframes.front().Translation);
-		XMVECTOR Q = XMLoadFloat4(&Keyframes.front().RotationQuat);
+		XMVECTOR S = XMLoadFloat3(&front.Scale);
+		XMVECTOR P = XMLoadFloat3(&front.Translation);
+		XMVECTOR Q = XMLoadFloat4(&front.RotationQuat);
 
 		XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
 		XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
 	}
-	else if( t >= Keyframes.back().TimePos )
+	else if( t >= back.TimePos )
 	{
-		XMVECTOR S = XMLoadFloat3(&Keyframes.back().Scale);
-		XMVECTOR P = XMLoadFloat3(&Keyframes.back().Translation);
-		XMVECTOR Q = XMLoadFloat4(&Keyframes.back().RotationQuat);
+		XMVECTOR S = XMLoadFloat3(&back.Scale);
+		XMVECTOR P = XMLoadFloat3(&back.Translation);
+		XMVECTOR Q = XMLoadFloat4(&back.RotationQuat);
 
 		XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
 		XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
 	}
 	else
 	{
-		for(UINT i = 0; i < Keyframes.size()-1; ++i)
+		for(UINT i = 0; i < keyframeCount-1; ++i)
 		{
-			if( t >= Keyframes[i].TimePos && t <= Keyframes[i+1].TimePos )
+			if( t >= keyframes[i].TimePos && t <= keyframes[i+1].TimePos )
 			{
-				float lerpPercent = (t - Keyframes[i].TimePos) / (Keyframes[i+1].TimePos - Keyframes[i].TimePos);
+				float lerpPercent = (t - keyframes[i].TimePos) / (keyframes[i+1].TimePos - keyframes[i].TimePos);
 
-				XMVECTOR s0 = XMLoadFloat3(&Keyframes[i].Scale);
-				XMVECTOR s1 = XMLoadFloat3(&Keyframes[i+1].Scale);
+				XMVECTOR s0 = XMLoadFloat3(&keyframes[i].Scale);
+				XMVECTOR s1 = XMLoadFloat3(&keyframes[i+1].Scale);
 
-				XMVECTOR p0 = XMLoadFloat3(&Keyframes[i].Translation);
-				XMVECTOR p1 = XMLoadFloat3(&Keyframes[i+1].Translation);
+				XMVECTOR p0 = XMLoadFloat3(&keyframes[i].Translation);
+				XMVECTOR p1 = XMLoadFloat3(&keyframes[i+1].Translation);
 
-				XMVECTOR q0 = XMLoadFloat4(&Keyframes[i].RotationQuat);
-				XMVECTOR q1 = XMLoadFloat4(&Keyframes[i+1].RotationQuat);
+				XMVECTOR q0 = XMLoadFloat4(&keyframes[i].RotationQuat);
+				XMVECTOR q1 = XMLoadFloat4(&keyframes[i+1].RotationQuat);
 
 				XMVECTOR S = XMVectorLerp(s0, s1, lerpPercent);
 				XMVECTOR P = XMVectorLerp(p0, p1, lerpPercent);
@@ -129,11 +141,13 @@ UINT SkinnedData::BoneCount()const
 
 void SkinnedData::Set(std::vector<int>& boneHierarchy, 
 		              std::vector<XMFLOAT4X4>& boneOffsets,
-		              std::unordered_map<std::string, AnimationClip>& animations)
+		              std::unordered_map<std::string, AnimationClip>& animations,
+		              std::shared_ptr<const MappedFile> keyframeFile)
 {
 	mBoneHierarchy = boneHierarchy;
 	mBoneOffsets   = boneOffsets;
 	mAnimations    = animations;
+	mKeyframeFile  = keyframeFile;
 }
  
 void SkinnedData::GetFinalTransforms(const std::string& clipName, float timePos,  std::vector<XMFLOAT4X4>& finalTransforms)const
@@ -4,13 +4,14 @@
 #include "../../Common/d3dUtil.h"
 #include "../../Common/MathHelper.h"
 
+class MappedFile;
+
 ///<summary>
 /// A Keyframe defines the bone transformation at an instant in time.
 ///</summary>
 struct Keyframe
 {
 	Keyframe();
-	~Keyframe();
 
     float TimePos;
 	DirectX::XMFLOAT3 Translation;
@@ -24,6 +25,10 @@ struct Keyframe
 /// two nearest keyframes that bound the time.  
 ///
 /// We assume an animation always has two keyframes.
+///
+/// The keyframes are either owned, in Keyframes, or viewed in place in the
+/// mapping of an .m3b file, through MappedKeyframes, which the SkinnedData the
+/// animation belongs to keeps open.
 ///</summary>
 struct BoneAnimation
 {
@@ -32,7 +37,13 @@ struct BoneAnimation
 
     void Interpolate(float t, DirectX::XMFLOAT4X4& M)const;
 
+	const Keyframe* GetKeyframes()const;
+	UINT GetKeyframeCount()const;
+
 	std::vector<Keyframe> Keyframes; 	
+
+	const Keyframe* MappedKeyframes = nullptr;
+	UINT MappedKeyframeCount = 0;
 };
 
 ///<summary>
@@ -59,10 +70,13 @@ public:
 	float GetClipStartTime(const std::string& clipName)const;
 	float GetClipEndTime(const std::string& clipName)const;
 
+	// keyframeFile is the mapping the animations' MappedKeyframes point into, if
+	// any; it stays open as long as this SkinnedData or a copy of it.
 	void Set(
 		std::vector<int>& boneHierarchy, 
 		std::vector<DirectX::XMFLOAT4X4>& boneOffsets,
-		std::unordered_map<std::string, AnimationClip>& animations);
+		std::unordered_map<std::string, AnimationClip>& animations,
+		std::shared_ptr<const MappedFile> keyframeFile = nullptr);
 
 	 // In a real project, you'd want to cache the result if there was a chance
 	 // that you were calling this several times with the same clipName at 
@@ -70,6 +84,10 @@ public:
     void GetFinalTransforms(const std::string& clipName, float timePos, 
 		 std::vector<DirectX::XMFLOAT4X4>& finalTransforms)const;
 
+	const std::vector<int>& BoneHierarchy()const { return mBoneHierarchy; }
+	const std::vector<DirectX::XMFLOAT4X4>& BoneOffsets()const { return mBoneOffsets; }
+	const std::unordered_map<std::string, AnimationClip>& Animations()const { return mAnimations; }
+
 private:
     // Gives parentIndex of ith bone.
 	std::vector<int> mBoneHierarchy;
@@ -77,6 +95,8 @@ private:
 	std::vector<DirectX::XMFLOAT4X4> mBoneOffsets;
    
 	std::unordered_map<std::string, AnimationClip> mAnimations;
+
+	std::shared_ptr<const MappedFile> mKeyframeFile;
 };
  
 #endif // SKINNEDDATA_H
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/MeshOptimizer.h"
+#include "../../Common/TangentGenerator.h"
 #include "../../Common/Camera.h"
 #include "FrameResource.h"
 #include "ShadowMap.h"
@@ -1121,9 +1123,9 @@ void SkinnedMeshApp::BuildShadersAndInputLayout()
         { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
         { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
         { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "WEIGHTS", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 44, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "BONEINDICES", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 56, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+        { "TANGENT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "WEIGHTS", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 48, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "BONEINDICES", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 60, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
     };
 }
 
@@ -1277,11 +1279,43 @@ void SkinnedMeshApp::BuildShapeGeometry()
 void SkinnedMeshApp::LoadSkinnedModel()
 {
 	std::vector<M3DLoader::SkinnedVertex> vertices;
-	std::vector<std::uint16_t> indices;	
+	std::vector<UINT> indices;	
  
+	// Loads Models/soldier.m3b, compiling it from the text on the first run.
 	M3DLoader m3dLoader;
-	m3dLoader.LoadM3d(mSkinnedModelFilename, vertices, indices, 
-        mSkinnedSubsets, mSkinnedMats, mSkinnedInfo);
+	if(!m3dLoader.LoadCompiled(mSkinnedModelFilename, vertices, indices,
+		mSkinnedSubsets, mSkinnedMats, mSkinnedInfo))
+	{
+		MessageBox(0, AnsiToWString(m3dLoader.Error()).c_str(), 0, 0);
+		return;
+	}
+
+	// Models exported without tangents store zeros; generate them so the normal
+	// maps still apply.
+	bool hasTangents = std::any_of(vertices.begin(), vertices.end(), [](const M3DLoader::SkinnedVertex& v)
+	{
+		return v.TangentU.x != 0.0f || v.TangentU.y != 0.0f || v.TangentU.z != 0.0f;
+	});
+
+	if(!hasTangents)
+	{
+		TangentGenerator::VertexLayout layout;
+		layout.Stride = sizeof(M3DLoader::SkinnedVertex);
+		layout.PositionOffset = offsetof(M3DLoader::SkinnedVertex, Pos);
+		layout.NormalOffset = offsetof(M3DLoader::SkinnedVertex, Normal);
+		layout.TexCOffset = offsetof(M3DLoader::SkinnedVertex, TexC);
+		layout.TangentOffset = offsetof(M3DLoader::SkinnedVertex, TangentU);
+		layout.HandednessOffset = offsetof(M3DLoader::SkinnedVertex, TangentU) + sizeof(float)*3;
+
+		TangentGenerator::Generate(vertices.data(), layout, (UINT)vertices.size(), indices.data(), indices.size());
+	}
+
+	// Reorder each subset for the post-transform cache and early-z.
+	for(const auto& subset : mSkinnedSubsets)
+	{
+		MeshOptimizer::Optimize(&vertices[subset.VertexStart], sizeof(M3DLoader::SkinnedVertex), subset.VertexCount,
+			offsetof(M3DLoader::SkinnedVertex, Pos), &indices[subset.FaceStart * 3], subset.FaceCount * 3, subset.VertexStart);
+	}
 
     mSkinnedModelInst = std::make_unique<SkinnedModelInstance>();
     mSkinnedModelInst->SkinnedInfo = &mSkinnedInfo;
@@ -1289,8 +1323,25 @@ void SkinnedMeshApp::LoadSkinnedModel()
     mSkinnedModelInst->ClipName = "Take1";
     mSkinnedModelInst->TimePos = 0.0f;
  
+	// Use 16-bit indices, splitting any subset that spans more vertices than they
+	// can address.
+	std::vector<IndexBuilder::Submesh> subsetRanges(mSkinnedSubsets.size());
+	for(size_t i = 0; i < mSkinnedSubsets.size(); ++i)
+	{
+		subsetRanges[i].StartIndex = mSkinnedSubsets[i].FaceStart * 3;
+		subsetRanges[i].IndexCount = mSkinnedSubsets[i].FaceCount * 3;
+	}
+
+	IndexBuilder::IndexData indexData = IndexBuilder::Build(indices.data(), (UINT)vertices.size(), subsetRanges);
+	if(!indexData.VertexRemap.empty())
+	{
+		std::vector<M3DLoader::SkinnedVertex> remapped(indexData.VertexRemap.size());
+		IndexBuilder::RemapVertices(vertices.data(), sizeof(M3DLoader::SkinnedVertex), indexData.VertexRemap, remapped.data());
+		vertices.swap(remapped);
+	}
+
 	const UINT vbByteSize = (UINT)vertices.size() * sizeof(SkinnedVertex);
-    const UINT ibByteSize = (UINT)indices.size()  * sizeof(std::uint16_t);
+    const UINT ibByteSize = (UINT)indexData.ByteSize();
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = mSkinnedModelFilename;
@@ -1299,29 +1350,32 @@ void SkinnedMeshApp::LoadSkinnedModel()
 	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indexData.Data(), ibByteSize);
 
 	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
 		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		mCommandList.Get(), indexData.Data(), ibByteSize, geo->IndexBufferUploader);
 
 	geo->VertexByteStride = sizeof(SkinnedVertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexFormat = IndexFormat(indexData);
 	geo->IndexBufferByteSize = ibByteSize;
 
+	// Subset i is drawn as "sm_i", and any further parts it was split into as
+	// "sm_i_1", "sm_i_2", ...
 	for(UINT i = 0; i < (UINT)mSkinnedSubsets.size(); ++i)
 	{
-		SubmeshGeometry submesh;
-		std::string name = "sm_" + std::to_string(i);
-		
-        submesh.IndexCount = (UINT)mSkinnedSubsets[i].FaceCount * 3;
-        submesh.StartIndexLocation = mSkinnedSubsets[i].FaceStart * 3;
-        submesh.BaseVertexLocation = 0;
-
-		geo->DrawArgs[name] = submesh;
+		std::vector<SubmeshGeometry> parts = BuildSubmeshes(indexData, i);
+		for(size_t part = 0; part < parts.size(); ++part)
+		{
+			std::string name = "sm_" + std::to_string(i);
+			if(part > 0)
+				name += "_" + std::to_string(part);
+
+			geo->DrawArgs[name] = parts[part];
+		}
 	}
 
 	mGeometries[geo->Name] = std::move(geo);
@@ -1729,34 +1783,44 @@ void SkinnedMeshApp::BuildRenderItems()
 		mAllRitems.push_back(std::move(rightSphereRitem));
 	}
 
+    MeshGeometry* skinnedGeo = mGeometries[mSkinnedModelFilename].get();
     for(UINT i = 0; i < mSkinnedMats.size(); ++i)
     {
-        std::string submeshName = "sm_" + std::to_string(i);
-
-        auto ritem = std::make_unique<RenderItem>();
-
-        // Reflect to change coordinate system from the RHS the data was exported out as.
-        XMMATRIX modelScale = XMMatrixScaling(0.05f, 0.05f, -0.05f);
-        XMMATRIX modelRot = XMMatrixRotationY(MathHelper::Pi);
-        XMMATRIX modelOffset = XMMatrixTranslation(0.0f, 0.0f, -5.0f);
-        XMStoreFloat4x4(&ritem->World, modelScale*modelRot*modelOffset);
-
-        ritem->TexTransform = MathHelper::Identity4x4();
-        ritem->ObjCBIndex = objCBIndex++;
-        ritem->Mat = mMaterials[mSkinnedMats[i].Name].get();
-        ritem->Geo = mGeometries[mSkinnedModelFilename].get();
-        ritem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        ritem->IndexCount = ritem->Geo->DrawArgs[submeshName].IndexCount;
-        ritem->StartIndexLocation = ritem->Geo->DrawArgs[submeshName].StartIndexLocation;
-        ritem->BaseVertexLocation = ritem->Geo->DrawArgs[submeshName].BaseVertexLocation;
-
-        // All render items for this solider.m3d instance share
-        // the same skinned model instance.
-        ritem->SkinnedCBIndex = 0;
-        ritem->SkinnedModelInst = mSkinnedModelInst.get();
-
-        mRitemLayer[(int)RenderLayer::SkinnedOpaque].push_back(ritem.get());
-        mAllRitems.push_back(std::move(ritem));
+        // One render item for each part the subset was split into.
+        for(UINT part = 0; ; ++part)
+        {
+            std::string submeshName = "sm_" + std::to_string(i);
+            if(part > 0)
+                submeshName += "_" + std::to_string(part);
+
+            if(skinnedGeo->DrawArgs.find(submeshName) == skinnedGeo->DrawArgs.end())
+                break;
+
+            auto ritem = std::make_unique<RenderItem>();
+
+            // Reflect to change coordinate system from the RHS the data was exported out as.
+            XMMATRIX modelScale = XMMatrixScaling(0.05f, 0.05f, -0.05f);
+            XMMATRIX modelRot = XMMatrixRotationY(MathHelper::Pi);
+            XMMATRIX modelOffset = XMMatrixTranslation(0.0f, 0.0f, -5.0f);
+            XMStoreFloat4x4(&ritem->World, modelScale*modelRot*modelOffset);
+
+            ritem->TexTransform = MathHelper::Identity4x4();
+            ritem->ObjCBIndex = objCBIndex++;
+            ritem->Mat = mMaterials[mSkinnedMats[i].Name].get();
+            ritem->Geo = skinnedGeo;
+            ritem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+            ritem->IndexCount = ritem->Geo->DrawArgs[submeshName].IndexCount;
+            ritem->StartIndexLocation = ritem->Geo->DrawArgs[submeshName].StartIndexLocation;
+            ritem->BaseVertexLocation = ritem->Geo->DrawArgs[submeshName].BaseVertexLocation;
+
+            // All render items for this solider.m3d instance share
+            // the same skinned model instance.
+            ritem->SkinnedCBIndex = 0;
+            ritem->SkinnedModelInst = mSkinnedModelInst.get();
+
+            mRitemLayer[(int)RenderLayer::SkinnedOpaque].push_back(ritem.get());
+            mAllRitems.push_back(std::move(ritem));
+        }
     }
 }
 
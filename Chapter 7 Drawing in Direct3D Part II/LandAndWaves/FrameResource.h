@@ -39,7 +39,7 @@ struct FrameResource
 {
 public:
     
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT waveVertCount);
+    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT waveVertCount, UINT terrainVertCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -57,6 +57,12 @@ public:
     // the commands that reference it.  So each frame needs their own.
     std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
 
+    // Waves::Version() when WavesVB was last written.
+    std::uint64_t WavesVersion = 0;
+
+    // The terrain chunks selected for this frame.
+    std::unique_ptr<UploadBuffer<Vertex>> TerrainVB = nullptr;
+
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
     UINT64 Fence = 0;
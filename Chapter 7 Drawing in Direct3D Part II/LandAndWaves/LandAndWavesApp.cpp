@@ -8,6 +8,7 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/Terrain.h"
 #include "FrameResource.h"
 #include "Waves.h"
 
@@ -51,6 +52,7 @@ struct RenderItem
 enum class RenderLayer : int
 {
 	Opaque = 0,
+	Terrain,
 	Count
 };
 
@@ -78,6 +80,7 @@ private:
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateWaves(const GameTimer& gt);
+	void UpdateTerrain(const GameTimer& gt);
 
     void BuildRootSignature();
     void BuildShadersAndInputLayout();
@@ -90,6 +93,7 @@ private:
 
     float GetHillsHeight(float x, float z)const;
     XMFLOAT3 GetHillsNormal(float x, float z)const;
+	XMFLOAT4 GetHillsColor(float y)const;
 
 private:
 
@@ -109,6 +113,10 @@ private:
 
 	RenderItem* mWavesRitem = nullptr;
 
+	// Holds the land's constants; the chunks drawn each frame are copies of it.
+	RenderItem* mLandRitem = nullptr;
+	std::vector<std::unique_ptr<RenderItem>> mTerrainChunkRitems;
+
 	// List of all the render items.
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 
@@ -116,6 +124,11 @@ private:
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
 	std::unique_ptr<Waves> mWaves;
+	std::vector<Waves::VertexRange> mWavesRanges;
+
+	std::unique_ptr<Terrain> mTerrain;
+	Terrain::Selection mTerrainSelection;
+	std::vector<Vertex> mTerrainVertices;
 
     PassConstants mMainPassCB;
 
@@ -125,6 +138,8 @@ private:
 	XMFLOAT4X4 mView = MathHelper::Identity4x4();
 	XMFLOAT4X4 mProj = MathHelper::Identity4x4();
 
+	BoundingFrustum mCamFrustum;
+
     float mTheta = 1.5f*XM_PI;
     float mPhi = XM_PIDIV2 - 0.1f;
     float mRadius = 50.0f;
@@ -206,6 +221,12 @@ void LandAndWavesApp::OnResize()
     // The window resized, so update the aspect ratio and recompute the projection matrix.
     XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
     XMStoreFloat4x4(&mProj, P);
+
+	BoundingFrustum::CreateFromMatrix(mCamFrustum, P);
+
+	// The terrain's level of detail is chosen in pixels.
+	if(mTerrain != nullptr)
+		mTerrain->SetScreenError(0.25f*MathHelper::Pi, (float)mClientHeight, 2.0f);
 }
 
 void LandAndWavesApp::Update(const GameTimer& gt)
@@ -230,6 +251,7 @@ void LandAndWavesApp::Update(const GameTimer& gt)
 	UpdateObjectCBs(gt);
 	UpdateMainPassCB(gt);
 	UpdateWaves(gt);
+	UpdateTerrain(gt);
 }
 
 void LandAndWavesApp::Draw(const GameTimer& gt)
@@ -272,6 +294,7 @@ void LandAndWavesApp::Draw(const GameTimer& gt)
 	mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
 
 	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Terrain]);
 
 	// Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -435,22 +458,71 @@ void LandAndWavesApp::UpdateWaves(const GameTimer& gt)
 	// Update the wave simulation.
 	mWaves->Update(gt.DeltaTime());
 
-	// Update the wave vertex buffer with the new solution.
+	// Update the wave vertex buffer with the new solution.  Only vertices that
+	// changed since this frame resource's buffer was last written need copying.
 	auto currWavesVB = mCurrFrameResource->WavesVB.get();
-	for(int i = 0; i < mWaves->VertexCount(); ++i)
+	mWaves->GetChangedVertexRanges(mCurrFrameResource->WavesVersion, mWavesRanges);
+	for(const auto& range : mWavesRanges)
 	{
-		Vertex v;
+		for(int i = range.First; i < range.First + range.Count; ++i)
+		{
+			Vertex v;
 
-		v.Pos = mWaves->Position(i);
-        v.Color = XMFLOAT4(DirectX::Colors::Blue);
+			v.Pos = mWaves->Position(i);
+	        v.Color = XMFLOAT4(DirectX::Colors::Blue);
 
-		currWavesVB->CopyData(i, v);
+			currWavesVB->CopyData(i, v);
+		}
 	}
+	mCurrFrameResource->WavesVersion = mWaves->Version();
 
 	// Set the dynamic VB of the wave renderitem to the current frame VB.
 	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
 }
 
+void LandAndWavesApp::UpdateTerrain(const GameTimer& gt)
+{
+	// Select the chunks of land in view, at a level of detail that depends on their
+	// distance.
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+
+	BoundingFrustum worldSpaceFrustum;
+	mCamFrustum.Transform(worldSpaceFrustum, invView);
+
+	mTerrain->Select(mEyePos, &worldSpaceFrustum, mTerrainSelection, mTerrain->MaxVertexCount());
+
+	// The land is colored by height, so build the vertices here and then copy them
+	// into this frame's vertex buffer, which is write-combined and must not be read.
+	GeometryGenerator::VertexLayout layout;
+	layout.Stride = sizeof(Vertex);
+	layout.PositionOffset = offsetof(Vertex, Pos);
+
+	mTerrainVertices.resize(mTerrainSelection.VertexCount);
+	mTerrain->WriteVertices(mTerrainSelection, mEyePos, mTerrainVertices.data(), layout);
+	for(auto& v : mTerrainVertices)
+		v.Color = GetHillsColor(v.Pos.y);
+
+	auto currTerrainVB = mCurrFrameResource->TerrainVB.get();
+	CopyMemory(currTerrainVB->MappedData(), mTerrainVertices.data(), mTerrainVertices.size()*sizeof(Vertex));
+	mLandRitem->Geo->VertexBufferGPU = currTerrainVB->Resource();
+
+	// One render item per chunk, all with the land's constants.
+	auto& chunkRitems = mRitemLayer[(int)RenderLayer::Terrain];
+	chunkRitems.clear();
+	for(const auto& chunk : mTerrainSelection.Chunks)
+	{
+		if(chunkRitems.size() == mTerrainChunkRitems.size())
+			mTerrainChunkRitems.push_back(std::make_unique<RenderItem>(*mLandRitem));
+
+		RenderItem* ri = mTerrainChunkRitems[chunkRitems.size()].get();
+		ri->IndexCount = chunk.IndexCount;
+		ri->StartIndexLocation = chunk.StartIndex;
+		ri->BaseVertexLocation = chunk.BaseVertex;
+		chunkRitems.push_back(ri);
+	}
+}
+
 void LandAndWavesApp::BuildRootSignature()
 {
     // Root parameter can be a table, root descriptor or root constants.
@@ -496,67 +568,33 @@ void LandAndWavesApp::BuildShadersAndInputLayout()
 
 void LandAndWavesApp::BuildLandGeometry()
 {
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(160.0f, 160.0f, 50, 50);
-
 	//
-	// Extract the vertex elements we are interested and apply the height function to
-	// each vertex.  In addition, color the vertices based on their height so we have
-	// sandy looking beaches, grassy low hills, and snow mountain peaks.
+	// Sample the hills into a heightfield and draw it as a Terrain: each frame only
+	// the chunks in view are written to a dynamic vertex buffer (see UpdateTerrain),
+	// all drawn with the same small index buffer.
 	//
 
-	std::vector<Vertex> vertices(grid.Vertices.size());
-	for(size_t i = 0; i < grid.Vertices.size(); ++i)
-	{
-		auto& p = grid.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Pos.y = GetHillsHeight(p.x, p.z);
-
-        // Color the vertex based on its height.
-        if(vertices[i].Pos.y < -10.0f)
-        {
-            // Sandy beach color.
-            vertices[i].Color = XMFLOAT4(1.0f, 0.96f, 0.62f, 1.0f);
-        }
-        else if(vertices[i].Pos.y < 5.0f)
-        {
-            // Light yellow-green.
-            vertices[i].Color = XMFLOAT4(0.48f, 0.77f, 0.46f, 1.0f);
-        }
-        else if(vertices[i].Pos.y < 12.0f)
-        {
-            // Dark yellow-green.
-            vertices[i].Color = XMFLOAT4(0.1f, 0.48f, 0.19f, 1.0f);
-        }
-        else if(vertices[i].Pos.y < 20.0f)
-        {
-            // Dark brown.
-            vertices[i].Color = XMFLOAT4(0.45f, 0.39f, 0.34f, 1.0f);
-        }
-        else
-        {
-            // White snow.
-            vertices[i].Color = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-        }
-	}
-    
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	Heightfield heightfield(257, 257, 0.625f);
+	heightfield.Generate([this](float x, float z) { return GetHillsHeight(x, z); });
+
+	mTerrain = std::make_unique<Terrain>(std::move(heightfield), 16);
+	mTerrain->SetScreenError(0.25f*MathHelper::Pi, (float)mClientHeight, 2.0f);
+
+	const UINT vbByteSize = mTerrain->MaxVertexCount()*sizeof(Vertex);
 
-	std::vector<std::uint16_t> indices = grid.GetIndices16();
+	const std::vector<std::uint16_t>& indices = mTerrain->Indices();
 	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "landGeo";
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	// Set dynamically.
+	geo->VertexBufferCPU = nullptr;
+	geo->VertexBufferGPU = nullptr;
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
 		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
@@ -565,20 +603,12 @@ void LandAndWavesApp::BuildLandGeometry()
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["grid"] = submesh;
-
 	mGeometries["landGeo"] = std::move(geo);
 }
 
 void LandAndWavesApp::BuildWavesGeometryBuffers()
 {
-	std::vector<std::uint16_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
-	assert(mWaves->VertexCount() < 0x0000ffff);
+	std::vector<std::uint32_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
 
 	// Iterate over each quad.
 	int m = mWaves->RowCount();
@@ -601,7 +631,12 @@ void LandAndWavesApp::BuildWavesGeometryBuffers()
 	}
 
 	UINT vbByteSize = mWaves->VertexCount()*sizeof(Vertex);
-	UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint16_t);
+	// The vertices are rewritten in place every frame, so the grid cannot be
+	// split; one too large for 16-bit indices gets 32-bit ones.
+	IndexBuilder::IndexData indexData = IndexBuilder::Build(indices.data(), indices.size(),
+		(UINT)mWaves->VertexCount(), IndexBuilder::SplitMode::None);
+
+	UINT ibByteSize = (UINT)indexData.ByteSize();
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "waterGeo";
@@ -611,20 +646,17 @@ void LandAndWavesApp::BuildWavesGeometryBuffers()
 	geo->VertexBufferGPU = nullptr;
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indexData.Data(), ibByteSize);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		mCommandList.Get(), indexData.Data(), ibByteSize, geo->IndexBufferUploader);
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexFormat = IndexFormat(indexData);
 	geo->IndexBufferByteSize = ibByteSize;
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+	SubmeshGeometry submesh = BuildSubmeshes(indexData, 0)[0];
 
 	geo->DrawArgs["grid"] = submesh;
 
@@ -677,7 +709,7 @@ void LandAndWavesApp::BuildFrameResources()
     for(int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), mWaves->VertexCount()));
+            1, (UINT)mAllRitems.size(), mWaves->VertexCount(), mTerrain->MaxVertexCount()));
     }
 }
 
@@ -696,16 +728,14 @@ void LandAndWavesApp::BuildRenderItems()
 
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(wavesRitem.get());
 
+	// The land is drawn a chunk at a time by copies of this item; see UpdateTerrain.
 	auto gridRitem = std::make_unique<RenderItem>();
 	gridRitem->World = MathHelper::Identity4x4();
 	gridRitem->ObjCBIndex = 1;
 	gridRitem->Geo = mGeometries["landGeo"].get();
 	gridRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-	gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
 
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
+	mLandRitem = gridRitem.get();
 
 	mAllRitems.push_back(std::move(wavesRitem));
 	mAllRitems.push_back(std::move(gridRitem));
@@ -753,3 +783,34 @@ XMFLOAT3 LandAndWavesApp::GetHillsNormal(float x, float z)const
 
     return n;
 }
+
+XMFLOAT4 LandAndWavesApp::GetHillsColor(float y)const
+{
+	// Color by height so we have sandy looking beaches, grassy low hills, and snow
+	// mountain peaks.
+    if(y < -10.0f)
+    {
+        // Sandy beach color.
+        return XMFLOAT4(1.0f, 0.96f, 0.62f, 1.0f);
+    }
+    else if(y < 5.0f)
+    {
+        // Light yellow-green.
+        return XMFLOAT4(0.48f, 0.77f, 0.46f, 1.0f);
+    }
+    else if(y < 12.0f)
+    {
+        // Dark yellow-green.
+        return XMFLOAT4(0.1f, 0.48f, 0.19f, 1.0f);
+    }
+    else if(y < 20.0f)
+    {
+        // Dark brown.
+        return XMFLOAT4(0.45f, 0.39f, 0.34f, 1.0f);
+    }
+    else
+    {
+        // White snow.
+        return XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+    }
+}
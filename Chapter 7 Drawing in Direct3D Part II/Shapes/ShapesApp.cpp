@@ -527,10 +527,10 @@ void ShapesApp::BuildShadersAndInputLayout()
 void ShapesApp::BuildShapeGeometry()
 {
     GeometryGenerator geoGen;
-	GeometryGenerator::MeshData box = geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3);
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(20.0f, 30.0f, 60, 40);
-	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
-	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);
+	GeometryGenerator::MeshSize box = geoGen.BoxSize(3);
+	GeometryGenerator::MeshSize grid = geoGen.GridSize(60, 40);
+	GeometryGenerator::MeshSize sphere = geoGen.SphereSize(20, 20);
+	GeometryGenerator::MeshSize cylinder = geoGen.CylinderSize(20, 20);
 
 	//
 	// We are concatenating all the geometry into one big vertex/index buffer.  So
@@ -539,82 +539,71 @@ void ShapesApp::BuildShapeGeometry()
 
 	// Cache the vertex offsets to each object in the concatenated vertex buffer.
 	UINT boxVertexOffset = 0;
-	UINT gridVertexOffset = (UINT)box.Vertices.size();
-	UINT sphereVertexOffset = gridVertexOffset + (UINT)grid.Vertices.size();
-	UINT cylinderVertexOffset = sphereVertexOffset + (UINT)sphere.Vertices.size();
+	UINT gridVertexOffset = box.VertexCount;
+	UINT sphereVertexOffset = gridVertexOffset + grid.VertexCount;
+	UINT cylinderVertexOffset = sphereVertexOffset + sphere.VertexCount;
 
 	// Cache the starting index for each object in the concatenated index buffer.
 	UINT boxIndexOffset = 0;
-	UINT gridIndexOffset = (UINT)box.Indices32.size();
-	UINT sphereIndexOffset = gridIndexOffset + (UINT)grid.Indices32.size();
-	UINT cylinderIndexOffset = sphereIndexOffset + (UINT)sphere.Indices32.size();
+	UINT gridIndexOffset = box.IndexCount;
+	UINT sphereIndexOffset = gridIndexOffset + grid.IndexCount;
+	UINT cylinderIndexOffset = sphereIndexOffset + sphere.IndexCount;
 
     // Define the SubmeshGeometry that cover different 
     // regions of the vertex/index buffers.
 
 	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
+	boxSubmesh.IndexCount = box.IndexCount;
 	boxSubmesh.StartIndexLocation = boxIndexOffset;
 	boxSubmesh.BaseVertexLocation = boxVertexOffset;
 
 	SubmeshGeometry gridSubmesh;
-	gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
+	gridSubmesh.IndexCount = grid.IndexCount;
 	gridSubmesh.StartIndexLocation = gridIndexOffset;
 	gridSubmesh.BaseVertexLocation = gridVertexOffset;
 
 	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
+	sphereSubmesh.IndexCount = sphere.IndexCount;
 	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
 	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
 
 	SubmeshGeometry cylinderSubmesh;
-	cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
+	cylinderSubmesh.IndexCount = cylinder.IndexCount;
 	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
 	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
 
 	//
-	// Extract the vertex elements we are interested in and pack the
-	// vertices of all the meshes into one vertex buffer.
+	// Generate the positions of all the meshes straight into one vertex buffer,
+	// then fill in the colors.
 	//
 
-	auto totalVertexCount =
-		box.Vertices.size() +
-		grid.Vertices.size() +
-		sphere.Vertices.size() +
-		cylinder.Vertices.size();
+	UINT totalVertexCount = cylinderVertexOffset + cylinder.VertexCount;
+	UINT totalIndexCount = cylinderIndexOffset + cylinder.IndexCount;
 
 	std::vector<Vertex> vertices(totalVertexCount);
+	std::vector<std::uint16_t> indices(totalIndexCount);
 
-	UINT k = 0;
-	for(size_t i = 0; i < box.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = box.Vertices[i].Position;
-        vertices[k].Color = XMFLOAT4(DirectX::Colors::DarkGreen);
-	}
+	GeometryGenerator::MeshBuffers out;
+	out.Vertices = vertices.data();
+	out.Layout.Stride = sizeof(Vertex);
+	out.Layout.PositionOffset = offsetof(Vertex, Pos);
+	out.Indices16 = indices.data();
 
-	for(size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-        vertices[k].Color = XMFLOAT4(DirectX::Colors::ForestGreen);
-	}
+	geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3, out.Advance(boxVertexOffset, boxIndexOffset));
+	geoGen.CreateGrid(20.0f, 30.0f, 60, 40, out.Advance(gridVertexOffset, gridIndexOffset));
+	geoGen.CreateSphere(0.5f, 20, 20, out.Advance(sphereVertexOffset, sphereIndexOffset));
+	geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20, out.Advance(cylinderVertexOffset, cylinderIndexOffset));
 
-	for(size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
+	auto setColor = [&](UINT first, UINT count, const XMVECTORF32& color)
 	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-        vertices[k].Color = XMFLOAT4(DirectX::Colors::Crimson);
-	}
-
-	for(size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::SteelBlue);
-	}
+		for(UINT i = first; i < first + count; ++i)
+			vertices[i].Color = XMFLOAT4(color);
+	};
 
-	std::vector<std::uint16_t> indices;
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
+	setColor(boxVertexOffset, box.VertexCount, DirectX::Colors::DarkGreen);
+	setColor(gridVertexOffset, grid.VertexCount, DirectX::Colors::ForestGreen);
+	setColor(sphereVertexOffset, sphere.VertexCount, DirectX::Colors::Crimson);
+	setColor(cylinderVertexOffset, cylinder.VertexCount, DirectX::Colors::SteelBlue);
 
     const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
     const UINT ibByteSize = (UINT)indices.size()  * sizeof(std::uint16_t);
@@ -6,6 +6,7 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/MeshCache.h"
 #include "FrameResource.h"
 
 using Microsoft::WRL::ComPtr;
@@ -49,6 +50,10 @@ struct RenderItem
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+	// If not empty, only the clusters that are in the frustum and not facing
+	// away from the eye are drawn.
+	std::vector<SubmeshCluster> Clusters;
 };
 
 class LitColumnsApp : public D3DApp
@@ -120,6 +125,8 @@ private:
 	XMFLOAT4X4 mView = MathHelper::Identity4x4();
 	XMFLOAT4X4 mProj = MathHelper::Identity4x4();
 
+	BoundingFrustum mCamFrustum;
+
     float mTheta = 1.5f*XM_PI;
     float mPhi = 0.2f*XM_PI;
     float mRadius = 15.0f;
@@ -200,6 +207,8 @@ void LitColumnsApp::OnResize()
     // The window resized, so update the aspect ratio and recompute the projection matrix.
     XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
     XMStoreFloat4x4(&mProj, P);
+
+	BoundingFrustum::CreateFromMatrix(mCamFrustum, P);
 }
 
 void LitColumnsApp::Update(const GameTimer& gt)
@@ -612,45 +621,34 @@ void LitColumnsApp::BuildShapeGeometry()
 
 void LitColumnsApp::BuildSkullGeometry()
 {
-	std::ifstream fin("Models/skull.txt");
+	MeshCache skull;
 
-	if(!fin)
+	if(!skull.Open(L"Models/skull.txt"))
 	{
-		MessageBox(0, L"Models/skull.txt not found.", 0, 0);
+		MessageBox(0, AnsiToWString("Models/skull.txt: " + skull.Error()).c_str(), 0, 0);
 		return;
 	}
 
-	UINT vcount = 0;
-	UINT tcount = 0;
-	std::string ignore;
-
-	fin >> ignore >> vcount;
-	fin >> ignore >> tcount;
-	fin >> ignore >> ignore >> ignore >> ignore;
+	UINT vcount = skull.VertexCount();
 
 	std::vector<Vertex> vertices(vcount);
 	for(UINT i = 0; i < vcount; ++i)
 	{
-		fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-		fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
-	}
-
-	fin >> ignore;
-	fin >> ignore;
-	fin >> ignore;
-
-	std::vector<std::int32_t> indices(3 * tcount);
-	for(UINT i = 0; i < tcount; ++i)
-	{
-		fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
+		vertices[i].Pos = skull.Vertices()[i].Pos;
+		vertices[i].Normal = skull.Vertices()[i].Normal;
 	}
 
-	fin.close();
+	std::vector<std::int32_t> indices(skull.Indices(), skull.Indices() + skull.IndexCount());
 
 	//
-	// Pack the indices of all the meshes into one index buffer.
+	// Split the skull into clusters, each drawn only when some of it can be seen.
+	// The index buffer is rewritten so each cluster is a contiguous range.
 	//
 
+	MeshletBuilder::MeshletData meshlets = MeshletBuilder::Build(vertices.data(), sizeof(Vertex),
+		vcount, offsetof(Vertex, Pos), indices.data(), indices.size());
+	MeshletBuilder::WriteIndices(meshlets, indices.data());
+
 	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
 
 	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::int32_t);
@@ -680,6 +678,15 @@ void LitColumnsApp::BuildSkullGeometry()
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
 
+	for(size_t i = 0; i < meshlets.Meshlets.size(); ++i)
+	{
+		SubmeshCluster cluster;
+		cluster.IndexCount = 3 * meshlets.Meshlets[i].TriangleCount;
+		cluster.StartIndexLocation = submesh.StartIndexLocation + 3 * meshlets.Meshlets[i].TriangleOffset;
+		cluster.Bounds = meshlets.MeshletBounds[i];
+		submesh.Clusters.push_back(cluster);
+	}
+
 	geo->DrawArgs["skull"] = submesh;
 
 	mGeometries[geo->Name] = std::move(geo);
@@ -803,6 +810,7 @@ void LitColumnsApp::BuildRenderItems()
 	skullRitem->IndexCount = skullRitem->Geo->DrawArgs["skull"].IndexCount;
 	skullRitem->StartIndexLocation = skullRitem->Geo->DrawArgs["skull"].StartIndexLocation;
 	skullRitem->BaseVertexLocation = skullRitem->Geo->DrawArgs["skull"].BaseVertexLocation;
+	skullRitem->Clusters = skullRitem->Geo->DrawArgs["skull"].Clusters;
 	mAllRitems.push_back(std::move(skullRitem));
 
 	XMMATRIX brickTexTransform = XMMatrixScaling(1.0f, 1.0f, 1.0f);
@@ -879,6 +887,9 @@ void LitColumnsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const st
 	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
 	auto matCB = mCurrFrameResource->MaterialCB->Resource();
 
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+
     // For each render item...
     for(size_t i = 0; i < ritems.size(); ++i)
     {
@@ -894,6 +905,44 @@ void LitColumnsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const st
         cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
 		cmdList->SetGraphicsRootConstantBufferView(1, matCBAddress);
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+		if(ri->Clusters.empty())
+		{
+			cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+			continue;
+		}
+
+		// Cull the clusters in the object's local space.
+		XMMATRIX world = XMLoadFloat4x4(&ri->World);
+		XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(world), world);
+
+		BoundingFrustum localSpaceFrustum;
+		mCamFrustum.Transform(localSpaceFrustum, XMMatrixMultiply(invView, invWorld));
+
+		XMFLOAT3 localEyePos;
+		XMStoreFloat3(&localEyePos, XMVector3TransformCoord(XMLoadFloat3(&mEyePos), invWorld));
+
+		// Draw each run of consecutive visible clusters with one call.
+		UINT runStart = 0;
+		UINT runCount = 0;
+		for(const auto& cluster : ri->Clusters)
+		{
+			bool visible = !MeshletBuilder::IsBackFacing(cluster.Bounds, localEyePos) &&
+				localSpaceFrustum.Contains(cluster.Bounds.Sphere) != DirectX::DISJOINT;
+
+			if(visible && runCount > 0 && runStart + runCount == cluster.StartIndexLocation)
+			{
+				runCount += cluster.IndexCount;
+				continue;
+			}
+
+			if(runCount > 0)
+				cmdList->DrawIndexedInstanced(runCount, 1, runStart, ri->BaseVertexLocation, 0);
+
+			runStart = cluster.StartIndexLocation;
+			runCount = visible ? cluster.IndexCount : 0;
+		}
+
+		if(runCount > 0)
+			cmdList->DrawIndexedInstanced(runCount, 1, runStart, ri->BaseVertexLocation, 0);
     }
 }
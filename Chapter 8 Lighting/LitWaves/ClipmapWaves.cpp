@@ -0,0 +1,279 @@
+//***************************************************************************************
+// ClipmapWaves.cpp
+//***************************************************************************************
+
+#include "ClipmapWaves.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace DirectX;
+
+const int ClipmapWaves::MaxCatchUpTicks;
+
+ClipmapWaves::ClipmapWaves(int levelCount, int n, float dx, float dt, float speed, float damping)
+{
+	assert(levelCount >= 1);
+	assert(n >= 9 && (n - 1) % 4 == 0);
+
+	mSize = n;
+	mSpatialStep = dx;
+	mTimeStep = dt;
+
+	// Scaling dx and dt together keeps speed*dt/dx, and so the stability of the
+	// scheme, the same on every level.
+	for(int l = 0; l < levelCount; ++l)
+	{
+		float scale = (float)(1 << l);
+		mLevels.push_back(std::make_unique<Waves>(n, n, dx*scale, dt*scale, speed, damping));
+	}
+
+	mCenterX.assign(levelCount, 0);
+	mCenterZ.assign(levelCount, 0);
+}
+
+ClipmapWaves::~ClipmapWaves()
+{
+}
+
+int ClipmapWaves::LevelCount()const
+{
+	return (int)mLevels.size();
+}
+
+const Waves& ClipmapWaves::Level(int level)const
+{
+	return *mLevels[level];
+}
+
+XMFLOAT3 ClipmapWaves::LevelOffset(int level)const
+{
+	return XMFLOAT3(mCenterX[level]*mSpatialStep, 0.0f, mCenterZ[level]*mSpatialStep);
+}
+
+XMFLOAT3 ClipmapWaves::Position(int level, int i)const
+{
+	XMFLOAT3 p = mLevels[level]->Position(i);
+	p.x += mCenterX[level]*mSpatialStep;
+	p.z += mCenterZ[level]*mSpatialStep;
+	return p;
+}
+
+XMFLOAT3 ClipmapWaves::Normal(int level, int i)const
+{
+	return mLevels[level]->Normal(i);
+}
+
+bool ClipmapWaves::SetViewerPosition(float x, float z)
+{
+	bool moved = false;
+	for(int l = 0; l < LevelCount(); ++l)
+	{
+		// Snap to the grid of the next coarser level.
+		int snap = 2 << l;
+		int cx = (int)std::lround(x / mSpatialStep / snap)*snap;
+		int cz = (int)std::lround(z / mSpatialStep / snap)*snap;
+		if(cx == mCenterX[l] && cz == mCenterZ[l])
+			continue;
+
+		// Rows run towards -z, hence the sign flip for di.
+		int spacing = 1 << l;
+		mLevels[l]->Shift(-(cz - mCenterZ[l]) / spacing, (cx - mCenterX[l]) / spacing);
+
+		mCenterX[l] = cx;
+		mCenterZ[l] = cz;
+		moved = true;
+	}
+
+	if(moved)
+	{
+		for(int l = LevelCount() - 2; l >= 0; --l)
+			DriveBoundary(l);
+	}
+
+	return moved;
+}
+
+void ClipmapWaves::Update(float dt)
+{
+	mAccumulatedTime += dt;
+
+	// A tick is one time step of level 0.
+	int ticks = (int)(mAccumulatedTime / mTimeStep);
+	mAccumulatedTime -= ticks*mTimeStep;
+	ticks = std::min(ticks, MaxCatchUpTicks);
+
+	for(int t = 0; t < ticks; ++t)
+	{
+		++mTick;
+
+		// Level l steps every 2^l ticks.
+		for(int l = 0; l < LevelCount(); ++l)
+		{
+			if(mTick % (1ull << l) == 0)
+				mLevels[l]->Advance(1);
+		}
+
+		// When a coarse level has stepped it is in sync with the finer level, so it
+		// can pick up the finer solution.  Go from fine to coarse so detail reaches
+		// every level that covers it.
+		for(int l = 0; l < LevelCount() - 1; ++l)
+		{
+			if(mTick % (2ull << l) == 0)
+				Restrict(l);
+		}
+
+		// Then drive each level's boundary from the (updated) level around it, going
+		// from coarse to fine.
+		for(int l = LevelCount() - 2; l >= 0; --l)
+			DriveBoundary(l);
+	}
+}
+
+void ClipmapWaves::Disturb(float x, float z, float magnitude)
+{
+	float ux = x / mSpatialStep;
+	float uz = z / mSpatialStep;
+
+	for(int l = 0; l < LevelCount(); ++l)
+	{
+		int spacing = 1 << l;
+		int halfExtent = (mSize - 1) / 2 * spacing;
+
+		int j = (int)std::lround((ux - (mCenterX[l] - halfExtent)) / spacing);
+		int i = (int)std::lround(((mCenterZ[l] + halfExtent) - uz) / spacing);
+
+		// Keep clear of the coupling band along the boundary.
+		if(i >= 3 && i < mSize - 3 && j >= 3 && j < mSize - 3)
+		{
+			mLevels[l]->Disturb(i, j, magnitude);
+			return;
+		}
+	}
+}
+
+void ClipmapWaves::BuildIndices(int level, std::vector<std::uint32_t>& indices)const
+{
+	const int n = mSize;
+
+	// Quads [holeI0, holeI1) x [holeJ0, holeJ1) are drawn by the finer level.
+	int holeI0 = 0, holeI1 = 0, holeJ0 = 0, holeJ1 = 0;
+	if(level > 0)
+	{
+		FineCorner(level, holeI0, holeJ0);
+		holeI1 = holeI0 + (n - 1) / 2;
+		holeJ1 = holeJ0 + (n - 1) / 2;
+	}
+
+	indices.clear();
+	indices.reserve(6*(n - 1)*(n - 1));
+
+	// Iterate over each quad.
+	for(int i = 0; i < n - 1; ++i)
+	{
+		for(int j = 0; j < n - 1; ++j)
+		{
+			if(i >= holeI0 && i < holeI1 && j >= holeJ0 && j < holeJ1)
+				continue;
+
+			indices.push_back(i*n + j);
+			indices.push_back(i*n + j + 1);
+			indices.push_back((i + 1)*n + j);
+
+			indices.push_back((i + 1)*n + j);
+			indices.push_back(i*n + j + 1);
+			indices.push_back((i + 1)*n + j + 1);
+		}
+	}
+}
+
+void ClipmapWaves::FineCorner(int coarseLevel, int& i0, int& j0)const
+{
+	int fine = coarseLevel - 1;
+	int coarseSpacing = 1 << coarseLevel;
+
+	int fineHalfExtent = (mSize - 1) / 2 * (1 << fine);
+	int coarseHalfExtent = (mSize - 1) / 2 * coarseSpacing;
+
+	j0 = ((mCenterX[fine] - fineHalfExtent) - (mCenterX[coarseLevel] - coarseHalfExtent)) / coarseSpacing;
+	i0 = ((mCenterZ[coarseLevel] + coarseHalfExtent) - (mCenterZ[fine] + fineHalfExtent)) / coarseSpacing;
+}
+
+float ClipmapWaves::SampleCurr(int level, float i, float j)const
+{
+	int i0 = std::min(std::max((int)std::floor(i), 0), mSize - 2);
+	int j0 = std::min(std::max((int)std::floor(j), 0), mSize - 2);
+	float s = i - i0;
+	float t = j - j0;
+
+	float prev, h00, h01, h10, h11;
+	mLevels[level]->GetHeights(i0, j0, prev, h00);
+	mLevels[level]->GetHeights(i0, j0 + 1, prev, h01);
+	mLevels[level]->GetHeights(i0 + 1, j0, prev, h10);
+	mLevels[level]->GetHeights(i0 + 1, j0 + 1, prev, h11);
+
+	return (1.0f - s)*((1.0f - t)*h00 + t*h01) + s*((1.0f - t)*h10 + t*h11);
+}
+
+void ClipmapWaves::Restrict(int fineLevel)
+{
+	Waves& fine = *mLevels[fineLevel];
+	Waves& coarse = *mLevels[fineLevel + 1];
+
+	int i0, j0;
+	FineCorner(fineLevel + 1, i0, j0);
+
+	// Leave a band along the fine boundary alone; that is where the coarse level
+	// drives the fine one.
+	const int h = (mSize - 1) / 2;
+	const int margin = 2;
+	for(int i = std::max(i0 + margin, 1); i <= std::min(i0 + h - margin, mSize - 2); ++i)
+	{
+		for(int j = std::max(j0 + margin, 1); j <= std::min(j0 + h - margin, mSize - 2); ++j)
+		{
+			float finePrev, fineCurr;
+			fine.GetHeights(2*(i - i0), 2*(j - j0), finePrev, fineCurr);
+
+			// The coarse previous solution is one coarse step (two fine steps) back;
+			// extrapolate it from the fine rate of change.
+			float prev = fineCurr - 2.0f*(fineCurr - finePrev);
+
+			float coarsePrev, coarseCurr;
+			coarse.GetHeights(i, j, coarsePrev, coarseCurr);
+			if(prev != coarsePrev || fineCurr != coarseCurr)
+				coarse.SetHeights(i, j, prev, fineCurr);
+		}
+	}
+}
+
+void ClipmapWaves::DriveBoundary(int fineLevel)
+{
+	Waves& fine = *mLevels[fineLevel];
+
+	int i0, j0;
+	FineCorner(fineLevel + 1, i0, j0);
+
+	const int n = mSize;
+	auto drive = [&](int i, int j)
+	{
+		float h = SampleCurr(fineLevel + 1, i0 + 0.5f*i, j0 + 0.5f*j);
+
+		// Boundary points are never stepped, so both time levels hold the same value.
+		float prev, curr;
+		fine.GetHeights(i, j, prev, curr);
+		if(prev != h || curr != h)
+			fine.SetHeights(i, j, h, h);
+	};
+
+	for(int k = 0; k < n; ++k)
+	{
+		drive(0, k);
+		drive(n - 1, k);
+	}
+
+	for(int k = 1; k < n - 1; ++k)
+	{
+		drive(k, 0);
+		drive(k, n - 1);
+	}
+}
@@ -0,0 +1,93 @@
+//***************************************************************************************
+// ClipmapWaves.h
+//
+// Wave simulation for large bodies of water.  A stack of nested Waves grids, all with
+// the same number of points, follows the viewer: level 0 is the finest, and every
+// level after it has twice the spacing (and covers four times the area) of the one
+// before.  Coarser levels also take time steps twice as long, so each level costs
+// half as much as the one inside it and the whole stack costs less than two copies
+// of the finest grid, however large the water is.
+//
+// The levels are coupled where they overlap: the boundary of a level is driven by
+// the coarser level around it, and the coarser level takes on the finer solution
+// wherever the finer level covers it.  A coarse level is only drawn outside the
+// footprint of the finer level, see BuildIndices().
+//***************************************************************************************
+
+#ifndef CLIPMAPWAVES_H
+#define CLIPMAPWAVES_H
+
+#include "Waves.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class ClipmapWaves
+{
+public:
+	// Creates levelCount levels of n x n points.  Level 0 has spacing dx and time
+	// step dt; level l has spacing and time step scaled by 2^l.  (n - 1) must be a
+	// multiple of 4 so the grid points of neighbouring levels line up.
+	ClipmapWaves(int levelCount, int n, float dx, float dt, float speed, float damping);
+	ClipmapWaves(const ClipmapWaves& rhs) = delete;
+	ClipmapWaves& operator=(const ClipmapWaves& rhs) = delete;
+	~ClipmapWaves();
+
+	int LevelCount()const;
+
+	// Each level answers the usual Position/Normal/WriteVertices queries in its own
+	// space, centred on LevelOffset().
+	const Waves& Level(int level)const;
+
+	// World-space position of the centre of a level.
+	DirectX::XMFLOAT3 LevelOffset(int level)const;
+
+	// World-space solution at the ith grid point of a level.
+	DirectX::XMFLOAT3 Position(int level, int i)const;
+	DirectX::XMFLOAT3 Normal(int level, int i)const;
+
+	// Recentres the levels on the viewer.  Levels only move in steps of two of their
+	// own grid points, so the simulation scrolls without resampling.  Returns true if
+	// any level moved, in which case the index buffers must be rebuilt.
+	bool SetViewerPosition(float x, float z);
+
+	void Update(float dt);
+
+	// Splashes at a world-space point, on the finest level that covers it.
+	void Disturb(float x, float z, float magnitude);
+
+	// Triangle list for a level.  Level 0 is the full grid; the other levels leave
+	// out the area covered by the finer level, so the levels form nested rings.  The
+	// seams are watertight because the fine boundary follows the coarse surface.
+	void BuildIndices(int level, std::vector<std::uint32_t>& indices)const;
+
+private:
+	// Row and column of the finer level's corner point in the coarser level's grid.
+	void FineCorner(int coarseLevel, int& i0, int& j0)const;
+
+	// Coarse level's current solution at fractional grid coordinates.
+	float SampleCurr(int level, float i, float j)const;
+
+	void Restrict(int fineLevel);
+	void DriveBoundary(int fineLevel);
+
+private:
+	// Ticks Update() may run per call before time is dropped.
+	static const int MaxCatchUpTicks = 8;
+
+	int mSize = 0;
+	float mSpatialStep = 0.0f;
+	float mTimeStep = 0.0f;
+
+	float mAccumulatedTime = 0.0f;
+	std::uint64_t mTick = 0;
+
+	std::vector<std::unique_ptr<Waves>> mLevels;
+
+	// Level centres in units of the level 0 spacing.  Level l stays on multiples of
+	// 2^(l+1) units, i.e. on grid points of level l+1.
+	std::vector<int> mCenterX;
+	std::vector<int> mCenterZ;
+};
+
+#endif // CLIPMAPWAVES_H
@@ -67,6 +67,9 @@ public:
     // the commands that reference it.  So each frame needs their own.
     std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
 
+    // Waves::Version() when WavesVB was last written.
+    std::uint64_t WavesVersion = 0;
+
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
     UINT64 Fence = 0;
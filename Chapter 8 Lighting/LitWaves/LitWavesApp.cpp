@@ -485,17 +485,15 @@ void LitWavesApp::UpdateWaves(const GameTimer& gt)
 	// Update the wave simulation.
 	mWaves->Update(gt.DeltaTime());
 
-	// Update the wave vertex buffer with the new solution.
+	// Update the wave vertex buffer with the new solution.  The vertices that changed
+	// since this frame resource's buffer was last written go straight into it.
 	auto currWavesVB = mCurrFrameResource->WavesVB.get();
-	for(int i = 0; i < mWaves->VertexCount(); ++i)
-	{
-		Vertex v;
-
-		v.Pos = mWaves->Position(i);
-		v.Normal = mWaves->Normal(i);
-
-		currWavesVB->CopyData(i, v);
-	}
+	Waves::VertexLayout layout;
+	layout.Stride = sizeof(Vertex);
+	layout.PositionOffset = offsetof(Vertex, Pos);
+	layout.NormalOffset = offsetof(Vertex, Normal);
+	mWaves->WriteVertices(currWavesVB->MappedData(), layout, mCurrFrameResource->WavesVersion);
+	mCurrFrameResource->WavesVersion = mWaves->Version();
 
 	// Set the dynamic VB of the wave renderitem to the current frame VB.
 	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
@@ -602,8 +600,7 @@ void LitWavesApp::BuildLandGeometry()
 
 void LitWavesApp::BuildWavesGeometryBuffers()
 {
-	std::vector<std::uint16_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
-	assert(mWaves->VertexCount() < 0x0000ffff);
+	std::vector<std::uint32_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
 
 	// Iterate over each quad.
 	int m = mWaves->RowCount();
@@ -626,7 +623,12 @@ void LitWavesApp::BuildWavesGeometryBuffers()
 	}
 
 	UINT vbByteSize = mWaves->VertexCount()*sizeof(Vertex);
-	UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint16_t);
+	// The vertices are rewritten in place every frame, so the grid cannot be
+	// split; one too large for 16-bit indices gets 32-bit ones.
+	IndexBuilder::IndexData indexData = IndexBuilder::Build(indices.data(), indices.size(),
+		(UINT)mWaves->VertexCount(), IndexBuilder::SplitMode::None);
+
+	UINT ibByteSize = (UINT)indexData.ByteSize();
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "waterGeo";
@@ -636,20 +638,17 @@ void LitWavesApp::BuildWavesGeometryBuffers()
 	geo->VertexBufferGPU = nullptr;
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indexData.Data(), ibByteSize);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		mCommandList.Get(), indexData.Data(), ibByteSize, geo->IndexBufferUploader);
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexFormat = IndexFormat(indexData);
 	geo->IndexBufferByteSize = ibByteSize;
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+	SubmeshGeometry submesh = BuildSubmeshes(indexData, 0)[0];
 
 	geo->DrawArgs["grid"] = submesh;
 
@@ -0,0 +1,196 @@
+//***************************************************************************************
+// AssetLoader.cpp
+//***************************************************************************************
+
+#include "AssetLoader.h"
+#include <cstring>
+
+using AssetLoaderDetail::Record;
+
+namespace
+{
+	const std::uint32_t DdsMagic = 0x20534444; // "DDS "
+
+	// The magic number and the size of the DDS_HEADER after it.
+	const std::size_t DdsHeaderBytes = 4 + 124;
+
+	// Reads in every page of a mapped file, so that the main thread does not take the
+	// page faults while it copies the file into an upload heap.
+	void Touch(const MappedFile& file)
+	{
+		const volatile std::uint8_t* bytes = file.Data();
+		for(std::size_t i = 0; i < file.Size(); i += 4096)
+			bytes[i];
+	}
+}
+
+AssetLoader::AssetLoader(AssetUploader& uploader, TaskSystem& taskSystem) :
+	mUploader(uploader),
+	mJobs(taskSystem)
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+	mJobs.Wait();
+}
+
+std::shared_ptr<Record> AssetLoader::Queue(const std::string& name, MeshDecoder decode,
+	const std::wstring& textureFile, void* placeholder, DoneCallback onDone)
+{
+	auto record = std::make_shared<Record>();
+	record->Name = name;
+	record->Placeholder = placeholder;
+	record->OnDone = std::move(onDone);
+
+	if(decode)
+	{
+		record->DecodeMesh = std::move(decode);
+	}
+	else
+	{
+		record->Texture = std::make_unique<TextureData>();
+		record->Texture->Filename = textureFile;
+	}
+
+	++mPendingCount;
+	++mStats.Requested;
+
+	mJobs.Run([this, record]()
+	{
+		Decode(*record);
+
+		std::lock_guard<std::mutex> lock(mCompletedMutex);
+		mCompleted.push_back(record);
+	});
+
+	return record;
+}
+
+void AssetLoader::Decode(Record& record)
+{
+	if(record.DecodeMesh)
+	{
+		record.Mesh = std::make_unique<MeshData>();
+		record.Decoded = record.DecodeMesh(*record.Mesh, record.Error);
+		record.DecodeMesh = nullptr;
+
+		MeshData& mesh = *record.Mesh;
+		if(record.Decoded && (mesh.VertexStride == 0 || mesh.Vertices.empty() || mesh.Indices.empty()))
+		{
+			record.Error = record.Name + ": has no vertices or indices";
+			record.Decoded = false;
+		}
+
+		if(record.Decoded && mesh.Parts.empty())
+		{
+			MeshData::Part part;
+			part.Name = record.Name;
+			part.IndexCount = (std::uint32_t)mesh.Indices.size();
+			mesh.Parts.push_back(part);
+		}
+
+		record.Bytes = mesh.Vertices.size() + mesh.Indices.size()*sizeof(std::uint32_t);
+		return;
+	}
+
+	TextureData& texture = *record.Texture;
+	if(!texture.File.Open(texture.Filename.c_str()))
+	{
+		record.Error = record.Name + ": file not found";
+		return;
+	}
+
+	std::uint32_t magic = 0;
+	if(texture.File.Size() >= DdsHeaderBytes)
+		std::memcpy(&magic, texture.File.Data(), sizeof(magic));
+
+	if(magic != DdsMagic)
+	{
+		record.Error = record.Name + ": not a .dds file";
+		return;
+	}
+
+	Touch(texture.File);
+
+	record.Decoded = true;
+	record.Bytes = texture.File.Size();
+}
+
+std::uint32_t AssetLoader::Update(std::uint64_t byteBudget)
+{
+	std::vector<std::shared_ptr<Record>> batch;
+	{
+		std::lock_guard<std::mutex> lock(mCompletedMutex);
+
+		std::uint64_t bytes = 0;
+		while(!mCompleted.empty() && (batch.empty() || bytes + mCompleted.front()->Bytes <= byteBudget))
+		{
+			bytes += mCompleted.front()->Bytes;
+			batch.push_back(std::move(mCompleted.front()));
+			mCompleted.pop_front();
+		}
+	}
+
+	if(batch.empty())
+		return 0;
+
+	bool anyDecoded = false;
+	for(auto& record : batch)
+		anyDecoded |= record->Decoded;
+
+	if(anyDecoded)
+	{
+		mUploader.BeginBatch();
+
+		for(auto& record : batch)
+		{
+			if(!record->Decoded)
+				continue;
+
+			record->Asset = record->Mesh != nullptr ?
+				mUploader.UploadMesh(record->Name, *record->Mesh, record->Error) :
+				mUploader.UploadTexture(record->Name, *record->Texture, record->Error);
+
+			if(record->Asset != nullptr)
+				mStats.BytesUploaded += record->Bytes;
+		}
+
+		mUploader.EndBatch();
+		++mStats.Batches;
+	}
+
+	// The uploads are on their way; the callbacks may use the assets from here on.
+	for(auto& record : batch)
+	{
+		record->Mesh.reset();
+		record->Texture.reset();
+
+		const bool loaded = record->Asset != nullptr;
+		record->State = loaded ? AssetState::Ready : AssetState::Failed;
+
+		--mPendingCount;
+		++(loaded ? mStats.Ready : mStats.Failed);
+
+		if(record->OnDone)
+		{
+			auto onDone = std::move(record->OnDone);
+			record->OnDone = nullptr;
+			onDone(loaded);
+		}
+	}
+
+	return (std::uint32_t)batch.size();
+}
+
+void AssetLoader::Finish()
+{
+	// Done callbacks may load more.
+	while(mPendingCount > 0)
+	{
+		mJobs.Wait();
+		while(Update() > 0)
+		{
+		}
+	}
+}
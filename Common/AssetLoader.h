@@ -0,0 +1,237 @@
+//***************************************************************************************
+// AssetLoader.h
+//
+// Loads meshes and textures in the background, so that an app can draw its first
+// frame without waiting for them.
+//
+// LoadMesh and LoadTexture return a handle straight away and queue a job on the
+// task pool that does the slow part on a worker: a mesh's decoder reads and parses
+// its file into vertex and index arrays, and a texture's .dds file is mapped and
+// read in.  Finished jobs go on a completion queue, which the main thread drains
+// with Update once a frame.  Update creates the GPU resources and records their
+// uploads in one batch through an AssetUploader, then calls each asset's done
+// callback.  Until an asset is ready its handle hands out the placeholder it was
+// loaded with, so the app can draw with a stand-in in the meantime.  Update takes
+// a byte budget, so that streaming assets in during play spreads their uploads
+// over several frames instead of stalling one.
+//
+// The GPU half sits behind AssetUploader so that the rest runs without a device:
+// D3DAssetUploader creates MeshGeometry and Texture objects and records on its own
+// command list, and AssetLoaderBenchmark uses a stub that only checks and counts.
+// The loader holds the uploaded objects type-erased; a handle's type names what the
+// uploader makes, such as AssetHandle<MeshGeometry>.
+//
+// Everything but the decoding happens on the thread that calls Update.
+//***************************************************************************************
+
+#pragma once
+
+#include "MappedFile.h"
+#include "TaskSystem.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A mesh as the workers decode it: vertices of any layout, 32-bit indices, and
+// named parts like MeshGeometry::DrawArgs.
+struct MeshData
+{
+	struct Part
+	{
+		std::string Name;
+		std::uint32_t IndexCount = 0;
+		std::uint32_t StartIndexLocation = 0;
+		std::int32_t BaseVertexLocation = 0;
+	};
+
+	std::vector<std::uint8_t> Vertices;
+	std::uint32_t VertexStride = 0;
+	std::vector<std::uint32_t> Indices;
+	std::vector<Part> Parts;
+
+	template<typename Vertex>
+	void SetVertices(const std::vector<Vertex>& vertices)
+	{
+		const std::uint8_t* bytes = (const std::uint8_t*)vertices.data();
+		Vertices.assign(bytes, bytes + vertices.size()*sizeof(Vertex));
+		VertexStride = sizeof(Vertex);
+	}
+
+	std::uint32_t VertexCount()const { return VertexStride != 0 ? (std::uint32_t)(Vertices.size() / VertexStride) : 0; }
+};
+
+// A .dds file as the workers read it, mapped whole.
+struct TextureData
+{
+	std::wstring Filename;
+	MappedFile File;
+};
+
+///<summary>
+/// Creates the GPU side of decoded assets, on the thread that calls
+/// AssetLoader::Update.  The uploads of one Update are recorded between BeginBatch
+/// and EndBatch.  The Upload functions return null and set error on failure.
+///</summary>
+class AssetUploader
+{
+public:
+	virtual ~AssetUploader() = default;
+
+	virtual void BeginBatch() = 0;
+	virtual std::shared_ptr<void> UploadMesh(const std::string& name, const MeshData& mesh, std::string& error) = 0;
+	virtual std::shared_ptr<void> UploadTexture(const std::string& name, const TextureData& texture, std::string& error) = 0;
+	virtual void EndBatch() = 0;
+};
+
+enum class AssetState
+{
+	Loading,
+	Ready,
+	Failed
+};
+
+namespace AssetLoaderDetail
+{
+	// What a handle shares with the loader.
+	struct Record
+	{
+		std::string Name;
+		std::atomic<AssetState> State{ AssetState::Loading };
+
+		// Written on the main thread before State becomes Ready.
+		std::shared_ptr<void> Asset;
+		void* Placeholder = nullptr;
+		std::string Error;
+		std::function<void(bool loaded)> OnDone;
+
+		// Filled in by the worker and released once uploaded.
+		std::function<bool(MeshData& mesh, std::string& error)> DecodeMesh;
+		std::unique_ptr<MeshData> Mesh;
+		std::unique_ptr<TextureData> Texture;
+		bool Decoded = false;
+		std::uint64_t Bytes = 0;
+	};
+}
+
+///<summary>
+/// An asset being loaded.  Get() is the asset once it is ready and the placeholder
+/// until then, or for good if it failed.  Copies share the asset, which stays alive
+/// while any of them does.
+///</summary>
+template<typename T>
+class AssetHandle
+{
+public:
+	AssetHandle() = default;
+
+	bool IsValid()const { return mRecord != nullptr; }
+	AssetState State()const { return mRecord != nullptr ? mRecord->State.load() : AssetState::Failed; }
+	bool IsReady()const { return State() == AssetState::Ready; }
+
+	T* Get()const
+	{
+		if(mRecord == nullptr)
+			return nullptr;
+
+		return (T*)(IsReady() ? mRecord->Asset.get() : mRecord->Placeholder);
+	}
+
+	T* operator->()const { return Get(); }
+
+	const std::string& Name()const { return mRecord->Name; }
+
+	// Why the load failed, such as "skull.txt not found".
+	const std::string& Error()const { return mRecord->Error; }
+
+private:
+	friend class AssetLoader;
+
+	explicit AssetHandle(std::shared_ptr<AssetLoaderDetail::Record> record) : mRecord(std::move(record)) {}
+
+	std::shared_ptr<AssetLoaderDetail::Record> mRecord;
+};
+
+class AssetLoader
+{
+public:
+	using MeshDecoder = std::function<bool(MeshData& mesh, std::string& error)>;
+
+	// Called on the thread that calls Update, once the asset is ready or has failed.
+	using DoneCallback = std::function<void(bool loaded)>;
+
+	struct Stats
+	{
+		std::uint32_t Requested = 0;
+		std::uint32_t Ready = 0;
+		std::uint32_t Failed = 0;
+		std::uint32_t Batches = 0;
+		std::uint64_t BytesUploaded = 0;
+	};
+
+	explicit AssetLoader(AssetUploader& uploader, TaskSystem& taskSystem = TaskSystem::Default());
+	AssetLoader(const AssetLoader& rhs) = delete;
+	AssetLoader& operator=(const AssetLoader& rhs) = delete;
+
+	// Waits for the jobs in flight; what they decoded is dropped.
+	~AssetLoader();
+
+	///<summary>
+	/// Queues decode to run on a worker.  The vertex stride and parts it leaves are
+	/// used as they are; a mesh without parts gets a single part named name.
+	///</summary>
+	template<typename T>
+	AssetHandle<T> LoadMesh(const std::string& name, MeshDecoder decode, T* placeholder = nullptr,
+		DoneCallback onDone = nullptr)
+	{
+		return AssetHandle<T>(Queue(name, std::move(decode), std::wstring(), placeholder, std::move(onDone)));
+	}
+
+	// Queues reading filename, a .dds file, on a worker.
+	template<typename T>
+	AssetHandle<T> LoadTexture(const std::string& name, const std::wstring& filename, T* placeholder = nullptr,
+		DoneCallback onDone = nullptr)
+	{
+		return AssetHandle<T>(Queue(name, nullptr, filename, placeholder, std::move(onDone)));
+	}
+
+	///<summary>
+	/// Uploads the assets the workers have finished, in the order they finished,
+	/// in one batch, then calls their done callbacks.  Stops once the batch holds
+	/// byteBudget bytes, though it always takes at least one asset.  Returns how
+	/// many assets it finished.
+	///</summary>
+	std::uint32_t Update(std::uint64_t byteBudget = UINT64_MAX);
+
+	// Blocks until every load so far has finished, helping with the decoding and
+	// uploading as they come in.
+	void Finish();
+
+	// Loads not yet ready or failed.
+	std::uint32_t PendingCount()const { return mPendingCount; }
+
+	const Stats& GetStats()const { return mStats; }
+
+private:
+	std::shared_ptr<AssetLoaderDetail::Record> Queue(const std::string& name, MeshDecoder decode,
+		const std::wstring& textureFile, void* placeholder, DoneCallback onDone);
+
+	static void Decode(AssetLoaderDetail::Record& record);
+
+private:
+	AssetUploader& mUploader;
+
+	// Decoded records waiting for the main thread.
+	std::mutex mCompletedMutex;
+	std::deque<std::shared_ptr<AssetLoaderDetail::Record>> mCompleted;
+
+	// Only touched by the main thread.
+	std::uint32_t mPendingCount = 0;
+	Stats mStats;
+
+	TaskGroup mJobs;
+};
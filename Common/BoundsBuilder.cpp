@@ -0,0 +1,724 @@
+//***************************************************************************************
+// BoundsBuilder.cpp
+//***************************************************************************************
+
+#include "BoundsBuilder.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// Added to the radius of a grown sphere so that rounding never leaves one of the
+	// points it was grown over outside it.
+	const float RadiusEpsilon = 1e-6f;
+
+	// The EPOS directions, ordered so that the first 3, 7, 13 and 49 are the sets of
+	// EPOS-6, -14, -26 and -98.  They need not be unit length.
+	const float EposNormals[49][3] =
+	{
+		{ 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 },
+
+		{ 1, 1, 1 }, { 1, 1, -1 }, { 1, -1, 1 }, { 1, -1, -1 },
+
+		{ 1, 1, 0 }, { 1, -1, 0 }, { 1, 0, 1 }, { 1, 0, -1 }, { 0, 1, 1 }, { 0, 1, -1 },
+
+		{ 0, 1, 2 }, { 0, 2, 1 }, { 1, 0, 2 }, { 2, 0, 1 }, { 1, 2, 0 }, { 2, 1, 0 },
+		{ 0, 1, -2 }, { 0, 2, -1 }, { 1, 0, -2 }, { 2, 0, -1 }, { 1, -2, 0 }, { 2, -1, 0 },
+		{ 1, 1, 2 }, { 2, 1, 1 }, { 1, 2, 1 }, { 1, -1, 2 }, { 1, 1, -2 }, { 1, -1, -2 },
+		{ 2, -1, 1 }, { 2, 1, -1 }, { 2, -1, -1 }, { 1, -2, 1 }, { 1, 2, -1 }, { 1, -2, -1 },
+		{ 2, 2, 1 }, { 1, 2, 2 }, { 2, 1, 2 }, { 2, -2, 1 }, { 2, 2, -1 }, { 2, -2, -1 },
+		{ 1, -2, 2 }, { 1, 2, -2 }, { 1, -2, -2 }, { 2, -1, 2 }, { 2, 1, -2 }, { 2, -1, -2 }
+	};
+
+	const int MaxDirections = 49;
+
+	// Directions projected onto four at a time.
+	const int MaxDirectionGroups = (MaxDirections + 3) / 4;
+
+	XMVECTOR LoadPosition(const std::uint8_t* positions, std::size_t vertexStride, std::uint32_t v)
+	{
+		return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(positions + v*vertexStride));
+	}
+
+	// Every position but the last can be read with a 16-byte load: the fourth float
+	// lies within the next vertex and is ignored.
+	void MinMax(const std::uint8_t* positions, std::size_t vertexStride, std::uint32_t vertexCount,
+		XMVECTOR& vMin, XMVECTOR& vMax)
+	{
+		std::uint32_t i = 0;
+
+#if defined(_XM_AVX2_INTRINSICS_)
+		// Eight positions an iteration, two to a register, into four pairs of
+		// accumulators so the min/max latencies overlap.
+		auto load2 = [&](std::uint32_t v)
+		{
+			const float* p = reinterpret_cast<const float*>(positions + v*vertexStride);
+			const float* q = reinterpret_cast<const float*>(positions + (v + 1)*vertexStride);
+			return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(q), 1);
+		};
+
+		__m256 min0 = _mm256_set1_ps(FLT_MAX), min1 = min0, min2 = min0, min3 = min0;
+		__m256 max0 = _mm256_set1_ps(-FLT_MAX), max1 = max0, max2 = max0, max3 = max0;
+		for(; i + 8 < vertexCount; i += 8)
+		{
+			__m256 a = load2(i + 0), b = load2(i + 2), c = load2(i + 4), d = load2(i + 6);
+			min0 = _mm256_min_ps(min0, a); max0 = _mm256_max_ps(max0, a);
+			min1 = _mm256_min_ps(min1, b); max1 = _mm256_max_ps(max1, b);
+			min2 = _mm256_min_ps(min2, c); max2 = _mm256_max_ps(max2, c);
+			min3 = _mm256_min_ps(min3, d); max3 = _mm256_max_ps(max3, d);
+		}
+
+		__m256 min8 = _mm256_min_ps(_mm256_min_ps(min0, min1), _mm256_min_ps(min2, min3));
+		__m256 max8 = _mm256_max_ps(_mm256_max_ps(max0, max1), _mm256_max_ps(max2, max3));
+		vMin = _mm_min_ps(_mm256_castps256_ps128(min8), _mm256_extractf128_ps(min8, 1));
+		vMax = _mm_max_ps(_mm256_castps256_ps128(max8), _mm256_extractf128_ps(max8, 1));
+#elif defined(_XM_SSE_INTRINSICS_)
+		auto load = [&](std::uint32_t v)
+		{
+			return _mm_loadu_ps(reinterpret_cast<const float*>(positions + v*vertexStride));
+		};
+
+		__m128 min0 = _mm_set1_ps(FLT_MAX), min1 = min0, min2 = min0, min3 = min0;
+		__m128 max0 = _mm_set1_ps(-FLT_MAX), max1 = max0, max2 = max0, max3 = max0;
+		for(; i + 4 < vertexCount; i += 4)
+		{
+			__m128 a = load(i + 0), b = load(i + 1), c = load(i + 2), d = load(i + 3);
+			min0 = _mm_min_ps(min0, a); max0 = _mm_max_ps(max0, a);
+			min1 = _mm_min_ps(min1, b); max1 = _mm_max_ps(max1, b);
+			min2 = _mm_min_ps(min2, c); max2 = _mm_max_ps(max2, c);
+			min3 = _mm_min_ps(min3, d); max3 = _mm_max_ps(max3, d);
+		}
+
+		vMin = _mm_min_ps(_mm_min_ps(min0, min1), _mm_min_ps(min2, min3));
+		vMax = _mm_max_ps(_mm_max_ps(max0, max1), _mm_max_ps(max2, max3));
+#else
+		vMin = XMVectorReplicate(FLT_MAX);
+		vMax = XMVectorReplicate(-FLT_MAX);
+#endif
+
+		for(; i < vertexCount; ++i)
+		{
+			XMVECTOR p = LoadPosition(positions, vertexStride, i);
+			vMin = XMVectorMin(vMin, p);
+			vMax = XMVectorMax(vMax, p);
+		}
+	}
+
+	// The vertices with the smallest and largest projection onto each of the first
+	// directionCount EposNormals; the first one found on ties.
+	void FindExtremePoints(const std::uint8_t* positions, std::size_t vertexStride, std::uint32_t vertexCount,
+		int directionCount, std::uint32_t* minIndex, std::uint32_t* maxIndex)
+	{
+		assert(directionCount <= MaxDirections && vertexCount > 0);
+
+		// Four directions to a group, in structure of arrays form; the padding is
+		// the zero direction, which is never used.
+		const int groupCount = (directionCount + 3) / 4;
+		XMVECTOR dirX[MaxDirectionGroups], dirY[MaxDirectionGroups], dirZ[MaxDirectionGroups];
+		for(int g = 0; g < groupCount; ++g)
+		{
+			float d[3][4] = {};
+			for(int k = 0; k < 4 && 4*g + k < directionCount; ++k)
+			{
+				for(int axis = 0; axis < 3; ++axis)
+					d[axis][k] = EposNormals[4*g + k][axis];
+			}
+			dirX[g] = XMVectorSet(d[0][0], d[0][1], d[0][2], d[0][3]);
+			dirY[g] = XMVectorSet(d[1][0], d[1][1], d[1][2], d[1][3]);
+			dirZ[g] = XMVectorSet(d[2][0], d[2][1], d[2][2], d[2][3]);
+		}
+
+		XMVECTOR minDot[MaxDirectionGroups], maxDot[MaxDirectionGroups];
+		XMVECTOR minIdx[MaxDirectionGroups], maxIdx[MaxDirectionGroups];
+		for(int g = 0; g < groupCount; ++g)
+		{
+			minDot[g] = XMVectorReplicate(FLT_MAX);
+			maxDot[g] = XMVectorReplicate(-FLT_MAX);
+			minIdx[g] = XMVectorZero();
+			maxIdx[g] = XMVectorZero();
+		}
+
+		// The indices ride along in the integer bits of a vector.
+		for(std::uint32_t i = 0; i < vertexCount; ++i)
+		{
+			XMVECTOR p = LoadPosition(positions, vertexStride, i);
+			XMVECTOR x = XMVectorSplatX(p);
+			XMVECTOR y = XMVectorSplatY(p);
+			XMVECTOR z = XMVectorSplatZ(p);
+			XMVECTOR index = XMVectorReplicateInt(i);
+
+			for(int g = 0; g < groupCount; ++g)
+			{
+				XMVECTOR dot = XMVectorMultiplyAdd(x, dirX[g], XMVectorMultiplyAdd(y, dirY[g], z*dirZ[g]));
+
+				XMVECTOR less = XMVectorLess(dot, minDot[g]);
+				minDot[g] = XMVectorSelect(minDot[g], dot, less);
+				minIdx[g] = XMVectorSelect(minIdx[g], index, less);
+
+				XMVECTOR greater = XMVectorGreater(dot, maxDot[g]);
+				maxDot[g] = XMVectorSelect(maxDot[g], dot, greater);
+				maxIdx[g] = XMVectorSelect(maxIdx[g], index, greater);
+			}
+		}
+
+		for(int g = 0; g < groupCount; ++g)
+		{
+			std::uint32_t mins[4], maxs[4];
+			XMStoreInt4(mins, minIdx[g]);
+			XMStoreInt4(maxs, maxIdx[g]);
+			for(int k = 0; k < 4 && 4*g + k < directionCount; ++k)
+			{
+				minIndex[4*g + k] = mins[k];
+				maxIndex[4*g + k] = maxs[k];
+			}
+		}
+	}
+
+	// Grows the sphere just enough to take in each point outside it, in turn.
+	void GrowSphere(const std::uint8_t* positions, std::size_t vertexStride, std::uint32_t vertexCount,
+		XMVECTOR& center, float& radius)
+	{
+		float radiusSq = radius*radius;
+		for(std::uint32_t i = 0; i < vertexCount; ++i)
+		{
+			XMVECTOR d = LoadPosition(positions, vertexStride, i) - center;
+			float distSq = XMVectorGetX(XMVector3LengthSq(d));
+			if(distSq <= radiusSq)
+				continue;
+
+			// The new sphere touches the point and the far side of the old one.
+			float dist = sqrtf(distSq);
+			float newRadius = 0.5f*(radius + dist);
+			center += ((newRadius - radius) / dist)*d;
+			radius = newRadius;
+			radiusSq = radius*radius;
+		}
+
+		radius += RadiusEpsilon*radius;
+	}
+
+	//
+	// The exact smallest sphere around a few points, by Welzl's algorithm with the
+	// move-to-front heuristic, in double precision.
+	//
+
+	struct Point
+	{
+		double x, y, z;
+	};
+
+	struct Sphere
+	{
+		Point Center = { 0.0, 0.0, 0.0 };
+
+		// Negative for the empty sphere.
+		double RadiusSq = -1.0;
+	};
+
+	Point Sub(const Point& a, const Point& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	Point Add(const Point& a, const Point& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	Point Scale(const Point& a, double s) { return { s*a.x, s*a.y, s*a.z }; }
+	double Dot(const Point& a, const Point& b) { return a.x*b.x + a.y*b.y + a.z*b.z; }
+	Point Cross(const Point& a, const Point& b) { return { a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x }; }
+
+	bool Contains(const Sphere& s, const Point& p)
+	{
+		Point d = Sub(p, s.Center);
+		return Dot(d, d) <= s.RadiusSq*(1.0 + 1e-9);
+	}
+
+	bool ContainsAll(const Sphere& s, const Point* points, int count)
+	{
+		for(int i = 0; i < count; ++i)
+		{
+			if(!Contains(s, points[i]))
+				return false;
+		}
+		return true;
+	}
+
+	Sphere SphereFrom2(const Point& a, const Point& b)
+	{
+		Sphere s;
+		s.Center = Scale(Add(a, b), 0.5);
+		Point d = Sub(a, s.Center);
+		s.RadiusSq = Dot(d, d);
+		return s;
+	}
+
+	// The smallest of the spheres through pairs of points that holds them all.
+	Sphere SmallestPairSphere(const Point* points, int count)
+	{
+		Sphere best;
+		for(int i = 0; i < count; ++i)
+		{
+			for(int j = i + 1; j < count; ++j)
+			{
+				Sphere s = SphereFrom2(points[i], points[j]);
+				if((best.RadiusSq < 0.0 || s.RadiusSq < best.RadiusSq) && ContainsAll(s, points, count))
+					best = s;
+			}
+		}
+		return best;
+	}
+
+	// Circumscribed circle, or the pair sphere if the points are collinear.
+	Sphere SphereFrom3(const Point& a, const Point& b, const Point& c)
+	{
+		Point ab = Sub(b, a);
+		Point ac = Sub(c, a);
+		Point n = Cross(ab, ac);
+		double nLengthSq = Dot(n, n);
+		if(nLengthSq <= 1e-18*Dot(ab, ab)*Dot(ac, ac))
+		{
+			const Point points[3] = { a, b, c };
+			return SmallestPairSphere(points, 3);
+		}
+
+		Point offset = Scale(Cross(Sub(Scale(ac, Dot(ab, ab)), Scale(ab, Dot(ac, ac))), n), 0.5 / nLengthSq);
+
+		Sphere s;
+		s.Center = Add(a, offset);
+		s.RadiusSq = Dot(offset, offset);
+		return s;
+	}
+
+	// Circumscribed sphere, or the smallest pair or triangle sphere around all four
+	// if the points are coplanar.
+	Sphere SphereFrom4(const Point& a, const Point& b, const Point& c, const Point& d)
+	{
+		Point ab = Sub(b, a);
+		Point ac = Sub(c, a);
+		Point ad = Sub(d, a);
+
+		double det = Dot(ab, Cross(ac, ad));
+		double scale = sqrt(Dot(ab, ab)*Dot(ac, ac)*Dot(ad, ad));
+		if(fabs(det) <= 1e-9*scale)
+		{
+			const Point points[4] = { a, b, c, d };
+			const int triples[4][3] = { { 0, 1, 2 }, { 0, 1, 3 }, { 0, 2, 3 }, { 1, 2, 3 } };
+
+			Sphere best = SmallestPairSphere(points, 4);
+			for(const auto& t : triples)
+			{
+				Sphere s = SphereFrom3(points[t[0]], points[t[1]], points[t[2]]);
+				if((best.RadiusSq < 0.0 || s.RadiusSq < best.RadiusSq) && ContainsAll(s, points, 4))
+					best = s;
+			}
+			return best;
+		}
+
+		// Solve 2*dot(x - a, p - a) = |p - a|^2 for p = b, c, d.
+		Point offset = Scale(Add(Add(
+			Scale(Cross(ac, ad), Dot(ab, ab)),
+			Scale(Cross(ad, ab), Dot(ac, ac))),
+			Scale(Cross(ab, ac), Dot(ad, ad))), 0.5 / det);
+
+		Sphere s;
+		s.Center = Add(a, offset);
+		s.RadiusSq = Dot(offset, offset);
+		return s;
+	}
+
+	Sphere SphereFromSupport(const Point* support, int count)
+	{
+		Sphere s;
+		switch(count)
+		{
+		case 1:
+			s.Center = support[0];
+			s.RadiusSq = 0.0;
+			break;
+		case 2:
+			s = SphereFrom2(support[0], support[1]);
+			break;
+		case 3:
+			s = SphereFrom3(support[0], support[1], support[2]);
+			break;
+		case 4:
+			s = SphereFrom4(support[0], support[1], support[2], support[3]);
+			break;
+		}
+		return s;
+	}
+
+	// The smallest sphere around points[0, count) with support[0, supportCount) on
+	// its surface.  Points that fall outside move to the front, which makes later
+	// passes find them early.
+	Sphere Welzl(Point* points, int count, Point* support, int supportCount)
+	{
+		Sphere s = SphereFromSupport(support, supportCount);
+		if(supportCount == 4)
+			return s;
+
+		for(int i = 0; i < count; ++i)
+		{
+			if(Contains(s, points[i]))
+				continue;
+
+			support[supportCount] = points[i];
+			s = Welzl(points, i, support, supportCount + 1);
+			std::rotate(points, points + i, points + i + 1);
+		}
+		return s;
+	}
+
+	// Half the surface area of a box of the given size.
+	float HalfArea(FXMVECTOR size)
+	{
+		XMFLOAT3 s;
+		XMStoreFloat3(&s, size);
+		return s.x*s.y + s.y*s.z + s.z*s.x;
+	}
+
+	// Half the surface area of the box around points in the frame whose axes are the
+	// columns of axesT, and its extremes along them.
+	float ProjectedArea(const XMFLOAT3* points, int count, FXMMATRIX axesT, XMVECTOR& vMin, XMVECTOR& vMax)
+	{
+		vMin = XMVectorReplicate(FLT_MAX);
+		vMax = XMVectorReplicate(-FLT_MAX);
+		for(int i = 0; i < count; ++i)
+		{
+			XMVECTOR p = XMVector3TransformNormal(XMLoadFloat3(&points[i]), axesT);
+			vMin = XMVectorMin(vMin, p);
+			vMax = XMVectorMax(vMax, p);
+		}
+		return HalfArea(vMax - vMin);
+	}
+
+	// Orthonormal, right-handed axes with the first along edge and the third along
+	// the normal of the face the edge lies in, as the rows of a matrix.
+	XMMATRIX AxesFromEdge(FXMVECTOR edge, FXMVECTOR faceNormal)
+	{
+		XMMATRIX axes;
+		axes.r[0] = XMVector3Normalize(edge);
+		axes.r[2] = faceNormal;
+		axes.r[1] = XMVector3Cross(axes.r[2], axes.r[0]);
+		axes.r[3] = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+		return axes;
+	}
+}
+
+void BoundsBuilder::ComputeMinMax(const void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+	std::size_t positionOffset, XMFLOAT3& vMin, XMFLOAT3& vMax)
+{
+	const std::uint8_t* positions = static_cast<const std::uint8_t*>(vertices) + positionOffset;
+
+	XMVECTOR mn, mx;
+	MinMax(positions, vertexStride, vertexCount, mn, mx);
+	XMStoreFloat3(&vMin, mn);
+	XMStoreFloat3(&vMax, mx);
+}
+
+BoundingBox BoundsBuilder::ComputeBox(const void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+	std::size_t positionOffset)
+{
+	BoundingBox box;
+	box.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	box.Extents = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	if(vertexCount == 0)
+		return box;
+
+	const std::uint8_t* positions = static_cast<const std::uint8_t*>(vertices) + positionOffset;
+
+	XMVECTOR vMin, vMax;
+	MinMax(positions, vertexStride, vertexCount, vMin, vMax);
+	XMStoreFloat3(&box.Center, 0.5f*(vMin + vMax));
+	XMStoreFloat3(&box.Extents, 0.5f*(vMax - vMin));
+	return box;
+}
+
+BoundingSphere BoundsBuilder::ComputeRitterSphere(const void* vertices, std::size_t vertexStride,
+	std::uint32_t vertexCount, std::size_t positionOffset)
+{
+	BoundingSphere sphere;
+	sphere.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	sphere.Radius = 0.0f;
+	if(vertexCount == 0)
+		return sphere;
+
+	const std::uint8_t* positions = static_cast<const std::uint8_t*>(vertices) + positionOffset;
+
+	std::uint32_t minIndex[3], maxIndex[3];
+	FindExtremePoints(positions, vertexStride, vertexCount, 3, minIndex, maxIndex);
+
+	// Start from the pair of extremes farthest apart.
+	XMVECTOR a = XMVectorZero(), b = XMVectorZero();
+	float bestDistSq = -1.0f;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		XMVECTOR p = LoadPosition(positions, vertexStride, minIndex[axis]);
+		XMVECTOR q = LoadPosition(positions, vertexStride, maxIndex[axis]);
+		float distSq = XMVectorGetX(XMVector3LengthSq(q - p));
+		if(distSq > bestDistSq)
+		{
+			a = p;
+			b = q;
+			bestDistSq = distSq;
+		}
+	}
+
+	XMVECTOR center = 0.5f*(a + b);
+	float radius = 0.5f*sqrtf(bestDistSq);
+	GrowSphere(positions, vertexStride, vertexCount, center, radius);
+
+	XMStoreFloat3(&sphere.Center, center);
+	sphere.Radius = radius;
+	return sphere;
+}
+
+BoundingSphere BoundsBuilder::ComputeEposSphere(const void* vertices, std::size_t vertexStride,
+	std::uint32_t vertexCount, std::size_t positionOffset, EposDirections directions)
+{
+	BoundingSphere sphere;
+	sphere.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	sphere.Radius = 0.0f;
+	if(vertexCount == 0)
+		return sphere;
+
+	const std::uint8_t* positions = static_cast<const std::uint8_t*>(vertices) + positionOffset;
+
+	const int directionCount = (int)directions;
+	std::uint32_t minIndex[MaxDirections], maxIndex[MaxDirections];
+	FindExtremePoints(positions, vertexStride, vertexCount, directionCount, minIndex, maxIndex);
+
+	// The same vertex is often extreme along several directions.
+	std::vector<std::uint32_t> extremes(minIndex, minIndex + directionCount);
+	extremes.insert(extremes.end(), maxIndex, maxIndex + directionCount);
+	std::sort(extremes.begin(), extremes.end());
+	extremes.erase(std::unique(extremes.begin(), extremes.end()), extremes.end());
+
+	std::vector<Point> points(extremes.size());
+	for(std::size_t i = 0; i < extremes.size(); ++i)
+	{
+		const XMFLOAT3& p = *reinterpret_cast<const XMFLOAT3*>(positions + extremes[i]*vertexStride);
+		points[i] = { p.x, p.y, p.z };
+	}
+
+	Point support[4];
+	Sphere s = Welzl(points.data(), (int)points.size(), support, 0);
+
+	XMVECTOR center = XMVectorSet((float)s.Center.x, (float)s.Center.y, (float)s.Center.z, 0.0f);
+	float radius = (float)sqrt(std::max(s.RadiusSq, 0.0));
+	GrowSphere(positions, vertexStride, vertexCount, center, radius);
+
+	XMStoreFloat3(&sphere.Center, center);
+	sphere.Radius = radius;
+	return sphere;
+}
+
+BoundingOrientedBox BoundsBuilder::ComputeOrientedBox(const void* vertices, std::size_t vertexStride,
+	std::uint32_t vertexCount, std::size_t positionOffset)
+{
+	BoundingOrientedBox obb;
+	obb.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	obb.Extents = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	obb.Orientation = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+	if(vertexCount == 0)
+		return obb;
+
+	const std::uint8_t* positions = static_cast<const std::uint8_t*>(vertices) + positionOffset;
+
+	// DiTO-14: the extremes along the seven EPOS-14 directions.
+	const int directionCount = (int)EposDirections::Epos14;
+	std::uint32_t minIndex[MaxDirections], maxIndex[MaxDirections];
+	FindExtremePoints(positions, vertexStride, vertexCount, directionCount, minIndex, maxIndex);
+
+	XMFLOAT3 extremes[2*MaxDirections];
+	for(int k = 0; k < directionCount; ++k)
+	{
+		extremes[2*k + 0] = *reinterpret_cast<const XMFLOAT3*>(positions + minIndex[k]*vertexStride);
+		extremes[2*k + 1] = *reinterpret_cast<const XMFLOAT3*>(positions + maxIndex[k]*vertexStride);
+	}
+	const int extremeCount = 2*directionCount;
+
+	// The axis-aligned box is the first candidate, so the result is never worse.
+	XMMATRIX bestAxes = XMMatrixIdentity();
+	bool rotated = false;
+	XMVECTOR vMin, vMax;
+	float bestArea = ProjectedArea(extremes, extremeCount, bestAxes, vMin, vMax);
+
+	auto tryAxes = [&](FXMMATRIX axes)
+	{
+		float area = ProjectedArea(extremes, extremeCount, XMMatrixTranspose(axes), vMin, vMax);
+		if(area < bestArea)
+		{
+			bestArea = area;
+			bestAxes = axes;
+			rotated = true;
+		}
+	};
+
+	// Every edge of a face gives a candidate, together with the face's normal.
+	auto tryFace = [&](FXMVECTOR p0, FXMVECTOR p1, FXMVECTOR p2)
+	{
+		XMVECTOR e0 = p1 - p0, e1 = p2 - p1, e2 = p0 - p2;
+		XMVECTOR n = XMVector3Cross(e0, e1);
+		float nLength = XMVectorGetX(XMVector3Length(n));
+		float scale = XMVectorGetX(XMVector3Length(e0))*XMVectorGetX(XMVector3Length(e1));
+		if(nLength <= 1e-6f*scale)
+			return;
+
+		n /= nLength;
+		tryAxes(AxesFromEdge(e0, n));
+		tryAxes(AxesFromEdge(e1, n));
+		tryAxes(AxesFromEdge(e2, n));
+	};
+
+	// The base triangle: the farthest apart pair of extremes along one direction, and
+	// the extreme farthest from the line through them.
+	int pairIndex = 0;
+	float bestDistSq = -1.0f;
+	for(int k = 0; k < directionCount; ++k)
+	{
+		XMVECTOR d = XMLoadFloat3(&extremes[2*k + 1]) - XMLoadFloat3(&extremes[2*k + 0]);
+		float distSq = XMVectorGetX(XMVector3LengthSq(d));
+		if(distSq > bestDistSq)
+		{
+			pairIndex = k;
+			bestDistSq = distSq;
+		}
+	}
+
+	XMVECTOR p0 = XMLoadFloat3(&extremes[2*pairIndex + 0]);
+	XMVECTOR p1 = XMLoadFloat3(&extremes[2*pairIndex + 1]);
+	XMVECTOR lineDir = XMVector3Normalize(p1 - p0);
+
+	XMVECTOR p2 = p0;
+	float bestLineDistSq = 0.0f;
+	for(int i = 0; i < extremeCount; ++i)
+	{
+		XMVECTOR d = XMLoadFloat3(&extremes[i]) - p0;
+		float distSq = XMVectorGetX(XMVector3LengthSq(d - XMVector3Dot(d, lineDir)*lineDir));
+		if(distSq > bestLineDistSq)
+		{
+			p2 = XMLoadFloat3(&extremes[i]);
+			bestLineDistSq = distSq;
+		}
+	}
+
+	XMVECTOR normal = XMVector3Normalize(XMVector3Cross(p1 - p0, p2 - p0));
+	if(bestLineDistSq > 0.0f)
+	{
+		tryFace(p0, p1, p2);
+
+		// The two tetrahedra on the triangle, with the extremes farthest above and
+		// below its plane as apexes.
+		XMVECTOR above = p0, below = p0;
+		float maxDist = 0.0f, minDist = 0.0f;
+		for(int i = 0; i < extremeCount; ++i)
+		{
+			XMVECTOR p = XMLoadFloat3(&extremes[i]);
+			float dist = XMVectorGetX(XMVector3Dot(p - p0, normal));
+			if(dist > maxDist)
+			{
+				above = p;
+				maxDist = dist;
+			}
+			if(dist < minDist)
+			{
+				below = p;
+				minDist = dist;
+			}
+		}
+
+		if(maxDist > 0.0f)
+		{
+			tryFace(p0, p1, above);
+			tryFace(p1, p2, above);
+			tryFace(p2, p0, above);
+		}
+		if(minDist < 0.0f)
+		{
+			tryFace(p0, p1, below);
+			tryFace(p1, p2, below);
+			tryFace(p2, p0, below);
+		}
+	}
+
+	// Bound every point along the winning axes, unless the axis-aligned box still
+	// turns out smaller once they are all in.
+	XMVECTOR boxMin, boxMax;
+	MinMax(positions, vertexStride, vertexCount, boxMin, boxMax);
+
+	XMVECTOR center = 0.5f*(boxMin + boxMax);
+	XMVECTOR extents = 0.5f*(boxMax - boxMin);
+	XMMATRIX axes = XMMatrixIdentity();
+
+	if(rotated)
+	{
+		XMMATRIX bestAxesT = XMMatrixTranspose(bestAxes);
+		vMin = XMVectorReplicate(FLT_MAX);
+		vMax = XMVectorReplicate(-FLT_MAX);
+		for(std::uint32_t i = 0; i < vertexCount; ++i)
+		{
+			XMVECTOR p = XMVector3TransformNormal(LoadPosition(positions, vertexStride, i), bestAxesT);
+			vMin = XMVectorMin(vMin, p);
+			vMax = XMVectorMax(vMax, p);
+		}
+
+		if(HalfArea(vMax - vMin) < HalfArea(boxMax - boxMin))
+		{
+			center = XMVector3TransformNormal(0.5f*(vMin + vMax), bestAxes);
+			extents = 0.5f*(vMax - vMin);
+			axes = bestAxes;
+		}
+	}
+
+	XMStoreFloat3(&obb.Center, center);
+	XMStoreFloat3(&obb.Extents, extents);
+	XMStoreFloat4(&obb.Orientation, XMQuaternionNormalize(XMQuaternionRotationMatrix(axes)));
+	return obb;
+}
+
+void BoundsBuilder::TransformBoxes(const BoundingBox* boxes, std::uint32_t boxCount, const XMFLOAT4X4& world,
+	BoundingBox* out)
+{
+	// Arvo: the extents go through the absolute value of the rotation and scale.
+	XMMATRIX m = XMLoadFloat4x4(&world);
+	XMVECTOR absR0 = XMVectorAbs(m.r[0]);
+	XMVECTOR absR1 = XMVectorAbs(m.r[1]);
+	XMVECTOR absR2 = XMVectorAbs(m.r[2]);
+
+	for(std::uint32_t i = 0; i < boxCount; ++i)
+	{
+		XMVECTOR c = XMLoadFloat3(&boxes[i].Center);
+		XMVECTOR e = XMLoadFloat3(&boxes[i].Extents);
+
+		XMVECTOR center = XMVectorMultiplyAdd(XMVectorSplatX(c), m.r[0],
+			XMVectorMultiplyAdd(XMVectorSplatY(c), m.r[1], XMVectorMultiplyAdd(XMVectorSplatZ(c), m.r[2], m.r[3])));
+		XMVECTOR extents = XMVectorMultiplyAdd(XMVectorSplatX(e), absR0,
+			XMVectorMultiplyAdd(XMVectorSplatY(e), absR1, XMVectorSplatZ(e)*absR2));
+
+		XMStoreFloat3(&out[i].Center, center);
+		XMStoreFloat3(&out[i].Extents, extents);
+	}
+}
+
+void BoundsBuilder::TransformBoxes(const BoundingBox& box, const XMFLOAT4X4* worlds, std::size_t worldStride,
+	std::uint32_t worldCount, BoundingBox* out)
+{
+	XMVECTOR c = XMLoadFloat3(&box.Center);
+	XMVECTOR e = XMLoadFloat3(&box.Extents);
+	XMVECTOR cx = XMVectorSplatX(c), cy = XMVectorSplatY(c), cz = XMVectorSplatZ(c);
+	XMVECTOR ex = XMVectorSplatX(e), ey = XMVectorSplatY(e), ez = XMVectorSplatZ(e);
+
+	const std::uint8_t* world = reinterpret_cast<const std::uint8_t*>(worlds);
+	for(std::uint32_t i = 0; i < worldCount; ++i, world += worldStride)
+	{
+		XMMATRIX m = XMLoadFloat4x4(reinterpret_cast<const XMFLOAT4X4*>(world));
+
+		XMVECTOR center = XMVectorMultiplyAdd(cx, m.r[0],
+			XMVectorMultiplyAdd(cy, m.r[1], XMVectorMultiplyAdd(cz, m.r[2], m.r[3])));
+		XMVECTOR extents = XMVectorMultiplyAdd(ex, XMVectorAbs(m.r[0]),
+			XMVectorMultiplyAdd(ey, XMVectorAbs(m.r[1]), ez*XMVectorAbs(m.r[2])));
+
+		XMStoreFloat3(&out[i].Center, center);
+		XMStoreFloat3(&out[i].Extents, extents);
+	}
+}
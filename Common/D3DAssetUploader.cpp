@@ -0,0 +1,147 @@
+//***************************************************************************************
+// D3DAssetUploader.cpp
+//***************************************************************************************
+
+#include "D3DAssetUploader.h"
+
+using Microsoft::WRL::ComPtr;
+
+D3DAssetUploader::D3DAssetUploader(ID3D12Device* device, ID3D12CommandQueue* commandQueue) :
+	md3dDevice(device),
+	mCommandQueue(commandQueue)
+{
+	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence)));
+}
+
+D3DAssetUploader::~D3DAssetUploader()
+{
+	if(mFence->GetCompletedValue() < mCurrentFence)
+	{
+		HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
+		mFence->SetEventOnCompletion(mCurrentFence, eventHandle);
+		WaitForSingleObject(eventHandle, INFINITE);
+		CloseHandle(eventHandle);
+	}
+}
+
+void D3DAssetUploader::Reclaim()
+{
+	const UINT64 completed = mFence->GetCompletedValue();
+	for(auto& batch : mBatches)
+	{
+		if(batch->Fence <= completed)
+			batch->UploadHeaps.clear();
+	}
+}
+
+void D3DAssetUploader::BeginBatch()
+{
+	Reclaim();
+
+	// Reuse the allocator of a batch the GPU is done with, if there is one.
+	const UINT64 completed = mFence->GetCompletedValue();
+	mCurrBatch = nullptr;
+	for(auto& batch : mBatches)
+	{
+		if(batch->Fence <= completed)
+		{
+			mCurrBatch = batch.get();
+			ThrowIfFailed(mCurrBatch->CmdListAlloc->Reset());
+			break;
+		}
+	}
+
+	if(mCurrBatch == nullptr)
+	{
+		auto batch = std::make_unique<Batch>();
+		ThrowIfFailed(md3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
+			IID_PPV_ARGS(batch->CmdListAlloc.GetAddressOf())));
+
+		mCurrBatch = batch.get();
+		mBatches.push_back(std::move(batch));
+	}
+
+	if(mCommandList == nullptr)
+	{
+		ThrowIfFailed(md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+			mCurrBatch->CmdListAlloc.Get(), nullptr, IID_PPV_ARGS(mCommandList.GetAddressOf())));
+	}
+	else
+	{
+		ThrowIfFailed(mCommandList->Reset(mCurrBatch->CmdListAlloc.Get(), nullptr));
+	}
+}
+
+std::shared_ptr<void> D3DAssetUploader::UploadMesh(const std::string& name, const MeshData& mesh, std::string& error)
+{
+	const UINT vbByteSize = (UINT)mesh.Vertices.size();
+	const UINT ibByteSize = (UINT)(mesh.Indices.size()*sizeof(std::uint32_t));
+
+	auto geo = std::make_shared<MeshGeometry>();
+	geo->Name = name;
+
+	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), mesh.Vertices.data(), vbByteSize);
+
+	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), mesh.Indices.data(), ibByteSize);
+
+	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice,
+		mCommandList.Get(), mesh.Vertices.data(), vbByteSize, geo->VertexBufferUploader);
+
+	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice,
+		mCommandList.Get(), mesh.Indices.data(), ibByteSize, geo->IndexBufferUploader);
+
+	// The batch keeps the upload buffers until the GPU has copied them.
+	mCurrBatch->UploadHeaps.push_back(std::move(geo->VertexBufferUploader));
+	mCurrBatch->UploadHeaps.push_back(std::move(geo->IndexBufferUploader));
+
+	geo->VertexByteStride = mesh.VertexStride;
+	geo->VertexBufferByteSize = vbByteSize;
+	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+	geo->IndexBufferByteSize = ibByteSize;
+
+	for(const auto& part : mesh.Parts)
+	{
+		SubmeshGeometry submesh;
+		submesh.IndexCount = part.IndexCount;
+		submesh.StartIndexLocation = part.StartIndexLocation;
+		submesh.BaseVertexLocation = part.BaseVertexLocation;
+
+		geo->DrawArgs[part.Name] = submesh;
+	}
+
+	return geo;
+}
+
+std::shared_ptr<void> D3DAssetUploader::UploadTexture(const std::string& name, const TextureData& texture, std::string& error)
+{
+	auto tex = std::make_shared<Texture>();
+	tex->Name = name;
+	tex->Filename = texture.Filename;
+
+	HRESULT hr = DirectX::CreateDDSTextureFromMemory12(md3dDevice, mCommandList.Get(),
+		texture.File.Data(), texture.File.Size(), tex->Resource, tex->UploadHeap);
+
+	if(FAILED(hr))
+	{
+		error = name + ": the .dds file could not be loaded (HRESULT " + std::to_string((long)hr) + ")";
+		return nullptr;
+	}
+
+	mCurrBatch->UploadHeaps.push_back(std::move(tex->UploadHeap));
+
+	return tex;
+}
+
+void D3DAssetUploader::EndBatch()
+{
+	ThrowIfFailed(mCommandList->Close());
+	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+	mCurrBatch->Fence = ++mCurrentFence;
+	ThrowIfFailed(mCommandQueue->Signal(mFence.Get(), mCurrentFence));
+
+	mCurrBatch = nullptr;
+}
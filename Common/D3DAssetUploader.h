@@ -0,0 +1,57 @@
+//***************************************************************************************
+// D3DAssetUploader.h
+//
+// The AssetUploader the demos use with AssetLoader.  Meshes become MeshGeometry
+// objects with default-heap buffers made by d3dUtil::CreateDefaultBuffer, and
+// textures become Texture objects made by CreateDDSTextureFromMemory12.
+//
+// Each batch is recorded on the uploader's own command list and executed on the
+// app's command queue when it ends, so it lands ahead of the next frame's commands
+// and the frame can draw with the new assets without waiting.  The upload heaps
+// are kept until the batch's fence has passed, and the command allocators are
+// reused once their batch is done.  Nothing waits on the GPU except the
+// destructor.
+//***************************************************************************************
+
+#pragma once
+
+#include "AssetLoader.h"
+#include "d3dUtil.h"
+
+class D3DAssetUploader : public AssetUploader
+{
+public:
+	D3DAssetUploader(ID3D12Device* device, ID3D12CommandQueue* commandQueue);
+	D3DAssetUploader(const D3DAssetUploader& rhs) = delete;
+	D3DAssetUploader& operator=(const D3DAssetUploader& rhs) = delete;
+
+	// Waits for the batches in flight.
+	~D3DAssetUploader();
+
+	virtual void BeginBatch()override;
+	virtual std::shared_ptr<void> UploadMesh(const std::string& name, const MeshData& mesh, std::string& error)override;
+	virtual std::shared_ptr<void> UploadTexture(const std::string& name, const TextureData& texture, std::string& error)override;
+	virtual void EndBatch()override;
+
+private:
+	struct Batch
+	{
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
+		std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> UploadHeaps;
+		UINT64 Fence = 0;
+	};
+
+	// Releases the upload heaps of the batches the GPU has finished.
+	void Reclaim();
+
+private:
+	ID3D12Device* md3dDevice;
+	ID3D12CommandQueue* mCommandQueue;
+
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCommandList;
+	Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+	UINT64 mCurrentFence = 0;
+
+	std::vector<std::unique_ptr<Batch>> mBatches;
+	Batch* mCurrBatch = nullptr;
+};
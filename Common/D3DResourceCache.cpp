@@ -0,0 +1,94 @@
+//***************************************************************************************
+// D3DResourceCache.cpp
+//***************************************************************************************
+
+#include "D3DResourceCache.h"
+#include "DDSTextureLoader.h"
+#include <map>
+#include <mutex>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	struct DeviceCache
+	{
+		// Held so the device outlives its resources and its address is not reused
+		// for another device while the cache is registered under it.
+		ComPtr<ID3D12Device> Device;
+		ResourceCache Cache;
+	};
+
+	std::mutex gDeviceMutex;
+	std::map<ID3D12Device*, std::unique_ptr<DeviceCache>> gDeviceCaches;
+}
+
+ResourceCache& D3DResourceCache::ForDevice(ID3D12Device* device)
+{
+	std::lock_guard<std::mutex> lock(gDeviceMutex);
+
+	auto& entry = gDeviceCaches[device];
+	if(entry == nullptr)
+	{
+		entry = std::make_unique<DeviceCache>();
+		entry->Device = device;
+	}
+
+	return entry->Cache;
+}
+
+void D3DResourceCache::ReleaseDevice(ID3D12Device* device)
+{
+	std::unique_ptr<DeviceCache> released;
+	{
+		std::lock_guard<std::mutex> lock(gDeviceMutex);
+
+		auto it = gDeviceCaches.find(device);
+		if(it == gDeviceCaches.end())
+			return;
+
+		released = std::move(it->second);
+		gDeviceCaches.erase(it);
+	}
+
+	// The textures, then the device, are released outside the lock.
+	released.reset();
+}
+
+std::shared_ptr<Texture> D3DResourceCache::LoadTexture(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+	const std::string& name, const std::wstring& filename)
+{
+	return LoadTexture(device, cmdList, name, filename, ForDevice(device));
+}
+
+std::shared_ptr<Texture> D3DResourceCache::LoadTexture(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+	const std::string& name, const std::wstring& filename, ResourceCache& cache)
+{
+	HRESULT hr = S_OK;
+
+	auto texture = cache.Acquire<Texture>(filename, [&](const MappedFile& file, std::uint64_t& bytes, std::string&)
+	{
+		auto tex = std::make_shared<Texture>();
+		tex->Name = name;
+		tex->Filename = filename;
+
+		hr = DirectX::CreateDDSTextureFromMemory12(device, cmdList, file.Data(), file.Size(),
+			tex->Resource, tex->UploadHeap);
+		if(FAILED(hr))
+			return std::shared_ptr<Texture>();
+
+		// The texture and the upload heap it keeps.
+		D3D12_RESOURCE_DESC desc = tex->Resource->GetDesc();
+		bytes = device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes + tex->UploadHeap->GetDesc().Width;
+
+		return tex;
+	});
+
+	if(texture == nullptr)
+	{
+		// A missing file fails as CreateDDSTextureFromFile12 does.
+		ThrowIfFailed(FAILED(hr) ? hr : HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+	}
+
+	return texture;
+}
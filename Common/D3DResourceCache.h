@@ -0,0 +1,49 @@
+//***************************************************************************************
+// D3DResourceCache.h
+//
+// The Direct3D resources the demos share through ResourceCache.  Each device has a
+// cache of its own, since a resource made on one device cannot be used on another:
+// a texture loaded here is made once per device for each .dds file's contents,
+// however many scenes on that device load it and under whatever path.
+//
+// The caches hold their devices.  A scene tearing its device down calls
+// ReleaseDevice after FlushCommandQueue, which drops the device's cache and with it
+// every texture no scene still holds.
+//***************************************************************************************
+
+#pragma once
+
+#include "ResourceCache.h"
+#include "d3dUtil.h"
+
+class D3DResourceCache
+{
+public:
+	///<summary>
+	/// The cache of the resources made on device, created on first use.
+	///</summary>
+	static ResourceCache& ForDevice(ID3D12Device* device);
+
+	///<summary>
+	/// Drops device's cache and the cache's reference to device.  Textures that scenes
+	/// still hold live on until they are released.  The GPU must be done with the
+	/// device's resources, so call it after FlushCommandQueue.
+	///</summary>
+	static void ReleaseDevice(ID3D12Device* device);
+
+	///<summary>
+	/// Returns the texture made from filename, a .dds file, from device's cache,
+	/// recording its upload on cmdList if it is made now.  The upload heap is kept
+	/// with the texture, as the demos keep it, so cmdList need not have executed
+	/// before the call returns; but a scene sharing the device must not draw with
+	/// the texture before the list that made it has executed.  The texture is named
+	/// by the scene that made it.  Throws like the demos' CreateDDSTextureFromFile12
+	/// calls if the file is missing or cannot be loaded.
+	///</summary>
+	static std::shared_ptr<Texture> LoadTexture(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+		const std::string& name, const std::wstring& filename);
+
+	// As above, with the texture kept in cache, which must only hold device's resources.
+	static std::shared_ptr<Texture> LoadTexture(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+		const std::string& name, const std::wstring& filename, ResourceCache& cache);
+};
@@ -4,9 +4,165 @@
 
 #include "GeometryGenerator.h"
 #include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <unordered_map>
 
 using namespace DirectX;
 
+// Writes the vertices and indices of one mesh, in order, into a MeshBuffers.
+class GeometryGenerator::MeshWriter
+{
+public:
+	explicit MeshWriter(const MeshBuffers& out) : mOut(out)
+	{
+		assert((mOut.Indices32 == nullptr) != (mOut.Indices16 == nullptr));
+	}
+
+	uint32 VertexCount()const
+	{
+		return mVertexCount;
+	}
+
+	void AddVertex(const Vertex& v)
+	{
+		const VertexLayout& layout = mOut.Layout;
+		std::uint8_t* dst = static_cast<std::uint8_t*>(mOut.Vertices) + (size_t)mVertexCount*layout.Stride;
+
+		if(layout.PositionOffset >= 0)
+			std::memcpy(dst + layout.PositionOffset, &v.Position, sizeof(XMFLOAT3));
+		if(layout.NormalOffset >= 0)
+			std::memcpy(dst + layout.NormalOffset, &v.Normal, sizeof(XMFLOAT3));
+		if(layout.TangentOffset >= 0)
+			std::memcpy(dst + layout.TangentOffset, &v.TangentU, sizeof(XMFLOAT3));
+		if(layout.TexCOffset >= 0)
+			std::memcpy(dst + layout.TexCOffset, &v.TexC, sizeof(XMFLOAT2));
+
+		++mVertexCount;
+	}
+
+	void AddIndex(uint32 index)
+	{
+		if(mOut.Indices32 != nullptr)
+		{
+			mOut.Indices32[mIndexCount++] = index;
+		}
+		else
+		{
+			if(index > 0xffff)
+				throw std::length_error("MeshWriter: index does not fit 16 bits; use Indices32 or IndexBuilder");
+			mOut.Indices16[mIndexCount++] = static_cast<uint16>(index);
+		}
+	}
+
+	void AddMesh(const MeshData& meshData)
+	{
+		for(const Vertex& v : meshData.Vertices)
+			AddVertex(v);
+		for(uint32 index : meshData.Indices32)
+			AddIndex(index);
+	}
+
+private:
+	MeshBuffers mOut;
+	uint32 mVertexCount = 0;
+	uint32 mIndexCount = 0;
+};
+
+namespace
+{
+	// Sizes meshData for a mesh and returns buffers that write into it.
+	GeometryGenerator::MeshBuffers AllocateMesh(const GeometryGenerator::MeshSize& size, GeometryGenerator::MeshData& meshData)
+	{
+		meshData.Vertices.resize(size.VertexCount);
+		meshData.Indices32.resize(size.IndexCount);
+
+		GeometryGenerator::MeshBuffers out;
+		out.Vertices = meshData.Vertices.data();
+		out.Layout = GeometryGenerator::FullLayout();
+		out.Indices32 = meshData.Indices32.data();
+		return out;
+	}
+}
+
+GeometryGenerator::MeshBuffers GeometryGenerator::MeshBuffers::Advance(uint32 vertexCount, uint32 indexCount)const
+{
+	MeshBuffers next = *this;
+	next.Vertices = static_cast<std::uint8_t*>(Vertices) + (size_t)vertexCount*Layout.Stride;
+	if(Indices32 != nullptr)
+		next.Indices32 = Indices32 + indexCount;
+	if(Indices16 != nullptr)
+		next.Indices16 = Indices16 + indexCount;
+	return next;
+}
+
+GeometryGenerator::VertexLayout GeometryGenerator::FullLayout()
+{
+	VertexLayout layout;
+	layout.Stride = sizeof(Vertex);
+	layout.PositionOffset = offsetof(Vertex, Position);
+	layout.NormalOffset = offsetof(Vertex, Normal);
+	layout.TangentOffset = offsetof(Vertex, TangentU);
+	layout.TexCOffset = offsetof(Vertex, TexC);
+	return layout;
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::BoxSize(uint32 numSubdivisions)const
+{
+	// Each face is two triangles that subdivide into a (2^n + 1)^2 vertex grid.
+	uint32 n = 1u << std::min<uint32>(numSubdivisions, 6u);
+
+	MeshSize size;
+	size.VertexCount = 6*(n + 1)*(n + 1);
+	size.IndexCount = 36*n*n;
+	return size;
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::SphereSize(uint32 sliceCount, uint32 stackCount)const
+{
+	MeshSize size;
+	size.VertexCount = (stackCount - 1)*(sliceCount + 1) + 2;
+	size.IndexCount = 6*sliceCount*(stackCount - 1);
+	return size;
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::GeosphereSize(uint32 numSubdivisions)const
+{
+	// Every subdivision quadruples the 20 faces of the icosahedron.
+	uint32 faces = 20u << (2*std::min<uint32>(numSubdivisions, 6u));
+
+	MeshSize size;
+	size.VertexCount = faces/2 + 2;
+	size.IndexCount = 3*faces;
+	return size;
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::CylinderSize(uint32 sliceCount, uint32 stackCount)const
+{
+	// Stack rings, then a ring plus a center vertex for each cap.
+	MeshSize size;
+	size.VertexCount = (stackCount + 1)*(sliceCount + 1) + 2*(sliceCount + 2);
+	size.IndexCount = 6*sliceCount*stackCount + 6*sliceCount;
+	return size;
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::GridSize(uint32 m, uint32 n)const
+{
+	MeshSize size;
+	size.VertexCount = m*n;
+	size.IndexCount = 6*(m - 1)*(n - 1);
+	return size;
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::QuadSize()const
+{
+	MeshSize size;
+	size.VertexCount = 4;
+	size.IndexCount = 6;
+	return size;
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
 {
     MeshData meshData;
@@ -100,9 +256,23 @@ GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float heig
     return meshData;
 }
 
+void GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions, const MeshBuffers& out)
+{
+	// Subdivision needs the whole mesh at hand, so build it first.
+	MeshWriter writer(out);
+	writer.AddMesh(CreateBox(width, height, depth, numSubdivisions));
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount)
 {
     MeshData meshData;
+	CreateSphere(radius, sliceCount, stackCount, AllocateMesh(SphereSize(sliceCount, stackCount), meshData));
+    return meshData;
+}
+
+void GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount, const MeshBuffers& out)
+{
+    MeshWriter writer(out);
 
 	//
 	// Compute the vertices stating at the top pole and moving down the stacks.
@@ -114,7 +284,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 	Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
 
-	meshData.Vertices.push_back( topVertex );
+	writer.AddVertex( topVertex );
 
 	float phiStep   = XM_PI/stackCount;
 	float thetaStep = 2.0f*XM_PI/sliceCount;
@@ -150,11 +320,11 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 			v.TexC.x = theta / XM_2PI;
 			v.TexC.y = phi / XM_PI;
 
-			meshData.Vertices.push_back( v );
+			writer.AddVertex( v );
 		}
 	}
 
-	meshData.Vertices.push_back( bottomVertex );
+	writer.AddVertex( bottomVertex );
 
 	//
 	// Compute indices for top stack.  The top stack was written first to the vertex buffer
@@ -163,9 +333,9 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 
     for(uint32 i = 1; i <= sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(0);
-		meshData.Indices32.push_back(i+1);
-		meshData.Indices32.push_back(i);
+		writer.AddIndex(0);
+		writer.AddIndex(i+1);
+		writer.AddIndex(i);
 	}
 	
 	//
@@ -180,13 +350,13 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	{
 		for(uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
+			writer.AddIndex(baseIndex + i*ringVertexCount + j);
+			writer.AddIndex(baseIndex + i*ringVertexCount + j+1);
+			writer.AddIndex(baseIndex + (i+1)*ringVertexCount + j);
 
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j+1);
+			writer.AddIndex(baseIndex + (i+1)*ringVertexCount + j);
+			writer.AddIndex(baseIndex + i*ringVertexCount + j+1);
+			writer.AddIndex(baseIndex + (i+1)*ringVertexCount + j+1);
 		}
 	}
 
@@ -196,30 +366,21 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	//
 
 	// South pole vertex was added last.
-	uint32 southPoleIndex = (uint32)meshData.Vertices.size()-1;
+	uint32 southPoleIndex = writer.VertexCount()-1;
 
 	// Offset the indices to the index of the first vertex in the last ring.
 	baseIndex = southPoleIndex - ringVertexCount;
 	
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(southPoleIndex);
-		meshData.Indices32.push_back(baseIndex+i);
-		meshData.Indices32.push_back(baseIndex+i+1);
+		writer.AddIndex(southPoleIndex);
+		writer.AddIndex(baseIndex+i);
+		writer.AddIndex(baseIndex+i+1);
 	}
-
-    return meshData;
 }
  
 void GeometryGenerator::Subdivide(MeshData& meshData)
 {
-	// Save a copy of the input geometry.
-	MeshData inputCopy = meshData;
-
-
-	meshData.Vertices.resize(0);
-	meshData.Indices32.resize(0);
-
 	//       v1
 	//       *
 	//      / \
@@ -230,48 +391,61 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 	// *-----*-----*
 	// v0    m2     v2
 
-	uint32 numTris = (uint32)inputCopy.Indices32.size()/3;
+	// The input vertices keep their indices and each edge gets one midpoint vertex,
+	// shared by the two triangles on either side of it, so the output stays indexed.
+	// Edges are keyed by the vertex indices of their endpoints; meshes that split
+	// vertices along a seam (like the faces of a box) keep the seam.
+	uint32 numTris = (uint32)meshData.Indices32.size()/3;
+
+	// A closed mesh has 3/2 edges per triangle.
+	meshData.Vertices.reserve(meshData.Vertices.size() + numTris*3/2 + 3);
+
+	std::unordered_map<std::uint64_t, uint32> midPoints;
+	midPoints.reserve(numTris*3/2 + 3);
+
+	auto midPoint = [&](uint32 a, uint32 b)
+	{
+		std::uint64_t key = a < b ? ((std::uint64_t)a << 32) | b : ((std::uint64_t)b << 32) | a;
+
+		auto it = midPoints.find(key);
+		if(it != midPoints.end())
+			return it->second;
+
+		uint32 index = (uint32)meshData.Vertices.size();
+		Vertex m = MidPoint(meshData.Vertices[a], meshData.Vertices[b]);
+		meshData.Vertices.push_back(m);
+		midPoints.emplace(key, index);
+		return index;
+	};
+
+	std::vector<uint32> indices(numTris*12);
 	for(uint32 i = 0; i < numTris; ++i)
 	{
-		Vertex v0 = inputCopy.Vertices[ inputCopy.Indices32[i*3+0] ];
-		Vertex v1 = inputCopy.Vertices[ inputCopy.Indices32[i*3+1] ];
-		Vertex v2 = inputCopy.Vertices[ inputCopy.Indices32[i*3+2] ];
+		uint32 v0 = meshData.Indices32[i*3+0];
+		uint32 v1 = meshData.Indices32[i*3+1];
+		uint32 v2 = meshData.Indices32[i*3+2];
 
 		//
 		// Generate the midpoints.
 		//
 
-        Vertex m0 = MidPoint(v0, v1);
-        Vertex m1 = MidPoint(v1, v2);
-        Vertex m2 = MidPoint(v0, v2);
+		uint32 m0 = midPoint(v0, v1);
+		uint32 m1 = midPoint(v1, v2);
+		uint32 m2 = midPoint(v0, v2);
 
 		//
 		// Add new geometry.
 		//
 
-		meshData.Vertices.push_back(v0); // 0
-		meshData.Vertices.push_back(v1); // 1
-		meshData.Vertices.push_back(v2); // 2
-		meshData.Vertices.push_back(m0); // 3
-		meshData.Vertices.push_back(m1); // 4
-		meshData.Vertices.push_back(m2); // 5
- 
-		meshData.Indices32.push_back(i*6+0);
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+5);
-
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+5);
-
-		meshData.Indices32.push_back(i*6+5);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+2);
+		uint32* tri = &indices[i*12];
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+1);
-		meshData.Indices32.push_back(i*6+4);
+		tri[0]  = v0; tri[1]  = m0; tri[2]  = m2;
+		tri[3]  = m0; tri[4]  = m1; tri[5]  = m2;
+		tri[6]  = m2; tri[7]  = m1; tri[8]  = v2;
+		tri[9]  = m0; tri[10] = v1; tri[11] = m1;
 	}
+
+	meshData.Indices32.swap(indices);
 }
 
 GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Vertex& v1)
@@ -379,9 +553,24 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uin
     return meshData;
 }
 
+void GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions, const MeshBuffers& out)
+{
+	// Subdivision needs the whole mesh at hand, so build it first.
+	MeshWriter writer(out);
+	writer.AddMesh(CreateGeosphere(radius, numSubdivisions));
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
 {
     MeshData meshData;
+	CreateCylinder(bottomRadius, topRadius, height, sliceCount, stackCount,
+		AllocateMesh(CylinderSize(sliceCount, stackCount), meshData));
+    return meshData;
+}
+
+void GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, const MeshBuffers& out)
+{
+    MeshWriter writer(out);
 
 	//
 	// Build Stacks.
@@ -444,7 +633,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
 			XMStoreFloat3(&vertex.Normal, N);
 
-			meshData.Vertices.push_back(vertex);
+			writer.AddVertex(vertex);
 		}
 	}
 
@@ -457,26 +646,24 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 	{
 		for(uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
+			writer.AddIndex(i*ringVertexCount + j);
+			writer.AddIndex((i+1)*ringVertexCount + j);
+			writer.AddIndex((i+1)*ringVertexCount + j+1);
 
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
-			meshData.Indices32.push_back(i*ringVertexCount + j+1);
+			writer.AddIndex(i*ringVertexCount + j);
+			writer.AddIndex((i+1)*ringVertexCount + j+1);
+			writer.AddIndex(i*ringVertexCount + j+1);
 		}
 	}
 
-	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-
-    return meshData;
+	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, writer);
+	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, writer);
 }
 
 void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius, float height,
-											uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+											uint32 sliceCount, uint32 stackCount, MeshWriter& out)
 {
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
+	uint32 baseIndex = out.VertexCount();
 
 	float y = 0.5f*height;
 	float dTheta = 2.0f*XM_PI/sliceCount;
@@ -492,31 +679,31 @@ void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius,
 		float u = x/height + 0.5f;
 		float v = z/height + 0.5f;
 
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
+		out.AddVertex( Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
 	}
 
 	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
+	out.AddVertex( Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
 
 	// Index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
+	uint32 centerIndex = out.VertexCount()-1;
 
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i+1);
-		meshData.Indices32.push_back(baseIndex + i);
+		out.AddIndex(centerIndex);
+		out.AddIndex(baseIndex + i+1);
+		out.AddIndex(baseIndex + i);
 	}
 }
 
 void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadius, float height,
-											   uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+											   uint32 sliceCount, uint32 stackCount, MeshWriter& out)
 {
 	// 
 	// Build bottom cap.
 	//
 
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
+	uint32 baseIndex = out.VertexCount();
 	float y = -0.5f*height;
 
 	// vertices of ring
@@ -531,29 +718,33 @@ void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadi
 		float u = x/height + 0.5f;
 		float v = z/height + 0.5f;
 
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
+		out.AddVertex( Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
 	}
 
 	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
+	out.AddVertex( Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
 
 	// Cache the index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
+	uint32 centerIndex = out.VertexCount()-1;
 
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i);
-		meshData.Indices32.push_back(baseIndex + i+1);
+		out.AddIndex(centerIndex);
+		out.AddIndex(baseIndex + i);
+		out.AddIndex(baseIndex + i+1);
 	}
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n)
 {
     MeshData meshData;
+	CreateGrid(width, depth, m, n, AllocateMesh(GridSize(m, n), meshData));
+    return meshData;
+}
 
-	uint32 vertexCount = m*n;
-	uint32 faceCount   = (m-1)*(n-1)*2;
+void GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n, const MeshBuffers& out)
+{
+    MeshWriter writer(out);
 
 	//
 	// Create the vertices.
@@ -568,7 +759,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	float du = 1.0f / (n-1);
 	float dv = 1.0f / (m-1);
 
-	meshData.Vertices.resize(vertexCount);
 	for(uint32 i = 0; i < m; ++i)
 	{
 		float z = halfDepth - i*dz;
@@ -576,13 +766,16 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 		{
 			float x = -halfWidth + j*dx;
 
-			meshData.Vertices[i*n+j].Position = XMFLOAT3(x, 0.0f, z);
-			meshData.Vertices[i*n+j].Normal   = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			meshData.Vertices[i*n+j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
+			Vertex v;
+			v.Position = XMFLOAT3(x, 0.0f, z);
+			v.Normal   = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			v.TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
 
 			// Stretch texture over grid.
-			meshData.Vertices[i*n+j].TexC.x = j*du;
-			meshData.Vertices[i*n+j].TexC.y = i*dv;
+			v.TexC.x = j*du;
+			v.TexC.y = i*dv;
+
+			writer.AddVertex(v);
 		}
 	}
  
@@ -590,68 +783,63 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	// Create the indices.
 	//
 
-	meshData.Indices32.resize(faceCount*3); // 3 indices per face
-
 	// Iterate over each quad and compute indices.
-	uint32 k = 0;
 	for(uint32 i = 0; i < m-1; ++i)
 	{
 		for(uint32 j = 0; j < n-1; ++j)
 		{
-			meshData.Indices32[k]   = i*n+j;
-			meshData.Indices32[k+1] = i*n+j+1;
-			meshData.Indices32[k+2] = (i+1)*n+j;
-
-			meshData.Indices32[k+3] = (i+1)*n+j;
-			meshData.Indices32[k+4] = i*n+j+1;
-			meshData.Indices32[k+5] = (i+1)*n+j+1;
+			writer.AddIndex(i*n+j);
+			writer.AddIndex(i*n+j+1);
+			writer.AddIndex((i+1)*n+j);
 
-			k += 6; // next quad
+			writer.AddIndex((i+1)*n+j);
+			writer.AddIndex(i*n+j+1);
+			writer.AddIndex((i+1)*n+j+1);
 		}
 	}
-
-    return meshData;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth)
 {
     MeshData meshData;
+	CreateQuad(x, y, w, h, depth, AllocateMesh(QuadSize(), meshData));
+    return meshData;
+}
 
-	meshData.Vertices.resize(4);
-	meshData.Indices32.resize(6);
+void GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth, const MeshBuffers& out)
+{
+    MeshWriter writer(out);
 
 	// Position coordinates specified in NDC space.
-	meshData.Vertices[0] = Vertex(
+	writer.AddVertex(Vertex(
         x, y - h, depth,
 		0.0f, 0.0f, -1.0f,
 		1.0f, 0.0f, 0.0f,
-		0.0f, 1.0f);
+		0.0f, 1.0f));
 
-	meshData.Vertices[1] = Vertex(
+	writer.AddVertex(Vertex(
 		x, y, depth,
 		0.0f, 0.0f, -1.0f,
 		1.0f, 0.0f, 0.0f,
-		0.0f, 0.0f);
+		0.0f, 0.0f));
 
-	meshData.Vertices[2] = Vertex(
+	writer.AddVertex(Vertex(
 		x+w, y, depth,
 		0.0f, 0.0f, -1.0f,
 		1.0f, 0.0f, 0.0f,
-		1.0f, 0.0f);
+		1.0f, 0.0f));
 
-	meshData.Vertices[3] = Vertex(
+	writer.AddVertex(Vertex(
 		x+w, y-h, depth,
 		0.0f, 0.0f, -1.0f,
 		1.0f, 0.0f, 0.0f,
-		1.0f, 1.0f);
-
-	meshData.Indices32[0] = 0;
-	meshData.Indices32[1] = 1;
-	meshData.Indices32[2] = 2;
+		1.0f, 1.0f));
 
-	meshData.Indices32[3] = 0;
-	meshData.Indices32[4] = 2;
-	meshData.Indices32[5] = 3;
+	writer.AddIndex(0);
+	writer.AddIndex(1);
+	writer.AddIndex(2);
 
-    return meshData;
+	writer.AddIndex(0);
+	writer.AddIndex(2);
+	writer.AddIndex(3);
 }
@@ -16,6 +16,7 @@
 
 #include <cstdint>
 #include <DirectXMath.h>
+#include <stdexcept>
 #include <vector>
 
 class GeometryGenerator
@@ -58,8 +59,14 @@ public:
 		std::vector<Vertex> Vertices;
         std::vector<uint32> Indices32;
 
+        // Only for meshes of at most 65536 vertices; IndexBuilder picks the format
+        // and splits larger meshes.  Throws std::length_error for a larger mesh
+        // rather than truncate its indices.
         std::vector<uint16>& GetIndices16()
         {
+			if(Vertices.size() > 0x10000)
+				throw std::length_error("GetIndices16: mesh has more than 65536 vertices; use IndexBuilder");
+
 			if(mIndices16.empty())
 			{
 				mIndices16.resize(Indices32.size());
@@ -74,6 +81,60 @@ public:
 		std::vector<uint16> mIndices16;
 	};
 
+	///<summary>
+	/// Describes where each attribute goes in a caller's vertex structure.  Offsets
+	/// are in bytes and -1 leaves an attribute out, so a depth-only pass can ask for
+	/// positions alone.
+	///</summary>
+	struct VertexLayout
+	{
+		uint32 Stride = 0;
+		int PositionOffset = 0;
+		int NormalOffset = -1;
+		int TangentOffset = -1;
+		int TexCOffset = -1;
+	};
+
+	///<summary>
+	/// Caller-owned storage the Create* overloads write a mesh into.  Set exactly one
+	/// of the index pointers; Indices16 throws std::length_error for a mesh of more
+	/// than 65536 vertices.  Indices are relative to the first vertex of the mesh,
+	/// i.e. suitable for drawing with a BaseVertexLocation.
+	///</summary>
+	struct MeshBuffers
+	{
+		void* Vertices = nullptr;
+		VertexLayout Layout;
+		uint32* Indices32 = nullptr;
+		uint16* Indices16 = nullptr;
+
+		// Returns the buffers just past a mesh of the given size, for packing
+		// several meshes back to back into one vertex/index buffer.
+		MeshBuffers Advance(uint32 vertexCount, uint32 indexCount)const;
+	};
+
+	struct MeshSize
+	{
+		uint32 VertexCount = 0;
+		uint32 IndexCount = 0;
+	};
+
+	///<summary>
+	/// Number of vertices and indices the corresponding Create* function makes, so
+	/// buffers can be allocated before the mesh is generated.
+	///</summary>
+	MeshSize BoxSize(uint32 numSubdivisions)const;
+	MeshSize SphereSize(uint32 sliceCount, uint32 stackCount)const;
+	MeshSize GeosphereSize(uint32 numSubdivisions)const;
+	MeshSize CylinderSize(uint32 sliceCount, uint32 stackCount)const;
+	MeshSize GridSize(uint32 m, uint32 n)const;
+	MeshSize QuadSize()const;
+
+	///<summary>
+	/// Layout of GeometryGenerator::Vertex itself.
+	///</summary>
+	static VertexLayout FullLayout();
+
 	///<summary>
 	/// Creates a box centered at the origin with the given dimensions, where each
     /// face has m rows and n columns of vertices.
@@ -110,10 +171,24 @@ public:
 	///</summary>
     MeshData CreateQuad(float x, float y, float w, float h, float depth);
 
+	///<summary>
+	/// Same as above, but the mesh is written straight into the caller's buffers in
+	/// the caller's vertex format.  The buffers must hold at least the matching
+	/// *Size() vertices and indices.
+	///</summary>
+    void CreateBox(float width, float height, float depth, uint32 numSubdivisions, const MeshBuffers& out);
+    void CreateSphere(float radius, uint32 sliceCount, uint32 stackCount, const MeshBuffers& out);
+    void CreateGeosphere(float radius, uint32 numSubdivisions, const MeshBuffers& out);
+    void CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, const MeshBuffers& out);
+    void CreateGrid(float width, float depth, uint32 m, uint32 n, const MeshBuffers& out);
+    void CreateQuad(float x, float y, float w, float h, float depth, const MeshBuffers& out);
+
 private:
+	class MeshWriter;
+
 	void Subdivide(MeshData& meshData);
     Vertex MidPoint(const Vertex& v0, const Vertex& v1);
-    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
-    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
+    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshWriter& out);
+    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshWriter& out);
 };
 
@@ -0,0 +1,107 @@
+//***************************************************************************************
+// Heightfield.cpp
+//***************************************************************************************
+
+#include "Heightfield.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+
+using namespace DirectX;
+
+Heightfield::Heightfield(std::uint32_t rows, std::uint32_t cols, float cellSize)
+	: mRows(rows), mCols(cols), mCellSize(cellSize), mHeights((std::size_t)rows*cols, 0.0f)
+{
+	assert(rows >= 2 && cols >= 2 && cellSize > 0.0f);
+}
+
+bool Heightfield::LoadRaw16(const std::string& filename, std::uint32_t rows, std::uint32_t cols, float cellSize,
+	float heightScale, float heightOffset)
+{
+	assert(rows >= 2 && cols >= 2 && cellSize > 0.0f);
+
+	std::ifstream fin(filename, std::ios::binary);
+	if(!fin)
+		return false;
+
+	const std::size_t count = (std::size_t)rows*cols;
+	std::vector<std::uint8_t> raw(2*count);
+	fin.read(reinterpret_cast<char*>(raw.data()), raw.size());
+	if((std::size_t)fin.gcount() != raw.size())
+		return false;
+
+	mRows = rows;
+	mCols = cols;
+	mCellSize = cellSize;
+	mHeights.resize(count);
+
+	const float scale = heightScale / 65535.0f;
+	TaskSystem::Default().ParallelFor(0, (int)rows, 16, [&](int row)
+	{
+		const std::uint8_t* src = &raw[2*(std::size_t)row*cols];
+		float* dst = &mHeights[(std::size_t)row*cols];
+		for(std::uint32_t col = 0; col < cols; ++col)
+			dst[col] = heightOffset + scale*(float)(src[2*col] | (src[2*col + 1] << 8));
+	});
+
+	return true;
+}
+
+XMFLOAT3 Heightfield::SampleNormal(int row, int col)const
+{
+	// Rows run along -z, so the sample above is at +z.
+	float l = Sample(row, col - 1);
+	float r = Sample(row, col + 1);
+	float t = Sample(row - 1, col);
+	float b = Sample(row + 1, col);
+
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, XMVector3Normalize(XMVectorSet(l - r, 2.0f*mCellSize, b - t, 0.0f)));
+	return n;
+}
+
+void Heightfield::Locate(float x, float z, int& row, int& col, float& fr, float& fc)const
+{
+	float c = (x + 0.5f*Width()) / mCellSize;
+	float r = (0.5f*Depth() - z) / mCellSize;
+
+	c = std::min(std::max(c, 0.0f), (float)(mCols - 1));
+	r = std::min(std::max(r, 0.0f), (float)(mRows - 1));
+
+	col = std::min((int)c, (int)mCols - 2);
+	row = std::min((int)r, (int)mRows - 2);
+	fc = c - col;
+	fr = r - row;
+}
+
+float Heightfield::HeightAt(float x, float z)const
+{
+	int row, col;
+	float fr, fc;
+	Locate(x, z, row, col, fr, fc);
+
+	const float* h = &mHeights[(std::size_t)row*mCols + col];
+	float top = h[0] + fc*(h[1] - h[0]);
+	float bottom = h[mCols] + fc*(h[mCols + 1] - h[mCols]);
+	return top + fr*(bottom - top);
+}
+
+XMFLOAT3 Heightfield::NormalAt(float x, float z)const
+{
+	int row, col;
+	float fr, fc;
+	Locate(x, z, row, col, fr, fc);
+
+	XMFLOAT3 n00 = SampleNormal(row, col);
+	XMFLOAT3 n01 = SampleNormal(row, col + 1);
+	XMFLOAT3 n10 = SampleNormal(row + 1, col);
+	XMFLOAT3 n11 = SampleNormal(row + 1, col + 1);
+
+	XMVECTOR top = XMVectorLerp(XMLoadFloat3(&n00), XMLoadFloat3(&n01), fc);
+	XMVECTOR bottom = XMVectorLerp(XMLoadFloat3(&n10), XMLoadFloat3(&n11), fc);
+
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, XMVector3Normalize(XMVectorLerp(top, bottom, fr)));
+	return n;
+}
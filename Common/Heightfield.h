@@ -0,0 +1,102 @@
+//***************************************************************************************
+// Heightfield.h
+//
+// A regular grid of terrain heights, laid out like GeometryGenerator::CreateGrid:
+// centred on the origin in the xz-plane, with columns running along +x and rows
+// along -z.  Heights come from a function, such as the demos' hills, or from a
+// 16-bit raw file as terrain tools export them.
+//
+// HeightAt and NormalAt interpolate bilinearly between samples, so gameplay code
+// can put objects on the ground anywhere without looking at the mesh.
+//***************************************************************************************
+
+#pragma once
+
+#include "TaskSystem.h"
+#include <DirectXMath.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Heightfield
+{
+public:
+	Heightfield() = default;
+
+	///<summary>
+	/// A flat heightfield of rows x cols samples, cellSize apart.
+	///</summary>
+	Heightfield(std::uint32_t rows, std::uint32_t cols, float cellSize);
+
+	///<summary>
+	/// Sets every sample to height(x, z) at its position, in parallel.
+	///</summary>
+	template<typename F>
+	void Generate(const F& height);
+
+	///<summary>
+	/// Loads rows x cols little-endian 16-bit samples, row after row, mapping 0 to
+	/// heightOffset and 65535 to heightOffset + heightScale.  Returns false, leaving
+	/// the heightfield unchanged, if the file is missing or too short.
+	///</summary>
+	bool LoadRaw16(const std::string& filename, std::uint32_t rows, std::uint32_t cols, float cellSize,
+		float heightScale, float heightOffset = 0.0f);
+
+	std::uint32_t RowCount()const { return mRows; }
+	std::uint32_t ColumnCount()const { return mCols; }
+	float CellSize()const { return mCellSize; }
+	float Width()const { return (mCols - 1)*mCellSize; }
+	float Depth()const { return (mRows - 1)*mCellSize; }
+
+	float X(int col)const { return -0.5f*Width() + col*mCellSize; }
+	float Z(int row)const { return 0.5f*Depth() - row*mCellSize; }
+
+	///<summary>
+	/// The sample at (row, col), clamped to the grid.
+	///</summary>
+	float Sample(int row, int col)const
+	{
+		row = row < 0 ? 0 : (row >= (int)mRows ? (int)mRows - 1 : row);
+		col = col < 0 ? 0 : (col >= (int)mCols ? (int)mCols - 1 : col);
+		return mHeights[(std::size_t)row*mCols + col];
+	}
+
+	void SetSample(int row, int col, float height)
+	{
+		mHeights[(std::size_t)row*mCols + col] = height;
+	}
+
+	///<summary>
+	/// Unit normal at a sample, from central differences.
+	///</summary>
+	DirectX::XMFLOAT3 SampleNormal(int row, int col)const;
+
+	///<summary>
+	/// Bilinearly interpolated height and normal at (x, z).  Points off the grid
+	/// take the value at the nearest edge.
+	///</summary>
+	float HeightAt(float x, float z)const;
+	DirectX::XMFLOAT3 NormalAt(float x, float z)const;
+
+private:
+	// Splits (x, z) into a sample and the fractions towards the next one.
+	void Locate(float x, float z, int& row, int& col, float& fr, float& fc)const;
+
+private:
+	std::uint32_t mRows = 0;
+	std::uint32_t mCols = 0;
+	float mCellSize = 1.0f;
+
+	std::vector<float> mHeights;
+};
+
+template<typename F>
+void Heightfield::Generate(const F& height)
+{
+	TaskSystem::Default().ParallelFor(0, (int)mRows, 16, [&](int row)
+	{
+		float z = Z(row);
+		for(std::uint32_t col = 0; col < mCols; ++col)
+			mHeights[(std::size_t)row*mCols + col] = height(X(col), z);
+	});
+}
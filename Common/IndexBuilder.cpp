@@ -0,0 +1,309 @@
+//***************************************************************************************
+// IndexBuilder.cpp
+//***************************************************************************************
+
+#include "IndexBuilder.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+const std::uint32_t IndexBuilder::MaxVertices16;
+
+namespace
+{
+	const std::uint32_t NotMarked = 0xffffffff;
+
+	// A run of whole triangles of a submesh whose vertices are in [Lo, Lo + max).
+	struct Window
+	{
+		std::uint32_t StartIndex = 0;
+		std::uint32_t IndexCount = 0;
+		std::uint32_t Lo = 0;
+	};
+
+	template<typename Index>
+	std::uint32_t VertexOf(const Index* indices, const IndexBuilder::Submesh& s, std::uint32_t i)
+	{
+		return (std::uint32_t)((std::int64_t)indices[s.StartIndex + i] + s.BaseVertex);
+	}
+
+	// Splits a submesh into windows, starting a new one whenever the next
+	// triangle would stretch the current one too far.  Fails if a single triangle
+	// spans too many vertices.
+	template<typename Index>
+	bool SplitContiguous(const Index* indices, const IndexBuilder::Submesh& s, std::uint32_t maxVertices,
+		std::vector<Window>& windows)
+	{
+		const std::uint32_t triCount = s.IndexCount / 3;
+
+		Window w;
+		w.StartIndex = s.StartIndex;
+		std::uint32_t hi = 0;
+
+		for(std::uint32_t t = 0; t < triCount; ++t)
+		{
+			std::uint32_t v0 = VertexOf(indices, s, 3*t + 0);
+			std::uint32_t v1 = VertexOf(indices, s, 3*t + 1);
+			std::uint32_t v2 = VertexOf(indices, s, 3*t + 2);
+
+			std::uint32_t triLo = std::min(v0, std::min(v1, v2));
+			std::uint32_t triHi = std::max(v0, std::max(v1, v2));
+			if(triHi - triLo >= maxVertices)
+				return false;
+
+			if(w.IndexCount == 0)
+			{
+				w.Lo = triLo;
+				hi = triHi;
+			}
+			else if(std::max(hi, triHi) - std::min(w.Lo, triLo) >= maxVertices)
+			{
+				windows.push_back(w);
+				w.StartIndex += w.IndexCount;
+				w.IndexCount = 0;
+				w.Lo = triLo;
+				hi = triHi;
+			}
+			else
+			{
+				w.Lo = std::min(w.Lo, triLo);
+				hi = std::max(hi, triHi);
+			}
+
+			w.IndexCount += 3;
+		}
+
+		if(w.IndexCount > 0)
+			windows.push_back(w);
+
+		return true;
+	}
+
+	// Walks a submesh splitting it into parts of at most maxVertices distinct
+	// vertices, calling addVertex the first time a part uses a vertex and
+	// addIndex with the vertex's index within its part.  Returns the number of
+	// parts.
+	template<typename Index, typename StartPart, typename AddVertex, typename AddIndex>
+	std::uint32_t SplitRemap(const Index* indices, const IndexBuilder::Submesh& s, std::uint32_t maxVertices,
+		std::vector<std::uint32_t>& mark, std::vector<std::uint32_t>& local, std::uint32_t& stamp,
+		StartPart startPart, AddVertex addVertex, AddIndex addIndex)
+	{
+		const std::uint32_t triCount = s.IndexCount / 3;
+
+		std::uint32_t parts = 0;
+		std::uint32_t partVertices = maxVertices;
+
+		for(std::uint32_t t = 0; t < triCount; ++t)
+		{
+			std::uint32_t v[3];
+			std::uint32_t newVertices = 0;
+			for(int k = 0; k < 3; ++k)
+			{
+				v[k] = VertexOf(indices, s, 3*t + k);
+				newVertices += mark[v[k]] != stamp;
+			}
+
+			// Repeated vertices within the triangle were counted twice, which can
+			// only end a part a triangle early.
+			if(partVertices + newVertices > maxVertices)
+			{
+				++stamp;
+				++parts;
+				partVertices = 0;
+				startPart(3*t);
+			}
+
+			for(int k = 0; k < 3; ++k)
+			{
+				if(mark[v[k]] != stamp)
+				{
+					mark[v[k]] = stamp;
+					local[v[k]] = partVertices++;
+					addVertex(v[k]);
+				}
+				addIndex(local[v[k]]);
+			}
+		}
+
+		++stamp;
+		return parts;
+	}
+}
+
+bool IndexBuilder::IndexData::Is16Bit()const
+{
+	return Indices32.empty();
+}
+
+const void* IndexBuilder::IndexData::Data()const
+{
+	return Is16Bit() ? (const void*)Indices16.data() : (const void*)Indices32.data();
+}
+
+std::size_t IndexBuilder::IndexData::ByteSize()const
+{
+	return Is16Bit() ? Indices16.size()*sizeof(std::uint16_t) : Indices32.size()*sizeof(std::uint32_t);
+}
+
+template<typename Index>
+IndexBuilder::IndexData IndexBuilder::Build(const Index* indices, std::uint32_t vertexCount,
+	const std::vector<Submesh>& submeshes, SplitMode mode, std::uint32_t maxPartVertices)
+{
+	assert(maxPartVertices >= 3 && maxPartVertices <= MaxVertices16);
+
+	IndexData data;
+
+	std::vector<std::vector<Window>> windows(submeshes.size());
+	bool contiguous = true;
+	bool split = false;
+	std::size_t contiguousParts = 0;
+	for(std::size_t s = 0; s < submeshes.size(); ++s)
+	{
+		assert(submeshes[s].IndexCount % 3 == 0);
+
+		contiguous = contiguous && SplitContiguous(indices, submeshes[s], maxPartVertices, windows[s]);
+		split = split || windows[s].size() > 1;
+		contiguousParts += std::max<std::size_t>(windows[s].size(), 1);
+	}
+
+	std::vector<std::uint32_t> mark;
+	std::vector<std::uint32_t> local;
+	std::uint32_t stamp = 0;
+
+	bool remap = false;
+	if(!contiguous || split)
+	{
+		if(mode == SplitMode::None)
+		{
+			contiguous = false;
+		}
+		else if(mode == SplitMode::Remap)
+		{
+			// Windows work badly when the vertices are scattered; if they need many
+			// more draws than parts with their own vertices would, remap instead.
+			mark.assign(vertexCount, NotMarked);
+			local.resize(vertexCount);
+
+			std::size_t remapParts = 0;
+			for(const Submesh& s : submeshes)
+			{
+				remapParts += std::max<std::uint32_t>(1, SplitRemap(indices, s, maxPartVertices, mark, local, stamp,
+					[](std::uint32_t) {}, [](std::uint32_t) {}, [](std::uint32_t) {}));
+			}
+
+			remap = !contiguous || contiguousParts > 2*remapParts;
+		}
+	}
+
+	if(remap)
+	{
+		for(std::size_t s = 0; s < submeshes.size(); ++s)
+		{
+			const Submesh& submesh = submeshes[s];
+
+			Part part;
+			part.Submesh = (std::uint32_t)s;
+			part.StartIndex = (std::uint32_t)data.Indices16.size();
+			part.BaseVertex = (std::int32_t)data.VertexRemap.size();
+
+			SplitRemap(indices, submesh, maxPartVertices, mark, local, stamp,
+				[&](std::uint32_t i)
+				{
+					if(i > 0)
+					{
+						data.Parts.push_back(part);
+						part.StartIndex = (std::uint32_t)data.Indices16.size();
+						part.IndexCount = 0;
+						part.BaseVertex = (std::int32_t)data.VertexRemap.size();
+					}
+				},
+				[&](std::uint32_t v) { data.VertexRemap.push_back(v); },
+				[&](std::uint32_t index)
+				{
+					data.Indices16.push_back((std::uint16_t)index);
+					++part.IndexCount;
+				});
+
+			data.Parts.push_back(part);
+		}
+	}
+	else if(contiguous)
+	{
+		for(std::size_t s = 0; s < submeshes.size(); ++s)
+		{
+			const Submesh& submesh = submeshes[s];
+
+			// An empty submesh still gets its part, so parts match submeshes.
+			if(windows[s].empty())
+			{
+				Window w;
+				w.StartIndex = submesh.StartIndex;
+				w.Lo = (std::uint32_t)std::max(submesh.BaseVertex, 0);
+				windows[s].push_back(w);
+			}
+
+			for(const Window& w : windows[s])
+			{
+				Part part;
+				part.Submesh = (std::uint32_t)s;
+				part.StartIndex = (std::uint32_t)data.Indices16.size();
+				part.IndexCount = w.IndexCount;
+				part.BaseVertex = (std::int32_t)w.Lo;
+				data.Parts.push_back(part);
+
+				for(std::uint32_t i = 0; i < w.IndexCount; ++i)
+				{
+					std::uint32_t v = VertexOf(indices, submesh, w.StartIndex - submesh.StartIndex + i);
+					data.Indices16.push_back((std::uint16_t)(v - w.Lo));
+				}
+			}
+		}
+	}
+	else
+	{
+		for(std::size_t s = 0; s < submeshes.size(); ++s)
+		{
+			const Submesh& submesh = submeshes[s];
+
+			Part part;
+			part.Submesh = (std::uint32_t)s;
+			part.StartIndex = (std::uint32_t)data.Indices32.size();
+			part.IndexCount = submesh.IndexCount;
+			part.BaseVertex = submesh.BaseVertex;
+			data.Parts.push_back(part);
+
+			for(std::uint32_t i = 0; i < submesh.IndexCount; ++i)
+				data.Indices32.push_back((std::uint32_t)indices[submesh.StartIndex + i]);
+		}
+	}
+
+	return data;
+}
+
+template<typename Index>
+IndexBuilder::IndexData IndexBuilder::Build(const Index* indices, std::size_t indexCount, std::uint32_t vertexCount,
+	SplitMode mode)
+{
+	Submesh submesh;
+	submesh.IndexCount = (std::uint32_t)indexCount;
+
+	return Build(indices, vertexCount, std::vector<Submesh>(1, submesh), mode);
+}
+
+void IndexBuilder::RemapVertices(const void* vertices, std::size_t vertexStride,
+	const std::vector<std::uint32_t>& remap, void* out)
+{
+	const std::uint8_t* src = static_cast<const std::uint8_t*>(vertices);
+	std::uint8_t* dst = static_cast<std::uint8_t*>(out);
+
+	for(std::size_t i = 0; i < remap.size(); ++i)
+		std::memcpy(dst + i*vertexStride, src + remap[i]*vertexStride, vertexStride);
+}
+
+#define INSTANTIATE_INDEX_BUILDER(Index) \
+	template IndexBuilder::IndexData IndexBuilder::Build<Index>(const Index*, std::uint32_t, const std::vector<Submesh>&, SplitMode, std::uint32_t); \
+	template IndexBuilder::IndexData IndexBuilder::Build<Index>(const Index*, std::size_t, std::uint32_t, SplitMode);
+
+INSTANTIATE_INDEX_BUILDER(std::uint16_t)
+INSTANTIATE_INDEX_BUILDER(std::uint32_t)
+INSTANTIATE_INDEX_BUILDER(std::int32_t)
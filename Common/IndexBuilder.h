@@ -0,0 +1,109 @@
+//***************************************************************************************
+// IndexBuilder.h
+//
+// Picks the narrowest index format a mesh can be drawn with.  A submesh whose
+// vertices all lie within 65536 of each other is rebased onto its lowest vertex
+// and gets 16-bit indices, drawn with that vertex as its BaseVertexLocation.
+//
+// A submesh that spans more vertices is split into parts that each fit:
+//
+//   - Contiguous: triangles are taken in order while the vertices they use stay
+//     within one 64K window.  The vertex buffer is used unchanged and windows may
+//     overlap, so nothing is duplicated.  This works well when the vertices are in
+//     roughly the order the triangles use them, as after MeshOptimizer.
+//   - Remap: triangles are taken in order while they use at most 64K distinct
+//     vertices, and each part gets its own copy of those vertices.  This always
+//     works but builds a new vertex buffer, duplicating vertices on part borders.
+//
+// If the submeshes cannot be split the way the caller allows, the indices are
+// left as they are in 32-bit form.
+//
+// Build is instantiated for 16-bit, 32-bit and signed 32-bit indices.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class IndexBuilder
+{
+public:
+	// Vertices one draw with 16-bit indices can address.
+	static const std::uint32_t MaxVertices16 = 0x10000;
+
+	enum class SplitMode
+	{
+		// Fall back to 32-bit indices rather than split.
+		None,
+
+		// Split into parts over windows of the unchanged vertex buffer.
+		Contiguous,
+
+		// Also allow parts with their own copies of the vertices.
+		Remap
+	};
+
+	// A range of the input indices drawn on its own, such as one material's
+	// triangles.  Its indices are relative to BaseVertex.
+	struct Submesh
+	{
+		std::uint32_t StartIndex = 0;
+		std::uint32_t IndexCount = 0;
+		std::int32_t BaseVertex = 0;
+	};
+
+	// One draw of the output: the DrawIndexed parameters of part of a submesh.
+	struct Part
+	{
+		std::uint32_t Submesh = 0;
+		std::uint32_t StartIndex = 0;
+		std::uint32_t IndexCount = 0;
+		std::int32_t BaseVertex = 0;
+	};
+
+	struct IndexData
+	{
+		// At most one of these is filled; with no indices at all the data counts
+		// as 16-bit.
+		std::vector<std::uint16_t> Indices16;
+		std::vector<std::uint32_t> Indices32;
+
+		// The source vertex of each vertex of the new vertex buffer, or empty if the
+		// parts draw from the vertex buffer as it was.
+		std::vector<std::uint32_t> VertexRemap;
+
+		// Grouped by submesh, in submesh order.  A submesh has one part unless it
+		// had to be split.
+		std::vector<Part> Parts;
+
+		bool Is16Bit()const;
+		const void* Data()const;
+		std::size_t ByteSize()const;
+	};
+
+	///<summary>
+	/// Builds the index buffer for the given submeshes of a triangle list.  The
+	/// output holds the same triangles, submesh after submesh; maxPartVertices can
+	/// be lowered from the 16-bit limit to force splitting.
+	///</summary>
+	template<typename Index>
+	static IndexData Build(const Index* indices, std::uint32_t vertexCount,
+		const std::vector<Submesh>& submeshes, SplitMode mode = SplitMode::Remap,
+		std::uint32_t maxPartVertices = MaxVertices16);
+
+	///<summary>
+	/// Same as above, for a single submesh of all the indices.
+	///</summary>
+	template<typename Index>
+	static IndexData Build(const Index* indices, std::size_t indexCount, std::uint32_t vertexCount,
+		SplitMode mode = SplitMode::Remap);
+
+	///<summary>
+	/// Writes the vertex buffer for IndexData::VertexRemap: out[i] is a copy of the
+	/// vertex remap[i] of vertices.  out must have room for remap.size() vertices.
+	///</summary>
+	static void RemapVertices(const void* vertices, std::size_t vertexStride,
+		const std::vector<std::uint32_t>& remap, void* out);
+};
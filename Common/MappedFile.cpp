@@ -0,0 +1,115 @@
+//***************************************************************************************
+// MappedFile.cpp
+//***************************************************************************************
+
+#include "MappedFile.h"
+#include <windows.h>
+#include <utility>
+
+MappedFile::MappedFile(MappedFile&& rhs)
+{
+	*this = std::move(rhs);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& rhs)
+{
+	if(this != &rhs)
+	{
+		Close();
+
+		std::swap(mFile, rhs.mFile);
+		std::swap(mMapping, rhs.mMapping);
+		std::swap(mView, rhs.mView);
+		std::swap(mSize, rhs.mSize);
+	}
+
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const wchar_t* filename)
+{
+	Close();
+
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+	HANDLE file = CreateFile2(filename, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+#else
+	HANDLE file = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+#endif
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(file, &size) || (std::uint64_t)size.QuadPart > (std::uint64_t)SIZE_MAX)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	mFile = file;
+	mSize = (std::size_t)size.QuadPart;
+
+	// A file mapping cannot be made of an empty file.
+	if(mSize == 0)
+		return true;
+
+	mMapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mMapping != nullptr)
+		mView = (const std::uint8_t*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+
+	if(mView == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if(mView != nullptr)
+		UnmapViewOfFile(mView);
+	if(mMapping != nullptr)
+		CloseHandle(mMapping);
+	if(mFile != nullptr)
+		CloseHandle(mFile);
+
+	mFile = nullptr;
+	mMapping = nullptr;
+	mView = nullptr;
+	mSize = 0;
+}
+
+bool MappedFile::GetStamp(const wchar_t* filename, Stamp& stamp)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if(!GetFileAttributesExW(filename, GetFileExInfoStandard, &data) ||
+		(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+		return false;
+
+	stamp.Size = ((std::uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	stamp.LastWriteTime = ((std::uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) |
+		data.ftLastWriteTime.dwLowDateTime;
+
+	return true;
+}
+
+std::uint64_t MappedFile::Hash(const void* data, std::size_t size)
+{
+	const std::uint8_t* bytes = (const std::uint8_t*)data;
+
+	std::uint64_t hash = 14695981039346656037ull;
+	for(std::size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
@@ -0,0 +1,64 @@
+//***************************************************************************************
+// MappedFile.h
+//
+// A read-only view of a whole file mapped into the address space.  Pages are read
+// from disk, or straight out of the file cache, as they are first touched, so
+// opening even a large file costs next to nothing and its contents can be used in
+// place without copying them into a buffer.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class MappedFile
+{
+public:
+	// Size and last write time of a file, enough to tell whether it has changed
+	// since it was last seen without reading it.
+	struct Stamp
+	{
+		std::uint64_t Size = 0;
+		std::uint64_t LastWriteTime = 0;
+
+		bool operator==(const Stamp& rhs)const { return Size == rhs.Size && LastWriteTime == rhs.LastWriteTime; }
+		bool operator!=(const Stamp& rhs)const { return !(*this == rhs); }
+	};
+
+	MappedFile() = default;
+	MappedFile(const MappedFile& rhs) = delete;
+	MappedFile& operator=(const MappedFile& rhs) = delete;
+	MappedFile(MappedFile&& rhs);
+	MappedFile& operator=(MappedFile&& rhs);
+	~MappedFile();
+
+	///<summary>
+	/// Maps filename, closing whatever was open before.  Returns false if the file
+	/// cannot be opened.  An empty file opens with a null Data().
+	///</summary>
+	bool Open(const wchar_t* filename);
+	void Close();
+
+	bool IsOpen()const { return mFile != nullptr; }
+
+	const std::uint8_t* Data()const { return mView; }
+	std::size_t Size()const { return mSize; }
+
+	///<summary>
+	/// Reads the stamp of filename, returning false if it does not exist.
+	///</summary>
+	static bool GetStamp(const wchar_t* filename, Stamp& stamp);
+
+	///<summary>
+	/// 64-bit FNV-1a hash of size bytes, for noticing changed contents behind an
+	/// unchanged stamp, or an unchanged file behind a new one.
+	///</summary>
+	static std::uint64_t Hash(const void* data, std::size_t size);
+
+private:
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+	const std::uint8_t* mView = nullptr;
+	std::size_t mSize = 0;
+};
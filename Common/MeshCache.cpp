@@ -0,0 +1,414 @@
+//***************************************************************************************
+// MeshCache.cpp
+//***************************************************************************************
+
+#include "MeshCache.h"
+#include "BoundsBuilder.h"
+#include "ParallelTextReader.h"
+#include "TextScanner.h"
+#include <windows.h>
+#include <cstddef>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	const std::uint32_t CacheMagic = 0x4843534D; // "MSCH"
+	const std::uint32_t CacheVersion = 1;
+
+	struct CacheHeader
+	{
+		std::uint32_t Magic;
+		std::uint32_t Version;
+
+		// The text file the cache was made from.
+		std::uint64_t SourceSize;
+		std::uint64_t SourceWriteTime;
+		std::uint64_t SourceHash;
+
+		std::uint32_t VertexCount;
+		std::uint32_t IndexCount;
+		std::uint64_t VertexOffset;
+		std::uint64_t IndexOffset;
+
+		XMFLOAT3 BoxCenter;
+		XMFLOAT3 BoxExtents;
+		XMFLOAT3 SphereCenter;
+		float SphereRadius;
+	};
+
+	static_assert(sizeof(CacheHeader) == 96, "The cache header must be packed and a multiple of 16 bytes.");
+
+	std::uint64_t AlignUp(std::uint64_t offset)
+	{
+		return (offset + 15) & ~(std::uint64_t)15;
+	}
+
+	// The header of a mapped cache, or null if it is not a cache of this version or
+	// its arrays overrun the file.
+	const CacheHeader* ValidHeader(const MappedFile& file)
+	{
+		if(file.Size() < sizeof(CacheHeader))
+			return nullptr;
+
+		const CacheHeader* header = (const CacheHeader*)file.Data();
+		if(header->Magic != CacheMagic || header->Version != CacheVersion)
+			return nullptr;
+
+		const std::uint64_t size = file.Size();
+		const std::uint64_t vertexBytes = (std::uint64_t)header->VertexCount * sizeof(MeshCache::Vertex);
+		const std::uint64_t indexBytes = (std::uint64_t)header->IndexCount * sizeof(std::uint32_t);
+
+		if(header->VertexOffset % 16 != 0 || header->VertexOffset < sizeof(CacheHeader) ||
+			header->VertexOffset > size || vertexBytes > size - header->VertexOffset)
+			return nullptr;
+
+		if(header->IndexOffset % 16 != 0 || header->IndexOffset < header->VertexOffset + vertexBytes ||
+			header->IndexOffset > size || indexBytes > size - header->IndexOffset)
+			return nullptr;
+
+		if(header->IndexCount % 3 != 0)
+			return nullptr;
+
+		return header;
+	}
+
+	// ValidHeader, and every index within the vertices.  The indices are only
+	// scanned when a cache is first opened, so a corrupt one is rebuilt rather than
+	// drawn out of bounds.
+	const CacheHeader* ValidCache(const MappedFile& file)
+	{
+		const CacheHeader* header = ValidHeader(file);
+		if(header == nullptr)
+			return nullptr;
+
+		const std::uint32_t* indices = (const std::uint32_t*)(file.Data() + header->IndexOffset);
+		std::uint32_t maxIndex = 0;
+		for(std::uint32_t i = 0; i < header->IndexCount; ++i)
+			maxIndex = indices[i] > maxIndex ? indices[i] : maxIndex;
+
+		if(header->IndexCount > 0 && maxIndex >= header->VertexCount)
+			return nullptr;
+
+		return header;
+	}
+
+	// A text model read and hashed, with its bounds.
+	struct TextMesh
+	{
+		std::vector<MeshCache::Vertex> Vertices;
+		std::vector<std::uint32_t> Indices;
+
+		MappedFile::Stamp Stamp;
+		std::uint64_t Hash = 0;
+
+		BoundingBox Box;
+		BoundingSphere Sphere;
+	};
+
+	bool LoadText(const wchar_t* textFile, TextMesh& mesh, std::string& error)
+	{
+		MappedFile text;
+		if(!MappedFile::GetStamp(textFile, mesh.Stamp) || !text.Open(textFile))
+		{
+			error = "file not found";
+			return false;
+		}
+
+		if(!MeshCache::ParseText((const char*)text.Data(), text.Size(), mesh.Vertices, mesh.Indices, &error))
+			return false;
+
+		mesh.Hash = MappedFile::Hash(text.Data(), text.Size());
+
+		const std::uint32_t vcount = (std::uint32_t)mesh.Vertices.size();
+		mesh.Box = BoundsBuilder::ComputeBox(mesh.Vertices.data(), sizeof(MeshCache::Vertex), vcount,
+			offsetof(MeshCache::Vertex, Pos));
+		mesh.Sphere = BoundsBuilder::ComputeEposSphere(mesh.Vertices.data(), sizeof(MeshCache::Vertex), vcount,
+			offsetof(MeshCache::Vertex, Pos));
+
+		return true;
+	}
+
+	bool WriteAll(HANDLE file, const void* data, std::uint64_t size)
+	{
+		const std::uint8_t* bytes = (const std::uint8_t*)data;
+		while(size > 0)
+		{
+			DWORD chunk = (DWORD)(size < 0x40000000 ? size : 0x40000000);
+			DWORD written = 0;
+			if(!WriteFile(file, bytes, chunk, &written, nullptr) || written != chunk)
+				return false;
+
+			bytes += chunk;
+			size -= chunk;
+		}
+
+		return true;
+	}
+
+	HANDLE CreateForWriting(const wchar_t* filename, DWORD disposition)
+	{
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+		return CreateFile2(filename, GENERIC_WRITE, 0, disposition, nullptr);
+#else
+		return CreateFileW(filename, GENERIC_WRITE, 0, nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+#endif
+	}
+
+	// Writes the cache to a temporary file and moves it over cacheFile, so that a
+	// failed write never leaves a truncated cache behind.
+	bool WriteCache(const wchar_t* cacheFile, const TextMesh& mesh)
+	{
+		CacheHeader header = {};
+		header.Magic = CacheMagic;
+		header.Version = CacheVersion;
+		header.SourceSize = mesh.Stamp.Size;
+		header.SourceWriteTime = mesh.Stamp.LastWriteTime;
+		header.SourceHash = mesh.Hash;
+		header.VertexCount = (std::uint32_t)mesh.Vertices.size();
+		header.IndexCount = (std::uint32_t)mesh.Indices.size();
+		header.VertexOffset = AlignUp(sizeof(CacheHeader));
+		header.IndexOffset = AlignUp(header.VertexOffset + mesh.Vertices.size() * sizeof(MeshCache::Vertex));
+		header.BoxCenter = mesh.Box.Center;
+		header.BoxExtents = mesh.Box.Extents;
+		header.SphereCenter = mesh.Sphere.Center;
+		header.SphereRadius = mesh.Sphere.Radius;
+
+		const std::uint64_t vertexBytes = mesh.Vertices.size() * sizeof(MeshCache::Vertex);
+		const std::uint64_t indexBytes = mesh.Indices.size() * sizeof(std::uint32_t);
+		const std::uint8_t zeros[16] = {};
+
+		const std::wstring tempFile = std::wstring(cacheFile) + L".tmp";
+
+		HANDLE file = CreateForWriting(tempFile.c_str(), CREATE_ALWAYS);
+		if(file == INVALID_HANDLE_VALUE)
+			return false;
+
+		bool ok = WriteAll(file, &header, sizeof(header)) &&
+			WriteAll(file, zeros, header.VertexOffset - sizeof(header)) &&
+			WriteAll(file, mesh.Vertices.data(), vertexBytes) &&
+			WriteAll(file, zeros, header.IndexOffset - header.VertexOffset - vertexBytes) &&
+			WriteAll(file, mesh.Indices.data(), indexBytes);
+
+		CloseHandle(file);
+
+		if(ok)
+			ok = MoveFileExW(tempFile.c_str(), cacheFile, MOVEFILE_REPLACE_EXISTING) != 0;
+
+		if(!ok)
+			DeleteFileW(tempFile.c_str());
+
+		return ok;
+	}
+
+	// Overwrites the header of an existing cache.
+	bool WriteHeader(const wchar_t* cacheFile, const CacheHeader& header)
+	{
+		HANDLE file = CreateForWriting(cacheFile, OPEN_EXISTING);
+		if(file == INVALID_HANDLE_VALUE)
+			return false;
+
+		bool ok = WriteAll(file, &header, sizeof(header));
+		CloseHandle(file);
+
+		return ok;
+	}
+}
+
+bool MeshCache::Open(const wchar_t* textFile, const wchar_t* cacheFile)
+{
+	Close();
+
+	const std::wstring cacheName = cacheFile != nullptr ? std::wstring(cacheFile) : DefaultCacheFile(textFile);
+
+	MappedFile::Stamp stamp;
+	const bool haveText = MappedFile::GetStamp(textFile, stamp);
+
+	if(mFile.Open(cacheName.c_str()))
+	{
+		const CacheHeader* header = ValidCache(mFile);
+		if(header != nullptr)
+		{
+			if(!haveText || (header->SourceSize == stamp.Size && header->SourceWriteTime == stamp.LastWriteTime))
+			{
+				mSource = Source::Cache;
+				return UseMapping();
+			}
+
+			// The text has a new stamp; if it has the same contents the cache only
+			// needs the new stamp.
+			MappedFile text;
+			if(header->SourceSize == stamp.Size && text.Open(textFile) &&
+				MappedFile::Hash(text.Data(), text.Size()) == header->SourceHash)
+			{
+				CacheHeader restamped = *header;
+				restamped.SourceWriteTime = stamp.LastWriteTime;
+
+				mFile.Close();
+				WriteHeader(cacheName.c_str(), restamped);
+
+				if(mFile.Open(cacheName.c_str()) && ValidHeader(mFile) != nullptr)
+				{
+					mSource = Source::RestampedCache;
+					return UseMapping();
+				}
+			}
+		}
+
+		mFile.Close();
+	}
+
+	TextMesh mesh;
+	if(!LoadText(textFile, mesh, mError))
+		return false;
+
+	mSource = Source::Text;
+
+	if(WriteCache(cacheName.c_str(), mesh) && mFile.Open(cacheName.c_str()) && ValidHeader(mFile) != nullptr)
+		return UseMapping();
+
+	mFile.Close();
+
+	mVertexStorage = std::move(mesh.Vertices);
+	mIndexStorage = std::move(mesh.Indices);
+
+	mVertices = mVertexStorage.data();
+	mIndices = mIndexStorage.data();
+	mVertexCount = (std::uint32_t)mVertexStorage.size();
+	mIndexCount = (std::uint32_t)mIndexStorage.size();
+	mBox = mesh.Box;
+	mSphere = mesh.Sphere;
+
+	return true;
+}
+
+void MeshCache::Close()
+{
+	mFile.Close();
+
+	mVertexStorage.clear();
+	mVertexStorage.shrink_to_fit();
+	mIndexStorage.clear();
+	mIndexStorage.shrink_to_fit();
+
+	mVertices = nullptr;
+	mIndices = nullptr;
+	mVertexCount = 0;
+	mIndexCount = 0;
+	mBox = BoundingBox();
+	mSphere = BoundingSphere();
+
+	mSource = Source::None;
+	mError.clear();
+}
+
+bool MeshCache::UseMapping()
+{
+	const CacheHeader* header = ValidHeader(mFile);
+	if(header == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	mVertices = (const Vertex*)(mFile.Data() + header->VertexOffset);
+	mIndices = (const std::uint32_t*)(mFile.Data() + header->IndexOffset);
+	mVertexCount = header->VertexCount;
+	mIndexCount = header->IndexCount;
+	mBox = BoundingBox(header->BoxCenter, header->BoxExtents);
+	mSphere = BoundingSphere(header->SphereCenter, header->SphereRadius);
+
+	return true;
+}
+
+bool MeshCache::Convert(const wchar_t* textFile, const wchar_t* cacheFile, std::string* error)
+{
+	TextMesh mesh;
+	std::string message;
+	if(!LoadText(textFile, mesh, message))
+	{
+		if(error != nullptr)
+			*error = message;
+		return false;
+	}
+
+	if(!WriteCache(cacheFile, mesh))
+	{
+		if(error != nullptr)
+			*error = "the cache could not be written";
+		return false;
+	}
+
+	return true;
+}
+
+bool MeshCache::ParseText(const char* text, std::size_t size, std::vector<Vertex>& vertices,
+	std::vector<std::uint32_t>& indices, std::string* error, TaskSystem& taskSystem)
+{
+	vertices.clear();
+	indices.clear();
+
+	TextScanner in(text, size);
+
+	std::uint32_t vcount = 0;
+	std::uint32_t tcount = 0;
+
+	// "VertexCount: n TriangleCount: m VertexList (pos, normal) {"
+	in.Expect("VertexCount:");
+	in.Read(vcount);
+	in.Expect("TriangleCount:");
+	in.Read(tcount);
+	in.Skip(4);
+
+	// Each vertex takes at least 12 characters and each triangle 6.
+	if(in.CheckCount(vcount, 12) && in.CheckCount(tcount, 6))
+	{
+		vertices.resize(vcount);
+
+		auto readVertex = [&vertices](TextScanner& scanner, std::uint32_t i)
+		{
+			scanner.Read(&vertices[i].Pos.x, 3);
+			scanner.Read(&vertices[i].Normal.x, 3);
+		};
+
+		if(!ParallelTextReader::ReadRecords(in, vcount, readVertex, taskSystem))
+		{
+			for(std::uint32_t i = 0; i < vcount && !in.Failed(); ++i)
+				readVertex(in, i);
+		}
+
+		// "} TriangleList {"
+		in.Skip(3);
+
+		indices.resize(3 * (std::size_t)tcount);
+
+		auto readTriangle = [&indices, vcount](TextScanner& scanner, std::uint32_t i)
+		{
+			std::uint32_t* triangle = &indices[3 * (std::size_t)i];
+			for(int k = 0; k < 3; ++k)
+			{
+				if(scanner.Read(triangle[k]) && triangle[k] >= vcount)
+					scanner.Fail("index out of range");
+			}
+		};
+
+		if(!ParallelTextReader::ReadRecords(in, tcount, readTriangle, taskSystem))
+		{
+			for(std::uint32_t i = 0; i < tcount && !in.Failed(); ++i)
+				readTriangle(in, i);
+		}
+	}
+
+	if(in.Failed())
+	{
+		if(error != nullptr)
+			*error = in.Error();
+
+		vertices.clear();
+		indices.clear();
+		return false;
+	}
+
+	return true;
+}
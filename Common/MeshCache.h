@@ -0,0 +1,137 @@
+//***************************************************************************************
+// MeshCache.h
+//
+// Loads the book's text models (Models/skull.txt, Models/car.txt) through a binary
+// cache kept beside them, so that they are parsed once rather than on every run.
+//
+// The cache is a header followed by the vertex and index arrays, each 16-byte
+// aligned, exactly as they are used:
+//
+//   header    magic, version, size, last write time and hash of the text file,
+//             vertex and index counts and offsets, bounding box and sphere
+//   vertices  VertexCount MeshCache::Vertex
+//   indices   IndexCount std::uint32_t
+//
+// Open maps the cache and hands out pointers straight into the mapping; nothing is
+// copied, and only the indices are read, to check them.  The text is parsed again only when its size or
+// last write time differs from the cache's, and then only if its hash differs too:
+// a file that was merely touched or copied just has its cache restamped.  A cache
+// whose arrays overrun the file or whose indices reach past its vertices is
+// rebuilt from the text.  If the cache cannot be written, say in a read-only
+// directory, the parsed mesh is kept in memory instead; if the text is missing,
+// the cache is used on its own.
+//
+// The bounds are computed once with BoundsBuilder, when the cache is written: the
+// exact box, and an EPOS sphere tighter than BoundingSphere::CreateFromPoints.
+//***************************************************************************************
+
+#pragma once
+
+#include "MappedFile.h"
+#include "TaskSystem.h"
+#include <DirectXCollision.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class MeshCache
+{
+public:
+	struct Vertex
+	{
+		DirectX::XMFLOAT3 Pos;
+		DirectX::XMFLOAT3 Normal;
+	};
+
+	// Where the mesh of the last Open came from.
+	enum class Source
+	{
+		None,
+		Cache,
+		// The cache, after finding the text unchanged behind a new stamp.
+		RestampedCache,
+		// The text, which was parsed and written to the cache.
+		Text
+	};
+
+	MeshCache() = default;
+	MeshCache(const MeshCache& rhs) = delete;
+	MeshCache& operator=(const MeshCache& rhs) = delete;
+
+	///<summary>
+	/// Opens the mesh of textFile, from cacheFile if it is up to date and otherwise
+	/// by parsing textFile and rewriting cacheFile.  The cache defaults to textFile
+	/// with ".cache" appended.  Returns false if neither can be read or the text is
+	/// malformed, and Error() says why.
+	///</summary>
+	bool Open(const wchar_t* textFile, const wchar_t* cacheFile = nullptr);
+	void Close();
+
+	Source GetSource()const { return mSource; }
+
+	// Why the last Open failed, such as "line 12: expected a number, found "x"".
+	const std::string& Error()const { return mError; }
+
+	// Valid until the next Open or Close.
+	const Vertex* Vertices()const { return mVertices; }
+	const std::uint32_t* Indices()const { return mIndices; }
+
+	std::uint32_t VertexCount()const { return mVertexCount; }
+	std::uint32_t IndexCount()const { return mIndexCount; }
+	std::uint32_t TriangleCount()const { return mIndexCount / 3; }
+
+	const DirectX::BoundingBox& Box()const { return mBox; }
+	const DirectX::BoundingSphere& Sphere()const { return mSphere; }
+
+	///<summary>
+	/// Parses textFile and writes cacheFile, as Open does when the cache is stale.
+	///</summary>
+	static bool Convert(const wchar_t* textFile, const wchar_t* cacheFile, std::string* error = nullptr);
+
+	///<summary>
+	/// Parses the text format the book's models are written in:
+	///
+	///   VertexCount: n
+	///   TriangleCount: m
+	///   VertexList (pos, normal)
+	///   {
+	///     n lines of px py pz nx ny nz
+	///   }
+	///   TriangleList
+	///   {
+	///     m lines of i0 i1 i2
+	///   }
+	///
+	/// Returns false if it is truncated, a number is malformed or an index is out of
+	/// range, and sets error to what was wrong and on which line.
+	///
+	/// The two lists are split by lines and parsed on taskSystem's workers, with
+	/// the same result as parsing them in order (see ParallelTextReader).
+	///</summary>
+	static bool ParseText(const char* text, std::size_t size, std::vector<Vertex>& vertices,
+		std::vector<std::uint32_t>& indices, std::string* error = nullptr,
+		TaskSystem& taskSystem = TaskSystem::Default());
+
+	static std::wstring DefaultCacheFile(const wchar_t* textFile) { return std::wstring(textFile) + L".cache"; }
+
+private:
+	bool UseMapping();
+
+private:
+	MappedFile mFile;
+
+	// Holds the mesh when the cache could not be written.
+	std::vector<Vertex> mVertexStorage;
+	std::vector<std::uint32_t> mIndexStorage;
+
+	const Vertex* mVertices = nullptr;
+	const std::uint32_t* mIndices = nullptr;
+	std::uint32_t mVertexCount = 0;
+	std::uint32_t mIndexCount = 0;
+
+	DirectX::BoundingBox mBox;
+	DirectX::BoundingSphere mSphere;
+
+	Source mSource = Source::None;
+	std::string mError;
+};
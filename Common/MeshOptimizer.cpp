@@ -0,0 +1,433 @@
+//***************************************************************************************
+// MeshOptimizer.cpp
+//***************************************************************************************
+
+#include "MeshOptimizer.h"
+#include <DirectXMath.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+using namespace DirectX;
+
+const std::uint32_t MeshOptimizer::DefaultCacheSize;
+
+namespace
+{
+	// FIFO post-transform cache.  A vertex is cached if fewer than cacheSize
+	// vertices have been inserted since it was.
+	class FifoCache
+	{
+	public:
+		FifoCache(std::uint32_t vertexCount, std::uint32_t cacheSize) :
+			mInsertTime(vertexCount, 0), mCacheSize(cacheSize), mTime(cacheSize + 1)
+		{
+		}
+
+		// Returns true on a miss, i.e. when the vertex has to be transformed.
+		bool Access(std::uint32_t v)
+		{
+			if(mTime - mInsertTime[v] < mCacheSize)
+				return false;
+
+			mInsertTime[v] = mTime++;
+			return true;
+		}
+
+		void Flush()
+		{
+			mTime += mCacheSize;
+		}
+
+	private:
+		std::vector<std::uint32_t> mInsertTime;
+		std::uint32_t mCacheSize;
+		std::uint32_t mTime;
+	};
+
+	XMVECTOR LoadPosition(const void* vertices, std::size_t vertexStride, std::size_t positionOffset, std::uint32_t v)
+	{
+		auto p = reinterpret_cast<const XMFLOAT3*>(
+			static_cast<const std::uint8_t*>(vertices) + v*vertexStride + positionOffset);
+		return XMLoadFloat3(p);
+	}
+}
+
+template<typename Index>
+MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache(const Index* indices, std::size_t indexCount,
+	std::uint32_t vertexCount, std::uint32_t cacheSize)
+{
+	CacheStats stats;
+
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<bool> referenced(vertexCount, false);
+	std::uint32_t referencedCount = 0;
+
+	for(std::size_t i = 0; i < indexCount; ++i)
+	{
+		std::uint32_t v = (std::uint32_t)indices[i];
+		assert(v < vertexCount);
+
+		if(cache.Access(v))
+			++stats.Transforms;
+
+		if(!referenced[v])
+		{
+			referenced[v] = true;
+			++referencedCount;
+		}
+	}
+
+	if(indexCount > 0)
+	{
+		stats.Acmr = (float)stats.Transforms / (indexCount / 3);
+		stats.Atvr = (float)stats.Transforms / referencedCount;
+	}
+
+	return stats;
+}
+
+template<typename Index>
+void MeshOptimizer::OptimizeVertexCache(Index* indices, std::size_t indexCount,
+	std::uint32_t vertexCount, std::uint32_t cacheSize)
+{
+	//
+	// Tipsify: fan out from a vertex, emitting all of its remaining triangles, then
+	// move on to the candidate vertex that has been in the cache longest but will
+	// still be there once its own remaining triangles are emitted.  When there is
+	// no such vertex, fall back to the most recently used vertex that still has
+	// triangles, then to the next one in input order.
+	//
+	const std::uint32_t triCount = (std::uint32_t)(indexCount / 3);
+
+	// Vertex-to-triangle adjacency, stored compactly.
+	std::vector<std::uint32_t> liveCount(vertexCount, 0);
+	for(std::size_t i = 0; i < indexCount; ++i)
+		++liveCount[(std::uint32_t)indices[i]];
+
+	std::vector<std::uint32_t> adjOffset(vertexCount + 1, 0);
+	for(std::uint32_t v = 0; v < vertexCount; ++v)
+		adjOffset[v + 1] = adjOffset[v] + liveCount[v];
+
+	std::vector<std::uint32_t> adjacency(indexCount);
+	{
+		std::vector<std::uint32_t> fill(adjOffset.begin(), adjOffset.end() - 1);
+		for(std::uint32_t t = 0; t < triCount; ++t)
+		{
+			for(int k = 0; k < 3; ++k)
+				adjacency[fill[(std::uint32_t)indices[3*t + k]]++] = t;
+		}
+	}
+
+	std::vector<Index> output;
+	output.reserve(triCount*3);
+
+	std::vector<bool> emitted(triCount, false);
+	std::vector<std::uint32_t> cacheTime(vertexCount, 0);
+	std::uint32_t time = cacheSize + 1;
+
+	std::vector<std::uint32_t> deadEnd;
+	deadEnd.reserve(indexCount);
+
+	std::vector<std::uint32_t> candidates;
+	std::uint32_t cursor = 0;
+
+	std::int64_t fanning = triCount > 0 ? (std::int64_t)indices[0] : -1;
+	while(fanning >= 0)
+	{
+		std::uint32_t f = (std::uint32_t)fanning;
+		candidates.clear();
+
+		for(std::uint32_t a = adjOffset[f]; a < adjOffset[f + 1]; ++a)
+		{
+			std::uint32_t t = adjacency[a];
+			if(emitted[t])
+				continue;
+
+			for(int k = 0; k < 3; ++k)
+			{
+				Index index = indices[3*t + k];
+				std::uint32_t v = (std::uint32_t)index;
+
+				output.push_back(index);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				--liveCount[v];
+
+				if(time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+
+			emitted[t] = true;
+		}
+
+		fanning = -1;
+		std::uint32_t bestPriority = 0;
+		for(std::uint32_t v : candidates)
+		{
+			if(liveCount[v] == 0)
+				continue;
+
+			std::uint32_t priority = 0;
+			if(time - cacheTime[v] + 2*liveCount[v] <= cacheSize)
+				priority = time - cacheTime[v];
+
+			if(priority > bestPriority)
+			{
+				bestPriority = priority;
+				fanning = v;
+			}
+		}
+
+		while(fanning < 0 && !deadEnd.empty())
+		{
+			std::uint32_t v = deadEnd.back();
+			deadEnd.pop_back();
+			if(liveCount[v] > 0)
+				fanning = v;
+		}
+
+		while(fanning < 0 && cursor < vertexCount)
+		{
+			if(liveCount[cursor] > 0)
+				fanning = cursor;
+			++cursor;
+		}
+	}
+
+	assert(output.size() == triCount*3);
+	std::copy(output.begin(), output.end(), indices);
+}
+
+template<typename Index>
+void MeshOptimizer::OptimizeOverdraw(Index* indices, std::size_t indexCount,
+	const void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+	std::size_t positionOffset, float threshold, std::uint32_t cacheSize)
+{
+	const std::uint32_t triCount = (std::uint32_t)(indexCount / 3);
+	if(triCount == 0)
+		return;
+
+	auto triangleMisses = [&](FifoCache& cache, std::uint32_t t)
+	{
+		std::uint32_t misses = 0;
+		for(int k = 0; k < 3; ++k)
+			misses += cache.Access((std::uint32_t)indices[3*t + k]) ? 1 : 0;
+		return misses;
+	};
+
+	//
+	// Hard boundaries: triangles that miss the cache on all three vertices start
+	// afresh anyway, so reordering there costs nothing.
+	//
+	std::vector<std::uint32_t> hardStarts;
+	{
+		FifoCache cache(vertexCount, cacheSize);
+		for(std::uint32_t t = 0; t < triCount; ++t)
+		{
+			if(triangleMisses(cache, t) == 3 || t == 0)
+				hardStarts.push_back(t);
+		}
+		hardStarts.push_back(triCount);
+	}
+
+	//
+	// Soft boundaries: split each run further as soon as the part of it seen so far
+	// is nearly as cache efficient as the whole run.  Every cluster is measured
+	// from a cold cache since it may be drawn after any other.
+	//
+	std::vector<std::uint32_t> clusterStarts;
+	{
+		FifoCache cache(vertexCount, cacheSize);
+		for(std::size_t h = 0; h + 1 < hardStarts.size(); ++h)
+		{
+			std::uint32_t first = hardStarts[h];
+			std::uint32_t last = hardStarts[h + 1];
+
+			cache.Flush();
+			std::uint32_t runMisses = 0;
+			for(std::uint32_t t = first; t < last; ++t)
+				runMisses += triangleMisses(cache, t);
+
+			float limit = threshold*runMisses / (last - first);
+
+			// Splitting only while the clusters so far, cold restarts included, are
+			// within the limit keeps that part of the run within it.
+			cache.Flush();
+			std::size_t firstCluster = clusterStarts.size();
+			std::uint32_t start = first;
+			std::uint32_t misses = 0;
+			std::vector<std::uint32_t> closedMisses;
+			clusterStarts.push_back(first);
+			closedMisses.push_back(0);
+			for(std::uint32_t t = first; t < last; ++t)
+			{
+				misses += triangleMisses(cache, t);
+				if(t + 1 < last && misses <= limit*(t + 1 - start) &&
+				   closedMisses.back() + misses <= limit*(t + 1 - first))
+				{
+					closedMisses.push_back(closedMisses.back() + misses);
+					start = t + 1;
+					misses = 0;
+					cache.Flush();
+					clusterStarts.push_back(start);
+				}
+			}
+
+			// The last cluster is what is left over and may be expensive; merge it
+			// into the ones before it until the run as a whole is within the limit.
+			while(clusterStarts.size() - firstCluster > 1 &&
+				  closedMisses.back() + misses > limit*(last - first))
+			{
+				clusterStarts.pop_back();
+				closedMisses.pop_back();
+
+				cache.Flush();
+				misses = 0;
+				for(std::uint32_t t = clusterStarts.back(); t < last; ++t)
+					misses += triangleMisses(cache, t);
+			}
+		}
+		clusterStarts.push_back(triCount);
+	}
+
+	//
+	// Sort the clusters so those facing away from the mesh centre, which tend to
+	// occlude the rest, are drawn first.
+	//
+	const std::size_t clusterCount = clusterStarts.size() - 1;
+
+	std::vector<XMFLOAT3> clusterCentroid(clusterCount);
+	std::vector<XMFLOAT3> clusterNormal(clusterCount);
+	XMVECTOR meshCentroid = XMVectorZero();
+	float meshArea = 0.0f;
+
+	for(std::size_t c = 0; c < clusterCount; ++c)
+	{
+		XMVECTOR centroid = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		float area = 0.0f;
+
+		for(std::uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t)
+		{
+			XMVECTOR p0 = LoadPosition(vertices, vertexStride, positionOffset, (std::uint32_t)indices[3*t + 0]);
+			XMVECTOR p1 = LoadPosition(vertices, vertexStride, positionOffset, (std::uint32_t)indices[3*t + 1]);
+			XMVECTOR p2 = LoadPosition(vertices, vertexStride, positionOffset, (std::uint32_t)indices[3*t + 2]);
+
+			// Twice the area-weighted normal.
+			XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+			float a = XMVectorGetX(XMVector3Length(n));
+
+			centroid += a*(p0 + p1 + p2);
+			normal += n;
+			area += a;
+		}
+
+		meshCentroid += centroid;
+		meshArea += area;
+
+		if(area > 0.0f)
+			centroid /= 3.0f*area;
+
+		XMStoreFloat3(&clusterCentroid[c], centroid);
+		XMStoreFloat3(&clusterNormal[c], XMVector3Normalize(normal));
+	}
+
+	if(meshArea > 0.0f)
+		meshCentroid /= 3.0f*meshArea;
+
+	std::vector<float> sortKey(clusterCount);
+	for(std::size_t c = 0; c < clusterCount; ++c)
+	{
+		XMVECTOR toCluster = XMLoadFloat3(&clusterCentroid[c]) - meshCentroid;
+		sortKey[c] = XMVectorGetX(XMVector3Dot(toCluster, XMLoadFloat3(&clusterNormal[c])));
+	}
+
+	std::vector<std::uint32_t> order(clusterCount);
+	for(std::size_t c = 0; c < clusterCount; ++c)
+		order[c] = (std::uint32_t)c;
+
+	std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b)
+	{
+		return sortKey[a] > sortKey[b];
+	});
+
+	std::vector<Index> input(indices, indices + triCount*3);
+	Index* dst = indices;
+	for(std::uint32_t c : order)
+	{
+		dst = std::copy(input.begin() + 3*clusterStarts[c], input.begin() + 3*clusterStarts[c + 1], dst);
+	}
+}
+
+template<typename Index>
+std::uint32_t MeshOptimizer::OptimizeVertexFetch(void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+	Index* indices, std::size_t indexCount)
+{
+	const std::uint32_t unassigned = 0xffffffff;
+
+	std::vector<std::uint32_t> remap(vertexCount, unassigned);
+	std::uint32_t next = 0;
+	for(std::size_t i = 0; i < indexCount; ++i)
+	{
+		std::uint32_t v = (std::uint32_t)indices[i];
+		if(remap[v] == unassigned)
+			remap[v] = next++;
+
+		indices[i] = (Index)remap[v];
+	}
+
+	const std::uint32_t referencedCount = next;
+	for(std::uint32_t v = 0; v < vertexCount; ++v)
+	{
+		if(remap[v] == unassigned)
+			remap[v] = next++;
+	}
+
+	auto data = static_cast<std::uint8_t*>(vertices);
+	std::vector<std::uint8_t> input(data, data + vertexCount*vertexStride);
+	for(std::uint32_t v = 0; v < vertexCount; ++v)
+		std::memcpy(data + remap[v]*vertexStride, &input[v*vertexStride], vertexStride);
+
+	return referencedCount;
+}
+
+template<typename Index>
+void MeshOptimizer::Optimize(void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+	std::size_t positionOffset, Index* indices, std::size_t indexCount, std::uint32_t baseVertex)
+{
+	if(baseVertex != 0)
+	{
+		for(std::size_t i = 0; i < indexCount; ++i)
+			indices[i] = (Index)(indices[i] - baseVertex);
+	}
+
+	// Models are often exported with a good order already; keep it if it is better.
+	std::vector<Index> input(indices, indices + indexCount);
+	OptimizeVertexCache(indices, indexCount, vertexCount);
+	if(AnalyzeVertexCache(indices, indexCount, vertexCount).Transforms >
+	   AnalyzeVertexCache(input.data(), indexCount, vertexCount).Transforms)
+	{
+		std::copy(input.begin(), input.end(), indices);
+	}
+
+	OptimizeOverdraw(indices, indexCount, vertices, vertexStride, vertexCount, positionOffset);
+	OptimizeVertexFetch(vertices, vertexStride, vertexCount, indices, indexCount);
+
+	if(baseVertex != 0)
+	{
+		for(std::size_t i = 0; i < indexCount; ++i)
+			indices[i] = (Index)(indices[i] + baseVertex);
+	}
+}
+
+#define INSTANTIATE_MESH_OPTIMIZER(Index) \
+	template MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache<Index>(const Index*, std::size_t, std::uint32_t, std::uint32_t); \
+	template void MeshOptimizer::OptimizeVertexCache<Index>(Index*, std::size_t, std::uint32_t, std::uint32_t); \
+	template void MeshOptimizer::OptimizeOverdraw<Index>(Index*, std::size_t, const void*, std::size_t, std::uint32_t, std::size_t, float, std::uint32_t); \
+	template std::uint32_t MeshOptimizer::OptimizeVertexFetch<Index>(void*, std::size_t, std::uint32_t, Index*, std::size_t); \
+	template void MeshOptimizer::Optimize<Index>(void*, std::size_t, std::uint32_t, std::size_t, Index*, std::size_t, std::uint32_t);
+
+INSTANTIATE_MESH_OPTIMIZER(std::uint16_t)
+INSTANTIATE_MESH_OPTIMIZER(std::uint32_t)
+INSTANTIATE_MESH_OPTIMIZER(std::int32_t)
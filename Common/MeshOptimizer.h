@@ -0,0 +1,97 @@
+//***************************************************************************************
+// MeshOptimizer.h
+//
+// Reorders indexed triangle lists for the GPU:
+//
+//   1. OptimizeVertexCache reorders triangles so recently transformed vertices are
+//      reused from the post-transform cache (Sander et al., "Fast Triangle
+//      Reordering for Vertex Locality and Reduced Overdraw", i.e. Tipsify).
+//   2. OptimizeOverdraw splits that order into clusters and draws the clusters that
+//      face away from the centre of the mesh first, so early-z rejects more of what
+//      comes after, while keeping most of the cache efficiency.
+//   3. OptimizeVertexFetch renumbers the vertices in the order they are first used
+//      so vertex fetches walk memory linearly.
+//
+// AnalyzeVertexCache simulates a FIFO post-transform cache so the result can be
+// measured without a GPU.
+//
+// The index functions are instantiated for 16-bit, 32-bit and (as the skull loaders
+// use) signed 32-bit indices.  Vertices are opaque: only their stride and the byte
+// offset of an XMFLOAT3 position are needed.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class MeshOptimizer
+{
+public:
+	struct CacheStats
+	{
+		// Vertex shader invocations.
+		std::uint32_t Transforms = 0;
+
+		// Average cache miss ratio: transforms per triangle.  Ranges from 3 down to
+		// about 0.5 for a large, regular mesh.
+		float Acmr = 0.0f;
+
+		// Average transform to vertex ratio: transforms per referenced vertex.  1 is
+		// ideal; unlike the ACMR it does not depend on the mesh topology.
+		float Atvr = 0.0f;
+	};
+
+	// Default post-transform cache size used for optimizing and measuring.
+	static const std::uint32_t DefaultCacheSize = 16;
+
+	///<summary>
+	/// Simulates a FIFO post-transform cache of cacheSize entries on a triangle list
+	/// whose indices are in [0, vertexCount).
+	///</summary>
+	template<typename Index>
+	static CacheStats AnalyzeVertexCache(const Index* indices, std::size_t indexCount,
+		std::uint32_t vertexCount, std::uint32_t cacheSize = DefaultCacheSize);
+
+	///<summary>
+	/// Reorders the triangles in place for post-transform cache reuse.
+	///</summary>
+	template<typename Index>
+	static void OptimizeVertexCache(Index* indices, std::size_t indexCount,
+		std::uint32_t vertexCount, std::uint32_t cacheSize = DefaultCacheSize);
+
+	///<summary>
+	/// Reorders clusters of an already cache-optimized triangle list in place to
+	/// reduce overdraw.  threshold bounds the loss of cache efficiency: a cluster is
+	/// closed once its ACMR is within threshold times that of the run it belongs to.
+	///</summary>
+	template<typename Index>
+	static void OptimizeOverdraw(Index* indices, std::size_t indexCount,
+		const void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+		std::size_t positionOffset, float threshold = 1.05f, std::uint32_t cacheSize = DefaultCacheSize);
+
+	///<summary>
+	/// Reorders the vertices in place into the order the indices first use them and
+	/// remaps the indices.  Unreferenced vertices move to the end, so the vertex
+	/// count does not change.  Returns the number of referenced vertices.
+	///</summary>
+	template<typename Index>
+	static std::uint32_t OptimizeVertexFetch(void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+		Index* indices, std::size_t indexCount);
+
+	///<summary>
+	/// Runs all three optimizations.  Indices refer to vertices[index - baseVertex],
+	/// so one subset of a mesh whose indices are absolute can be optimized on its own.
+	///</summary>
+	template<typename Index>
+	static void Optimize(void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+		std::size_t positionOffset, Index* indices, std::size_t indexCount, std::uint32_t baseVertex = 0);
+
+	template<typename Vertex, typename Index>
+	static void Optimize(std::vector<Vertex>& vertices, std::vector<Index>& indices, std::size_t positionOffset)
+	{
+		Optimize(vertices.data(), sizeof(Vertex), (std::uint32_t)vertices.size(),
+			positionOffset, indices.data(), indices.size());
+	}
+};
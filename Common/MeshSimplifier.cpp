@@ -0,0 +1,661 @@
+//***************************************************************************************
+// MeshSimplifier.cpp
+//***************************************************************************************
+
+#include "MeshSimplifier.h"
+#include <DirectXMath.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace DirectX;
+
+namespace
+{
+	// Weight of the planes that hold seams and borders in place, relative to the
+	// planes of the faces.
+	const double FeatureWeight = 10.0;
+
+	// A collapse is rejected if it turns a face by more than about 75 degrees.
+	const float FlipCosine = 0.25f;
+
+	// Q(p) = p^T A p + 2 b.p + c, summed over planes, and the total plane weight.
+	struct Quadric
+	{
+		double A00 = 0.0, A01 = 0.0, A02 = 0.0, A11 = 0.0, A12 = 0.0, A22 = 0.0;
+		double B0 = 0.0, B1 = 0.0, B2 = 0.0;
+		double C = 0.0;
+		double W = 0.0;
+
+		// Adds the plane n.p + d = 0 (n unit length) with weight w.
+		void AddPlane(double nx, double ny, double nz, double d, double w)
+		{
+			A00 += w*nx*nx; A01 += w*nx*ny; A02 += w*nx*nz;
+			A11 += w*ny*ny; A12 += w*ny*nz; A22 += w*nz*nz;
+			B0 += w*nx*d; B1 += w*ny*d; B2 += w*nz*d;
+			C += w*d*d;
+			W += w;
+		}
+
+		void Add(const Quadric& q)
+		{
+			A00 += q.A00; A01 += q.A01; A02 += q.A02;
+			A11 += q.A11; A12 += q.A12; A22 += q.A22;
+			B0 += q.B0; B1 += q.B1; B2 += q.B2;
+			C += q.C;
+			W += q.W;
+		}
+
+		double Evaluate(const XMFLOAT3& p)const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double r = A00*x*x + A11*y*y + A22*z*z + 2.0*(A01*x*y + A02*x*z + A12*y*z)
+				+ 2.0*(B0*x + B1*y + B2*z) + C;
+			return std::max(r, 0.0);
+		}
+	};
+
+	struct Collapse
+	{
+		std::uint32_t From;
+		std::uint32_t To;
+		double Cost;
+	};
+
+	std::uint64_t EdgeKey(std::uint32_t a, std::uint32_t b)
+	{
+		return ((std::uint64_t)a << 32) | b;
+	}
+
+	class Simplifier
+	{
+	public:
+		template<typename Index>
+		Simplifier(const void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+			std::size_t positionOffset, const Index* indices, std::size_t indexCount);
+
+		// Collapses edges until at most targetIndexCount indices are left or the next
+		// collapse would exceed maxError.  Returns false if nothing could be collapsed.
+		bool Run(std::size_t targetIndexCount, float maxError);
+
+		const std::vector<std::uint32_t>& Indices()const { return mIndices; }
+		float Error()const { return (float)std::sqrt(mMaxError); }
+
+	private:
+		void BuildAdjacency();
+		void FindFeatures();
+		void InitQuadrics();
+
+		bool CanCollapse(std::uint32_t g, std::uint32_t h);
+		void ApplyCollapse(std::uint32_t g, std::uint32_t h);
+
+		XMVECTOR Position(std::uint32_t v)const { return XMLoadFloat3(&mPositions[v]); }
+
+	private:
+		std::uint32_t mVertexCount = 0;
+		std::vector<XMFLOAT3> mPositions;
+
+		// Vertices with the same position form a group, named by its first vertex.
+		// mNextWedge links the vertices of a group in a ring.
+		std::vector<std::uint32_t> mGroup;
+		std::vector<std::uint32_t> mNextWedge;
+
+		std::vector<Quadric> mQuadrics;
+		std::vector<std::uint32_t> mIndices;
+
+		// Per pass: vertex-to-triangle adjacency, and per group the groups it is
+		// joined to by seam or border edges (up to two; a third locks the group).
+		std::vector<std::uint32_t> mAdjOffset;
+		std::vector<std::uint32_t> mAdjacency;
+		std::vector<std::uint32_t> mFeature0;
+		std::vector<std::uint32_t> mFeature1;
+		std::vector<std::uint8_t> mFeatureCount;
+
+		std::vector<bool> mLocked;
+		std::vector<std::uint32_t> mCollapseTo;
+
+		// Per collapse test: the wedge of the target group each wedge goes to.
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> mWedgeMap;
+
+		double mMaxError = 0.0;
+	};
+
+	const std::uint8_t Locked = 0xff;
+
+	template<typename Index>
+	Simplifier::Simplifier(const void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+		std::size_t positionOffset, const Index* indices, std::size_t indexCount)
+	{
+		mVertexCount = vertexCount;
+		mPositions.resize(vertexCount);
+		for(std::uint32_t v = 0; v < vertexCount; ++v)
+		{
+			std::memcpy(&mPositions[v],
+				static_cast<const std::uint8_t*>(vertices) + v*vertexStride + positionOffset, sizeof(XMFLOAT3));
+		}
+
+		// Group vertices by exact position.
+		struct PositionHash
+		{
+			std::size_t operator()(const XMFLOAT3& p)const
+			{
+				std::uint32_t h[3];
+				std::memcpy(h, &p, sizeof(h));
+				return (h[0]*73856093u) ^ (h[1]*19349663u) ^ (h[2]*83492791u);
+			}
+		};
+		struct PositionEqual
+		{
+			bool operator()(const XMFLOAT3& a, const XMFLOAT3& b)const
+			{
+				return a.x == b.x && a.y == b.y && a.z == b.z;
+			}
+		};
+
+		std::unordered_map<XMFLOAT3, std::uint32_t, PositionHash, PositionEqual> firstVertex;
+		firstVertex.reserve(vertexCount);
+
+		mGroup.resize(vertexCount);
+		mNextWedge.resize(vertexCount);
+		for(std::uint32_t v = 0; v < vertexCount; ++v)
+		{
+			auto it = firstVertex.emplace(mPositions[v], v).first;
+			std::uint32_t g = it->second;
+
+			mGroup[v] = g;
+			if(g == v)
+			{
+				mNextWedge[v] = v;
+			}
+			else
+			{
+				mNextWedge[v] = mNextWedge[g];
+				mNextWedge[g] = v;
+			}
+		}
+
+		mIndices.resize(indexCount);
+		for(std::size_t i = 0; i < indexCount; ++i)
+			mIndices[i] = (std::uint32_t)indices[i];
+
+		mCollapseTo.resize(vertexCount);
+		mLocked.resize(vertexCount);
+
+		BuildAdjacency();
+		FindFeatures();
+		InitQuadrics();
+	}
+
+	void Simplifier::BuildAdjacency()
+	{
+		const std::uint32_t triCount = (std::uint32_t)(mIndices.size() / 3);
+
+		mAdjOffset.assign(mVertexCount + 1, 0);
+		for(std::uint32_t v : mIndices)
+			++mAdjOffset[v + 1];
+		for(std::uint32_t v = 0; v < mVertexCount; ++v)
+			mAdjOffset[v + 1] += mAdjOffset[v];
+
+		mAdjacency.resize(mIndices.size());
+		std::vector<std::uint32_t> fill(mAdjOffset.begin(), mAdjOffset.end() - 1);
+		for(std::uint32_t t = 0; t < triCount; ++t)
+		{
+			for(int k = 0; k < 3; ++k)
+				mAdjacency[fill[mIndices[3*t + k]]++] = t;
+		}
+	}
+
+	void Simplifier::FindFeatures()
+	{
+		// An edge is a seam or border edge if no triangle uses it in the opposite
+		// direction with the same vertices.
+		std::unordered_set<std::uint64_t> edges;
+		edges.reserve(mIndices.size());
+		for(std::size_t i = 0; i < mIndices.size(); i += 3)
+		{
+			for(int k = 0; k < 3; ++k)
+				edges.insert(EdgeKey(mIndices[i + k], mIndices[i + (k + 1) % 3]));
+		}
+
+		mFeatureCount.assign(mVertexCount, 0);
+		mFeature0.assign(mVertexCount, 0);
+		mFeature1.assign(mVertexCount, 0);
+
+		auto addFeature = [this](std::uint32_t g, std::uint32_t h)
+		{
+			std::uint8_t& count = mFeatureCount[g];
+			if(count == Locked)
+				return;
+			if(count >= 1 && mFeature0[g] == h)
+				return;
+			if(count >= 2 && mFeature1[g] == h)
+				return;
+
+			if(count == 0)
+				mFeature0[g] = h;
+			else if(count == 1)
+				mFeature1[g] = h;
+
+			count = count < 2 ? count + 1 : Locked;
+		};
+
+		for(std::size_t i = 0; i < mIndices.size(); i += 3)
+		{
+			for(int k = 0; k < 3; ++k)
+			{
+				std::uint32_t a = mIndices[i + k];
+				std::uint32_t b = mIndices[i + (k + 1) % 3];
+				if(edges.count(EdgeKey(b, a)) == 0)
+				{
+					addFeature(mGroup[a], mGroup[b]);
+					addFeature(mGroup[b], mGroup[a]);
+				}
+			}
+		}
+
+		// A feature vertex needs exactly two feature neighbours to slide between.
+		for(std::uint32_t g = 0; g < mVertexCount; ++g)
+		{
+			if(mFeatureCount[g] == 1)
+				mFeatureCount[g] = Locked;
+		}
+	}
+
+	void Simplifier::InitQuadrics()
+	{
+		mQuadrics.assign(mVertexCount, Quadric());
+
+		std::unordered_set<std::uint64_t> edges;
+		edges.reserve(mIndices.size());
+		for(std::size_t i = 0; i < mIndices.size(); i += 3)
+		{
+			for(int k = 0; k < 3; ++k)
+				edges.insert(EdgeKey(mIndices[i + k], mIndices[i + (k + 1) % 3]));
+		}
+
+		for(std::size_t i = 0; i < mIndices.size(); i += 3)
+		{
+			XMVECTOR p[3];
+			for(int k = 0; k < 3; ++k)
+				p[k] = Position(mIndices[i + k]);
+
+			XMVECTOR n = XMVector3Cross(p[1] - p[0], p[2] - p[0]);
+			float twiceArea = XMVectorGetX(XMVector3Length(n));
+			if(twiceArea <= 0.0f)
+				continue;
+
+			n /= twiceArea;
+			XMFLOAT3 fn;
+			XMStoreFloat3(&fn, n);
+			double d = -XMVectorGetX(XMVector3Dot(n, p[0]));
+
+			Quadric face;
+			face.AddPlane(fn.x, fn.y, fn.z, d, 0.5*twiceArea);
+
+			for(int k = 0; k < 3; ++k)
+			{
+				std::uint32_t a = mIndices[i + k];
+				std::uint32_t b = mIndices[i + (k + 1) % 3];
+				mQuadrics[mGroup[a]].Add(face);
+
+				// Seam and border edges get a plane through the edge, perpendicular to
+				// the face, that keeps their vertices on the feature line.
+				if(edges.count(EdgeKey(b, a)) == 0)
+				{
+					XMVECTOR e = p[(k + 1) % 3] - p[k];
+					float length = XMVectorGetX(XMVector3Length(e));
+					if(length <= 0.0f)
+						continue;
+
+					XMVECTOR en = XMVector3Normalize(XMVector3Cross(e, n));
+					XMFLOAT3 fen;
+					XMStoreFloat3(&fen, en);
+					double ed = -XMVectorGetX(XMVector3Dot(en, p[k]));
+
+					Quadric edge;
+					edge.AddPlane(fen.x, fen.y, fen.z, ed, FeatureWeight*length*length);
+					mQuadrics[mGroup[a]].Add(edge);
+					mQuadrics[mGroup[b]].Add(edge);
+				}
+			}
+		}
+	}
+
+	bool Simplifier::CanCollapse(std::uint32_t g, std::uint32_t h)
+	{
+		// Seam and border vertices only move along their feature.
+		std::uint8_t features = mFeatureCount[g];
+		if(features == Locked)
+			return false;
+		if(features == 2 && mFeature0[g] != h && mFeature1[g] != h)
+			return false;
+
+		// Every wedge of g must go to one wedge of h, the one it shares triangles with.
+		mWedgeMap.clear();
+		std::uint32_t p = g;
+		do
+		{
+			std::uint32_t target = ~0u;
+			bool used = mAdjOffset[p + 1] > mAdjOffset[p];
+			for(std::uint32_t a = mAdjOffset[p]; a < mAdjOffset[p + 1]; ++a)
+			{
+				const std::uint32_t* tri = &mIndices[3*mAdjacency[a]];
+				for(int k = 0; k < 3; ++k)
+				{
+					if(mGroup[tri[k]] != h)
+						continue;
+					if(target != ~0u && target != tri[k])
+						return false;
+					target = tri[k];
+				}
+			}
+
+			if(used)
+			{
+				if(target == ~0u)
+					return false;
+				mWedgeMap.push_back(std::make_pair(p, target));
+			}
+
+			p = mNextWedge[p];
+		}
+		while(p != g);
+
+		// Link condition: the groups next to both g and h must be exactly those
+		// opposite the edge, otherwise the collapse pinches the surface.
+		auto collectNeighbours = [this](std::uint32_t group, std::vector<std::uint32_t>& out)
+		{
+			out.clear();
+			std::uint32_t w = group;
+			do
+			{
+				for(std::uint32_t a = mAdjOffset[w]; a < mAdjOffset[w + 1]; ++a)
+				{
+					const std::uint32_t* tri = &mIndices[3*mAdjacency[a]];
+					for(int k = 0; k < 3; ++k)
+					{
+						if(mGroup[tri[k]] != group)
+							out.push_back(mGroup[tri[k]]);
+					}
+				}
+				w = mNextWedge[w];
+			}
+			while(w != group);
+
+			std::sort(out.begin(), out.end());
+			out.erase(std::unique(out.begin(), out.end()), out.end());
+		};
+
+		static thread_local std::vector<std::uint32_t> gNeighbours, hNeighbours, opposite;
+		collectNeighbours(g, gNeighbours);
+		collectNeighbours(h, hNeighbours);
+
+		opposite.clear();
+		p = g;
+		do
+		{
+			for(std::uint32_t a = mAdjOffset[p]; a < mAdjOffset[p + 1]; ++a)
+			{
+				const std::uint32_t* tri = &mIndices[3*mAdjacency[a]];
+				bool hasH = mGroup[tri[0]] == h || mGroup[tri[1]] == h || mGroup[tri[2]] == h;
+				if(!hasH)
+					continue;
+
+				for(int k = 0; k < 3; ++k)
+				{
+					std::uint32_t o = mGroup[tri[k]];
+					if(o != g && o != h)
+						opposite.push_back(o);
+				}
+			}
+			p = mNextWedge[p];
+		}
+		while(p != g);
+
+		std::sort(opposite.begin(), opposite.end());
+		opposite.erase(std::unique(opposite.begin(), opposite.end()), opposite.end());
+
+		std::size_t common = 0;
+		for(std::size_t i = 0, j = 0; i < gNeighbours.size() && j < hNeighbours.size(); )
+		{
+			if(gNeighbours[i] < hNeighbours[j])
+				++i;
+			else if(gNeighbours[i] > hNeighbours[j])
+				++j;
+			else
+			{
+				++common; ++i; ++j;
+			}
+		}
+
+		if(common != opposite.size())
+			return false;
+
+		// Reject collapses that flip or fold a remaining triangle.
+		XMVECTOR target = Position(h);
+		p = g;
+		do
+		{
+			for(std::uint32_t a = mAdjOffset[p]; a < mAdjOffset[p + 1]; ++a)
+			{
+				const std::uint32_t* tri = &mIndices[3*mAdjacency[a]];
+				if(mGroup[tri[0]] == h || mGroup[tri[1]] == h || mGroup[tri[2]] == h)
+					continue;
+
+				XMVECTOR v[3];
+				XMVECTOR w[3];
+				for(int k = 0; k < 3; ++k)
+				{
+					v[k] = Position(tri[k]);
+					w[k] = tri[k] == p ? target : v[k];
+				}
+
+				XMVECTOR n0 = XMVector3Cross(v[1] - v[0], v[2] - v[0]);
+				XMVECTOR n1 = XMVector3Cross(w[1] - w[0], w[2] - w[0]);
+				float dot = XMVectorGetX(XMVector3Dot(n0, n1));
+				float lengths = XMVectorGetX(XMVector3Length(n0))*XMVectorGetX(XMVector3Length(n1));
+				if(dot <= FlipCosine*lengths)
+					return false;
+			}
+			p = mNextWedge[p];
+		}
+		while(p != g);
+
+		return true;
+	}
+
+	void Simplifier::ApplyCollapse(std::uint32_t g, std::uint32_t h)
+	{
+		for(const auto& m : mWedgeMap)
+			mCollapseTo[m.first] = m.second;
+
+		mQuadrics[h].Add(mQuadrics[g]);
+
+		// Lock everything the collapse touches; the costs and checks of collapses
+		// around it are out of date until the next pass.
+		std::uint32_t p = g;
+		do
+		{
+			for(std::uint32_t a = mAdjOffset[p]; a < mAdjOffset[p + 1]; ++a)
+			{
+				const std::uint32_t* tri = &mIndices[3*mAdjacency[a]];
+				for(int k = 0; k < 3; ++k)
+					mLocked[mGroup[tri[k]]] = true;
+			}
+			p = mNextWedge[p];
+		}
+		while(p != g);
+	}
+
+	bool Simplifier::Run(std::size_t targetIndexCount, float maxError)
+	{
+		const double maxSquaredError = (double)maxError*maxError;
+
+		bool progress = false;
+		while(mIndices.size() > targetIndexCount)
+		{
+			// Candidate collapses along every edge, in both directions.
+			std::vector<Collapse> candidates;
+			candidates.reserve(mIndices.size()*2);
+			for(std::size_t i = 0; i < mIndices.size(); i += 3)
+			{
+				for(int k = 0; k < 3; ++k)
+				{
+					std::uint32_t g = mGroup[mIndices[i + k]];
+					std::uint32_t h = mGroup[mIndices[i + (k + 1) % 3]];
+					if(g == h)
+						continue;
+
+					for(int dir = 0; dir < 2; ++dir)
+					{
+						std::uint32_t from = dir == 0 ? g : h;
+						std::uint32_t to = dir == 0 ? h : g;
+						if(mFeatureCount[from] == Locked)
+							continue;
+
+						Quadric q = mQuadrics[from];
+						q.Add(mQuadrics[to]);
+
+						Collapse c;
+						c.From = from;
+						c.To = to;
+						c.Cost = q.W > 0.0 ? q.Evaluate(mPositions[to]) / q.W : 0.0;
+						candidates.push_back(c);
+					}
+				}
+			}
+
+			std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b)
+			{
+				return a.Cost < b.Cost;
+			});
+
+			std::fill(mLocked.begin(), mLocked.end(), false);
+			for(std::uint32_t v = 0; v < mVertexCount; ++v)
+				mCollapseTo[v] = v;
+
+			// Each interior collapse removes two triangles, a border collapse one.
+			std::size_t removable = (mIndices.size() - targetIndexCount) / 3;
+			std::size_t removed = 0;
+			std::size_t collapses = 0;
+			double passError = mMaxError;
+
+			// Locking lets only some of the candidates through each pass.  Without a
+			// per-pass limit the later ones would be far from the cheapest, so stop at
+			// about the cost of the cheapest collapses that are actually needed.  Each
+			// edge is in the list about four times (two faces, two directions).
+			double passLimit = candidates.empty() ? 0.0 :
+				candidates[std::min(candidates.size() - 1, removable*4)].Cost;
+
+			for(const Collapse& c : candidates)
+			{
+				if(removed >= removable || c.Cost > maxSquaredError)
+					break;
+				if(collapses > 0 && c.Cost > passLimit)
+					break;
+				if(mLocked[c.From] || mLocked[c.To])
+					continue;
+				if(!CanCollapse(c.From, c.To))
+					continue;
+
+				ApplyCollapse(c.From, c.To);
+				passError = std::max(passError, c.Cost);
+				removed += mFeatureCount[c.From] == 0 ? 2 : 1;
+				++collapses;
+			}
+
+			if(collapses == 0)
+				break;
+
+			progress = true;
+			mMaxError = passError;
+
+			// Remap the indices and drop the triangles that collapsed.
+			std::size_t out = 0;
+			for(std::size_t i = 0; i < mIndices.size(); i += 3)
+			{
+				std::uint32_t a = mCollapseTo[mIndices[i + 0]];
+				std::uint32_t b = mCollapseTo[mIndices[i + 1]];
+				std::uint32_t c = mCollapseTo[mIndices[i + 2]];
+				if(mGroup[a] == mGroup[b] || mGroup[b] == mGroup[c] || mGroup[a] == mGroup[c])
+					continue;
+
+				mIndices[out++] = a;
+				mIndices[out++] = b;
+				mIndices[out++] = c;
+			}
+			mIndices.resize(out);
+
+			BuildAdjacency();
+			FindFeatures();
+		}
+
+		return progress;
+	}
+}
+
+template<typename Index>
+MeshSimplifier::Lod MeshSimplifier::Simplify(const void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+	std::size_t positionOffset, const Index* indices, std::size_t indexCount,
+	std::size_t targetIndexCount, float maxError)
+{
+	Simplifier simplifier(vertices, vertexStride, vertexCount, positionOffset, indices, indexCount);
+	simplifier.Run(targetIndexCount, maxError);
+
+	Lod lod;
+	lod.Indices = simplifier.Indices();
+	lod.Error = simplifier.Error();
+	return lod;
+}
+
+template<typename Index>
+std::vector<MeshSimplifier::Lod> MeshSimplifier::BuildLodChain(const void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+	std::size_t positionOffset, const Index* indices, std::size_t indexCount,
+	int lodCount, float reduction)
+{
+	std::vector<Lod> lods;
+	if(lodCount <= 0)
+		return lods;
+
+	// Each level continues from the one before, so the error keeps accumulating
+	// against the input.
+	Simplifier simplifier(vertices, vertexStride, vertexCount, positionOffset, indices, indexCount);
+
+	Lod full;
+	full.Indices = simplifier.Indices();
+	lods.push_back(std::move(full));
+
+	for(int level = 1; level < lodCount; ++level)
+	{
+		std::size_t target = (std::size_t)(lods.back().Indices.size() / 3 * reduction) * 3;
+		if(!simplifier.Run(target, FLT_MAX))
+			break;
+
+		Lod lod;
+		lod.Indices = simplifier.Indices();
+		lod.Error = simplifier.Error();
+		lods.push_back(std::move(lod));
+	}
+
+	return lods;
+}
+
+int MeshSimplifier::SelectLod(const float* lodErrors, int lodCount, float errorToPixels, float maxPixelError)
+{
+	int lod = 0;
+	while(lod + 1 < lodCount && lodErrors[lod + 1]*errorToPixels <= maxPixelError)
+		++lod;
+
+	return lod;
+}
+
+#define INSTANTIATE_MESH_SIMPLIFIER(Index) \
+	template MeshSimplifier::Lod MeshSimplifier::Simplify<Index>(const void*, std::size_t, std::uint32_t, std::size_t, const Index*, std::size_t, std::size_t, float); \
+	template std::vector<MeshSimplifier::Lod> MeshSimplifier::BuildLodChain<Index>(const void*, std::size_t, std::uint32_t, std::size_t, const Index*, std::size_t, int, float);
+
+INSTANTIATE_MESH_SIMPLIFIER(std::uint16_t)
+INSTANTIATE_MESH_SIMPLIFIER(std::uint32_t)
+INSTANTIATE_MESH_SIMPLIFIER(std::int32_t)
@@ -0,0 +1,58 @@
+//***************************************************************************************
+// MeshSimplifier.h
+//
+// Reduces the triangle count of an indexed mesh by collapsing edges in order of
+// quadric error (Garland and Heckbert, "Surface Simplification Using Quadric Error
+// Metrics").  Collapses are half-edge collapses, i.e. a vertex moves onto one of
+// its neighbours, so every level of detail indexes the original vertex buffer and
+// only needs its own index list.
+//
+// Vertices that share a position but not their other attributes (UV and normal
+// seams) are moved together, and vertices on a seam or an open border only slide
+// along it, so seams and borders keep their shape.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class MeshSimplifier
+{
+public:
+	struct Lod
+	{
+		std::vector<std::uint32_t> Indices;
+
+		// Estimated distance, in model units, between this level and the input.
+		float Error = 0.0f;
+	};
+
+	///<summary>
+	/// Simplifies a triangle list down to about targetIndexCount indices, or until
+	/// the next collapse would exceed maxError.  Vertices are opaque apart from the
+	/// XMFLOAT3 position at positionOffset.
+	///</summary>
+	template<typename Index>
+	static Lod Simplify(const void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+		std::size_t positionOffset, const Index* indices, std::size_t indexCount,
+		std::size_t targetIndexCount, float maxError);
+
+	///<summary>
+	/// Builds up to lodCount levels of detail.  Level 0 is the input, and each
+	/// level after it has about reduction times the triangles of the one before.
+	/// The chain ends early if the mesh cannot be simplified further.
+	///</summary>
+	template<typename Index>
+	static std::vector<Lod> BuildLodChain(const void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+		std::size_t positionOffset, const Index* indices, std::size_t indexCount,
+		int lodCount, float reduction = 0.5f);
+
+	///<summary>
+	/// Picks the coarsest level whose error, projected to the screen, is at most
+	/// maxPixelError pixels.  errorToPixels converts model units to pixels at the
+	/// instance, e.g. scale * viewportHeight / (2 * tan(fovY/2) * distance).
+	///</summary>
+	static int SelectLod(const float* lodErrors, int lodCount, float errorToPixels, float maxPixelError = 1.0f);
+};
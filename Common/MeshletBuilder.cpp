@@ -0,0 +1,274 @@
+//***************************************************************************************
+// MeshletBuilder.cpp
+//***************************************************************************************
+
+#include "MeshletBuilder.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace DirectX;
+
+const std::uint32_t MeshletBuilder::MaxVertices;
+const std::uint32_t MeshletBuilder::MaxTriangles;
+
+namespace
+{
+	// A meshlet whose normals spread further than this from the cone axis (in
+	// cosine) is too wide to be culled by its cone.
+	const float MinCullableConeDot = 0.1f;
+
+	const std::uint8_t NotInMeshlet = 0xff;
+
+	XMFLOAT3 LoadPosition(const void* vertices, std::size_t vertexStride, std::size_t positionOffset, std::uint32_t v)
+	{
+		return *reinterpret_cast<const XMFLOAT3*>(
+			static_cast<const std::uint8_t*>(vertices) + v*vertexStride + positionOffset);
+	}
+
+	MeshletBuilder::Bounds ComputeBounds(const std::vector<XMFLOAT3>& positions,
+		const std::uint8_t* triangles, std::uint32_t triangleCount)
+	{
+		MeshletBuilder::Bounds bounds;
+		BoundingSphere::CreateFromPoints(bounds.Sphere, positions.size(), positions.data(), sizeof(XMFLOAT3));
+
+		// The cone axis is the average of the face normals.
+		std::vector<XMFLOAT3> normals(triangleCount);
+		XMVECTOR axis = XMVectorZero();
+		for(std::uint32_t t = 0; t < triangleCount; ++t)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&positions[triangles[3*t + 0]]);
+			XMVECTOR p1 = XMLoadFloat3(&positions[triangles[3*t + 1]]);
+			XMVECTOR p2 = XMLoadFloat3(&positions[triangles[3*t + 2]]);
+
+			// Degenerate triangles get a zero normal and do not count.
+			XMVECTOR n = XMVector3Normalize(XMVector3Cross(p1 - p0, p2 - p0));
+			XMStoreFloat3(&normals[t], n);
+			axis += n;
+		}
+
+		float axisLength = XMVectorGetX(XMVector3Length(axis));
+		if(axisLength <= 0.0f)
+			return bounds;
+		axis /= axisLength;
+
+		float minDot = 1.0f;
+		for(std::uint32_t t = 0; t < triangleCount; ++t)
+		{
+			XMVECTOR n = XMLoadFloat3(&normals[t]);
+			if(XMVectorGetX(XMVector3LengthSq(n)) > 0.0f)
+				minDot = std::min(minDot, XMVectorGetX(XMVector3Dot(n, axis)));
+		}
+
+		if(minDot <= MinCullableConeDot)
+			return bounds;
+
+		// Move the apex back along the axis from the centre until it is behind
+		// every triangle's plane; the cone from there contains all back-facing
+		// eye positions of every triangle.
+		XMVECTOR center = XMLoadFloat3(&bounds.Sphere.Center);
+		float maxT = 0.0f;
+		for(std::uint32_t t = 0; t < triangleCount; ++t)
+		{
+			XMVECTOR n = XMLoadFloat3(&normals[t]);
+			float dn = XMVectorGetX(XMVector3Dot(n, axis));
+			if(dn <= 0.0f)
+				continue;
+
+			XMVECTOR p0 = XMLoadFloat3(&positions[triangles[3*t + 0]]);
+			float dc = XMVectorGetX(XMVector3Dot(center - p0, n));
+			maxT = std::max(maxT, dc / dn);
+		}
+
+		XMStoreFloat3(&bounds.ConeApex, center - axis*maxT);
+		XMStoreFloat3(&bounds.ConeAxis, axis);
+		bounds.ConeCutoff = sqrtf(1.0f - minDot*minDot);
+
+		return bounds;
+	}
+}
+
+template<typename Index>
+MeshletBuilder::MeshletData MeshletBuilder::Build(const void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+	std::size_t positionOffset, const Index* indices, std::size_t indexCount,
+	std::uint32_t maxVertices, std::uint32_t maxTriangles, float coneLimit)
+{
+	assert(maxVertices >= 3 && maxVertices < NotInMeshlet);
+	assert(maxTriangles >= 1);
+
+	const std::uint32_t triCount = (std::uint32_t)(indexCount / 3);
+
+	MeshletData data;
+	if(triCount == 0)
+		return data;
+
+	// Vertex-to-triangle adjacency.
+	std::vector<std::uint32_t> adjOffset(vertexCount + 1, 0);
+	for(std::size_t i = 0; i < 3*(std::size_t)triCount; ++i)
+		++adjOffset[(std::uint32_t)indices[i] + 1];
+	for(std::uint32_t v = 0; v < vertexCount; ++v)
+		adjOffset[v + 1] += adjOffset[v];
+
+	std::vector<std::uint32_t> adjacency(3*(std::size_t)triCount);
+	{
+		std::vector<std::uint32_t> fill(adjOffset.begin(), adjOffset.end() - 1);
+		for(std::uint32_t t = 0; t < triCount; ++t)
+		{
+			for(int k = 0; k < 3; ++k)
+				adjacency[fill[(std::uint32_t)indices[3*t + k]]++] = t;
+		}
+	}
+
+	std::vector<XMFLOAT3> triNormals(triCount);
+	for(std::uint32_t t = 0; t < triCount; ++t)
+	{
+		XMFLOAT3 p0 = LoadPosition(vertices, vertexStride, positionOffset, (std::uint32_t)indices[3*t + 0]);
+		XMFLOAT3 p1 = LoadPosition(vertices, vertexStride, positionOffset, (std::uint32_t)indices[3*t + 1]);
+		XMFLOAT3 p2 = LoadPosition(vertices, vertexStride, positionOffset, (std::uint32_t)indices[3*t + 2]);
+
+		XMVECTOR a = XMLoadFloat3(&p0);
+		XMVECTOR n = XMVector3Normalize(XMVector3Cross(XMLoadFloat3(&p1) - a, XMLoadFloat3(&p2) - a));
+		XMStoreFloat3(&triNormals[t], n);
+	}
+
+	std::vector<bool> emitted(triCount, false);
+
+	// Local index of each vertex in the meshlet being built.
+	std::vector<std::uint8_t> localIndex(vertexCount, NotInMeshlet);
+
+	std::vector<XMFLOAT3> meshletPositions;
+	meshletPositions.reserve(maxVertices);
+
+	Meshlet meshlet;
+	XMVECTOR normalSum = XMVectorZero();
+
+	auto addTriangle = [&](std::uint32_t t)
+	{
+		for(int k = 0; k < 3; ++k)
+		{
+			std::uint32_t v = (std::uint32_t)indices[3*t + k];
+			if(localIndex[v] == NotInMeshlet)
+			{
+				localIndex[v] = (std::uint8_t)meshlet.VertexCount++;
+				data.Vertices.push_back(v);
+			}
+			data.Triangles.push_back(localIndex[v]);
+		}
+
+		++meshlet.TriangleCount;
+		normalSum += XMLoadFloat3(&triNormals[t]);
+		emitted[t] = true;
+	};
+
+	auto finishMeshlet = [&]()
+	{
+		meshletPositions.clear();
+		for(std::uint32_t i = 0; i < meshlet.VertexCount; ++i)
+		{
+			std::uint32_t v = data.Vertices[meshlet.VertexOffset + i];
+			meshletPositions.push_back(LoadPosition(vertices, vertexStride, positionOffset, v));
+			localIndex[v] = NotInMeshlet;
+		}
+
+		data.Meshlets.push_back(meshlet);
+		data.MeshletBounds.push_back(ComputeBounds(meshletPositions,
+			&data.Triangles[3*meshlet.TriangleOffset], meshlet.TriangleCount));
+
+		meshlet.VertexOffset = (std::uint32_t)data.Vertices.size();
+		meshlet.VertexCount = 0;
+		meshlet.TriangleOffset = (std::uint32_t)(data.Triangles.size() / 3);
+		meshlet.TriangleCount = 0;
+		normalSum = XMVectorZero();
+	};
+
+	// Seeds are taken in index order, which after MeshOptimizer is already local.
+	std::uint32_t seed = 0;
+	for(;;)
+	{
+		while(seed < triCount && emitted[seed])
+			++seed;
+		if(seed == triCount)
+			break;
+
+		addTriangle(seed);
+
+		while(meshlet.TriangleCount < maxTriangles)
+		{
+			XMVECTOR axis = XMVector3Normalize(normalSum);
+
+			// Best unemitted triangle sharing a vertex with the meshlet: fewest new
+			// vertices, then most closely aligned with the meshlet's normal.
+			std::uint32_t best = ~0u;
+			std::uint32_t bestNew = 3;
+			float bestDot = -2.0f;
+
+			for(std::uint32_t i = 0; i < meshlet.VertexCount; ++i)
+			{
+				std::uint32_t v = data.Vertices[meshlet.VertexOffset + i];
+				for(std::uint32_t a = adjOffset[v]; a < adjOffset[v + 1]; ++a)
+				{
+					std::uint32_t t = adjacency[a];
+					if(emitted[t])
+						continue;
+
+					std::uint32_t newVertices =
+						(localIndex[(std::uint32_t)indices[3*t + 0]] == NotInMeshlet) +
+						(localIndex[(std::uint32_t)indices[3*t + 1]] == NotInMeshlet) +
+						(localIndex[(std::uint32_t)indices[3*t + 2]] == NotInMeshlet);
+					if(meshlet.VertexCount + newVertices > maxVertices)
+						continue;
+
+					float dot = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&triNormals[t]), axis));
+					if(dot < coneLimit)
+						continue;
+
+					if(newVertices < bestNew || (newVertices == bestNew && dot > bestDot))
+					{
+						best = t;
+						bestNew = newVertices;
+						bestDot = dot;
+					}
+				}
+			}
+
+			if(best == ~0u)
+				break;
+
+			addTriangle(best);
+		}
+
+		finishMeshlet();
+	}
+
+	return data;
+}
+
+template<typename Index>
+void MeshletBuilder::WriteIndices(const MeshletData& data, Index* indices)
+{
+	for(const Meshlet& m : data.Meshlets)
+	{
+		const std::uint32_t* meshletVertices = &data.Vertices[m.VertexOffset];
+		const std::uint8_t* triangles = &data.Triangles[3*m.TriangleOffset];
+
+		for(std::uint32_t i = 0; i < 3*m.TriangleCount; ++i)
+			indices[3*m.TriangleOffset + i] = (Index)meshletVertices[triangles[i]];
+	}
+}
+
+bool MeshletBuilder::IsBackFacing(const Bounds& bounds, const XMFLOAT3& eyePos)
+{
+	if(bounds.ConeCutoff >= 1.0f)
+		return false;
+
+	XMVECTOR toApex = XMVector3Normalize(XMLoadFloat3(&bounds.ConeApex) - XMLoadFloat3(&eyePos));
+	return XMVectorGetX(XMVector3Dot(toApex, XMLoadFloat3(&bounds.ConeAxis))) >= bounds.ConeCutoff;
+}
+
+#define INSTANTIATE_MESHLET_BUILDER(Index) \
+	template MeshletBuilder::MeshletData MeshletBuilder::Build<Index>(const void*, std::size_t, std::uint32_t, std::size_t, const Index*, std::size_t, std::uint32_t, std::uint32_t, float); \
+	template void MeshletBuilder::WriteIndices<Index>(const MeshletData&, Index*);
+
+INSTANTIATE_MESHLET_BUILDER(std::uint16_t)
+INSTANTIATE_MESHLET_BUILDER(std::uint32_t)
+INSTANTIATE_MESHLET_BUILDER(std::int32_t)
@@ -0,0 +1,94 @@
+//***************************************************************************************
+// MeshletBuilder.h
+//
+// Splits an indexed triangle list into meshlets: small clusters of at most 64
+// vertices and 124 triangles, the limits mesh shaders are usually tuned for.  Each
+// meshlet gets a bounding sphere for frustum culling and a normal cone for
+// back-face culling of the whole cluster, so most of a closed mesh can be rejected
+// on the CPU before anything is drawn.
+//
+// Triangles are grown into a meshlet by adjacency, preferring those that add the
+// fewest new vertices and then those that face the same way as the meshlet so far,
+// which keeps the cones narrow.
+//
+// Build is instantiated for 16-bit, 32-bit and signed 32-bit indices.  Vertices
+// are opaque: only their stride and the byte offset of an XMFLOAT3 position are
+// needed.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXCollision.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class MeshletBuilder
+{
+public:
+	static const std::uint32_t MaxVertices = 64;
+	static const std::uint32_t MaxTriangles = 124;
+
+	struct Meshlet
+	{
+		// Range in MeshletData::Vertices.
+		std::uint32_t VertexOffset = 0;
+		std::uint32_t VertexCount = 0;
+
+		// Range of triangles in MeshletData::Triangles; triangle t has the local
+		// indices Triangles[3*t + 0..2].
+		std::uint32_t TriangleOffset = 0;
+		std::uint32_t TriangleCount = 0;
+	};
+
+	struct Bounds
+	{
+		DirectX::BoundingSphere Sphere;
+
+		// The meshlet faces away from every eye position p for which
+		// dot(normalize(ConeApex - p), ConeAxis) >= ConeCutoff.  A cutoff of 1 means
+		// the normals are too spread out for the meshlet to be culled this way.
+		DirectX::XMFLOAT3 ConeApex = { 0.0f, 0.0f, 0.0f };
+		DirectX::XMFLOAT3 ConeAxis = { 0.0f, 0.0f, 1.0f };
+		float ConeCutoff = 1.0f;
+	};
+
+	struct MeshletData
+	{
+		std::vector<Meshlet> Meshlets;
+		std::vector<Bounds> MeshletBounds;
+
+		// Per meshlet, the vertices it uses, as indices into the vertex buffer.
+		std::vector<std::uint32_t> Vertices;
+
+		// Per triangle, three indices into the vertices of its meshlet.
+		std::vector<std::uint8_t> Triangles;
+	};
+
+	///<summary>
+	/// Splits a triangle list into meshlets.  maxVertices can be at most 255.
+	/// A triangle whose normal is further from a meshlet's average normal than
+	/// coneLimit (a cosine) is left for another meshlet; raising it above -1 gives
+	/// narrower cones, so more back-face culling, at the cost of smaller meshlets.
+	///</summary>
+	template<typename Index>
+	static MeshletData Build(const void* vertices, std::size_t vertexStride, std::uint32_t vertexCount,
+		std::size_t positionOffset, const Index* indices, std::size_t indexCount,
+		std::uint32_t maxVertices = MaxVertices, std::uint32_t maxTriangles = MaxTriangles,
+		float coneLimit = -1.0f);
+
+	///<summary>
+	/// Writes the meshlets back out as an ordinary triangle list, meshlet after
+	/// meshlet, so meshlet m can be drawn without mesh shaders as the
+	/// 3*TriangleCount indices starting at 3*TriangleOffset.  indices must have room
+	/// for Triangles.size() indices.
+	///</summary>
+	template<typename Index>
+	static void WriteIndices(const MeshletData& data, Index* indices);
+
+	///<summary>
+	/// Returns true if the whole meshlet faces away from eyePos, given in the space
+	/// of the mesh.
+	///</summary>
+	static bool IsBackFacing(const Bounds& bounds, const DirectX::XMFLOAT3& eyePos);
+};
@@ -0,0 +1,120 @@
+//***************************************************************************************
+// ParallelTextReader.h
+//
+// Reads a long run of same-shaped records, such as the vertex and triangle lists of
+// the book's text models, on several workers at once.
+//
+// Parsing a record needs the one before it to have been parsed, to know where it
+// starts, so the run is split by lines instead.  The first record is parsed to find
+// how many lines a record takes, a quick pre-scan over the newlines (memchr, no
+// parsing) finds where each chunk of records starts, and the chunks are parsed in
+// parallel, each with its own TextScanner.  Every chunk but the last must end
+// exactly where the next one starts, so a file whose records do not keep to the
+// line count of the first is caught rather than misread.
+//
+// ReadRecords returns false, having moved nothing, whenever the split does not
+// work out: the run is short, the lines do not line up or a record is malformed.
+// The caller then reads the records one after another from the same place, which
+// gives exactly the same values and, for a malformed file, the same error on the
+// same line as before.
+//***************************************************************************************
+
+#pragma once
+
+#include "TaskSystem.h"
+#include "TextScanner.h"
+#include <vector>
+
+class ParallelTextReader
+{
+public:
+	// Runs shorter than this are read serially, as splitting them gains nothing.
+	static const std::uint32_t MinChunkRecords = 1024;
+
+	///<summary>
+	/// Reads count records starting at in, calling readRecord(scanner, i) for each,
+	/// and leaves in after the last.  readRecord is called from several threads at
+	/// once and must only write to record i; it may be called more than once for the
+	/// same record.  Returns false, with in as it was, if the records must be read
+	/// serially instead.
+	///</summary>
+	template<typename F>
+	static bool ReadRecords(TextScanner& in, std::uint32_t count, const F& readRecord,
+		TaskSystem& taskSystem = TaskSystem::Default());
+};
+
+template<typename F>
+bool ParallelTextReader::ReadRecords(TextScanner& in, std::uint32_t count, const F& readRecord,
+	TaskSystem& taskSystem)
+{
+	if(in.Failed() || count < 2*MinChunkRecords)
+		return false;
+
+	// The lines the first record takes, up to where the second starts.
+	TextScanner first = in;
+	first.SkipSpace();
+
+	TextScanner probe = first;
+	readRecord(probe, 0);
+	probe.SkipSpace();
+
+	const std::uint32_t linesPerRecord = probe.PositionLine() - first.PositionLine();
+	if(probe.Failed() || linesPerRecord == 0)
+		return false;
+
+	// A few chunks a worker, so that a slow one does not hold up the rest.
+	const std::uint32_t chunkCount = 4*(taskSystem.WorkerCount() + 1);
+	std::uint32_t chunkRecords = (count + chunkCount - 1) / chunkCount;
+	if(chunkRecords < MinChunkRecords)
+		chunkRecords = MinChunkRecords;
+
+	// The pre-scan: a scanner at the first line of each chunk.
+	std::vector<TextScanner> starts;
+	starts.reserve((count + chunkRecords - 1) / chunkRecords);
+	starts.push_back(first);
+
+	TextScanner walker = first;
+	for(std::uint32_t i = chunkRecords; i < count; i += chunkRecords)
+	{
+		if(!walker.SkipLines((std::uint64_t)chunkRecords * linesPerRecord))
+			return false;
+
+		walker.SkipSpace();
+		starts.push_back(walker);
+	}
+
+	const int chunks = (int)starts.size();
+	std::vector<char> lined(chunks, 0);
+	TextScanner last = starts.back();
+
+	taskSystem.ParallelFor(0, chunks, 1, [&](int chunk)
+	{
+		TextScanner scanner = starts[chunk];
+
+		const std::uint32_t begin = chunk*chunkRecords;
+		const std::uint32_t end = chunk + 1 < chunks ? begin + chunkRecords : count;
+		for(std::uint32_t i = begin; i < end && !scanner.Failed(); ++i)
+			readRecord(scanner, i);
+
+		scanner.SkipSpace();
+
+		if(chunk + 1 < chunks)
+		{
+			lined[chunk] = !scanner.Failed() && scanner.Position() == starts[chunk + 1].Position();
+		}
+		else
+		{
+			lined[chunk] = !scanner.Failed();
+			last = scanner;
+		}
+	});
+
+	for(int chunk = 0; chunk < chunks; ++chunk)
+	{
+		if(!lined[chunk])
+			return false;
+	}
+
+	in = last;
+	return true;
+}
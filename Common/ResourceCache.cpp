@@ -0,0 +1,222 @@
+//***************************************************************************************
+// ResourceCache.cpp
+//***************************************************************************************
+
+#include "ResourceCache.h"
+#include <windows.h>
+#include <cwctype>
+#include <vector>
+
+namespace
+{
+	// For error messages; the demos' paths are ASCII.
+	std::string Narrow(const std::wstring& s)
+	{
+		std::string narrow;
+		for(wchar_t c : s)
+			narrow += c < 128 ? (char)c : '?';
+		return narrow;
+	}
+}
+
+ResourceCache::ResourceCache(std::uint64_t byteBudget) :
+	mBudget(byteBudget)
+{
+}
+
+ResourceCache& ResourceCache::Default()
+{
+	static ResourceCache cache;
+	return cache;
+}
+
+std::wstring ResourceCache::NormalizePath(const std::wstring& filename)
+{
+	std::wstring path = filename;
+
+	DWORD length = GetFullPathNameW(filename.c_str(), 0, nullptr, nullptr);
+	if(length != 0)
+	{
+		std::vector<wchar_t> full(length);
+		length = GetFullPathNameW(filename.c_str(), length, full.data(), nullptr);
+		if(length != 0 && length < full.size())
+			path.assign(full.data(), length);
+	}
+
+	for(wchar_t& c : path)
+		c = c == L'/' ? L'\\' : (wchar_t)std::towlower(c);
+
+	return path;
+}
+
+std::shared_ptr<void> ResourceCache::Acquire(const std::wstring& filename, std::type_index kind,
+	const ErasedCreator& create, std::string* error)
+{
+	const PathKey pathKey(kind, NormalizePath(filename));
+
+	MappedFile::Stamp stamp;
+	const bool exists = MappedFile::GetStamp(filename.c_str(), stamp);
+
+	// An unchanged file at a path seen before.
+	if(exists)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		auto path = mPaths.find(pathKey);
+		if(path != mPaths.end() && path->second.Stamp == stamp)
+		{
+			auto entry = mEntries.find(path->second.Content);
+			if(entry != mEntries.end())
+			{
+				++mStats.Hits;
+				return Touch(entry->second);
+			}
+
+			// Evicted since.
+			mPaths.erase(path);
+		}
+	}
+
+	MappedFile file;
+	if(!exists || !file.Open(filename.c_str()))
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		++mStats.Failures;
+
+		if(error != nullptr)
+			*error = Narrow(filename) + ": file not found";
+		return nullptr;
+	}
+
+	const ContentKey contentKey(kind, std::make_pair((std::uint64_t)file.Size(),
+		MappedFile::Hash(file.Data(), file.Size())));
+
+	auto remember = [&]()
+	{
+		auto path = mPaths.find(pathKey);
+		if(path != mPaths.end())
+		{
+			path->second.Stamp = stamp;
+			path->second.Content = contentKey;
+		}
+		else
+		{
+			mPaths.emplace(pathKey, PathRecord{ stamp, contentKey });
+		}
+	};
+
+	// The same contents under another path or stamp.
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		auto entry = mEntries.find(contentKey);
+		if(entry != mEntries.end())
+		{
+			remember();
+			++mStats.Hits;
+			++mStats.SharedHits;
+			return Touch(entry->second);
+		}
+	}
+
+	std::uint64_t bytes = 0;
+	std::string createError;
+	std::shared_ptr<void> resource = create(file, bytes, createError);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	if(resource == nullptr)
+	{
+		++mStats.Failures;
+
+		if(error != nullptr)
+			*error = createError;
+		return nullptr;
+	}
+
+	remember();
+
+	// Another thread made it while this one was.
+	auto entry = mEntries.find(contentKey);
+	if(entry != mEntries.end())
+	{
+		++mStats.Hits;
+		++mStats.SharedHits;
+		return Touch(entry->second);
+	}
+
+	mLru.push_front(contentKey);
+
+	Entry& added = mEntries.emplace(contentKey, Entry()).first->second;
+	added.Resource = resource;
+	added.Bytes = bytes;
+	added.Lru = mLru.begin();
+
+	++mStats.Misses;
+	++mStats.Resources;
+	mStats.Bytes += bytes;
+
+	// The new resource is referenced by the caller, so it is not evicted itself.
+	Evict(mBudget);
+
+	return resource;
+}
+
+std::shared_ptr<void> ResourceCache::Touch(Entry& entry)
+{
+	mLru.splice(mLru.begin(), mLru, entry.Lru);
+	return entry.Resource;
+}
+
+void ResourceCache::Evict(std::uint64_t byteBudget)
+{
+	auto it = mLru.end();
+	while(it != mLru.begin() && (mStats.Bytes > byteBudget || byteBudget == 0))
+	{
+		--it;
+
+		// Only the cache can hand out new references, and it holds the lock, so a
+		// resource with no other owner stays that way.
+		auto entry = mEntries.find(*it);
+		if(entry->second.Resource.use_count() > 1)
+			continue;
+
+		mStats.Bytes -= entry->second.Bytes;
+		--mStats.Resources;
+		++mStats.Evictions;
+
+		mEntries.erase(entry);
+		it = mLru.erase(it);
+	}
+}
+
+void ResourceCache::Trim()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	Evict(mBudget);
+}
+
+void ResourceCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	Evict(0);
+}
+
+void ResourceCache::SetBudget(std::uint64_t byteBudget)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mBudget = byteBudget;
+	Evict(mBudget);
+}
+
+std::uint64_t ResourceCache::Budget()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mBudget;
+}
+
+ResourceCache::Stats ResourceCache::GetStats()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
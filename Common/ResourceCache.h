@@ -0,0 +1,161 @@
+//***************************************************************************************
+// ResourceCache.h
+//
+// Shares meshes, textures and anything else made from a file between the scenes of
+// one process, so a tool or test harness that builds several demos' scenes pays for
+// bricks.dds or skull.txt once.
+//
+// Resources are keyed by what was made from the file and the file's contents: the
+// type of the resource and the size and hash of the file.  A second index maps the
+// normalised path, which is the full path, lower-cased with backslashes, to the
+// contents it last held and the file's stamp.  A lookup whose file's stamp has not
+// changed is answered from the path alone, without touching the file.  Otherwise
+// the file is mapped and hashed, so the same file reached by another path, a copy
+// of it in another chapter's folder, or a file rewritten with the same contents all
+// find the resource already made.  Only a file with new contents is made again.
+//
+// Acquire hands out shared_ptrs, so a resource lives while any scene holds it.  The
+// cache holds one more reference and keeps the resource after the scenes are done
+// with it, until its byte budget is exceeded.  Then the unreferenced resources are
+// evicted, least recently acquired first.  A resource that is still in use is never
+// evicted, so the cache can go over its budget while the scenes hold more than that.
+//
+// A D3D resource must not be released while the GPU may still use it.  Scenes that
+// drop their handles mid-run should do so after a fence has passed, as the demos do
+// in their destructors after FlushCommandQueue.
+//
+// Acquire may be called from several threads.  The resources are made outside the
+// lock, so two threads after the same new file may both make it; one copy is kept
+// and the other is dropped.
+//***************************************************************************************
+
+#pragma once
+
+#include "MappedFile.h"
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <utility>
+
+class ResourceCache
+{
+public:
+	///<summary>
+	/// Makes a resource from the contents of a file.  Sets bytes to what the resource
+	/// costs, such as the size of its GPU buffers, which is charged to the budget.
+	/// Returns null and sets error on failure.
+	///</summary>
+	template<typename T>
+	using Creator = std::function<std::shared_ptr<T>(const MappedFile& file, std::uint64_t& bytes, std::string& error)>;
+
+	struct Stats
+	{
+		// Acquires answered from the cache, and how many of those were found by their
+		// contents because the path or the stamp was new.
+		std::uint64_t Hits = 0;
+		std::uint64_t SharedHits = 0;
+
+		// Acquires that made a resource, and those that failed.
+		std::uint64_t Misses = 0;
+		std::uint64_t Failures = 0;
+
+		std::uint64_t Evictions = 0;
+
+		// What the cache holds now.
+		std::uint32_t Resources = 0;
+		std::uint64_t Bytes = 0;
+	};
+
+	explicit ResourceCache(std::uint64_t byteBudget = UINT64_MAX);
+	ResourceCache(const ResourceCache& rhs) = delete;
+	ResourceCache& operator=(const ResourceCache& rhs) = delete;
+
+	// Process-wide cache shared by the demos' scenes.  Resources made on a device
+	// go in that device's cache instead (see D3DResourceCache).
+	static ResourceCache& Default();
+
+	///<summary>
+	/// Returns the resource of type T made from filename, calling create to make it
+	/// if the cache does not hold one for the file's contents.  Kind tells apart
+	/// resources of one type made differently from the same file, such as meshes
+	/// with different vertex layouts.  Returns null, and sets error if given, if the
+	/// file cannot be read or create fails.
+	///</summary>
+	template<typename T, typename Kind = T>
+	std::shared_ptr<T> Acquire(const std::wstring& filename, const Creator<T>& create, std::string* error = nullptr)
+	{
+		auto resource = Acquire(filename, typeid(Kind), [&create](const MappedFile& file, std::uint64_t& bytes,
+			std::string& error) -> std::shared_ptr<void>
+		{
+			return create(file, bytes, error);
+		}, error);
+
+		return std::static_pointer_cast<T>(resource);
+	}
+
+	///<summary>
+	/// Evicts the unreferenced resources, least recently acquired first, until the
+	/// cache is within its budget.  Acquire does this after each miss; call it after
+	/// dropping a scene's handles to give the memory back at once.
+	///</summary>
+	void Trim();
+
+	// Evicts every unreferenced resource.
+	void Clear();
+
+	void SetBudget(std::uint64_t byteBudget);
+	std::uint64_t Budget()const;
+
+	Stats GetStats()const;
+
+	// The full path of filename, lower-cased and with backslashes.
+	static std::wstring NormalizePath(const std::wstring& filename);
+
+private:
+	// The type a resource was made as, and the size and hash of the file.
+	using ContentKey = std::pair<std::type_index, std::pair<std::uint64_t, std::uint64_t>>;
+	using PathKey = std::pair<std::type_index, std::wstring>;
+
+	struct Entry
+	{
+		std::shared_ptr<void> Resource;
+		std::uint64_t Bytes = 0;
+		std::list<ContentKey>::iterator Lru;
+	};
+
+	struct PathRecord
+	{
+		MappedFile::Stamp Stamp;
+		ContentKey Content;
+	};
+
+	using ErasedCreator = std::function<std::shared_ptr<void>(const MappedFile& file, std::uint64_t& bytes, std::string& error)>;
+
+	std::shared_ptr<void> Acquire(const std::wstring& filename, std::type_index kind, const ErasedCreator& create,
+		std::string* error);
+
+	// Moves an entry to the front of the LRU list and returns its resource.
+	std::shared_ptr<void> Touch(Entry& entry);
+
+	// Evicts unreferenced entries from the back of the LRU list while the cache holds
+	// more than byteBudget bytes, or all of them for a budget of 0.
+	void Evict(std::uint64_t byteBudget);
+
+private:
+	mutable std::mutex mMutex;
+
+	std::uint64_t mBudget;
+
+	std::map<ContentKey, Entry> mEntries;
+	std::map<PathKey, PathRecord> mPaths;
+
+	// Content keys, most recently acquired first.
+	std::list<ContentKey> mLru;
+
+	Stats mStats;
+};
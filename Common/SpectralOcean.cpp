@@ -0,0 +1,557 @@
+//***************************************************************************************
+// SpectralOcean.cpp
+//***************************************************************************************
+
+#include "SpectralOcean.h"
+#include "TaskSystem.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	const float Gravity = 9.81f;
+	const float Pi = 3.1415926535f;
+
+	// Rows of an N x N plane handed to each task, about 16K floats per task.
+	int RowGrain(int n)
+	{
+		return std::max(1, 16384 / n);
+	}
+
+	//
+	// FFT butterflies.  Every butterfly input and output is a whole row of N complex
+	// numbers (separate real and imaginary planes), so one butterfly transforms all N
+	// columns at once and the inner loops run straight down contiguous memory, four
+	// lanes per SSE instruction.  N is a multiple of 4, so there are no leftovers.
+	//
+
+#if defined(_XM_SSE_INTRINSICS_)
+	// (ur + i*ui) * (wr + i*wi) for four lanes.
+	inline void ComplexMul(__m128 ur, __m128 ui, __m128 wr, __m128 wi, __m128& outRe, __m128& outIm)
+	{
+		outRe = _mm_sub_ps(_mm_mul_ps(ur, wr), _mm_mul_ps(ui, wi));
+		outIm = _mm_add_ps(_mm_mul_ps(ur, wi), _mm_mul_ps(ui, wr));
+	}
+#endif
+
+	// Radix-4 butterfly with the twiddles w1, w2 = w1^2 and w3 = w1^3 (forward
+	// transform, so multiplication by -i for the odd terms).
+	void Radix4Rows(const float* const xr[4], const float* const xi[4], float* const yr[4], float* const yi[4],
+		float w1r, float w1i, float w2r, float w2i, float w3r, float w3i, int n)
+	{
+		int j = 0;
+
+#if defined(_XM_SSE_INTRINSICS_)
+		const __m128 W1r = _mm_set1_ps(w1r), W1i = _mm_set1_ps(w1i);
+		const __m128 W2r = _mm_set1_ps(w2r), W2i = _mm_set1_ps(w2i);
+		const __m128 W3r = _mm_set1_ps(w3r), W3i = _mm_set1_ps(w3i);
+		for(; j + 4 <= n; j += 4)
+		{
+			__m128 ar = _mm_loadu_ps(xr[0] + j), ai = _mm_loadu_ps(xi[0] + j);
+			__m128 br = _mm_loadu_ps(xr[1] + j), bi = _mm_loadu_ps(xi[1] + j);
+			__m128 cr = _mm_loadu_ps(xr[2] + j), ci = _mm_loadu_ps(xi[2] + j);
+			__m128 dr = _mm_loadu_ps(xr[3] + j), di = _mm_loadu_ps(xi[3] + j);
+
+			__m128 apcR = _mm_add_ps(ar, cr), apcI = _mm_add_ps(ai, ci);
+			__m128 amcR = _mm_sub_ps(ar, cr), amcI = _mm_sub_ps(ai, ci);
+			__m128 bpdR = _mm_add_ps(br, dr), bpdI = _mm_add_ps(bi, di);
+			__m128 bmdR = _mm_sub_ps(br, dr), bmdI = _mm_sub_ps(bi, di);
+
+			_mm_storeu_ps(yr[0] + j, _mm_add_ps(apcR, bpdR));
+			_mm_storeu_ps(yi[0] + j, _mm_add_ps(apcI, bpdI));
+
+			__m128 re, im;
+			ComplexMul(_mm_add_ps(amcR, bmdI), _mm_sub_ps(amcI, bmdR), W1r, W1i, re, im);
+			_mm_storeu_ps(yr[1] + j, re);
+			_mm_storeu_ps(yi[1] + j, im);
+
+			ComplexMul(_mm_sub_ps(apcR, bpdR), _mm_sub_ps(apcI, bpdI), W2r, W2i, re, im);
+			_mm_storeu_ps(yr[2] + j, re);
+			_mm_storeu_ps(yi[2] + j, im);
+
+			ComplexMul(_mm_sub_ps(amcR, bmdI), _mm_add_ps(amcI, bmdR), W3r, W3i, re, im);
+			_mm_storeu_ps(yr[3] + j, re);
+			_mm_storeu_ps(yi[3] + j, im);
+		}
+#endif
+
+		for(; j < n; ++j)
+		{
+			float apcR = xr[0][j] + xr[2][j], apcI = xi[0][j] + xi[2][j];
+			float amcR = xr[0][j] - xr[2][j], amcI = xi[0][j] - xi[2][j];
+			float bpdR = xr[1][j] + xr[3][j], bpdI = xi[1][j] + xi[3][j];
+			float bmdR = xr[1][j] - xr[3][j], bmdI = xi[1][j] - xi[3][j];
+
+			yr[0][j] = apcR + bpdR;
+			yi[0][j] = apcI + bpdI;
+
+			float ur = amcR + bmdI, ui = amcI - bmdR;
+			yr[1][j] = ur*w1r - ui*w1i;
+			yi[1][j] = ur*w1i + ui*w1r;
+
+			ur = apcR - bpdR; ui = apcI - bpdI;
+			yr[2][j] = ur*w2r - ui*w2i;
+			yi[2][j] = ur*w2i + ui*w2r;
+
+			ur = amcR - bmdI; ui = amcI + bmdR;
+			yr[3][j] = ur*w3r - ui*w3i;
+			yi[3][j] = ur*w3i + ui*w3r;
+		}
+	}
+
+	// Final radix-2 butterfly, used when log2(N) is odd.  Its twiddle is always 1.
+	void Radix2Rows(const float* ar, const float* ai, const float* br, const float* bi,
+		float* sumR, float* sumI, float* diffR, float* diffI, int n)
+	{
+		int j = 0;
+
+#if defined(_XM_SSE_INTRINSICS_)
+		for(; j + 4 <= n; j += 4)
+		{
+			__m128 xr = _mm_loadu_ps(ar + j), xi = _mm_loadu_ps(ai + j);
+			__m128 yr = _mm_loadu_ps(br + j), yi = _mm_loadu_ps(bi + j);
+			_mm_storeu_ps(sumR + j, _mm_add_ps(xr, yr));
+			_mm_storeu_ps(sumI + j, _mm_add_ps(xi, yi));
+			_mm_storeu_ps(diffR + j, _mm_sub_ps(xr, yr));
+			_mm_storeu_ps(diffI + j, _mm_sub_ps(xi, yi));
+		}
+#endif
+
+		for(; j < n; ++j)
+		{
+			float xr = ar[j], xi = ai[j], yr = br[j], yi = bi[j];
+			sumR[j] = xr + yr;
+			sumI[j] = xi + yi;
+			diffR[j] = xr - yr;
+			diffI[j] = xi - yi;
+		}
+	}
+}
+
+SpectralOcean::SpectralOcean(const Desc& desc)
+{
+	assert(desc.Resolution >= 16 && (desc.Resolution & (desc.Resolution - 1)) == 0);
+
+	mN = desc.Resolution;
+
+	mPatchSize = desc.PatchSize;
+	mSpatialStep = desc.PatchSize / mN;
+	mChoppiness = desc.Choppiness;
+	mRepeatPeriod = desc.RepeatPeriod;
+
+	const int count = mN*mN;
+	mSpectrumRe.resize(count);
+	mSpectrumIm.resize(count);
+	mFreqRe.resize(count);
+	mFreqIm.resize(count);
+	mWorkRe.resize(count);
+	mWorkIm.resize(count);
+
+	mHeights.assign(count, 0.0f);
+	mSlopeX.assign(count, 0.0f);
+	mSlopeZ.assign(count, 0.0f);
+	mDisplaceX.assign(count, 0.0f);
+	mDisplaceZ.assign(count, 0.0f);
+
+	InitSpectrum(desc);
+	Update(0.0f);
+}
+
+SpectralOcean::~SpectralOcean()
+{
+}
+
+int SpectralOcean::RowCount()const
+{
+	return mN;
+}
+
+int SpectralOcean::ColumnCount()const
+{
+	return mN;
+}
+
+int SpectralOcean::VertexCount()const
+{
+	return mN*mN;
+}
+
+int SpectralOcean::TriangleCount()const
+{
+	return (mN - 1)*(mN - 1)*2;
+}
+
+float SpectralOcean::Width()const
+{
+	return mPatchSize;
+}
+
+float SpectralOcean::Depth()const
+{
+	return mPatchSize;
+}
+
+XMFLOAT3 SpectralOcean::Position(int i)const
+{
+	int row = i / mN;
+	int col = i - row*mN;
+
+	// Same orientation as Waves: x grows with the column, z shrinks with the row.
+	return XMFLOAT3(
+		(col - mN/2)*mSpatialStep + mChoppiness*mDisplaceX[i],
+		mHeights[i],
+		(mN/2 - row)*mSpatialStep - mChoppiness*mDisplaceZ[i]);
+}
+
+XMFLOAT3 SpectralOcean::Normal(int i)const
+{
+	// The row direction is -z, hence the flipped z slope.
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, XMVector3Normalize(XMVectorSet(-mSlopeX[i], 1.0f, mSlopeZ[i], 0.0f)));
+	return n;
+}
+
+XMFLOAT3 SpectralOcean::TangentX(int i)const
+{
+	XMFLOAT3 t;
+	XMStoreFloat3(&t, XMVector3Normalize(XMVectorSet(1.0f, mSlopeX[i], 0.0f, 0.0f)));
+	return t;
+}
+
+void SpectralOcean::InitSpectrum(const Desc& desc)
+{
+	const int n = mN;
+	const int count = n*n;
+	mH0Re.assign(count, 0.0f);
+	mH0Im.assign(count, 0.0f);
+	mH0ConjRe.assign(count, 0.0f);
+	mH0ConjIm.assign(count, 0.0f);
+	mOmega.assign(count, 0.0f);
+	mInvK.assign(count, 0.0f);
+
+	XMFLOAT2 wind;
+	XMStoreFloat2(&wind, XMVector2Normalize(XMLoadFloat2(&desc.WindDirection)));
+
+	const float U = desc.WindSpeed;
+	const float dk = 2.0f*Pi / mPatchSize;
+
+	// Phillips: largest wave that the wind can raise, and a cut-off for tiny ones.
+	const float L = U*U / Gravity;
+	const float l = L / 1000.0f;
+
+	// JONSWAP: spectrum scale and peak frequency for the given fetch.
+	const float alpha = 0.076f*std::pow(U*U / (desc.Fetch*Gravity), 0.22f);
+	const float omegaPeak = 22.0f*std::pow(Gravity*Gravity / (U*desc.Fetch), 1.0f/3.0f);
+
+	// Variance of the wave with wave vector (kx, kz), i.e. the spectral density
+	// times the area of one frequency cell.
+	auto variance = [&](float kx, float kz)
+	{
+		float k = std::sqrt(kx*kx + kz*kz);
+		if(k < 1.0e-6f)
+			return 0.0f;
+
+		float cosTheta = (kx*wind.x + kz*wind.y) / k;
+
+		float density = 0.0f;
+		if(desc.Type == Spectrum::Phillips)
+		{
+			density = 0.0081f / (k*k*k*k) * std::exp(-1.0f / (k*L*k*L))
+				* cosTheta*cosTheta * std::exp(-k*k*l*l);
+		}
+		else
+		{
+			// S(omega) with a cos^2 spread over the half plane facing downwind,
+			// converted to a wave number density with the deep-water dispersion
+			// omega^2 = g*k.
+			if(cosTheta <= 0.0f)
+				return 0.0f;
+
+			float omega = std::sqrt(Gravity*k);
+			float sigma = omega <= omegaPeak ? 0.07f : 0.09f;
+			float r = std::exp(-(omega - omegaPeak)*(omega - omegaPeak) / (2.0f*sigma*sigma*omegaPeak*omegaPeak));
+			float ratio = omegaPeak / omega;
+			float s = alpha*Gravity*Gravity / std::pow(omega, 5.0f)
+				* std::exp(-1.25f*ratio*ratio*ratio*ratio) * std::pow(desc.PeakEnhancement, r);
+
+			float dOmegaDk = Gravity / (2.0f*omega);
+			float spread = 2.0f / Pi * cosTheta*cosTheta;
+			density = s*dOmegaDk*spread / k;
+		}
+
+		return desc.Amplitude*density*dk*dk;
+	};
+
+	// Frequencies are multiples of this so every wave repeats after RepeatPeriod.
+	const float omega0 = 2.0f*Pi / desc.RepeatPeriod;
+
+	std::mt19937 rng(desc.Seed);
+	std::normal_distribution<float> gaussian(0.0f, 1.0f);
+
+	// Index 0 holds the Nyquist frequency -N/2, which has no partner at +N/2; leave it
+	// at zero so the spectrum is exactly Hermitian and the surface exactly real.
+	for(int m = 1; m < n; ++m)
+	{
+		for(int j = 1; j < n; ++j)
+		{
+			float kx = (j - n/2)*dk;
+			float kz = (m - n/2)*dk;
+			float k = std::sqrt(kx*kx + kz*kz);
+			float amplitude = std::sqrt(0.5f*variance(kx, kz));
+
+			mH0Re[m*n + j] = gaussian(rng)*amplitude;
+			mH0Im[m*n + j] = gaussian(rng)*amplitude;
+			mOmega[m*n + j] = std::floor(std::sqrt(Gravity*k) / omega0)*omega0;
+			mInvK[m*n + j] = k > 0.0f ? 1.0f / k : 0.0f;
+		}
+	}
+
+	for(int m = 1; m < n; ++m)
+	{
+		for(int j = 1; j < n; ++j)
+		{
+			int mirror = (n - m)*n + (n - j);
+			mH0ConjRe[m*n + j] = mH0Re[mirror];
+			mH0ConjIm[m*n + j] = -mH0Im[mirror];
+		}
+	}
+}
+
+void SpectralOcean::Update(float dt)
+{
+	mTime = std::fmod(mTime + dt, mRepeatPeriod);
+
+	EvaluateSpectrum();
+
+	float* re;
+	float* im;
+
+	// Height in the real part, x slope in the imaginary part: h + i*(i*kx*h).
+	FillSpectrum([](float kx, float /*kz*/, float /*invK*/, float hr, float hi, float& outRe, float& outIm)
+	{
+		outRe = hr*(1.0f - kx);
+		outIm = hi*(1.0f - kx);
+	});
+	InverseFFT2D(re, im);
+	ExtractField(re, 1.0f, mHeights);
+	ExtractField(im, -1.0f, mSlopeX);
+
+	if(mChoppiness == 0.0f)
+	{
+		// z slope alone: i*kz*h.
+		FillSpectrum([](float /*kx*/, float kz, float /*invK*/, float hr, float hi, float& outRe, float& outIm)
+		{
+			outRe = -kz*hi;
+			outIm = kz*hr;
+		});
+		InverseFFT2D(re, im);
+		ExtractField(re, 1.0f, mSlopeZ);
+		return;
+	}
+
+	// z slope in the real part, x displacement in the imaginary part:
+	// i*kz*h + i*(-i*kx/k*h) = h*(kx/k + i*kz).
+	FillSpectrum([](float kx, float kz, float invK, float hr, float hi, float& outRe, float& outIm)
+	{
+		float c = kx*invK;
+		outRe = hr*c - hi*kz;
+		outIm = hi*c + hr*kz;
+	});
+	InverseFFT2D(re, im);
+	ExtractField(re, 1.0f, mSlopeZ);
+	ExtractField(im, -1.0f, mDisplaceX);
+
+	// z displacement: -i*kz/k*h.
+	FillSpectrum([](float /*kx*/, float kz, float invK, float hr, float hi, float& outRe, float& outIm)
+	{
+		float c = kz*invK;
+		outRe = hi*c;
+		outIm = -hr*c;
+	});
+	InverseFFT2D(re, im);
+	ExtractField(re, 1.0f, mDisplaceZ);
+}
+
+void SpectralOcean::EvaluateSpectrum()
+{
+	const int n = mN;
+
+	TaskSystem::Default().ParallelFor(0, n, RowGrain(n), [&](int m)
+	{
+		for(int j = 0; j < n; ++j)
+		{
+			int idx = m*n + j;
+
+			// h(k, t) = h0(k)*e^(i*w*t) + conj(h0(-k))*e^(-i*w*t)
+			float s, c;
+			XMScalarSinCos(&s, &c, mOmega[idx]*mTime);
+			mSpectrumRe[idx] = (mH0Re[idx] + mH0ConjRe[idx])*c - (mH0Im[idx] - mH0ConjIm[idx])*s;
+			mSpectrumIm[idx] = (mH0Im[idx] + mH0ConjIm[idx])*c + (mH0Re[idx] - mH0ConjRe[idx])*s;
+		}
+	});
+}
+
+template<typename F>
+void SpectralOcean::FillSpectrum(const F& f)
+{
+	const int n = mN;
+	const float dk = 2.0f*Pi / mPatchSize;
+
+	TaskSystem::Default().ParallelFor(0, n, RowGrain(n), [&](int m)
+	{
+		float kz = (m - n/2)*dk;
+		for(int j = 0; j < n; ++j)
+		{
+			int idx = m*n + j;
+			float kx = (j - n/2)*dk;
+
+			float outRe, outIm;
+			f(kx, kz, mInvK[idx], mSpectrumRe[idx], mSpectrumIm[idx], outRe, outIm);
+
+			// The frequencies are centred on zero, which the FFT expects at index 0;
+			// multiplying by (-1)^(m+j) on the way in and out shifts them.  The inverse
+			// transform is done as a forward one on the conjugate.
+			float sign = ((m + j) & 1) ? -1.0f : 1.0f;
+			mFreqRe[idx] = sign*outRe;
+			mFreqIm[idx] = -sign*outIm;
+		}
+	});
+}
+
+void SpectralOcean::InverseFFT2D(float*& re, float*& im)
+{
+	re = mFreqRe.data();
+	im = mFreqIm.data();
+
+	auto other = [this](const float* p, bool real) -> float*
+	{
+		bool inFreq = (p == mFreqRe.data() || p == mFreqIm.data());
+		if(real)
+			return inFreq ? mWorkRe.data() : mFreqRe.data();
+		return inFreq ? mWorkIm.data() : mFreqIm.data();
+	};
+
+	// Transform the columns, transpose, transform the columns again (which are the
+	// original rows) and transpose back.
+	for(int pass = 0; pass < 2; ++pass)
+	{
+		FFTColumns(re, im, other(re, true), other(im, false));
+
+		float* dstRe = other(re, true);
+		float* dstIm = other(im, false);
+		Transpose(re, dstRe);
+		Transpose(im, dstIm);
+		re = dstRe;
+		im = dstIm;
+	}
+}
+
+void SpectralOcean::FFTColumns(float*& re, float*& im, float* scratchRe, float* scratchIm)
+{
+	//
+	// Stockham autosort FFT: every stage reads one buffer and writes the other in an
+	// order that leaves the output sorted, so no bit-reversal pass is needed.  Radix-4
+	// stages do the bulk and a radix-2 stage finishes when log2(N) is odd.
+	//
+	const int n = mN;
+
+	float* srcRe = re;
+	float* srcIm = im;
+	float* dstRe = scratchRe;
+	float* dstIm = scratchIm;
+
+	int len = n;
+	int stride = 1;
+	while(len >= 4)
+	{
+		const int quarter = len / 4;
+		const float theta = -2.0f*Pi / len;
+
+		TaskSystem::Default().ParallelFor(0, quarter*stride, std::max(1, RowGrain(n) / 8), [&](int b)
+		{
+			int p = b / stride;
+			int q = b - p*stride;
+
+			float w1r = std::cos(theta*p), w1i = std::sin(theta*p);
+			float w2r = w1r*w1r - w1i*w1i, w2i = 2.0f*w1r*w1i;
+			float w3r = w2r*w1r - w2i*w1i, w3i = w2r*w1i + w2i*w1r;
+
+			const float* xr[4];
+			const float* xi[4];
+			float* yr[4];
+			float* yi[4];
+			for(int k = 0; k < 4; ++k)
+			{
+				xr[k] = srcRe + (q + stride*(p + k*quarter))*n;
+				xi[k] = srcIm + (q + stride*(p + k*quarter))*n;
+				yr[k] = dstRe + (q + stride*(4*p + k))*n;
+				yi[k] = dstIm + (q + stride*(4*p + k))*n;
+			}
+
+			Radix4Rows(xr, xi, yr, yi, w1r, w1i, w2r, w2i, w3r, w3i, n);
+		});
+
+		std::swap(srcRe, dstRe);
+		std::swap(srcIm, dstIm);
+		len /= 4;
+		stride *= 4;
+	}
+
+	if(len == 2)
+	{
+		TaskSystem::Default().ParallelFor(0, stride, RowGrain(n) / 4 + 1, [&](int q)
+		{
+			Radix2Rows(srcRe + q*n, srcIm + q*n, srcRe + (q + stride)*n, srcIm + (q + stride)*n,
+				dstRe + q*n, dstIm + q*n, dstRe + (q + stride)*n, dstIm + (q + stride)*n, n);
+		});
+
+		std::swap(srcRe, dstRe);
+		std::swap(srcIm, dstIm);
+	}
+
+	re = srcRe;
+	im = srcIm;
+}
+
+void SpectralOcean::Transpose(const float* src, float* dst)const
+{
+	const int n = mN;
+
+	// 4x4 blocks, one row of blocks per task index.
+	TaskSystem::Default().ParallelFor(0, n/4, std::max(1, RowGrain(n) / 4), [&](int bi)
+	{
+		int i = 4*bi;
+		for(int j = 0; j < n; j += 4)
+		{
+#if defined(_XM_SSE_INTRINSICS_)
+			__m128 r0 = _mm_loadu_ps(src + (i + 0)*n + j);
+			__m128 r1 = _mm_loadu_ps(src + (i + 1)*n + j);
+			__m128 r2 = _mm_loadu_ps(src + (i + 2)*n + j);
+			__m128 r3 = _mm_loadu_ps(src + (i + 3)*n + j);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(dst + (j + 0)*n + i, r0);
+			_mm_storeu_ps(dst + (j + 1)*n + i, r1);
+			_mm_storeu_ps(dst + (j + 2)*n + i, r2);
+			_mm_storeu_ps(dst + (j + 3)*n + i, r3);
+#else
+			for(int a = 0; a < 4; ++a)
+				for(int b = 0; b < 4; ++b)
+					dst[(j + b)*n + i + a] = src[(i + a)*n + j + b];
+#endif
+		}
+	});
+}
+
+void SpectralOcean::ExtractField(const float* src, float sign, std::vector<float>& field)const
+{
+	const int n = mN;
+	TaskSystem::Default().ParallelFor(0, n, RowGrain(n), [&](int i)
+	{
+		for(int j = 0; j < n; ++j)
+			field[i*n + j] = ((i + j) & 1) ? -sign*src[i*n + j] : sign*src[i*n + j];
+	});
+}
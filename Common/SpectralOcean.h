@@ -0,0 +1,143 @@
+//***************************************************************************************
+// SpectralOcean.h
+//
+// Tessendorf-style statistical ocean.  Wave amplitudes are drawn once from an ocean
+// spectrum (Phillips or JONSWAP) in frequency space; every update advances each wave
+// by its deep-water dispersion relation and inverse-FFTs the result back to a grid of
+// heights, slopes and horizontal (choppy) displacements.
+//
+// Unlike the finite-difference Waves solver the result is periodic, so one patch tiles
+// seamlessly, it is unconditionally stable, and an update costs the same no matter
+// what happened before.  The query interface mirrors Waves.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+class SpectralOcean
+{
+public:
+	enum class Spectrum
+	{
+		Phillips,
+		Jonswap
+	};
+
+	struct Desc
+	{
+		// Grid points per side; a power of two, at least 16.
+		int Resolution = 128;
+
+		// World-space size of one (tileable) patch.
+		float PatchSize = 64.0f;
+
+		Spectrum Type = Spectrum::Phillips;
+
+		// Wind speed in m/s at 10m and the direction it blows towards in the xz-plane.
+		float WindSpeed = 10.0f;
+		DirectX::XMFLOAT2 WindDirection = { 1.0f, 0.0f };
+
+		// Overall scale applied to the wave amplitudes.
+		float Amplitude = 1.0f;
+
+		// JONSWAP only: distance the wind has blown over open water (m) and the peak
+		// enhancement factor.
+		float Fetch = 100000.0f;
+		float PeakEnhancement = 3.3f;
+
+		// Scale of the horizontal displacement that sharpens crests.  0 gives plain
+		// height field waves and saves two of the five transforms.
+		float Choppiness = 0.0f;
+
+		// The wave frequencies are rounded so the animation loops after this many
+		// seconds, which keeps the phase accurate however long the ocean runs.
+		float RepeatPeriod = 200.0f;
+
+		std::uint32_t Seed = 0;
+	};
+
+	explicit SpectralOcean(const Desc& desc);
+	SpectralOcean(const SpectralOcean& rhs) = delete;
+	SpectralOcean& operator=(const SpectralOcean& rhs) = delete;
+	~SpectralOcean();
+
+	int RowCount()const;
+	int ColumnCount()const;
+	int VertexCount()const;
+	int TriangleCount()const;
+	float Width()const;
+	float Depth()const;
+
+	// Returns the displaced surface point at the ith grid point.
+	DirectX::XMFLOAT3 Position(int i)const;
+
+	// Returns the surface normal at the ith grid point.
+	DirectX::XMFLOAT3 Normal(int i)const;
+
+	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
+	DirectX::XMFLOAT3 TangentX(int i)const;
+
+	// Advances the ocean by dt seconds and evaluates the new surface.
+	void Update(float dt);
+
+private:
+	void InitSpectrum(const Desc& desc);
+
+	// Evaluates h(k, t) for the current time into mSpectrumRe/mSpectrumIm.
+	void EvaluateSpectrum();
+
+	// Builds the input of one transform from h(k, t).  Each complex transform carries
+	// two real fields, one in the real and one in the imaginary part of the result.
+	template<typename F>
+	void FillSpectrum(const F& f);
+
+	// Inverse 2D FFT of mFreqRe/mFreqIm.  Returns the buffer pair holding the result.
+	void InverseFFT2D(float*& re, float*& im);
+
+	// One 1D FFT along the columns of an N x N complex plane, computed for all columns
+	// at once.  Ping-pongs between the two buffer pairs; returns the one holding the result.
+	void FFTColumns(float*& re, float*& im, float* scratchRe, float* scratchIm);
+
+	void Transpose(const float* src, float* dst)const;
+
+	// Copies a transform result into a field with the (-1)^(i+j) shift that centres the
+	// frequencies; sign selects the real (+1 picks re) or imaginary part.
+	void ExtractField(const float* src, float sign, std::vector<float>& field)const;
+
+private:
+	int mN = 0;
+	float mPatchSize = 0.0f;
+	float mSpatialStep = 0.0f;
+	float mChoppiness = 0.0f;
+	float mRepeatPeriod = 0.0f;
+	float mTime = 0.0f;
+
+	// Initial amplitudes h0(k) and conj(h0(-k)), the angular frequency per wave and
+	// the reciprocal wave number (0 for the constant term).
+	std::vector<float> mH0Re;
+	std::vector<float> mH0Im;
+	std::vector<float> mH0ConjRe;
+	std::vector<float> mH0ConjIm;
+	std::vector<float> mOmega;
+	std::vector<float> mInvK;
+
+	// h(k, t) at the current time.
+	std::vector<float> mSpectrumRe;
+	std::vector<float> mSpectrumIm;
+
+	// Transform work buffers.
+	std::vector<float> mFreqRe;
+	std::vector<float> mFreqIm;
+	std::vector<float> mWorkRe;
+	std::vector<float> mWorkIm;
+
+	// Surface fields; the z quantities are along the row direction (-z).
+	std::vector<float> mHeights;
+	std::vector<float> mSlopeX;
+	std::vector<float> mSlopeZ;
+	std::vector<float> mDisplaceX;
+	std::vector<float> mDisplaceZ;
+};
@@ -0,0 +1,214 @@
+//***************************************************************************************
+// TangentGenerator.cpp
+//***************************************************************************************
+
+#include "TangentGenerator.h"
+#include <DirectXMath.h>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// Triangles and vertices handled per task.
+	const int TriangleGrain = 4096;
+	const int VertexGrain = 4096;
+
+	// Squared lengths below this are treated as zero.
+	const float Epsilon = 1.0e-12f;
+
+	// The texture space frame of one triangle, with the angle at each corner to
+	// weight it by.  Triangles that cannot give a frame have zero angles.
+	struct TriangleFrame
+	{
+		XMFLOAT3 Tangent;
+		XMFLOAT3 Bitangent;
+		float CornerAngle[3];
+	};
+
+	XMVECTOR LoadFloat3(const std::uint8_t* vertex, int offset)
+	{
+		XMFLOAT3 f;
+		std::memcpy(&f, vertex + offset, sizeof(f));
+		return XMLoadFloat3(&f);
+	}
+
+	XMFLOAT2 LoadFloat2(const std::uint8_t* vertex, int offset)
+	{
+		XMFLOAT2 f;
+		std::memcpy(&f, vertex + offset, sizeof(f));
+		return f;
+	}
+
+	float AngleBetween(FXMVECTOR a, FXMVECTOR b)
+	{
+		float cosAngle = XMVectorGetX(XMVector3Dot(XMVector3Normalize(a), XMVector3Normalize(b)));
+		return acosf(std::min(std::max(cosAngle, -1.0f), 1.0f));
+	}
+
+	// Removes the component along the unit vector n and normalises what is left, or
+	// returns zero if nothing is.
+	XMVECTOR ProjectOntoPlane(FXMVECTOR v, FXMVECTOR n)
+	{
+		XMVECTOR p = v - n*XMVector3Dot(n, v);
+		if(XMVectorGetX(XMVector3LengthSq(p)) < Epsilon)
+			return XMVectorZero();
+		return XMVector3Normalize(p);
+	}
+
+	// Any unit vector perpendicular to n.
+	XMVECTOR AnyTangent(FXMVECTOR n)
+	{
+		XMFLOAT3 n3;
+		XMStoreFloat3(&n3, n);
+
+		if(fabsf(n3.x) + fabsf(n3.y) + fabsf(n3.z) == 0.0f)
+			return XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+
+		XMVECTOR up = fabsf(n3.y) < 1.0f - 0.001f ?
+			XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+		return XMVector3Normalize(XMVector3Cross(up, n));
+	}
+
+	TriangleFrame ComputeTriangleFrame(const std::uint8_t* v0, const std::uint8_t* v1, const std::uint8_t* v2,
+		const TangentGenerator::VertexLayout& layout)
+	{
+		TriangleFrame frame = {};
+
+		XMVECTOR p0 = LoadFloat3(v0, layout.PositionOffset);
+		XMVECTOR p1 = LoadFloat3(v1, layout.PositionOffset);
+		XMVECTOR p2 = LoadFloat3(v2, layout.PositionOffset);
+
+		XMFLOAT2 uv0 = LoadFloat2(v0, layout.TexCOffset);
+		XMFLOAT2 uv1 = LoadFloat2(v1, layout.TexCOffset);
+		XMFLOAT2 uv2 = LoadFloat2(v2, layout.TexCOffset);
+
+		XMVECTOR e1 = p1 - p0;
+		XMVECTOR e2 = p2 - p0;
+
+		float du1 = uv1.x - uv0.x;
+		float dv1 = uv1.y - uv0.y;
+		float du2 = uv2.x - uv0.x;
+		float dv2 = uv2.y - uv0.y;
+
+		// Twice the signed area of the triangle in texture space.
+		float det = du1*dv2 - du2*dv1;
+
+		if(XMVectorGetX(XMVector3LengthSq(XMVector3Cross(e1, e2))) < Epsilon || fabsf(det) < Epsilon ||
+			!std::isfinite(det))
+		{
+			return frame;
+		}
+
+		// Solve e1 = du1*T + dv1*B, e2 = du2*T + dv2*B for the derivatives of the
+		// position along u and v.
+		float invDet = 1.0f / det;
+		XMStoreFloat3(&frame.Tangent, (e1*dv2 - e2*dv1)*invDet);
+		XMStoreFloat3(&frame.Bitangent, (e2*du1 - e1*du2)*invDet);
+
+		frame.CornerAngle[0] = AngleBetween(e1, e2);
+		frame.CornerAngle[1] = AngleBetween(p2 - p1, p0 - p1);
+		frame.CornerAngle[2] = std::max(XM_PI - frame.CornerAngle[0] - frame.CornerAngle[1], 0.0f);
+
+		return frame;
+	}
+}
+
+template<typename Index>
+std::uint32_t TangentGenerator::Generate(void* vertices, const VertexLayout& layout, std::uint32_t vertexCount,
+	const Index* indices, std::size_t indexCount, TaskSystem& taskSystem)
+{
+	assert(layout.NormalOffset >= 0 && layout.TexCOffset >= 0 && layout.TangentOffset >= 0);
+
+	std::uint8_t* bytes = static_cast<std::uint8_t*>(vertices);
+	const int triangleCount = (int)(indexCount / 3);
+
+	std::vector<TriangleFrame> frames(triangleCount);
+	taskSystem.ParallelFor(0, triangleCount, TriangleGrain, [&](int t)
+	{
+		const Index* tri = indices + 3*t;
+		assert((std::uint32_t)tri[0] < vertexCount && (std::uint32_t)tri[1] < vertexCount &&
+			(std::uint32_t)tri[2] < vertexCount);
+
+		frames[t] = ComputeTriangleFrame(bytes + (std::size_t)tri[0]*layout.Stride,
+			bytes + (std::size_t)tri[1]*layout.Stride, bytes + (std::size_t)tri[2]*layout.Stride, layout);
+	});
+
+	// The corners of each vertex, 3*triangle + corner, in triangle order.
+	std::vector<std::uint32_t> cornerStart(vertexCount + 1, 0);
+	for(int i = 0; i < 3*triangleCount; ++i)
+		++cornerStart[indices[i] + 1];
+	for(std::uint32_t v = 0; v < vertexCount; ++v)
+		cornerStart[v + 1] += cornerStart[v];
+
+	std::vector<std::uint32_t> corners(3*(std::size_t)triangleCount);
+	{
+		std::vector<std::uint32_t> next(cornerStart.begin(), cornerStart.end() - 1);
+		for(int i = 0; i < 3*triangleCount; ++i)
+			corners[next[indices[i]]++] = (std::uint32_t)i;
+	}
+
+	std::atomic<std::uint32_t> fallbackCount(0);
+	taskSystem.ParallelForRange(0, (int)vertexCount, VertexGrain, [&](int begin, int end)
+	{
+		std::uint32_t fallbacks = 0;
+
+		for(int v = begin; v < end; ++v)
+		{
+			std::uint8_t* vertex = bytes + (std::size_t)v*layout.Stride;
+
+			XMVECTOR n = LoadFloat3(vertex, layout.NormalOffset);
+			bool hasNormal = XMVectorGetX(XMVector3LengthSq(n)) >= Epsilon;
+			if(hasNormal)
+				n = XMVector3Normalize(n);
+
+			XMVECTOR tangentSum = XMVectorZero();
+			XMVECTOR bitangentSum = XMVectorZero();
+			for(std::uint32_t c = cornerStart[v]; hasNormal && c < cornerStart[v + 1]; ++c)
+			{
+				const TriangleFrame& frame = frames[corners[c] / 3];
+				float angle = frame.CornerAngle[corners[c] % 3];
+				if(angle == 0.0f)
+					continue;
+
+				tangentSum += angle*ProjectOntoPlane(XMLoadFloat3(&frame.Tangent), n);
+				bitangentSum += angle*ProjectOntoPlane(XMLoadFloat3(&frame.Bitangent), n);
+			}
+
+			XMVECTOR tangent = hasNormal ? ProjectOntoPlane(tangentSum, n) : XMVectorZero();
+			float handedness = 1.0f;
+			if(XMVectorGetX(XMVector3LengthSq(tangent)) == 0.0f)
+			{
+				tangent = AnyTangent(n);
+				++fallbacks;
+			}
+			else if(XMVectorGetX(XMVector3Dot(XMVector3Cross(n, tangent), bitangentSum)) < 0.0f)
+			{
+				handedness = -1.0f;
+			}
+
+			XMFLOAT3 t3;
+			XMStoreFloat3(&t3, tangent);
+			std::memcpy(vertex + layout.TangentOffset, &t3, sizeof(t3));
+
+			if(layout.HandednessOffset >= 0)
+				std::memcpy(vertex + layout.HandednessOffset, &handedness, sizeof(handedness));
+		}
+
+		fallbackCount += fallbacks;
+	});
+
+	return fallbackCount;
+}
+
+#define INSTANTIATE_TANGENT_GENERATOR(Index) \
+	template std::uint32_t TangentGenerator::Generate<Index>(void*, const VertexLayout&, std::uint32_t, const Index*, std::size_t, TaskSystem&);
+
+INSTANTIATE_TANGENT_GENERATOR(std::uint16_t)
+INSTANTIATE_TANGENT_GENERATOR(std::uint32_t)
+INSTANTIATE_TANGENT_GENERATOR(std::int32_t)
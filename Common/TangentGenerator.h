@@ -0,0 +1,60 @@
+//***************************************************************************************
+// TangentGenerator.h
+//
+// Computes per-vertex tangent frames for an indexed triangle list from its
+// positions, normals and texture coordinates, so normal maps can be used on meshes
+// that come without tangents.
+//
+// The frames follow the conventions of MikkTSpace (Mikkelsen, "Simulation of
+// Wrinkled Surfaces Revisited"): each triangle's tangent and bitangent are projected
+// onto the tangent plane of each of its vertices and summed weighted by the angle at
+// that corner, then the tangent is orthonormalised against the normal.  The
+// bitangent is not stored; a vertex keeps only its handedness, the sign s with
+// B = s*cross(N, T), which is -1 where the texture is mirrored.
+//
+// Unlike MikkTSpace the vertex buffer is never split: a vertex shared by triangles
+// of opposite handedness gets the sign of the larger share.  Models normally
+// duplicate such vertices already, since their texture coordinates differ.
+//
+// Triangles are processed in parallel on the task system and vertices then gather
+// from their own triangles in a fixed order, so the result does not depend on the
+// number of threads.
+//
+// Generate is instantiated for 16-bit, 32-bit and signed 32-bit indices.
+//***************************************************************************************
+
+#pragma once
+
+#include "TaskSystem.h"
+#include <cstddef>
+#include <cstdint>
+
+class TangentGenerator
+{
+public:
+	///<summary>
+	/// Describes where each attribute is in a caller's vertex, in the same way as
+	/// GeometryGenerator::VertexLayout.  Offsets are in bytes.  Positions, normals and
+	/// tangents are XMFLOAT3s and texture coordinates an XMFLOAT2.  The handedness is
+	/// a float, for example TangentOffset + 12 for an XMFLOAT4 tangent; -1 drops it.
+	///</summary>
+	struct VertexLayout
+	{
+		std::uint32_t Stride = 0;
+		int PositionOffset = 0;
+		int NormalOffset = -1;
+		int TexCOffset = -1;
+		int TangentOffset = -1;
+		int HandednessOffset = -1;
+	};
+
+	///<summary>
+	/// Writes the tangent, and the handedness if the layout has one, of every vertex.
+	/// Vertices that no triangle gives a usable tangent to, because they are unused or
+	/// their texture coordinates are degenerate, get an arbitrary tangent
+	/// perpendicular to the normal and a handedness of +1.  Returns how many did.
+	///</summary>
+	template<typename Index>
+	static std::uint32_t Generate(void* vertices, const VertexLayout& layout, std::uint32_t vertexCount,
+		const Index* indices, std::size_t indexCount, TaskSystem& taskSystem = TaskSystem::Default());
+};
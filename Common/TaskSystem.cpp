@@ -0,0 +1,242 @@
+//***************************************************************************************
+// TaskSystem.cpp
+//***************************************************************************************
+
+#include "TaskSystem.h"
+#include <chrono>
+
+namespace
+{
+    // Identifies the pool (and the queue within it) that owns the calling thread.
+    thread_local const TaskSystem* tOwner = nullptr;
+    thread_local unsigned int tQueueIndex = 0;
+}
+
+TaskSystem::TaskSystem(unsigned int workerCount) :
+    mQueuedCount(0),
+    mSleepingCount(0),
+    mQuit(false)
+{
+    if(workerCount == 0)
+    {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    // Worker queues plus the injection queue.
+    for(unsigned int i = 0; i < workerCount + 1; ++i)
+        mQueues.push_back(std::make_unique<TaskQueue>());
+
+    for(unsigned int i = 0; i < workerCount; ++i)
+        mThreads.emplace_back(&TaskSystem::WorkerLoop, this, i);
+}
+
+TaskSystem::~TaskSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(mWakeMutex);
+        mQuit = true;
+    }
+    mWakeCondition.notify_all();
+
+    for(auto& t : mThreads)
+        t.join();
+}
+
+TaskSystem& TaskSystem::Default()
+{
+    static TaskSystem taskSystem;
+    return taskSystem;
+}
+
+unsigned int TaskSystem::WorkerCount()const
+{
+    return (unsigned int)mThreads.size();
+}
+
+unsigned int TaskSystem::CallerQueueIndex()const
+{
+    return tOwner == this ? tQueueIndex : WorkerCount();
+}
+
+void TaskSystem::Submit(Task task)
+{
+    TaskQueue& queue = *mQueues[CallerQueueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.Mutex);
+        queue.Tasks.push_back(std::move(task));
+    }
+    mQueuedCount.fetch_add(1);
+
+    // Taking the wake mutex orders this against a worker that has just checked the
+    // queued count and is about to sleep, so the notification cannot be lost.
+    if(mSleepingCount.load() > 0)
+    {
+        { std::lock_guard<std::mutex> lock(mWakeMutex); }
+        mWakeCondition.notify_one();
+    }
+}
+
+bool TaskSystem::PopLocal(unsigned int index, Task& task)
+{
+    TaskQueue& queue = *mQueues[index];
+    std::lock_guard<std::mutex> lock(queue.Mutex);
+    if(queue.Tasks.empty())
+        return false;
+
+    task = std::move(queue.Tasks.back());
+    queue.Tasks.pop_back();
+    mQueuedCount.fetch_sub(1);
+    return true;
+}
+
+bool TaskSystem::Steal(unsigned int thiefIndex, Task& task)
+{
+    // Start with the injection queue, then walk the other workers beginning with the
+    // thief's neighbour so that thieves spread out over the victims.
+    unsigned int queueCount = (unsigned int)mQueues.size();
+    for(unsigned int k = 0; k < queueCount; ++k)
+    {
+        unsigned int victim = (k == 0) ? queueCount - 1 : (thiefIndex + k) % (queueCount - 1);
+        if(victim == thiefIndex)
+            continue;
+
+        TaskQueue& queue = *mQueues[victim];
+        std::unique_lock<std::mutex> lock(queue.Mutex, std::try_to_lock);
+        if(!lock.owns_lock() || queue.Tasks.empty())
+            continue;
+
+        task = std::move(queue.Tasks.front());
+        queue.Tasks.pop_front();
+        mQueuedCount.fetch_sub(1);
+        return true;
+    }
+
+    return false;
+}
+
+bool TaskSystem::RunPendingTask()
+{
+    if(mQueuedCount.load() == 0)
+        return false;
+
+    unsigned int index = CallerQueueIndex();
+
+    Task task;
+    if(PopLocal(index, task) || Steal(index, task))
+    {
+        task();
+        return true;
+    }
+
+    return false;
+}
+
+void TaskSystem::WorkerLoop(unsigned int index)
+{
+    tOwner = this;
+    tQueueIndex = index;
+
+    while(true)
+    {
+        Task task;
+        if(PopLocal(index, task) || Steal(index, task))
+        {
+            task();
+            continue;
+        }
+
+        // Nothing to run; sleep until more work is queued.  The timeout covers a
+        // failed try_lock in Steal() leaving a task behind with everyone asleep.
+        std::unique_lock<std::mutex> lock(mWakeMutex);
+        mSleepingCount.fetch_add(1);
+        mWakeCondition.wait_for(lock, std::chrono::milliseconds(2), [this]()
+        {
+            return mQuit.load() || mQueuedCount.load() > 0;
+        });
+        mSleepingCount.fetch_sub(1);
+
+        if(mQuit.load())
+            return;
+    }
+}
+
+TaskGroup::TaskGroup(TaskSystem& taskSystem) :
+    mTaskSystem(taskSystem),
+    mPendingCount(0)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+    Wait();
+}
+
+void TaskGroup::Run(TaskSystem::Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPendingCount.fetch_add(1);
+    }
+
+    Launch(std::move(task));
+}
+
+void TaskGroup::Then(TaskSystem::Task continuation)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if(mPendingCount.load() > 0)
+        {
+            mContinuations.push_back(std::move(continuation));
+            return;
+        }
+
+        mPendingCount.fetch_add(1);
+    }
+
+    Launch(std::move(continuation));
+}
+
+void TaskGroup::Launch(TaskSystem::Task task)
+{
+    mTaskSystem.Submit([this, task]()
+    {
+        task();
+        Finish();
+    });
+}
+
+void TaskGroup::Finish()
+{
+    std::vector<TaskSystem::Task> continuations;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        // If this was the last task in flight, its continuations become pending
+        // before the count can drop to zero, so Wait() cannot return in between.
+        if(mPendingCount.load() == 1 && !mContinuations.empty())
+        {
+            continuations.swap(mContinuations);
+            mPendingCount.fetch_add((int)continuations.size());
+        }
+
+        mPendingCount.fetch_sub(1);
+    }
+
+    for(auto& c : continuations)
+        Launch(std::move(c));
+}
+
+void TaskGroup::Wait()
+{
+    while(mPendingCount.load() > 0)
+    {
+        if(!mTaskSystem.RunPendingTask())
+            std::this_thread::yield();
+    }
+
+    // The last task drops the count while holding the mutex; acquire it so that task
+    // is done touching the group before the caller is allowed to destroy it.
+    std::lock_guard<std::mutex> lock(mMutex);
+}
@@ -0,0 +1,174 @@
+//***************************************************************************************
+// TaskSystem.h
+//
+// A small portable task scheduler built only on the C++ standard library.  A fixed
+// pool of worker threads each owns a deque of tasks: a worker pushes and pops work at
+// the back of its own deque (LIFO, cache friendly) and, when it runs dry, steals from
+// the front of the other deques (FIFO, so thieves take the largest pieces of work).
+// Tasks submitted from threads outside the pool go to a shared injection queue.
+//
+// On top of this sit TaskGroup (fork/join with continuations) and ParallelFor, which
+// recursively halves an index range down to a caller-chosen grain size.
+//
+// Threads that wait on a TaskGroup help execute pending tasks rather than blocking,
+// so groups and parallel loops may be nested freely.
+//***************************************************************************************
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskSystem
+{
+public:
+    using Task = std::function<void()>;
+
+    // Creates a pool with the given number of worker threads.  Zero picks one thread
+    // per hardware thread minus one, since the submitting thread helps while it waits.
+    explicit TaskSystem(unsigned int workerCount = 0);
+    TaskSystem(const TaskSystem& rhs) = delete;
+    TaskSystem& operator=(const TaskSystem& rhs) = delete;
+    ~TaskSystem();
+
+    // Process-wide pool shared by the demos.
+    static TaskSystem& Default();
+
+    unsigned int WorkerCount()const;
+
+    // Queues a task.  Prefer TaskGroup::Run, which also lets you wait on the task.
+    void Submit(Task task);
+
+    // Runs one queued task on the calling thread if any are available.  Returns false
+    // if there was nothing to do.
+    bool RunPendingTask();
+
+    // Calls f(begin, end) over disjoint subranges covering [first, last), each no
+    // larger than grain.  A grain <= 0 picks one that gives every worker a few chunks.
+    template<typename F>
+    void ParallelForRange(int first, int last, int grain, const F& f);
+
+    // Calls f(i) for every i in [first, last), scheduling grain indices per task.
+    template<typename F>
+    void ParallelFor(int first, int last, int grain, const F& f)
+    {
+        ParallelForRange(first, last, grain, [&f](int begin, int end)
+        {
+            for(int i = begin; i < end; ++i)
+                f(i);
+        });
+    }
+
+private:
+    struct TaskQueue
+    {
+        std::mutex Mutex;
+        std::deque<Task> Tasks;
+    };
+
+    void WorkerLoop(unsigned int index);
+
+    bool PopLocal(unsigned int index, Task& task);
+    bool Steal(unsigned int thiefIndex, Task& task);
+
+    // Index of the calling thread's own queue, or the injection queue for threads
+    // outside the pool.
+    unsigned int CallerQueueIndex()const;
+
+private:
+    // One queue per worker, followed by the injection queue for outside threads.
+    std::vector<std::unique_ptr<TaskQueue>> mQueues;
+    std::vector<std::thread> mThreads;
+
+    // Number of tasks sitting in any queue; lets idle workers sleep.
+    std::atomic<int> mQueuedCount;
+    std::atomic<int> mSleepingCount;
+    std::atomic<bool> mQuit;
+
+    std::mutex mWakeMutex;
+    std::condition_variable mWakeCondition;
+};
+
+///<summary>
+/// A set of tasks that can be waited on as a unit.  Continuations registered with
+/// Then() are queued once every task run so far has finished; they belong to the
+/// group too, so Wait() also waits for them.
+///</summary>
+class TaskGroup
+{
+public:
+    explicit TaskGroup(TaskSystem& taskSystem = TaskSystem::Default());
+    TaskGroup(const TaskGroup& rhs) = delete;
+    TaskGroup& operator=(const TaskGroup& rhs) = delete;
+    ~TaskGroup();
+
+    void Run(TaskSystem::Task task);
+
+    // Queues continuation once the tasks currently in flight complete.  If the group
+    // is already idle the continuation is queued immediately.
+    void Then(TaskSystem::Task continuation);
+
+    // Blocks until all tasks and continuations are done, executing queued work on the
+    // calling thread in the meantime.
+    void Wait();
+
+private:
+    void Launch(TaskSystem::Task task);
+    void Finish();
+
+private:
+    TaskSystem& mTaskSystem;
+
+    std::mutex mMutex;
+    std::atomic<int> mPendingCount;
+    std::vector<TaskSystem::Task> mContinuations;
+};
+
+template<typename F>
+void TaskSystem::ParallelForRange(int first, int last, int grain, const F& f)
+{
+    int count = last - first;
+    if(count <= 0)
+        return;
+
+    if(grain <= 0)
+    {
+        int chunks = 4*((int)WorkerCount() + 1);
+        grain = (count + chunks - 1) / chunks;
+    }
+
+    if(count <= grain || WorkerCount() == 0)
+    {
+        f(first, last);
+        return;
+    }
+
+    // split is declared before group so that it outlives it: if f throws here,
+    // ~TaskGroup waits for the queued halves, which still call split.
+    std::function<void(int, int)> split;
+    TaskGroup group(*this);
+
+    // Split the range in half, hand the upper half to the pool and keep splitting the
+    // lower half.  Thieves therefore pick up large ranges that they split further
+    // themselves, instead of the caller queueing count/grain tiny tasks up front.
+    split = [&](int begin, int end)
+    {
+        while(end - begin > grain)
+        {
+            int mid = begin + (end - begin) / 2;
+            group.Run([&split, mid, end]() { split(mid, end); });
+            end = mid;
+        }
+
+        f(begin, end);
+    };
+
+    split(first, last);
+    group.Wait();
+}
@@ -0,0 +1,453 @@
+//***************************************************************************************
+// Terrain.cpp
+//***************************************************************************************
+
+#include "Terrain.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <numeric>
+
+using namespace DirectX;
+
+namespace
+{
+	// Vertices morph over the last third of their level's range.
+	const float MorphStartRatio = 2.0f / 3.0f;
+
+	// No level's range is less than this many node diagonals.  It keeps the
+	// neighbours of a chunk within one level of it, and the vertices along the edge
+	// of a coarser neighbour from starting to morph themselves.
+	const float MinRangeInDiagonals = 2.0f;
+
+	// Heightfield rows handed to each task when building.
+	const int RowGrain = 16;
+
+	// Same as in Waves: vertex buffers are write-combined upload memory.
+	void StreamFloats(std::uint8_t* dst, const float* src, int count)
+	{
+#if defined(_XM_SSE_INTRINSICS_)
+		for(int k = 0; k < count; ++k)
+			_mm_stream_si32(reinterpret_cast<int*>(dst) + k, _mm_cvtsi128_si32(_mm_castps_si128(_mm_load_ss(src + k))));
+#else
+		std::memcpy(dst, src, count*sizeof(float));
+#endif
+	}
+
+	void StreamFence()
+	{
+#if defined(_XM_SSE_INTRINSICS_)
+		_mm_sfence();
+#endif
+	}
+
+	// Streaming stores write whole floats; -1 leaves an attribute out.
+	bool IsAligned(int offset)
+	{
+		return offset < 0 || offset % 4 == 0;
+	}
+
+	float DistanceSq(FXMVECTOR p, const BoundingBox& box)
+	{
+		XMVECTOR center = XMLoadFloat3(&box.Center);
+		XMVECTOR extents = XMLoadFloat3(&box.Extents);
+		XMVECTOR d = XMVectorMax(XMVectorAbs(p - center) - extents, XMVectorZero());
+		return XMVectorGetX(XMVector3LengthSq(d));
+	}
+
+	void AddGridIndices(std::uint32_t quads, std::vector<std::uint16_t>& indices)
+	{
+		const std::uint32_t n = quads + 1;
+		for(std::uint32_t i = 0; i < quads; ++i)
+		{
+			for(std::uint32_t j = 0; j < quads; ++j)
+			{
+				indices.push_back((std::uint16_t)(i*n + j));
+				indices.push_back((std::uint16_t)(i*n + j + 1));
+				indices.push_back((std::uint16_t)((i + 1)*n + j));
+
+				indices.push_back((std::uint16_t)((i + 1)*n + j));
+				indices.push_back((std::uint16_t)(i*n + j + 1));
+				indices.push_back((std::uint16_t)((i + 1)*n + j + 1));
+			}
+		}
+	}
+}
+
+Terrain::Terrain(Heightfield heightfield, std::uint32_t chunkQuads)
+	: mHeightfield(std::move(heightfield)), mChunkQuads(chunkQuads)
+{
+	assert(chunkQuads >= 4 && chunkQuads <= 128 && (chunkQuads & (chunkQuads - 1)) == 0);
+	assert(mHeightfield.RowCount() >= 2 && mHeightfield.ColumnCount() >= 2);
+
+	const std::uint32_t quadRows = mHeightfield.RowCount() - 1;
+	const std::uint32_t quadCols = mHeightfield.ColumnCount() - 1;
+
+	for(std::uint32_t level = 0; ; ++level)
+	{
+		std::uint32_t nodeQuads = chunkQuads << level;
+
+		Level l;
+		l.Rows = (quadRows + nodeQuads - 1) / nodeQuads;
+		l.Columns = (quadCols + nodeQuads - 1) / nodeQuads;
+		l.HeightRange.resize((std::size_t)l.Rows*l.Columns);
+		mLevels.push_back(std::move(l));
+
+		if(mLevels.back().Rows == 1 && mLevels.back().Columns == 1)
+			break;
+	}
+
+	// Leaves take the range of their samples, edges included, and parents that of
+	// their children.
+	Level& leaves = mLevels[0];
+	TaskSystem::Default().ParallelFor(0, (int)leaves.Rows, 1, [&](int row)
+	{
+		std::uint32_t r0 = row*chunkQuads;
+		std::uint32_t r1 = std::min(r0 + chunkQuads, quadRows);
+		for(std::uint32_t col = 0; col < leaves.Columns; ++col)
+		{
+			std::uint32_t c0 = col*chunkQuads;
+			std::uint32_t c1 = std::min(c0 + chunkQuads, quadCols);
+
+			XMFLOAT2 range(FLT_MAX, -FLT_MAX);
+			for(std::uint32_t r = r0; r <= r1; ++r)
+			{
+				for(std::uint32_t c = c0; c <= c1; ++c)
+				{
+					float h = mHeightfield.Sample(r, c);
+					range.x = std::min(range.x, h);
+					range.y = std::max(range.y, h);
+				}
+			}
+
+			leaves.HeightRange[(std::size_t)row*leaves.Columns + col] = range;
+		}
+	});
+
+	for(std::uint32_t level = 1; level < LevelCount(); ++level)
+	{
+		const Level& children = mLevels[level - 1];
+		Level& parents = mLevels[level];
+		for(std::uint32_t row = 0; row < parents.Rows; ++row)
+		{
+			for(std::uint32_t col = 0; col < parents.Columns; ++col)
+			{
+				XMFLOAT2 range(FLT_MAX, -FLT_MAX);
+				for(std::uint32_t r = 2*row; r < std::min(2*row + 2, children.Rows); ++r)
+				{
+					for(std::uint32_t c = 2*col; c < std::min(2*col + 2, children.Columns); ++c)
+					{
+						const XMFLOAT2& child = children.HeightRange[(std::size_t)r*children.Columns + c];
+						range.x = std::min(range.x, child.x);
+						range.y = std::max(range.y, child.y);
+					}
+				}
+
+				parents.HeightRange[(std::size_t)row*parents.Columns + col] = range;
+			}
+		}
+	}
+
+	ComputeLevelErrors();
+	SetScreenError(0.25f*XM_PI, 800.0f, 2.0f);
+
+	AddGridIndices(chunkQuads, mIndices);
+	AddGridIndices(chunkQuads / 2, mIndices);
+}
+
+void Terrain::ComputeLevelErrors()
+{
+	// The error of a level is the largest difference between a sample and the
+	// level's mesh above it, triangulated as the chunks are.
+	const int quadRows = (int)mHeightfield.RowCount() - 1;
+	const int quadCols = (int)mHeightfield.ColumnCount() - 1;
+	const std::uint32_t levelCount = LevelCount();
+
+	std::mutex mutex;
+	TaskSystem::Default().ParallelForRange(0, quadRows + 1, RowGrain, [&](int begin, int end)
+	{
+		std::vector<float> errors(levelCount, 0.0f);
+		for(int r = begin; r < end; ++r)
+		{
+			for(std::uint32_t level = 1; level < levelCount; ++level)
+			{
+				const int step = 1 << level;
+				const int r0 = r & ~(step - 1);
+				const float fr = (float)(r - r0) / step;
+
+				for(int c = 0; c <= quadCols; ++c)
+				{
+					const int c0 = c & ~(step - 1);
+					const float fc = (float)(c - c0) / step;
+
+					float mesh;
+					if(fr + fc <= 1.0f)
+					{
+						float h00 = mHeightfield.Sample(r0, c0);
+						mesh = h00 + fc*(mHeightfield.Sample(r0, c0 + step) - h00) +
+							fr*(mHeightfield.Sample(r0 + step, c0) - h00);
+					}
+					else
+					{
+						float h11 = mHeightfield.Sample(r0 + step, c0 + step);
+						mesh = h11 + (1.0f - fc)*(mHeightfield.Sample(r0 + step, c0) - h11) +
+							(1.0f - fr)*(mHeightfield.Sample(r0, c0 + step) - h11);
+					}
+
+					errors[level] = std::max(errors[level], fabsf(mHeightfield.Sample(r, c) - mesh));
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for(std::uint32_t level = 1; level < levelCount; ++level)
+			mLevels[level].Error = std::max(mLevels[level].Error, errors[level]);
+	});
+
+	// A coarser level can never be closer than a finer one.
+	for(std::uint32_t level = 1; level < levelCount; ++level)
+		mLevels[level].Error = std::max(mLevels[level].Error, mLevels[level - 1].Error);
+}
+
+void Terrain::SetScreenError(float fovY, float viewportHeight, float maxPixelError)
+{
+	assert(fovY > 0.0f && viewportHeight > 0.0f && maxPixelError > 0.0f);
+
+	// An error e at distance d covers e*k/d pixels.
+	const float k = viewportHeight / (2.0f*tanf(0.5f*fovY));
+
+	const XMFLOAT2& rootRange = mLevels.back().HeightRange[0];
+	const float heightSpan = rootRange.y - rootRange.x;
+
+	float previousRange = 0.0f;
+	for(std::uint32_t level = 0; level < LevelCount(); ++level)
+	{
+		Level& l = mLevels[level];
+		if(level + 1 == LevelCount())
+		{
+			l.Range = FLT_MAX;
+			l.MorphStart = FLT_MAX;
+			break;
+		}
+
+		float nodeSize = (float)(mChunkQuads << level)*mHeightfield.CellSize();
+		float diagonal = sqrtf(2.0f*nodeSize*nodeSize + heightSpan*heightSpan);
+
+		l.Range = std::max(mLevels[level + 1].Error*k / maxPixelError,
+			std::max(2.0f*previousRange, MinRangeInDiagonals*diagonal));
+		l.MorphStart = previousRange + MorphStartRatio*(l.Range - previousRange);
+		previousRange = l.Range;
+	}
+}
+
+BoundingBox Terrain::NodeBounds(std::uint32_t level, std::uint32_t row, std::uint32_t col)const
+{
+	const Level& l = mLevels[level];
+	const XMFLOAT2& heights = l.HeightRange[(std::size_t)row*l.Columns + col];
+
+	const std::uint32_t nodeQuads = mChunkQuads << level;
+	int r0 = row*nodeQuads;
+	int r1 = std::min(r0 + nodeQuads, mHeightfield.RowCount() - 1);
+	int c0 = col*nodeQuads;
+	int c1 = std::min(c0 + nodeQuads, mHeightfield.ColumnCount() - 1);
+
+	float x0 = mHeightfield.X(c0), x1 = mHeightfield.X(c1);
+	float z0 = mHeightfield.Z(r1), z1 = mHeightfield.Z(r0);
+
+	BoundingBox box;
+	box.Center = XMFLOAT3(0.5f*(x0 + x1), 0.5f*(heights.x + heights.y), 0.5f*(z0 + z1));
+	box.Extents = XMFLOAT3(0.5f*(x1 - x0), 0.5f*(heights.y - heights.x), 0.5f*(z1 - z0));
+	return box;
+}
+
+BoundingBox Terrain::Bounds(const Chunk& chunk)const
+{
+	// A chunk covers a whole node, possibly of the level below.
+	std::uint32_t nodeLevel = chunk.QuadCount == mChunkQuads ? chunk.Level : chunk.Level - 1;
+	std::uint32_t nodeQuads = mChunkQuads << nodeLevel;
+	return NodeBounds(nodeLevel, chunk.Row / nodeQuads, chunk.Column / nodeQuads);
+}
+
+void Terrain::AddChunk(const BoundingBox& box, std::uint32_t level, std::uint32_t row, std::uint32_t col,
+	std::uint32_t quads, const BoundingFrustum* frustum, std::vector<Chunk>& chunks)const
+{
+	if(frustum != nullptr && frustum->Contains(box) == DirectX::DISJOINT)
+		return;
+
+	Chunk chunk;
+	chunk.Row = row;
+	chunk.Column = col;
+	chunk.Level = level;
+	chunk.QuadCount = quads;
+	chunk.StartIndex = quads == mChunkQuads ? 0 : 6*mChunkQuads*mChunkQuads;
+	chunk.IndexCount = 6*quads*quads;
+	chunks.push_back(chunk);
+}
+
+bool Terrain::SelectNode(std::uint32_t level, std::uint32_t row, std::uint32_t col, FXMVECTOR eye,
+	const BoundingFrustum* frustum, std::vector<Chunk>& chunks)const
+{
+	const Level& l = mLevels[level];
+	BoundingBox box = NodeBounds(level, row, col);
+	float distanceSq = DistanceSq(eye, box);
+
+	if(level + 1 < LevelCount() && distanceSq > l.Range*l.Range)
+		return false;
+
+	if(frustum != nullptr && frustum->Contains(box) == DirectX::DISJOINT)
+		return true;
+
+	const std::uint32_t nodeQuads = mChunkQuads << level;
+	if(level == 0 || distanceSq > mLevels[level - 1].Range*mLevels[level - 1].Range)
+	{
+		AddChunk(box, level, row*nodeQuads, col*nodeQuads, mChunkQuads, nullptr, chunks);
+		return true;
+	}
+
+	// Children beyond their range are drawn as quarters of this node.
+	const Level& children = mLevels[level - 1];
+	for(std::uint32_t r = 2*row; r < std::min(2*row + 2, children.Rows); ++r)
+	{
+		for(std::uint32_t c = 2*col; c < std::min(2*col + 2, children.Columns); ++c)
+		{
+			if(!SelectNode(level - 1, r, c, eye, frustum, chunks))
+			{
+				AddChunk(NodeBounds(level - 1, r, c), level, r*nodeQuads / 2, c*nodeQuads / 2, mChunkQuads / 2,
+					frustum, chunks);
+			}
+		}
+	}
+
+	return true;
+}
+
+void Terrain::Select(const XMFLOAT3& eyePos, const BoundingFrustum* frustum, Selection& selection,
+	std::uint32_t maxVertices)const
+{
+	XMVECTOR eye = XMLoadFloat3(&eyePos);
+
+	std::vector<Chunk> chunks;
+	SelectNode(LevelCount() - 1, 0, 0, eye, frustum, chunks);
+
+	std::vector<float> keys(chunks.size());
+	for(std::size_t i = 0; i < chunks.size(); ++i)
+	{
+		BoundingBox box = Bounds(chunks[i]);
+		keys[i] = XMVectorGetX(XMVector3LengthSq(eye - XMLoadFloat3(&box.Center)));
+	}
+
+	std::vector<std::uint32_t> order(chunks.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b)
+	{
+		return keys[a] < keys[b] || (keys[a] == keys[b] && a < b);
+	});
+
+	selection.Chunks.clear();
+	selection.VertexCount = 0;
+	selection.TriangleCount = 0;
+	selection.DroppedChunks = 0;
+
+	for(std::uint32_t i : order)
+	{
+		Chunk chunk = chunks[i];
+		std::uint32_t vertexCount = (chunk.QuadCount + 1)*(chunk.QuadCount + 1);
+		if(vertexCount > maxVertices - selection.VertexCount)
+		{
+			++selection.DroppedChunks;
+			continue;
+		}
+
+		chunk.BaseVertex = selection.VertexCount;
+		selection.VertexCount += vertexCount;
+		selection.TriangleCount += 2*chunk.QuadCount*chunk.QuadCount;
+		selection.Chunks.push_back(chunk);
+	}
+}
+
+void Terrain::WriteVertices(const Selection& selection, const XMFLOAT3& eyePos, void* dst,
+	const GeometryGenerator::VertexLayout& layout)const
+{
+	assert(layout.Stride % 4 == 0);
+	assert(IsAligned(layout.PositionOffset) && IsAligned(layout.NormalOffset));
+	assert(IsAligned(layout.TangentOffset) && IsAligned(layout.TexCOffset));
+
+	std::uint8_t* vertices = static_cast<std::uint8_t*>(dst);
+	const int lastRow = (int)mHeightfield.RowCount() - 1;
+	const int lastCol = (int)mHeightfield.ColumnCount() - 1;
+	const float width = mHeightfield.Width();
+	const float depth = mHeightfield.Depth();
+	const float cellSize = mHeightfield.CellSize();
+
+	TaskSystem::Default().ParallelFor(0, (int)selection.Chunks.size(), 1, [&](int index)
+	{
+		const Chunk& chunk = selection.Chunks[index];
+		const Level& l = mLevels[chunk.Level];
+		const bool morphs = chunk.Level + 1 < LevelCount();
+		const float morphScale = morphs ? 1.0f / (l.Range - l.MorphStart) : 0.0f;
+		const int step = 1 << chunk.Level;
+		const int n = chunk.QuadCount + 1;
+
+		std::uint8_t* v = vertices + (std::size_t)chunk.BaseVertex*layout.Stride;
+		for(int i = 0; i < n; ++i)
+		{
+			const int row = chunk.Row + i*step;
+			const int r = std::min(row, lastRow);
+
+			for(int j = 0; j < n; ++j, v += layout.Stride)
+			{
+				const int col = chunk.Column + j*step;
+				const int c = std::min(col, lastCol);
+
+				XMFLOAT3 pos(mHeightfield.X(c), mHeightfield.Sample(r, c), mHeightfield.Z(r));
+
+				// Odd vertices move onto the edges of the coarser level's triangles.
+				if(morphs && ((i | j) & 1))
+				{
+					float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&pos) - XMLoadFloat3(&eyePos)));
+					float t = std::min(std::max((distance - l.MorphStart)*morphScale, 0.0f), 1.0f);
+					if(t > 0.0f)
+					{
+						float coarse;
+						if((i & 1) && (j & 1))
+							coarse = 0.5f*(mHeightfield.Sample(r - step, c + step) + mHeightfield.Sample(r + step, c - step));
+						else if(i & 1)
+							coarse = 0.5f*(mHeightfield.Sample(r - step, c) + mHeightfield.Sample(r + step, c));
+						else
+							coarse = 0.5f*(mHeightfield.Sample(r, c - step) + mHeightfield.Sample(r, c + step));
+
+						pos.y += t*(coarse - pos.y);
+					}
+				}
+
+				if(layout.PositionOffset >= 0)
+					StreamFloats(v + layout.PositionOffset, &pos.x, 3);
+
+				if(layout.NormalOffset >= 0)
+				{
+					XMFLOAT3 normal = mHeightfield.SampleNormal(r, c);
+					StreamFloats(v + layout.NormalOffset, &normal.x, 3);
+				}
+
+				if(layout.TangentOffset >= 0)
+				{
+					XMFLOAT3 tangent;
+					XMStoreFloat3(&tangent, XMVector3Normalize(XMVectorSet(2.0f*cellSize,
+						mHeightfield.Sample(r, c + 1) - mHeightfield.Sample(r, c - 1), 0.0f, 0.0f)));
+					StreamFloats(v + layout.TangentOffset, &tangent.x, 3);
+				}
+
+				if(layout.TexCOffset >= 0)
+				{
+					float texC[2] = { 0.5f + pos.x / width, 0.5f - pos.z / depth };
+					StreamFloats(v + layout.TexCOffset, texC, 2);
+				}
+			}
+		}
+
+		StreamFence();
+	});
+}
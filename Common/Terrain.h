@@ -0,0 +1,163 @@
+//***************************************************************************************
+// Terrain.h
+//
+// Draws a Heightfield of any size with a roughly constant number of triangles per
+// view, using a chunked quadtree in the manner of CDLOD (Strugar, "Continuous
+// Distance-Dependent Level of Detail for Rendering Heightmaps").
+//
+// A node at level L covers ChunkQuads << L quads of the heightfield and is drawn
+// as a ChunkQuads x ChunkQuads grid taking every (1 << L)th sample.  Each level has
+// a range, derived from its geometric error and the allowed error in pixels, and
+// Select walks the tree from the root, splitting nodes closer to the eye than the
+// range of the level below them and skipping those outside the view frustum.
+//
+// Vertices morph smoothly into the next coarser level as they approach the end of
+// their level's range, so the odd vertices along the edge between two levels sit
+// exactly on the coarser neighbour's edges: there are no cracks and no popping.
+// As with Waves, the CPU writes the selected chunks into a per-frame upload buffer;
+// every chunk draws with the same small 16-bit index buffer.
+//
+// Heightfields of (ChunkQuads << k) + 1 samples on a side fit the tree exactly.
+// Others work too, with the vertices of the nodes that hang over the far edges
+// clamped onto them.
+//***************************************************************************************
+
+#pragma once
+
+#include "GeometryGenerator.h"
+#include "Heightfield.h"
+#include <DirectXCollision.h>
+#include <cstdint>
+#include <vector>
+
+class Terrain
+{
+public:
+	static const std::uint32_t DefaultChunkQuads = 32;
+
+	struct Chunk
+	{
+		// The sample of the chunk's first vertex, and the level, whose vertices are
+		// 1 << Level samples apart.
+		std::uint32_t Row = 0;
+		std::uint32_t Column = 0;
+		std::uint32_t Level = 0;
+
+		// ChunkQuads, or half of it for a quarter of a node whose other quarters are
+		// drawn at a finer level.
+		std::uint32_t QuadCount = 0;
+
+		// Where WriteVertices puts the chunk's vertices, and the part of Indices() it
+		// draws with; pass BaseVertex as the BaseVertexLocation.
+		std::uint32_t BaseVertex = 0;
+		std::uint32_t StartIndex = 0;
+		std::uint32_t IndexCount = 0;
+	};
+
+	struct Selection
+	{
+		// Nearest first.
+		std::vector<Chunk> Chunks;
+
+		std::uint32_t VertexCount = 0;
+		std::uint32_t TriangleCount = 0;
+
+		// Chunks in view that were left out to keep within the vertex budget.
+		std::uint32_t DroppedChunks = 0;
+	};
+
+	///<summary>
+	/// Builds the quadtree over heightfield: the height range of every node and the
+	/// error of every level, in parallel.  chunkQuads must be a power of two from 4
+	/// to 128.  The ranges are set for a 45 degree field of view, an 800 pixel high
+	/// viewport and 2 pixels of error until SetScreenError is called.
+	///</summary>
+	explicit Terrain(Heightfield heightfield, std::uint32_t chunkQuads = DefaultChunkQuads);
+
+	const Heightfield& GetHeightfield()const { return mHeightfield; }
+	float HeightAt(float x, float z)const { return mHeightfield.HeightAt(x, z); }
+	DirectX::XMFLOAT3 NormalAt(float x, float z)const { return mHeightfield.NormalAt(x, z); }
+
+	///<summary>
+	/// Sets the level ranges so that no level is used where its error would cover
+	/// more than maxPixelError pixels on a viewport viewportHeight pixels high.
+	///</summary>
+	void SetScreenError(float fovY, float viewportHeight, float maxPixelError);
+
+	std::uint32_t ChunkQuads()const { return mChunkQuads; }
+	std::uint32_t LevelCount()const { return (std::uint32_t)mLevels.size(); }
+
+	// Largest vertical distance between the heightfield and the mesh of a level.
+	float LevelError(std::uint32_t level)const { return mLevels[level].Error; }
+
+	// Distance from the eye up to which a level is used; infinite for the root.
+	float LevelRange(std::uint32_t level)const { return mLevels[level].Range; }
+
+	///<summary>
+	/// The index list every chunk draws with: a full chunk's grid followed by a half
+	/// chunk's, with the triangles of GeometryGenerator::CreateGrid.
+	///</summary>
+	const std::vector<std::uint16_t>& Indices()const { return mIndices; }
+
+	std::uint32_t ChunkVertexCount()const { return (mChunkQuads + 1)*(mChunkQuads + 1); }
+
+	// Vertices in a selection of every leaf, which no selection exceeds; enough for a
+	// vertex buffer that never drops chunks.
+	std::uint32_t MaxVertexCount()const { return mLevels[0].Rows*mLevels[0].Columns*ChunkVertexCount(); }
+
+	///<summary>
+	/// Chooses the chunks to draw from eyePos, culled against frustum unless it is
+	/// null.  Chunks past maxVertices are dropped, farthest first.
+	///</summary>
+	void Select(const DirectX::XMFLOAT3& eyePos, const DirectX::BoundingFrustum* frustum, Selection& selection,
+		std::uint32_t maxVertices = UINT32_MAX)const;
+
+	DirectX::BoundingBox Bounds(const Chunk& chunk)const;
+
+	///<summary>
+	/// Writes the selection's VertexCount vertices, morphed for eyePos, in parallel.
+	/// Texture coordinates map the whole heightfield to [0,1] and the tangent follows
+	/// +x.  As with Waves::WriteVertices, the vertices are written with streaming
+	/// stores and never read, so dst can be a mapped upload buffer.
+	///</summary>
+	void WriteVertices(const Selection& selection, const DirectX::XMFLOAT3& eyePos, void* dst,
+		const GeometryGenerator::VertexLayout& layout)const;
+
+private:
+	struct Level
+	{
+		// Nodes on each side.
+		std::uint32_t Rows = 0;
+		std::uint32_t Columns = 0;
+
+		// Lowest and highest sample under each node.
+		std::vector<DirectX::XMFLOAT2> HeightRange;
+
+		float Error = 0.0f;
+		float Range = 0.0f;
+
+		// Vertices morph from this distance to Range.
+		float MorphStart = 0.0f;
+	};
+
+	// Bounds of node (row, col) of a level.
+	DirectX::BoundingBox NodeBounds(std::uint32_t level, std::uint32_t row, std::uint32_t col)const;
+
+	// Returns false if the node is beyond its level's range, so that its parent has
+	// to cover it.
+	bool SelectNode(std::uint32_t level, std::uint32_t row, std::uint32_t col, DirectX::FXMVECTOR eye,
+		const DirectX::BoundingFrustum* frustum, std::vector<Chunk>& chunks)const;
+
+	// Adds the chunk at a sample unless box is outside the frustum.
+	void AddChunk(const DirectX::BoundingBox& box, std::uint32_t level, std::uint32_t row, std::uint32_t col,
+		std::uint32_t quads, const DirectX::BoundingFrustum* frustum, std::vector<Chunk>& chunks)const;
+
+	void ComputeLevelErrors();
+
+private:
+	Heightfield mHeightfield;
+	std::uint32_t mChunkQuads = DefaultChunkQuads;
+
+	std::vector<Level> mLevels;
+	std::vector<std::uint16_t> mIndices;
+};
@@ -0,0 +1,396 @@
+//***************************************************************************************
+// TextScanner.cpp
+//***************************************************************************************
+
+#include "TextScanner.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#if (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)) && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+// Set when std::from_chars converts floats, not just integers.
+#if defined(__cpp_lib_to_chars)
+#define TEXT_SCANNER_FROM_CHARS 1
+#else
+#define TEXT_SCANNER_FROM_CHARS 0
+#endif
+
+namespace
+{
+	bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	// Longest number token converted; far longer than any float needs.
+	const std::size_t MaxNumberLength = 63;
+
+#if !TEXT_SCANNER_FROM_CHARS
+	// Every power of ten up to 10^10 is exact in a float.
+	const float ExactPowersOf10[] =
+	{
+		1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+	};
+
+	const std::uint64_t MaxExactMantissa = 1 << 24;
+#endif
+}
+
+TextScanner::TextScanner(const char* text, std::size_t size) :
+	mPos(text),
+	mEnd(text + size)
+{
+}
+
+bool TextScanner::Next(const char*& token, std::size_t& length)
+{
+	if(mFailed)
+		return false;
+
+	SkipSpace();
+
+	token = mPos;
+	while(mPos != mEnd && !IsSpace(*mPos))
+		++mPos;
+
+	length = mPos - token;
+	mTokenLine = mLine;
+
+	if(length == 0)
+	{
+		Fail("unexpected end of file");
+		return false;
+	}
+
+	return true;
+}
+
+bool TextScanner::Skip(std::uint32_t count)
+{
+	const char* token;
+	std::size_t length;
+	for(std::uint32_t i = 0; i < count; ++i)
+	{
+		if(!Next(token, length))
+			return false;
+	}
+
+	return true;
+}
+
+void TextScanner::SkipSpace()
+{
+	while(mPos != mEnd && IsSpace(*mPos))
+	{
+		if(*mPos == '\n')
+			++mLine;
+		++mPos;
+	}
+}
+
+bool TextScanner::SkipLines(std::uint64_t count)
+{
+	if(mFailed)
+		return false;
+
+	for(std::uint64_t i = 0; i < count; ++i)
+	{
+		const char* newline = (const char*)std::memchr(mPos, '\n', mEnd - mPos);
+		if(newline == nullptr)
+		{
+			mPos = mEnd;
+			mTokenLine = mLine;
+			Fail("unexpected end of file");
+			return false;
+		}
+
+		mPos = newline + 1;
+		++mLine;
+	}
+
+	return true;
+}
+
+bool TextScanner::Expect(const char* label)
+{
+	const char* token;
+	std::size_t length;
+	if(!Next(token, length))
+		return false;
+
+	if(length != std::strlen(label) || std::memcmp(token, label, length) != 0)
+	{
+		std::string message = std::string("expected ") + label + ", found";
+		Fail(message.c_str(), token, length);
+		return false;
+	}
+
+	return true;
+}
+
+bool TextScanner::Read(float& value)
+{
+	const char* token;
+	std::size_t length;
+	if(!Next(token, length))
+		return false;
+
+	if(ParseFloat(token, token + length, value) != token + length)
+	{
+		Fail("expected a number, found", token, length);
+		return false;
+	}
+
+	return true;
+}
+
+bool TextScanner::Read(float* values, std::uint32_t count)
+{
+	for(std::uint32_t i = 0; i < count; ++i)
+	{
+		if(!Read(values[i]))
+			return false;
+	}
+
+	return true;
+}
+
+bool TextScanner::Read(std::int32_t& value)
+{
+	const char* token;
+	std::size_t length;
+	if(!Next(token, length))
+		return false;
+
+	bool negative = token[0] == '-';
+	std::size_t i = (token[0] == '-' || token[0] == '+') ? 1 : 0;
+
+	std::int64_t v = 0;
+	bool ok = i < length;
+	for(; ok && i < length; ++i)
+	{
+		ok = IsDigit(token[i]);
+		v = v * 10 + (token[i] - '0');
+		ok = ok && v <= (std::int64_t)INT32_MAX + 1;
+	}
+
+	if(negative)
+		v = -v;
+
+	if(!ok || v > INT32_MAX)
+	{
+		Fail("expected an integer, found", token, length);
+		return false;
+	}
+
+	value = (std::int32_t)v;
+	return true;
+}
+
+bool TextScanner::Read(std::uint32_t& value)
+{
+	const char* token;
+	std::size_t length;
+	if(!Next(token, length))
+		return false;
+
+	std::uint64_t v = 0;
+	bool ok = true;
+	for(std::size_t i = 0; ok && i < length; ++i)
+	{
+		ok = IsDigit(token[i]);
+		v = v * 10 + (token[i] - '0');
+		ok = ok && v <= UINT32_MAX;
+	}
+
+	if(!ok)
+	{
+		Fail("expected an unsigned integer, found", token, length);
+		return false;
+	}
+
+	value = (std::uint32_t)v;
+	return true;
+}
+
+bool TextScanner::Read(bool& value)
+{
+	const char* token;
+	std::size_t length;
+	if(!Next(token, length))
+		return false;
+
+	if(length != 1 || (token[0] != '0' && token[0] != '1'))
+	{
+		Fail("expected 0 or 1, found", token, length);
+		return false;
+	}
+
+	value = token[0] == '1';
+	return true;
+}
+
+bool TextScanner::Read(std::string& value)
+{
+	const char* token;
+	std::size_t length;
+	if(!Next(token, length))
+		return false;
+
+	value.assign(token, length);
+	return true;
+}
+
+bool TextScanner::CheckCount(std::uint64_t count, std::size_t bytesPerItem)
+{
+	if(mFailed)
+		return false;
+
+	if(bytesPerItem > 0 && count > (std::uint64_t)(mEnd - mPos) / bytesPerItem)
+	{
+		std::string message = "count of " + std::to_string(count) + " is more than the rest of the file can hold";
+		Fail(message.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void TextScanner::Fail(const char* message, const char* token, std::size_t length)
+{
+	if(mFailed)
+		return;
+
+	mFailed = true;
+
+	mError = "line " + std::to_string(mTokenLine) + ": " + message;
+	if(token != nullptr)
+	{
+		const std::size_t maxShown = 32;
+		mError += " \"" + std::string(token, length < maxShown ? length : maxShown) + (length > maxShown ? "...\"" : "\"");
+	}
+}
+
+const char* TextScanner::ParseFloat(const char* first, const char* last, float& value)
+{
+	// from_chars takes no leading plus; an ifstream does.
+	const char* start = first;
+	if(last - start > 1 && start[0] == '+' && start[1] != '-' && start[1] != '+')
+		++start;
+
+#if TEXT_SCANNER_FROM_CHARS
+	std::from_chars_result result = std::from_chars(start, last, value);
+	return result.ec == std::errc() ? result.ptr : first;
+#else
+	const char* p = start;
+
+	bool negative = p != last && *p == '-';
+	if(negative)
+		++p;
+
+	// Up to 19 significant digits of the mantissa, and the power of ten it is
+	// scaled by.
+	std::uint64_t mantissa = 0;
+	int significant = 0;
+	int exponent = 0;
+	bool anyDigits = false;
+	bool truncated = false;
+
+	for(; p != last && IsDigit(*p); ++p)
+	{
+		anyDigits = true;
+		if(significant < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			significant += mantissa != 0;
+		}
+		else
+		{
+			++exponent;
+			truncated |= *p != '0';
+		}
+	}
+
+	if(p != last && *p == '.')
+	{
+		++p;
+		for(; p != last && IsDigit(*p); ++p)
+		{
+			anyDigits = true;
+			if(significant < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				significant += mantissa != 0;
+				--exponent;
+			}
+			else
+			{
+				truncated |= *p != '0';
+			}
+		}
+	}
+
+	if(!anyDigits)
+		return first;
+
+	// An exponent without digits is not part of the number.
+	if(p != last && (*p == 'e' || *p == 'E'))
+	{
+		const char* e = p + 1;
+		bool negativeExponent = e != last && *e == '-';
+		if(e != last && (*e == '-' || *e == '+'))
+			++e;
+
+		if(e != last && IsDigit(*e))
+		{
+			int written = 0;
+			for(; e != last && IsDigit(*e); ++e)
+			{
+				if(written < 100000)
+					written = written * 10 + (*e - '0');
+			}
+
+			exponent += negativeExponent ? -written : written;
+			p = e;
+		}
+	}
+
+	// A mantissa and a power of ten that are both exact in a float give a correctly
+	// rounded result with a single operation.
+	if(!truncated && mantissa <= MaxExactMantissa && exponent >= -10 && exponent <= 10)
+	{
+		float f = (float)mantissa;
+		f = exponent < 0 ? f / ExactPowersOf10[-exponent] : f * ExactPowersOf10[exponent];
+		value = negative ? -f : f;
+		return p;
+	}
+
+	std::size_t length = p - start;
+	if(length > MaxNumberLength)
+		return first;
+
+	char buffer[MaxNumberLength + 1];
+	std::memcpy(buffer, start, length);
+	buffer[length] = '\0';
+
+	// Overflow and underflow fail, as they do with from_chars.
+	char* end = nullptr;
+	errno = 0;
+	float f = std::strtof(buffer, &end);
+	if(end != buffer + length || errno == ERANGE)
+		return first;
+
+	value = f;
+	return p;
+#endif
+}
@@ -0,0 +1,101 @@
+//***************************************************************************************
+// TextScanner.h
+//
+// Reads whitespace separated tokens and numbers out of a block of text, such as a
+// MappedFile, for the book's text model formats.  Unlike reading them with an
+// ifstream it allocates nothing (other than for the strings asked for), is not
+// slowed down by locales, and keeps track of the line it is on, so malformed input
+// is reported with where it is rather than leaving the rest of the values zero.
+//
+// Numbers are converted with std::from_chars where the standard library has it
+// for floats; otherwise the common case of up to seven significant digits and a
+// small exponent is converted exactly with one float multiply or divide, and the
+// rest with strtof.  Both round correctly, so every path gives the same floats.
+//
+// Errors are sticky: once a read fails, every read after it fails too, so a whole
+// section can be read before checking Failed().
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class TextScanner
+{
+public:
+	// The text need not be null terminated.
+	TextScanner(const char* text, std::size_t size);
+
+	///<summary>
+	/// The next token, which points into the text.  Fails at the end of the text.
+	///</summary>
+	bool Next(const char*& token, std::size_t& length);
+
+	bool Skip(std::uint32_t count = 1);
+
+	// Skips whitespace, so that Position() is at the next token.
+	void SkipSpace();
+
+	///<summary>
+	/// Moves to the start of the count-th line after the current one, without
+	/// looking at what is on the lines skipped.  Fails at the end of the text.
+	///</summary>
+	bool SkipLines(std::uint64_t count);
+
+	///<summary>
+	/// Reads a token that has to be label, such as "VertexCount:".
+	///</summary>
+	bool Expect(const char* label);
+
+	bool Read(float& value);
+	bool Read(float* values, std::uint32_t count);
+	bool Read(std::int32_t& value);
+	bool Read(std::uint32_t& value);
+
+	// 0 or 1, as an ifstream reads a bool.
+	bool Read(bool& value);
+
+	bool Read(std::string& value);
+
+	///<summary>
+	/// Fails unless count items of at least bytesPerItem bytes each could fit in the
+	/// rest of the text, so that a corrupt count does not lead to a huge allocation.
+	///</summary>
+	bool CheckCount(std::uint64_t count, std::size_t bytesPerItem);
+
+	///<summary>
+	/// Fails at the line of the last token, with a message such as "expected a
+	/// number" followed by the token, if there is one.
+	///</summary>
+	void Fail(const char* message, const char* token = nullptr, std::size_t length = 0);
+
+	bool Failed()const { return mFailed; }
+
+	// "line n: message" for the first failure.
+	const std::string& Error()const { return mError; }
+
+	// The line, counting from 1, of the last token read.
+	std::uint32_t Line()const { return mTokenLine; }
+
+	// Where the next read starts, and the line that is on.
+	const char* Position()const { return mPos; }
+	std::uint32_t PositionLine()const { return mLine; }
+
+	///<summary>
+	/// Converts the number at the start of [first, last) as std::from_chars does,
+	/// returning the character after it, or first if there is no number there.
+	///</summary>
+	static const char* ParseFloat(const char* first, const char* last, float& value);
+
+private:
+	const char* mPos;
+	const char* mEnd;
+
+	std::uint32_t mLine = 1;
+	std::uint32_t mTokenLine = 1;
+
+	bool mFailed = false;
+	std::string mError;
+};
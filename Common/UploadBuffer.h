@@ -50,6 +50,13 @@ public:
         return mUploadBuffer.Get();
     }
 
+    // Start of the persistently mapped memory, for filling the buffer in place.  The
+    // memory is write-combined: write it sequentially and never read it back.
+    void* MappedData()const
+    {
+        return mMappedData;
+    }
+
     void CopyData(int elementIndex, const T& data)
     {
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
@@ -0,0 +1,309 @@
+//***************************************************************************************
+// VertexCompression.cpp
+//***************************************************************************************
+
+#include "VertexCompression.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+// Measured over every direction the encoding can represent, with a little margin.
+const float VertexCompression::MaxUnitVectorError = 5.0e-5f;
+
+const float VertexCompression::MaxBoneWeightError = 1.0f / 255.0f;
+
+const float VertexCompression::MaxTexCRelativeError = 1.0f / 2048.0f;
+
+namespace
+{
+	// Positions are never quantised to a box thinner than this on any axis.
+	const float MinExtent = 1.0e-6f;
+
+	float SignNotZero(float x)
+	{
+		return x >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	// Decodes snorm16 the way the input assembler does.
+	float SnormToFloat(std::int16_t s)
+	{
+		return std::max(s / 32767.0f, -1.0f);
+	}
+
+	std::int16_t FloatToSnorm(float f)
+	{
+		return (std::int16_t)std::lround(std::min(std::max(f, -1.0f), 1.0f)*32767.0f);
+	}
+
+	XMVECTOR DecodeOctahedral(float x, float y)
+	{
+		float z = 1.0f - fabsf(x) - fabsf(y);
+		if(z < 0.0f)
+		{
+			float ox = x;
+			x = (1.0f - fabsf(y))*SignNotZero(ox);
+			y = (1.0f - fabsf(ox))*SignNotZero(y);
+		}
+
+		return XMVector3Normalize(XMVectorSet(x, y, z, 0.0f));
+	}
+
+	XMVECTOR LoadFloat3(const void* vertex, int offset)
+	{
+		if(offset < 0)
+			return XMVectorZero();
+
+		XMFLOAT3 f;
+		std::memcpy(&f, static_cast<const std::uint8_t*>(vertex) + offset, sizeof(f));
+		return XMLoadFloat3(&f);
+	}
+
+	float LoadFloat(const void* vertex, int offset, float missing)
+	{
+		float f = missing;
+		if(offset >= 0)
+			std::memcpy(&f, static_cast<const std::uint8_t*>(vertex) + offset, sizeof(f));
+		return f;
+	}
+
+	XMFLOAT2 LoadFloat2(const void* vertex, int offset)
+	{
+		XMFLOAT2 f(0.0f, 0.0f);
+		if(offset >= 0)
+			std::memcpy(&f, static_cast<const std::uint8_t*>(vertex) + offset, sizeof(f));
+		return f;
+	}
+
+	template<typename CompressedVertex>
+	void CompressCommon(const void* vertex, const VertexCompression::SourceLayout& layout,
+		const BoundingBox& bounds, CompressedVertex& out)
+	{
+		out.Position = VertexCompression::EncodePosition(LoadFloat3(vertex, layout.PositionOffset), bounds,
+			LoadFloat(vertex, layout.TangentSignOffset, 1.0f));
+		out.Normal = VertexCompression::EncodeUnitVector(LoadFloat3(vertex, layout.NormalOffset));
+		out.TangentU = VertexCompression::EncodeUnitVector(LoadFloat3(vertex, layout.TangentOffset));
+
+		XMFLOAT2 texC = LoadFloat2(vertex, layout.TexCOffset);
+		out.TexC.x = XMConvertFloatToHalf(texC.x);
+		out.TexC.y = XMConvertFloatToHalf(texC.y);
+	}
+}
+
+XMFLOAT3 VertexCompression::MaxPositionError(const BoundingBox& bounds)
+{
+	// Half a quantisation step of 2*Extents/65535.
+	return XMFLOAT3(bounds.Extents.x / 65535.0f, bounds.Extents.y / 65535.0f, bounds.Extents.z / 65535.0f);
+}
+
+XMSHORTN2 VertexCompression::EncodeUnitVector(FXMVECTOR v)
+{
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, v);
+
+	XMSHORTN2 e;
+	e.x = 0;
+	e.y = 0;
+
+	float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if(l1 <= 0.0f)
+		return e;
+
+	// Project onto the octahedron and fold the lower half over the upper.
+	float x = n.x / l1;
+	float y = n.y / l1;
+	if(n.z < 0.0f)
+	{
+		float ox = x;
+		x = (1.0f - fabsf(y))*SignNotZero(ox);
+		y = (1.0f - fabsf(ox))*SignNotZero(y);
+	}
+
+	// Rounding each component on its own is not always closest once decoded, so
+	// try both neighbours on each axis and keep the best.  Candidates are compared
+	// by distance rather than by dot product, which is too close to one to tell
+	// them apart in single precision.
+	XMVECTOR unit = XMVector3Normalize(v);
+	float bestDistSq = FLT_MAX;
+
+	float fx = floorf(x*32767.0f);
+	float fy = floorf(y*32767.0f);
+	for(int i = 0; i < 2; ++i)
+	{
+		for(int j = 0; j < 2; ++j)
+		{
+			std::int16_t sx = FloatToSnorm((fx + i) / 32767.0f);
+			std::int16_t sy = FloatToSnorm((fy + j) / 32767.0f);
+
+			float distSq = XMVectorGetX(XMVector3LengthSq(unit - DecodeOctahedral(SnormToFloat(sx), SnormToFloat(sy))));
+			if(distSq < bestDistSq)
+			{
+				bestDistSq = distSq;
+				e.x = sx;
+				e.y = sy;
+			}
+		}
+	}
+
+	return e;
+}
+
+XMVECTOR VertexCompression::DecodeUnitVector(XMSHORTN2 e)
+{
+	return DecodeOctahedral(SnormToFloat(e.x), SnormToFloat(e.y));
+}
+
+XMUSHORTN4 VertexCompression::EncodePosition(FXMVECTOR p, const BoundingBox& bounds, float tangentSign)
+{
+	XMVECTOR center = XMLoadFloat3(&bounds.Center);
+	XMVECTOR extents = XMLoadFloat3(&bounds.Extents);
+
+	XMFLOAT3 u;
+	XMStoreFloat3(&u, (p - center + extents) / (2.0f*extents));
+
+	auto quantize = [](float f)
+	{
+		return (std::uint16_t)std::lround(std::min(std::max(f, 0.0f), 1.0f)*65535.0f);
+	};
+
+	XMUSHORTN4 e;
+	e.x = quantize(u.x);
+	e.y = quantize(u.y);
+	e.z = quantize(u.z);
+	e.w = tangentSign >= 0.0f ? 65535 : 0;
+	return e;
+}
+
+XMVECTOR VertexCompression::DecodePosition(XMUSHORTN4 e, const BoundingBox& bounds)
+{
+	XMVECTOR u = XMVectorSet(e.x / 65535.0f, e.y / 65535.0f, e.z / 65535.0f, 1.0f);
+	return XMVector3Transform(u, PositionDecodeTransform(bounds));
+}
+
+float VertexCompression::DecodeTangentSign(XMUSHORTN4 e)
+{
+	return 2.0f*(e.w / 65535.0f) - 1.0f;
+}
+
+XMMATRIX VertexCompression::PositionDecodeTransform(const BoundingBox& bounds)
+{
+	const XMFLOAT3& c = bounds.Center;
+	const XMFLOAT3& e = bounds.Extents;
+
+	return XMMatrixScaling(2.0f*e.x, 2.0f*e.y, 2.0f*e.z)*
+		XMMatrixTranslation(c.x - e.x, c.y - e.y, c.z - e.z);
+}
+
+XMUBYTEN4 VertexCompression::EncodeBoneWeights(const XMFLOAT3& weights)
+{
+	float w[4] = { weights.x, weights.y, weights.z, 1.0f - weights.x - weights.y - weights.z };
+
+	// Round down, then give the units left over to the weights that lost the most,
+	// so the sum is exactly 255 and no weight is off by a whole unit.
+	int q[4];
+	float remainder[4];
+	int sum = 0;
+	for(int i = 0; i < 4; ++i)
+	{
+		float scaled = std::min(std::max(w[i], 0.0f), 1.0f)*255.0f;
+		q[i] = (int)scaled;
+		remainder[i] = scaled - q[i];
+		sum += q[i];
+	}
+
+	while(sum < 255)
+	{
+		int largest = (int)(std::max_element(remainder, remainder + 4) - remainder);
+		++q[largest];
+		remainder[largest] = -1.0f;
+		++sum;
+	}
+
+	// Only weights that were clamped can push the sum over.
+	while(sum > 255)
+	{
+		int largest = (int)(std::max_element(q, q + 4) - q);
+		--q[largest];
+		--sum;
+	}
+
+	XMUBYTEN4 e;
+	e.x = (std::uint8_t)q[0];
+	e.y = (std::uint8_t)q[1];
+	e.z = (std::uint8_t)q[2];
+	e.w = (std::uint8_t)q[3];
+	return e;
+}
+
+XMFLOAT4 VertexCompression::DecodeBoneWeights(XMUBYTEN4 e)
+{
+	return XMFLOAT4(e.x / 255.0f, e.y / 255.0f, e.z / 255.0f, e.w / 255.0f);
+}
+
+BoundingBox VertexCompression::ComputeBounds(const void* vertices, const SourceLayout& layout, std::uint32_t vertexCount)
+{
+	BoundingBox bounds;
+	if(vertexCount == 0)
+		return bounds;
+
+	BoundingBox::CreateFromPoints(bounds, vertexCount,
+		reinterpret_cast<const XMFLOAT3*>(static_cast<const std::uint8_t*>(vertices) + layout.PositionOffset),
+		layout.Stride);
+
+	bounds.Extents.x = std::max(bounds.Extents.x, MinExtent);
+	bounds.Extents.y = std::max(bounds.Extents.y, MinExtent);
+	bounds.Extents.z = std::max(bounds.Extents.z, MinExtent);
+	return bounds;
+}
+
+void VertexCompression::Compress(const void* vertices, const SourceLayout& layout, std::uint32_t vertexCount,
+	const BoundingBox& bounds, Vertex* out)
+{
+	for(std::uint32_t i = 0; i < vertexCount; ++i)
+	{
+		const void* vertex = static_cast<const std::uint8_t*>(vertices) + (std::size_t)i*layout.Stride;
+		CompressCommon(vertex, layout, bounds, out[i]);
+	}
+}
+
+void VertexCompression::Compress(const void* vertices, const SourceLayout& layout, std::uint32_t vertexCount,
+	const BoundingBox& bounds, SkinnedVertex* out)
+{
+	for(std::uint32_t i = 0; i < vertexCount; ++i)
+	{
+		const std::uint8_t* vertex = static_cast<const std::uint8_t*>(vertices) + (std::size_t)i*layout.Stride;
+		CompressCommon(vertex, layout, bounds, out[i]);
+
+		// Without weights everything goes to the first bone.
+		XMFLOAT3 weights(1.0f, 0.0f, 0.0f);
+		if(layout.BoneWeightsOffset >= 0)
+			std::memcpy(&weights, vertex + layout.BoneWeightsOffset, sizeof(weights));
+		out[i].BoneWeights = EncodeBoneWeights(weights);
+
+		std::memset(out[i].BoneIndices, 0, sizeof(out[i].BoneIndices));
+		if(layout.BoneIndicesOffset >= 0)
+			std::memcpy(out[i].BoneIndices, vertex + layout.BoneIndicesOffset, sizeof(out[i].BoneIndices));
+	}
+}
+
+BoundingBox VertexCompression::Compress(const GeometryGenerator::MeshData& meshData, std::vector<Vertex>& out)
+{
+	SourceLayout layout;
+	layout.Stride = sizeof(GeometryGenerator::Vertex);
+	layout.PositionOffset = offsetof(GeometryGenerator::Vertex, Position);
+	layout.NormalOffset = offsetof(GeometryGenerator::Vertex, Normal);
+	layout.TangentOffset = offsetof(GeometryGenerator::Vertex, TangentU);
+	layout.TexCOffset = offsetof(GeometryGenerator::Vertex, TexC);
+
+	const std::uint32_t vertexCount = (std::uint32_t)meshData.Vertices.size();
+	BoundingBox bounds = ComputeBounds(meshData.Vertices.data(), layout, vertexCount);
+
+	out.resize(vertexCount);
+	Compress(meshData.Vertices.data(), layout, vertexCount, bounds, out.data());
+
+	return bounds;
+}
@@ -0,0 +1,132 @@
+//***************************************************************************************
+// VertexCompression.h
+//
+// Compact vertex formats and the functions that encode and decode them:
+//
+//   - Positions are quantised to 16-bit unorm within the mesh's bounding box.
+//     PositionDecodeTransform gives the matrix that maps them back to model space,
+//     so it can be folded into the world matrix.
+//   - Normals and tangents are octahedral encoded (Meyer et al., "On Floating-Point
+//     Normal Vectors") into two 16-bit snorms.  The handedness of the tangent frame,
+//     the w of an M3D tangent, goes in the w of the position.
+//   - Texture coordinates are stored as halfs.
+//   - Bone weights are stored as 8-bit unorms that still sum to exactly one.
+//
+// Vertex is 20 bytes against the 44 of GeometryGenerator::Vertex, and
+// SkinnedVertex is 28 against the 64 of M3DLoader::SkinnedVertex.  The Max*Error
+// constants bound what a round trip loses.
+//***************************************************************************************
+
+#pragma once
+
+#include "GeometryGenerator.h"
+#include <DirectXCollision.h>
+#include <DirectXPackedVector.h>
+#include <cstdint>
+#include <vector>
+
+class VertexCompression
+{
+public:
+	// In both formats Position.w is 1 where the tangent's sign is +1 and 0 where it
+	// is -1.  The shader takes the sign as 2*w - 1 and transforms (x, y, z, 1).
+	struct Vertex
+	{
+		DirectX::PackedVector::XMUSHORTN4 Position;
+		DirectX::PackedVector::XMSHORTN2 Normal;
+		DirectX::PackedVector::XMSHORTN2 TangentU;
+		DirectX::PackedVector::XMHALF2 TexC;
+	};
+
+	struct SkinnedVertex
+	{
+		DirectX::PackedVector::XMUSHORTN4 Position;
+		DirectX::PackedVector::XMSHORTN2 Normal;
+		DirectX::PackedVector::XMSHORTN2 TangentU;
+		DirectX::PackedVector::XMHALF2 TexC;
+
+		// All four weights; they sum to 255.
+		DirectX::PackedVector::XMUBYTEN4 BoneWeights;
+		std::uint8_t BoneIndices[4];
+	};
+
+	///<summary>
+	/// Describes where each attribute is in a caller's uncompressed vertex, in the
+	/// same way as GeometryGenerator::VertexLayout.  Offsets are in bytes and -1
+	/// leaves an attribute out, in which case it is encoded as zero.  The tangent
+	/// sign is one float, such as the w of an M3D tangent; without it the sign is
+	/// +1.  Bone weights are three floats with the fourth implied, as M3D files
+	/// store them.
+	///</summary>
+	struct SourceLayout
+	{
+		std::uint32_t Stride = 0;
+		int PositionOffset = 0;
+		int NormalOffset = -1;
+		int TangentOffset = -1;
+		int TangentSignOffset = -1;
+		int TexCOffset = -1;
+		int BoneWeightsOffset = -1;
+		int BoneIndicesOffset = -1;
+	};
+
+	// Largest angle, in radians, between a unit vector and its decoded value.
+	static const float MaxUnitVectorError;
+
+	// Largest difference between a bone weight and its decoded value.
+	static const float MaxBoneWeightError;
+
+	// Largest relative error of a decoded texture coordinate of magnitude at least
+	// 2^-14; below that, halfs have a fixed step of 2^-24.
+	static const float MaxTexCRelativeError;
+
+	///<summary>
+	/// Largest difference on each axis between a position inside bounds and its
+	/// decoded value.
+	///</summary>
+	static DirectX::XMFLOAT3 MaxPositionError(const DirectX::BoundingBox& bounds);
+
+	static DirectX::PackedVector::XMSHORTN2 EncodeUnitVector(DirectX::FXMVECTOR v);
+	static DirectX::XMVECTOR DecodeUnitVector(DirectX::PackedVector::XMSHORTN2 e);
+
+	///<summary>
+	/// Encodes a position and the sign of the tangent, which is +1 for tangentSign
+	/// >= 0 and -1 otherwise.
+	///</summary>
+	static DirectX::PackedVector::XMUSHORTN4 EncodePosition(DirectX::FXMVECTOR p, const DirectX::BoundingBox& bounds,
+		float tangentSign = 1.0f);
+	static DirectX::XMVECTOR DecodePosition(DirectX::PackedVector::XMUSHORTN4 e, const DirectX::BoundingBox& bounds);
+
+	// The sign of the tangent stored with a position, +1 or -1.
+	static float DecodeTangentSign(DirectX::PackedVector::XMUSHORTN4 e);
+
+	///<summary>
+	/// Maps a position as read by the input assembler, (x, y, z) in [0, 1] with w
+	/// set to 1, to model space.  Multiply it on the left of the world matrix.
+	///</summary>
+	static DirectX::XMMATRIX PositionDecodeTransform(const DirectX::BoundingBox& bounds);
+
+	///<summary>
+	/// Encodes three weights, with the fourth being one minus their sum.
+	///</summary>
+	static DirectX::PackedVector::XMUBYTEN4 EncodeBoneWeights(const DirectX::XMFLOAT3& weights);
+	static DirectX::XMFLOAT4 DecodeBoneWeights(DirectX::PackedVector::XMUBYTEN4 e);
+
+	///<summary>
+	/// Returns the box the positions are quantised to: the bounds of the positions,
+	/// grown a little on any axis where they are flat so the scale never divides by
+	/// zero.
+	///</summary>
+	static DirectX::BoundingBox ComputeBounds(const void* vertices, const SourceLayout& layout, std::uint32_t vertexCount);
+
+	static void Compress(const void* vertices, const SourceLayout& layout, std::uint32_t vertexCount,
+		const DirectX::BoundingBox& bounds, Vertex* out);
+	static void Compress(const void* vertices, const SourceLayout& layout, std::uint32_t vertexCount,
+		const DirectX::BoundingBox& bounds, SkinnedVertex* out);
+
+	///<summary>
+	/// Compresses the vertices of a generated mesh and returns the bounds their
+	/// positions were quantised to.
+	///</summary>
+	static DirectX::BoundingBox Compress(const GeometryGenerator::MeshData& meshData, std::vector<Vertex>& out);
+};
@@ -28,6 +28,8 @@
 #include "d3dx12.h"
 #include "DDSTextureLoader.h"
 #include "MathHelper.h"
+#include "IndexBuilder.h"
+#include "MeshletBuilder.h"
 
 extern const int gNumFrameResources;
 
@@ -142,6 +144,16 @@ public:
     int LineNumber = -1;
 };
 
+// A cluster of a submesh's triangles that can be culled on its own.  Its indices
+// are a contiguous range of the submesh's.
+struct SubmeshCluster
+{
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+
+	MeshletBuilder::Bounds Bounds;
+};
+
 // Defines a subrange of geometry in a MeshGeometry.  This is for when multiple
 // geometries are stored in one vertex and index buffer.  It provides the offsets
 // and data needed to draw a subset of geometry stores in the vertex and index 
@@ -155,8 +167,46 @@ struct SubmeshGeometry
     // Bounding box of the geometry defined by this submesh. 
     // This is used in later chapters of the book.
 	DirectX::BoundingBox Bounds;
+
+	// Bounding sphere fitted to the same geometry, where a demo computes one; it is
+	// usually much tighter than the sphere around Bounds.
+	DirectX::BoundingSphere Sphere;
+
+	// For a simplified level of detail, the estimated distance in model units
+	// between it and the full mesh.  0 for full detail.
+	float GeometricError = 0.0f;
+
+	// Clusters covering the submesh in index order, for culling finer than Bounds.
+	// Empty if the submesh was not clustered.
+	std::vector<SubmeshCluster> Clusters;
 };
 
+// The submeshes to draw submesh 'submesh' of an IndexBuilder index buffer with,
+// one for each part it was split into.  startIndexLocation and baseVertexLocation
+// are where the index and vertex data were placed in the MeshGeometry's buffers.
+inline std::vector<SubmeshGeometry> BuildSubmeshes(const IndexBuilder::IndexData& indexData, UINT submesh,
+	UINT startIndexLocation = 0, INT baseVertexLocation = 0)
+{
+	std::vector<SubmeshGeometry> submeshes;
+	for(const auto& part : indexData.Parts)
+	{
+		if(part.Submesh != submesh)
+			continue;
+
+		SubmeshGeometry s;
+		s.IndexCount = part.IndexCount;
+		s.StartIndexLocation = startIndexLocation + part.StartIndex;
+		s.BaseVertexLocation = baseVertexLocation + part.BaseVertex;
+		submeshes.push_back(s);
+	}
+	return submeshes;
+}
+
+inline DXGI_FORMAT IndexFormat(const IndexBuilder::IndexData& indexData)
+{
+	return indexData.Is16Bit() ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+}
+
 struct MeshGeometry
 {
 	// Give it a name so we can look it up by name.